@@ -0,0 +1,165 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace benchmark {
+
+namespace {
+
+std::vector<Benchmark>&
+registry()
+{
+  static std::vector<Benchmark> benchmarks;
+  return benchmarks;
+}
+
+} // namespace
+
+State::State(std::chrono::nanoseconds min_time, std::string dir)
+  : m_min_time(min_time),
+    m_dir(std::move(dir))
+{
+}
+
+bool
+State::keep_running()
+{
+  if (!m_started) {
+    m_started = true;
+    m_next_check = 1;
+    m_start = Clock::now();
+    return true;
+  }
+
+  ++m_iterations;
+  if (m_iterations < m_next_check) {
+    return true;
+  }
+
+  // Only read the clock after an exponentially growing number of iterations to
+  // keep the overhead low for fast operations.
+  m_elapsed = Clock::now() - m_start;
+  if (m_elapsed >= m_min_time) {
+    return false;
+  }
+  m_next_check = m_iterations + std::max<uint64_t>(1, m_iterations / 2);
+  return true;
+}
+
+void
+State::set_bytes_per_iteration(uint64_t bytes)
+{
+  m_bytes_per_iteration = bytes;
+}
+
+void
+State::skip(std::string reason)
+{
+  m_skip_reason = std::move(reason);
+}
+
+const std::string&
+State::dir() const
+{
+  return m_dir;
+}
+
+uint64_t
+State::iterations() const
+{
+  return m_iterations;
+}
+
+std::chrono::nanoseconds
+State::elapsed() const
+{
+  return m_elapsed;
+}
+
+uint64_t
+State::bytes_per_iteration() const
+{
+  return m_bytes_per_iteration;
+}
+
+const std::string&
+State::skip_reason() const
+{
+  return m_skip_reason;
+}
+
+bool
+register_benchmark(const char* name, Function function)
+{
+  registry().push_back({name, std::move(function)});
+  return true;
+}
+
+const std::vector<Benchmark>&
+benchmarks()
+{
+  auto& benchmarks = registry();
+  std::sort(benchmarks.begin(),
+            benchmarks.end(),
+            [](const auto& a, const auto& b) { return a.name < b.name; });
+  return benchmarks;
+}
+
+std::string
+source_code(const size_t size)
+{
+  static const char* const lines[] = {
+    "static int\n",
+    "compute_value(const struct item* item, size_t count)\n",
+    "{\n",
+    "  int result = 0;\n",
+    "  for (size_t i = 0; i < count; ++i) {\n",
+    "    result += item[i].weight * FACTOR;\n",
+    "  }\n",
+    "  return result; // __LINE__ is fine, the others are not\n",
+    "}\n",
+    "\n",
+  };
+
+  std::string result;
+  result.reserve(size + 100);
+  for (size_t i = 0; result.size() < size; ++i) {
+    result += lines[i % std::size(lines)];
+  }
+  result.resize(size);
+  return result;
+}
+
+std::string
+binary_data(const size_t size)
+{
+  // Half of the bytes are pseudo-random and half are zero.
+  std::string result(size, '\0');
+  uint32_t state = 4711;
+  for (size_t i = 0; i < size; i += 2) {
+    state = state * 1103515245 + 12345;
+    result[i] = static_cast<char>(state >> 24);
+  }
+  return result;
+}
+
+} // namespace benchmark
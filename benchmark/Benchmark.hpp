@@ -0,0 +1,121 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace benchmark {
+
+// State passed to a benchmark function. The function performs its setup, then
+// runs the code to measure in a `while (state.keep_running())` loop and
+// finally does its teardown. Only the loop is timed.
+class State
+{
+public:
+  State(std::chrono::nanoseconds min_time, std::string dir);
+
+  // Return true if another iteration should be run.
+  bool keep_running();
+
+  // Set the number of bytes processed per iteration, used to report
+  // throughput.
+  void set_bytes_per_iteration(uint64_t bytes);
+
+  // Mark the benchmark as not applicable, e.g. due to missing CPU or file
+  // system support. The benchmark function should return directly after
+  // calling this.
+  void skip(std::string reason);
+
+  // Directory that the benchmark may use for temporary files. It is removed
+  // after the benchmark.
+  const std::string& dir() const;
+
+  uint64_t iterations() const;
+  std::chrono::nanoseconds elapsed() const;
+  uint64_t bytes_per_iteration() const;
+  const std::string& skip_reason() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  std::chrono::nanoseconds m_min_time;
+  std::string m_dir;
+  std::string m_skip_reason;
+  uint64_t m_iterations = 0;
+  uint64_t m_next_check = 0;
+  uint64_t m_bytes_per_iteration = 0;
+  bool m_started = false;
+  Clock::time_point m_start;
+  std::chrono::nanoseconds m_elapsed{0};
+};
+
+using Function = std::function<void(State& state)>;
+
+struct Benchmark
+{
+  std::string name;
+  Function function;
+};
+
+// Register a benchmark. Returns true so that it can be used to initialize a
+// static variable.
+bool register_benchmark(const char* name, Function function);
+
+const std::vector<Benchmark>& benchmarks();
+
+// Return `size` bytes of deterministic text resembling C source code.
+std::string source_code(size_t size);
+
+// Return `size` bytes of deterministic data that compresses roughly like
+// object code.
+std::string binary_data(size_t size);
+
+// Prevent the compiler from optimizing away `value`.
+template<typename T>
+void
+do_not_optimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static const void* volatile sink;
+  sink = &value;
+#endif
+}
+
+} // namespace benchmark
+
+#define BENCHMARK_CONCAT_(a_, b_) a_##b_
+#define BENCHMARK_CONCAT(a_, b_) BENCHMARK_CONCAT_(a_, b_)
+
+#define BENCHMARK_IMPL_(name_, function_)                                      \
+  static void function_(benchmark::State& state);                              \
+  [[maybe_unused]] static const bool BENCHMARK_CONCAT(function_,               \
+                                                      _registered) =           \
+    benchmark::register_benchmark(name_, function_);                           \
+  static void function_([[maybe_unused]] benchmark::State& state)
+
+// Define a benchmark called `name_`, e.g. BENCHMARK("Hash 1 MiB") { ... }.
+#define BENCHMARK(name_)                                                       \
+  BENCHMARK_IMPL_(name_, BENCHMARK_CONCAT(benchmark_function_, __LINE__))
@@ -0,0 +1,99 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "Benchmark.hpp"
+
+#include <Context.hpp>
+#include <Hash.hpp>
+#include <core/exceptions.hpp>
+#include <hashutil.hpp>
+#include <util/expected.hpp>
+#include <util/file.hpp>
+#include <util/fmtmacros.hpp>
+
+#include <third_party/blake3/blake3_cpu_supports_avx2.h>
+
+#include <string>
+#include <vector>
+
+BENCHMARK("Hash 64 B")
+{
+  const auto data = benchmark::source_code(64);
+  state.set_bytes_per_iteration(data.size());
+  while (state.keep_running()) {
+    benchmark::do_not_optimize(Hash().hash(data).digest());
+  }
+}
+
+BENCHMARK("Hash 1 MiB")
+{
+  const auto data = benchmark::source_code(1024 * 1024);
+  state.set_bytes_per_iteration(data.size());
+  while (state.keep_running()) {
+    benchmark::do_not_optimize(Hash().hash(data).digest());
+  }
+}
+
+BENCHMARK("check_for_temporal_macros BMH 1 MiB")
+{
+  const auto data = benchmark::source_code(1024 * 1024);
+  state.set_bytes_per_iteration(data.size());
+  while (state.keep_running()) {
+    benchmark::do_not_optimize(check_for_temporal_macros_bmh(data));
+  }
+}
+
+BENCHMARK("check_for_temporal_macros AVX2 1 MiB")
+{
+#ifdef HAVE_AVX2
+  if (!blake3_cpu_supports_avx2()) {
+    state.skip("CPU does not support AVX2");
+    return;
+  }
+  const auto data = benchmark::source_code(1024 * 1024);
+  state.set_bytes_per_iteration(data.size());
+  while (state.keep_running()) {
+    benchmark::do_not_optimize(check_for_temporal_macros_avx2(data));
+  }
+#else
+  state.skip("built without AVX2 support");
+#endif
+}
+
+BENCHMARK("hash_source_code_file 200 headers")
+{
+  // The per-include work in preprocessor and direct mode: 200 headers, each
+  // contributing 2 KiB of code.
+  std::vector<std::string> paths;
+  for (size_t i = 0; i < 200; ++i) {
+    paths.push_back(FMT("{}/header_{}.h", state.dir(), i));
+    util::throw_on_error<core::Error>(
+      util::write_file(paths.back(), benchmark::source_code(2048)));
+  }
+
+  Context ctx;
+  ctx.config.set_inode_cache(false);
+  state.set_bytes_per_iteration(200 * 2048);
+  while (state.keep_running()) {
+    for (const auto& path : paths) {
+      Hash::Digest digest;
+      benchmark::do_not_optimize(hash_source_code_file(ctx, digest, path));
+      benchmark::do_not_optimize(digest);
+    }
+  }
+}
@@ -0,0 +1,107 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#include "Benchmark.hpp"
+
+#include <Config.hpp>
+#include <Hash.hpp>
+#include <InodeCache.hpp>
+#include <core/exceptions.hpp>
+#include <util/Fd.hpp>
+#include <util/expected.hpp>
+#include <util/file.hpp>
+#include <util/fmtmacros.hpp>
+
+#include <fcntl.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const auto k_content_type = InodeCache::ContentType::checked_for_temporal_macros;
+
+// Run `threads` threads that hammer the inode cache with lookups and
+// insertions while the benchmark loop measures lookups of a single file.
+void
+run_contended_get(benchmark::State& state, const size_t threads)
+{
+  util::Fd fd(open(state.dir().c_str(), O_RDONLY));
+  if (!fd || !InodeCache::available(*fd)) {
+    state.skip("inode cache not supported by the file system");
+    return;
+  }
+
+  Config config;
+  config.set_inode_cache(true);
+  config.set_temporary_dir(state.dir());
+
+  std::vector<std::string> paths;
+  for (size_t i = 0; i < 64; ++i) {
+    paths.push_back(FMT("{}/file_{}.c", state.dir(), i));
+    util::throw_on_error<core::Error>(
+      util::write_file(paths.back(), benchmark::source_code(100 + i)));
+  }
+
+  InodeCache inode_cache(config, util::Duration(0));
+  if (!inode_cache.put(
+        paths[0], k_content_type, Hash::Digest(), HashSourceCodeResult())) {
+    throw core::Error("Failed to put file in inode cache");
+  }
+
+  // Each thread uses its own InodeCache instance like separate ccache
+  // processes would.
+  std::atomic<bool> stop = false;
+  std::vector<std::thread> background;
+  for (size_t t = 0; t < threads; ++t) {
+    background.emplace_back([&, t] {
+      InodeCache thread_inode_cache(config, util::Duration(0));
+      for (size_t i = 0; !stop; ++i) {
+        const auto& path = paths[(t * 16 + i) % paths.size()];
+        if (!thread_inode_cache.get(path, k_content_type)) {
+          thread_inode_cache.put(
+            path, k_content_type, Hash::Digest(), HashSourceCodeResult());
+        }
+      }
+    });
+  }
+
+  while (state.keep_running()) {
+    benchmark::do_not_optimize(inode_cache.get(paths[0], k_content_type));
+  }
+
+  stop = true;
+  for (auto& thread : background) {
+    thread.join();
+  }
+}
+
+} // namespace
+
+BENCHMARK("InodeCache get uncontended")
+{
+  run_contended_get(state, 0);
+}
+
+BENCHMARK("InodeCache get 3 contending threads")
+{
+  run_contended_get(state, 3);
+}
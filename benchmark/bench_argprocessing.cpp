@@ -0,0 +1,107 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "Benchmark.hpp"
+
+#include <Args.hpp>
+#include <Context.hpp>
+#include <argprocessing.hpp>
+#include <compopt.hpp>
+#include <core/exceptions.hpp>
+#include <util/expected.hpp>
+#include <util/file.hpp>
+#include <util/fmtmacros.hpp>
+
+#include <string>
+
+namespace {
+
+// A command line of 300+ arguments like the ones generated by CMake for large
+// projects, with many -D and -I options.
+Args
+command_line(const std::string& dir)
+{
+  Args args;
+  args.push_back("/usr/bin/c++");
+  for (size_t i = 0; i < 120; ++i) {
+    args.push_back(FMT("-DPROJECT_FEATURE_{}=1", i));
+  }
+  for (size_t i = 0; i < 120; ++i) {
+    args.push_back(FMT("-I{}/src/module_{}/include", dir, i));
+  }
+  for (size_t i = 0; i < 20; ++i) {
+    args.push_back("-isystem");
+    args.push_back(FMT("{}/third_party/lib_{}/include", dir, i));
+  }
+  for (const char* arg : {"-O2",
+                          "-g",
+                          "-fPIC",
+                          "-std=gnu++17",
+                          "-Wall",
+                          "-Wextra",
+                          "-Wno-unused-parameter",
+                          "-fvisibility=hidden",
+                          "-pthread",
+                          "-MD",
+                          "-MT",
+                          "main.o",
+                          "-MF",
+                          "main.o.d",
+                          "-o",
+                          "main.o",
+                          "-c"}) {
+    args.push_back(arg);
+  }
+  args.push_back(FMT("{}/main.cpp", dir));
+  return args;
+}
+
+} // namespace
+
+BENCHMARK("compopt classification 300+ arguments")
+{
+  const auto args = command_line(state.dir());
+  while (state.keep_running()) {
+    size_t count = 0;
+    for (size_t i = 1; i < args.size(); ++i) {
+      count += compopt_too_hard(args[i]);
+      count += compopt_takes_arg(args[i]);
+      count += compopt_affects_cpp_output(args[i]);
+      count += compopt_prefix_affects_cpp_output(args[i]);
+      count += compopt_prefix_affects_compiler_output(args[i]);
+    }
+    benchmark::do_not_optimize(count);
+  }
+}
+
+BENCHMARK("process_args 300+ arguments")
+{
+  util::throw_on_error<core::Error>(
+    util::write_file(FMT("{}/main.cpp", state.dir()), ""));
+  const auto args = command_line(state.dir());
+
+  while (state.keep_running()) {
+    Context ctx;
+    ctx.orig_args = args;
+    const auto result = process_args(ctx);
+    if (result.error) {
+      throw core::Error("Failed to process arguments");
+    }
+    benchmark::do_not_optimize(result.compiler_args.size());
+  }
+}
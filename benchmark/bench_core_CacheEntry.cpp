@@ -0,0 +1,54 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#include "Benchmark.hpp"
+
+#include <Config.hpp>
+#include <core/CacheEntry.hpp>
+#include <util/Bytes.hpp>
+#include <util/conversion.hpp>
+
+#include <string>
+
+BENCHMARK("CacheEntry::serialize 1 MiB")
+{
+  Config config;
+  const core::CacheEntry::Header header(config, core::CacheEntryType::result);
+  const auto payload = benchmark::binary_data(1024 * 1024);
+  state.set_bytes_per_iteration(payload.size());
+  while (state.keep_running()) {
+    const auto data =
+      core::CacheEntry::serialize(header, util::to_span(payload));
+    benchmark::do_not_optimize(data.data());
+  }
+}
+
+BENCHMARK("CacheEntry verify 1 MiB")
+{
+  Config config;
+  const core::CacheEntry::Header header(config, core::CacheEntryType::result);
+  const auto payload = benchmark::binary_data(1024 * 1024);
+  const auto data = core::CacheEntry::serialize(header, util::to_span(payload));
+  state.set_bytes_per_iteration(payload.size());
+  while (state.keep_running()) {
+    core::CacheEntry cache_entry(data);
+    cache_entry.verify_checksum();
+    benchmark::do_not_optimize(cache_entry.payload().data());
+  }
+}
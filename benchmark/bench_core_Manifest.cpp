@@ -0,0 +1,120 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#include "Benchmark.hpp"
+
+#include <Context.hpp>
+#include <Hash.hpp>
+#include <core/Manifest.hpp>
+#include <core/exceptions.hpp>
+#include <hashutil.hpp>
+#include <util/Bytes.hpp>
+#include <util/expected.hpp>
+#include <util/file.hpp>
+#include <util/fmtmacros.hpp>
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+const size_t k_headers = 200;
+const size_t k_results = 10;
+
+// Create a manifest with `k_results` results that all include the same
+// `k_headers` headers. Only the oldest result matches the headers on disk.
+core::Manifest
+create_manifest(const Context& ctx, const std::string& dir)
+{
+  std::vector<std::string> paths;
+  std::unordered_map<std::string_view, Hash::Digest> included_files;
+  std::unordered_map<std::string_view, uint64_t> sizes;
+  paths.reserve(k_headers);
+  for (size_t i = 0; i < k_headers; ++i) {
+    const auto& path = paths.emplace_back(FMT("{}/header_{}.h", dir, i));
+    const auto code = benchmark::source_code(1024 + i);
+    util::throw_on_error<core::Error>(util::write_file(path, code));
+    Hash::Digest digest;
+    hash_source_code_file(ctx, digest, path);
+    included_files.emplace(path, digest);
+    sizes.emplace(path, code.size());
+  }
+
+  core::Manifest manifest;
+  for (size_t i = 0; i < k_results; ++i) {
+    auto files = included_files;
+    if (i > 0) {
+      // Make newer results mismatch on one header each.
+      files[paths[i]] =
+        Hash().hash(static_cast<int64_t>(i)).digest();
+    }
+    manifest.add_result(
+      Hash().hash(FMT("result {}", i)).digest(),
+      files,
+      [&](std::string_view path) {
+        return core::Manifest::FileStats{
+          sizes[path], util::TimePoint(), util::TimePoint()};
+      });
+  }
+  return manifest;
+}
+
+} // namespace
+
+BENCHMARK("Manifest::serialize 10 results 200 files")
+{
+  Context ctx;
+  ctx.config.set_inode_cache(false);
+  auto manifest = create_manifest(ctx, state.dir());
+  while (state.keep_running()) {
+    util::Bytes data;
+    manifest.serialize(data);
+    benchmark::do_not_optimize(data.data());
+  }
+}
+
+BENCHMARK("Manifest::read 10 results 200 files")
+{
+  Context ctx;
+  ctx.config.set_inode_cache(false);
+  util::Bytes data;
+  create_manifest(ctx, state.dir()).serialize(data);
+  state.set_bytes_per_iteration(data.size());
+  while (state.keep_running()) {
+    core::Manifest manifest;
+    manifest.read(data);
+    benchmark::do_not_optimize(manifest);
+  }
+}
+
+BENCHMARK("Manifest::look_up_result_digest 10 results 200 files")
+{
+  Context ctx;
+  ctx.config.set_inode_cache(false);
+  const auto manifest = create_manifest(ctx, state.dir());
+  while (state.keep_running()) {
+    const auto result_key = manifest.look_up_result_digest(ctx);
+    if (!result_key) {
+      throw core::Error("No matching result in manifest");
+    }
+    benchmark::do_not_optimize(*result_key);
+  }
+}
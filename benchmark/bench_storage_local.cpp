@@ -0,0 +1,95 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#include "Benchmark.hpp"
+
+#include <Config.hpp>
+#include <Hash.hpp>
+#include <core/CacheEntry.hpp>
+#include <core/Statistic.hpp>
+#include <core/exceptions.hpp>
+#include <storage/local/LocalStorage.hpp>
+#include <storage/local/StatsFile.hpp>
+#include <util/conversion.hpp>
+#include <util/fmtmacros.hpp>
+
+#include <string>
+#include <vector>
+
+using storage::local::LocalStorage;
+using storage::local::StatsFile;
+
+namespace {
+
+util::Bytes
+create_cache_entry(const Config& config, const size_t payload_size)
+{
+  const core::CacheEntry::Header header(config, core::CacheEntryType::result);
+  return core::CacheEntry::serialize(
+    header, util::to_span(benchmark::binary_data(payload_size)));
+}
+
+} // namespace
+
+BENCHMARK("StatsFile::update")
+{
+  const StatsFile stats_file(FMT("{}/stats", state.dir()));
+  while (state.keep_running()) {
+    stats_file.update([](auto& counters) {
+      counters.increment(core::Statistic::direct_cache_hit);
+    });
+  }
+}
+
+BENCHMARK("LocalStorage::put 16 KiB")
+{
+  Config config;
+  config.set_cache_dir(state.dir());
+  const auto value = create_cache_entry(config, 16 * 1024);
+  LocalStorage local_storage(config);
+  state.set_bytes_per_iteration(value.size());
+  int64_t i = 0;
+  while (state.keep_running()) {
+    local_storage.put(
+      Hash().hash(i++).digest(), core::CacheEntryType::result, value);
+  }
+}
+
+BENCHMARK("LocalStorage::get 16 KiB")
+{
+  Config config;
+  config.set_cache_dir(state.dir());
+  const auto value = create_cache_entry(config, 16 * 1024);
+  LocalStorage local_storage(config);
+  std::vector<Hash::Digest> keys;
+  for (int64_t i = 0; i < 256; ++i) {
+    keys.push_back(Hash().hash(i).digest());
+    local_storage.put(keys.back(), core::CacheEntryType::result, value);
+  }
+  state.set_bytes_per_iteration(value.size());
+  size_t i = 0;
+  while (state.keep_running()) {
+    const auto data = local_storage.get(keys[i++ % keys.size()],
+                                        core::CacheEntryType::result);
+    if (!data) {
+      throw core::Error("Cache entry missing");
+    }
+    benchmark::do_not_optimize(data->data());
+  }
+}
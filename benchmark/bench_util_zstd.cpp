@@ -0,0 +1,67 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#include "Benchmark.hpp"
+
+#include <core/exceptions.hpp>
+#include <util/Bytes.hpp>
+#include <util/conversion.hpp>
+#include <util/expected.hpp>
+#include <util/zstd.hpp>
+
+#include <string>
+
+BENCHMARK("zstd_compress level 1 1 MiB")
+{
+  const auto input = benchmark::binary_data(1024 * 1024);
+  state.set_bytes_per_iteration(input.size());
+  while (state.keep_running()) {
+    util::Bytes output;
+    util::throw_on_error<core::Error>(
+      util::zstd_compress(util::to_span(input), output, 1));
+    benchmark::do_not_optimize(output.data());
+  }
+}
+
+BENCHMARK("zstd_compress level 8 1 MiB")
+{
+  const auto input = benchmark::binary_data(1024 * 1024);
+  state.set_bytes_per_iteration(input.size());
+  while (state.keep_running()) {
+    util::Bytes output;
+    util::throw_on_error<core::Error>(
+      util::zstd_compress(util::to_span(input), output, 8));
+    benchmark::do_not_optimize(output.data());
+  }
+}
+
+BENCHMARK("zstd_decompress 1 MiB")
+{
+  const auto input = benchmark::binary_data(1024 * 1024);
+  util::Bytes compressed;
+  util::throw_on_error<core::Error>(
+    util::zstd_compress(util::to_span(input), compressed, 1));
+  state.set_bytes_per_iteration(input.size());
+  while (state.keep_running()) {
+    util::Bytes output;
+    util::throw_on_error<core::Error>(
+      util::zstd_decompress(compressed, output, input.size()));
+    benchmark::do_not_optimize(output.data());
+  }
+}
@@ -0,0 +1,210 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "Benchmark.hpp"
+
+#include <ccache.hpp>
+#include <core/exceptions.hpp>
+#include <util/DirEntry.hpp>
+#include <util/FileStream.hpp>
+#include <util/PathString.hpp>
+#include <util/TimePoint.hpp>
+#include <util/filesystem.hpp>
+#include <util/fmtmacros.hpp>
+#include <util/string.hpp>
+
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+namespace fs = util::filesystem;
+
+using pstr = util::PathString;
+
+namespace {
+
+const char USAGE_TEXT[] =
+  R"(Usage: {0} [options]
+
+Run ccache microbenchmarks and print the results in JSON format.
+
+Options:
+    -d, --dir DIR        create temporary files in DIR (default: /dev/shm if
+                         available, otherwise the system temporary directory)
+    -f, --filter STRING  only run benchmarks whose name contains STRING
+    -l, --list           list benchmark names and exit
+    -o, --output PATH    write results to PATH instead of standard output
+    -t, --min-time SEC   run each benchmark for at least SEC seconds (default:
+                         0.5)
+    -h, --help           print this help text
+)";
+
+std::string
+json_escape(std::string_view str)
+{
+  std::string result;
+  for (const char c : str) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+    }
+    result += c;
+  }
+  return result;
+}
+
+std::string
+default_base_dir()
+{
+  if (util::DirEntry("/dev/shm").is_directory()) {
+    return "/dev/shm";
+  }
+  const auto temp_dir = fs::temp_directory_path();
+  return temp_dir ? pstr(*temp_dir).str() : ".";
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  std::string base_dir;
+  std::string filter;
+  std::string output_path;
+  bool list = false;
+  double min_time = 0.5;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const auto next_arg = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        PRINT(stderr, "Error: missing argument to {}\n", arg);
+        exit(EXIT_FAILURE);
+      }
+      return argv[++i];
+    };
+    if (arg == "-d" || arg == "--dir") {
+      base_dir = next_arg();
+    } else if (arg == "-f" || arg == "--filter") {
+      filter = next_arg();
+    } else if (arg == "-l" || arg == "--list") {
+      list = true;
+    } else if (arg == "-o" || arg == "--output") {
+      output_path = next_arg();
+    } else if (arg == "-t" || arg == "--min-time") {
+      const auto value = util::parse_double(next_arg());
+      if (!value || *value < 0) {
+        PRINT_RAW(stderr, "Error: invalid minimum time\n");
+        return EXIT_FAILURE;
+      }
+      min_time = *value;
+    } else if (arg == "-h" || arg == "--help") {
+      PRINT(stdout, USAGE_TEXT, argv[0]);
+      return EXIT_SUCCESS;
+    } else {
+      PRINT(stderr, "Error: unknown option {}\n", arg);
+      PRINT(stderr, USAGE_TEXT, argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (list) {
+    for (const auto& benchmark : benchmark::benchmarks()) {
+      PRINT(stdout, "{}\n", benchmark.name);
+    }
+    return EXIT_SUCCESS;
+  }
+
+  if (base_dir.empty()) {
+    base_dir = default_base_dir();
+  }
+  const auto run_dir = FMT(
+    "{}/ccache-bench.{}", base_dir, util::TimePoint::now().nsec_decimal_part());
+
+  std::string result =
+    FMT("{{\n  \"ccache_version\": \"{}\",\n", CCACHE_VERSION);
+  result += FMT("  \"min_time_s\": {},\n", min_time);
+  result += "  \"benchmarks\": [";
+
+  size_t index = 0;
+  bool failed = false;
+  for (const auto& benchmark : benchmark::benchmarks()) {
+    if (benchmark.name.find(filter) == std::string::npos) {
+      continue;
+    }
+
+    PRINT(stderr, "{} ... ", benchmark.name);
+    std::string entry =
+      FMT("\n    {{\n      \"name\": \"{}\",\n", json_escape(benchmark.name));
+    const auto dir = FMT("{}/{}", run_dir, index);
+    try {
+      if (const auto created = fs::create_directories(dir); !created) {
+        throw core::Error(
+          FMT("Failed to create {}: {}", dir, created.error().message()));
+      }
+      benchmark::State state(
+        std::chrono::nanoseconds(static_cast<int64_t>(min_time * 1e9)), dir);
+      benchmark.function(state);
+
+      if (!state.skip_reason().empty()) {
+        entry += FMT("      \"skipped\": \"{}\"",
+                     json_escape(state.skip_reason()));
+        PRINT(stderr, "skipped: {}\n", state.skip_reason());
+      } else {
+        const double ns_per_iteration =
+          state.iterations() > 0
+            ? static_cast<double>(state.elapsed().count())
+                / static_cast<double>(state.iterations())
+            : 0.0;
+        entry += FMT("      \"iterations\": {},\n", state.iterations());
+        entry += FMT("      \"ns_per_iteration\": {:.1f}", ns_per_iteration);
+        if (state.bytes_per_iteration() > 0 && ns_per_iteration > 0) {
+          entry += FMT(",\n      \"bytes_per_second\": {:.0f}",
+                       static_cast<double>(state.bytes_per_iteration()) * 1e9
+                         / ns_per_iteration);
+        }
+        PRINT(stderr, "{:.1f} ns/iteration\n", ns_per_iteration);
+      }
+    } catch (const core::ErrorBase& e) {
+      entry += FMT("      \"error\": \"{}\"", json_escape(e.what()));
+      PRINT(stderr, "error: {}\n", e.what());
+      failed = true;
+    }
+    entry += "\n    }";
+    fs::remove_all(dir);
+
+    result += index > 0 ? "," : "";
+    result += entry;
+    ++index;
+  }
+  fs::remove_all(run_dir);
+
+  result += "\n  ]\n}\n";
+
+  if (output_path.empty()) {
+    PRINT_RAW(stdout, result);
+  } else {
+    util::FileStream file(output_path, "w");
+    if (!file) {
+      PRINT(stderr, "Error: failed to open {}\n", output_path);
+      return EXIT_FAILURE;
+    }
+    PRINT_RAW(*file, result);
+  }
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
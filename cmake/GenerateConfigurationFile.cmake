@@ -3,10 +3,13 @@ set(include_files
     dirent.h
     linux/fs.h
     pwd.h
+    spawn.h
     sys/clonefile.h
     sys/file.h
+    sys/inotify.h
     sys/ioctl.h
     sys/mman.h
+    sys/resource.h
     sys/utime.h
     sys/wait.h
     syslog.h
@@ -32,6 +35,7 @@ set(functions
     unsetenv
     utimensat
     utimes
+    wait4
 )
 foreach(func IN ITEMS ${functions})
   string(TOUPPER ${func} func_var)
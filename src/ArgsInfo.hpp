@@ -26,6 +26,9 @@
 #include <vector>
 
 // This class holds meta-information derived from the compiler arguments.
+//
+// Note: New fields must also be stored in argument templates, see
+// ArgsTemplate.cpp.
 struct ArgsInfo
 {
   // The source file path.
@@ -0,0 +1,589 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "ArgsTemplate.hpp"
+
+#include "Context.hpp"
+#include "Hash.hpp"
+#include "ccache.hpp"
+
+#include <core/AtomicFile.hpp>
+#include <core/CacheEntryDataReader.hpp>
+#include <core/CacheEntryDataWriter.hpp>
+#include <core/exceptions.hpp>
+#include <util/DirEntry.hpp>
+#include <util/file.hpp>
+#include <util/fmtmacros.hpp>
+#include <util/logging.hpp>
+#include <util/path.hpp>
+#include <util/string.hpp>
+#include <util/wincompat.hpp>
+
+#ifdef HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <unordered_map>
+#include <vector>
+
+#ifndef environ
+DLLIMPORT extern char** environ;
+#endif
+
+using util::DirEntry;
+
+namespace {
+
+const char k_placeholder = '\x01';
+
+// Version of the template file format. Templates are also keyed by the ccache
+// version since they contain a raw hash state.
+const uint8_t k_format_version = 1;
+
+#ifdef _WIN32
+const char k_dir_separators[] = "/\\";
+#else
+const char k_dir_separators[] = "/";
+#endif
+
+struct StoredTemplate
+{
+  bool confirmed;
+  std::string_view name;
+  nonstd::span<const uint8_t> payload;
+};
+
+// Template file format:
+//
+// <file>    ::= <version> <confirmed> <namelen> <name> <payload>
+// <version> ::= uint8_t
+// <confirmed> ::= uint8_t ; 1 if stored by two compilations with different
+//                         ; names, otherwise 0
+// <namelen> ::= uint16_t
+// <name>    ::= namelen bytes ; name of the last storing compilation
+// <payload> ::= process_args result with the name replaced by a placeholder
+//               followed by the hash state after hash_common_info
+std::optional<StoredTemplate>
+parse_stored(nonstd::span<const uint8_t> data)
+{
+  try {
+    core::CacheEntryDataReader reader(data);
+    if (reader.read_int<uint8_t>() != k_format_version) {
+      return std::nullopt;
+    }
+    StoredTemplate stored;
+    stored.confirmed = reader.read_int<uint8_t>() != 0;
+    stored.name = reader.read_str(reader.read_int<uint16_t>());
+    const size_t header_size = 1 + 1 + 2 + stored.name.size();
+    stored.payload = data.subspan(header_size);
+    return stored;
+  } catch (const core::Error&) {
+    return std::nullopt;
+  }
+}
+
+class Writer
+{
+public:
+  Writer(util::Bytes& output, std::string_view name)
+    : m_writer(output),
+      m_name(name)
+  {
+  }
+
+  void
+  write_count(size_t count)
+  {
+    m_writer.write_int(static_cast<uint32_t>(count));
+  }
+
+  void
+  operator()(bool value)
+  {
+    m_writer.write_int<uint8_t>(value);
+  }
+
+  void
+  operator()(const std::string& value)
+  {
+    const auto templatized = ArgsTemplate::templatize(value, m_name);
+    write_count(templatized.size());
+    m_writer.write_str(templatized);
+  }
+
+  void
+  operator()(const std::optional<std::string>& value)
+  {
+    (*this)(value.has_value());
+    if (value) {
+      (*this)(*value);
+    }
+  }
+
+  void
+  operator()(const std::vector<std::string>& values)
+  {
+    write_count(values.size());
+    for (const auto& value : values) {
+      (*this)(value);
+    }
+  }
+
+  void
+  operator()(const Args& args)
+  {
+    write_count(args.size());
+    for (size_t i = 0; i < args.size(); ++i) {
+      (*this)(args[i]);
+    }
+  }
+
+  void
+  operator()(
+    const std::unordered_map<std::string, std::vector<std::string>>& map)
+  {
+    std::vector<std::string> keys;
+    for (const auto& [key, values] : map) {
+      keys.push_back(key);
+    }
+    std::sort(keys.begin(), keys.end());
+    write_count(keys.size());
+    for (const auto& key : keys) {
+      (*this)(key);
+      (*this)(map.at(key));
+    }
+  }
+
+  void
+  operator()(nonstd::span<const uint8_t> data)
+  {
+    write_count(data.size());
+    m_writer.write_bytes(data);
+  }
+
+private:
+  core::CacheEntryDataWriter m_writer;
+  std::string_view m_name;
+};
+
+class Reader
+{
+public:
+  Reader(nonstd::span<const uint8_t> data, std::string_view name)
+    : m_reader(data),
+      m_name(name)
+  {
+  }
+
+  size_t
+  read_count()
+  {
+    return m_reader.read_int<uint32_t>();
+  }
+
+  void
+  operator()(bool& value)
+  {
+    value = m_reader.read_int<uint8_t>() != 0;
+  }
+
+  void
+  operator()(std::string& value)
+  {
+    value = ArgsTemplate::instantiate(m_reader.read_str(read_count()), m_name);
+  }
+
+  void
+  operator()(std::optional<std::string>& value)
+  {
+    bool has_value;
+    (*this)(has_value);
+    value.reset();
+    if (has_value) {
+      (*this)(value.emplace());
+    }
+  }
+
+  void
+  operator()(std::vector<std::string>& values)
+  {
+    values.resize(read_count());
+    for (auto& value : values) {
+      (*this)(value);
+    }
+  }
+
+  void
+  operator()(Args& args)
+  {
+    const size_t count = read_count();
+    for (size_t i = 0; i < count; ++i) {
+      std::string arg;
+      (*this)(arg);
+      args.push_back(std::move(arg));
+    }
+  }
+
+  void
+  operator()(std::unordered_map<std::string, std::vector<std::string>>& map)
+  {
+    const size_t count = read_count();
+    for (size_t i = 0; i < count; ++i) {
+      std::string key;
+      (*this)(key);
+      (*this)(map[key]);
+    }
+  }
+
+  void
+  operator()(nonstd::span<const uint8_t>& data)
+  {
+    data = m_reader.read_bytes(read_count());
+  }
+
+private:
+  core::CacheEntryDataReader m_reader;
+  std::string_view m_name;
+};
+
+// Note: All ArgsInfo fields must be visited.
+template<typename T, typename Visitor>
+void
+visit_args_info(T& args_info, Visitor& visitor)
+{
+  visitor(args_info.orig_input_file);
+  visitor(args_info.input_file);
+  visitor(args_info.normalized_input_file);
+  visitor(args_info.expect_output_obj);
+  visitor(args_info.orig_output_obj);
+  visitor(args_info.output_obj);
+  visitor(args_info.output_dep);
+  visitor(args_info.output_su);
+  visitor(args_info.output_dia);
+  visitor(args_info.output_dwo);
+  visitor(args_info.output_al);
+  visitor(args_info.included_pch_file);
+  visitor(args_info.actual_language);
+  visitor(args_info.generating_debuginfo);
+  visitor(args_info.generating_dependencies);
+  visitor(args_info.generating_includes);
+  visitor(args_info.dependency_target);
+  visitor(args_info.generating_coverage);
+  visitor(args_info.generating_stackusage);
+  visitor(args_info.generating_diagnostics);
+  visitor(args_info.generating_pch);
+  visitor(args_info.strip_diagnostics_colors);
+  visitor(args_info.seen_double_dash);
+  visitor(args_info.seen_split_dwarf);
+  visitor(args_info.direct_i_file);
+  visitor(args_info.output_is_precompiled_header);
+  visitor(args_info.profile_arcs);
+  visitor(args_info.profile_path);
+  visitor(args_info.profile_use);
+  visitor(args_info.profile_generate);
+  visitor(args_info.using_precompiled_header);
+  visitor(args_info.fno_pch_timestamp);
+  visitor(args_info.sanitize_blacklists);
+  visitor(args_info.arch_args);
+  visitor(args_info.xarch_args);
+  visitor(args_info.debug_prefix_maps);
+  visitor(args_info.depend_extra_args);
+}
+
+bool
+is_output_option(std::string_view arg)
+{
+  return arg == "-o" || arg == "-MF" || arg == "-MT" || arg == "-MQ";
+}
+
+} // namespace
+
+ArgsTemplate::ArgsTemplate(const Context& ctx)
+{
+  const auto& config = ctx.config;
+  const auto& args = ctx.orig_args;
+  if (config.build_session().empty() || config.debug()
+      || config.is_compiler_group_msvc()) {
+    return;
+  }
+
+  // The name is taken from the output file, so only the common "-o file" form
+  // is handled. Response and options files are not handled since their
+  // content is not part of the key.
+  std::optional<size_t> output_index;
+  for (size_t i = 1; i < args.size(); ++i) {
+    if (args[i].find(k_placeholder) != std::string::npos
+        || util::starts_with(args[i], "@") || util::starts_with(args[i], "-@")
+        || args[i] == "-optf" || args[i] == "--options-file"
+        || (args[i] == "-o" && output_index)) {
+      return;
+    }
+    if (args[i] == "-o" && i + 1 < args.size()) {
+      output_index = i + 1;
+    }
+  }
+  if (!output_index) {
+    return;
+  }
+  const auto& output = args[*output_index];
+  const auto filename =
+    std::string_view(output).substr(output.find_last_of(k_dir_separators) + 1);
+  const auto name = filename.substr(0, filename.find('.'));
+  if (name.empty() || name.length() == filename.length()
+      || !std::all_of(name.begin(), name.end(), [](char c) {
+           return isalnum(static_cast<unsigned char>(c)) || c == '_'
+                  || c == '-' || c == '+';
+         })) {
+    return;
+  }
+  m_name = std::string(name);
+
+  Hash hash;
+  hash.hash_delimiter("version");
+  hash.hash(CCACHE_VERSION);
+  hash.hash(k_format_version);
+  hash.hash_delimiter("session");
+  hash.hash(config.build_session());
+  for (size_t i = 0; i < args.size(); ++i) {
+    const auto templatized = templatize(args[i], m_name);
+    if (i == 0 && templatized != args[i]) {
+      m_name.clear();
+      return;
+    }
+    hash.hash_delimiter("arg");
+    hash.hash(templatized);
+  }
+  hash.hash_delimiter("cwd");
+  hash.hash(ctx.actual_cwd);
+  hash.hash(ctx.apparent_cwd);
+  config.visit_items([&](const auto& key, const auto& value, const auto&) {
+    hash.hash_delimiter(key);
+    hash.hash(value);
+  });
+  for (char** env = environ; *env; ++env) {
+    hash.hash_delimiter("env");
+    hash.hash(*env);
+  }
+  hash.hash_delimiter("stderr_tty");
+  hash.hash(isatty(STDERR_FILENO));
+  const DirEntry compiler(args[0]);
+  hash.hash_delimiter("compiler");
+  hash.hash(compiler.size());
+  hash.hash(compiler.mtime().nsec());
+  hash.hash(compiler.ctime().nsec());
+  hash.hash(compiler.inode());
+
+  m_path = FMT("{}/args-template/{}",
+               config.temporary_dir(),
+               util::format_digest(hash.digest()));
+  if (auto data = util::read_file<util::Bytes>(m_path)) {
+    m_stored = std::move(*data);
+  }
+}
+
+std::optional<ProcessArgsResult>
+ArgsTemplate::apply(Context& ctx, Hash& common_hash) const
+{
+  if (!m_stored) {
+    return std::nullopt;
+  }
+  const auto stored = parse_stored(*m_stored);
+  if (!stored || !stored->confirmed) {
+    return std::nullopt;
+  }
+
+  ArgsInfo args_info;
+  Args preprocessor_args;
+  Args extra_args_to_hash;
+  Args compiler_args;
+  bool hash_actual_cwd;
+  bool direct_mode;
+  bool run_second_cpp;
+  std::string cpp_extension;
+  size_t input_index;
+  nonstd::span<const uint8_t> hash_state;
+  try {
+    Reader reader(stored->payload, m_name);
+    visit_args_info(args_info, reader);
+    reader(preprocessor_args);
+    reader(extra_args_to_hash);
+    reader(compiler_args);
+    reader(hash_actual_cwd);
+    reader(direct_mode);
+    reader(run_second_cpp);
+    reader(cpp_extension);
+    input_index = reader.read_count();
+    reader(hash_state);
+  } catch (const core::Error& e) {
+    LOG("Failed to read argument template {}: {}", m_path, e.what());
+    return std::nullopt;
+  }
+
+  // The source file is looked up and the output file is checked by
+  // process_args, so do the same here.
+  if (input_index >= ctx.orig_args.size()
+      || ctx.orig_args[input_index] != args_info.orig_input_file) {
+    return std::nullopt;
+  }
+  const DirEntry input(args_info.orig_input_file);
+  if (!input.is_regular_file() || input.is_symlink()) {
+    return std::nullopt;
+  }
+  const DirEntry output(args_info.output_obj);
+  if (output.exists() && !output.is_regular_file()) {
+    return std::nullopt;
+  }
+
+  Hash hash;
+  if (!hash.set_state(hash_state)) {
+    return std::nullopt;
+  }
+
+  LOG("Using argument template {}", m_path);
+  common_hash = hash;
+  ctx.args_info = std::move(args_info);
+  ctx.config.set_direct_mode(direct_mode);
+  ctx.config.set_run_second_cpp(run_second_cpp);
+  ctx.config.set_cpp_extension(cpp_extension);
+  return ProcessArgsResult(
+    preprocessor_args, extra_args_to_hash, compiler_args, hash_actual_cwd);
+}
+
+void
+ArgsTemplate::update(const Context& ctx,
+                     const ProcessArgsResult& processed,
+                     const Hash& common_hash) const
+{
+  if (m_path.empty() || processed.error) {
+    return;
+  }
+
+  // Precompiled headers, split DWARF and coverage make the common hash or
+  // other files depend on the output name.
+  const auto& args_info = ctx.args_info;
+  if (args_info.output_is_precompiled_header || args_info.generating_pch
+      || args_info.seen_split_dwarf || args_info.profile_arcs
+      || args_info.generating_coverage || ctx.auto_depend_mode
+      || util::is_dev_null_path(args_info.output_obj)
+      || util::is_dev_null_path(args_info.output_dep)) {
+    return;
+  }
+
+  // Only the source file and the values of output options may contain the
+  // name, since other arguments may refer to files that exist for one name but
+  // not for another.
+  const auto& args = ctx.orig_args;
+  std::optional<size_t> input_index;
+  for (size_t i = 1; i < args.size(); ++i) {
+    if (templatize(args[i], m_name) == args[i]) {
+      continue;
+    }
+    if (!input_index && args[i] == args_info.orig_input_file
+        && !is_output_option(args[i - 1])) {
+      input_index = i;
+    } else if (!is_output_option(args[i - 1])) {
+      LOG("Not storing argument template since {} contains {}",
+          args[i],
+          m_name);
+      return;
+    }
+  }
+  if (!input_index || DirEntry(args[*input_index]).is_symlink()) {
+    return;
+  }
+
+  const auto payload = serialize(ctx, processed, common_hash, *input_index);
+  const auto stored =
+    m_stored ? parse_stored(*m_stored) : std::optional<StoredTemplate>();
+  if (!stored) {
+    store(false, payload);
+  } else if (!stored->confirmed && stored->name != m_name
+             && std::equal(stored->payload.begin(),
+                           stored->payload.end(),
+                           payload.begin(),
+                           payload.end())) {
+    LOG("Confirmed argument template {}", m_path);
+    store(true, payload);
+  }
+}
+
+std::string
+ArgsTemplate::templatize(std::string_view value, std::string_view name)
+{
+  const size_t start = value.find_last_of(k_dir_separators) + 1;
+  if (value.substr(start, name.length()) != name
+      || value.substr(start + name.length(), 1) != ".") {
+    return std::string(value);
+  }
+  return FMT("{}{}{}",
+             value.substr(0, start),
+             k_placeholder,
+             value.substr(start + name.length()));
+}
+
+std::string
+ArgsTemplate::instantiate(std::string_view value, std::string_view name)
+{
+  const size_t pos = value.find(k_placeholder);
+  if (pos == std::string_view::npos) {
+    return std::string(value);
+  }
+  return FMT("{}{}{}", value.substr(0, pos), name, value.substr(pos + 1));
+}
+
+util::Bytes
+ArgsTemplate::serialize(const Context& ctx,
+                        const ProcessArgsResult& processed,
+                        const Hash& common_hash,
+                        size_t input_index) const
+{
+  util::Bytes payload;
+  Writer writer(payload, m_name);
+  visit_args_info(ctx.args_info, writer);
+  writer(processed.preprocessor_args);
+  writer(processed.extra_args_to_hash);
+  writer(processed.compiler_args);
+  writer(processed.hash_actual_cwd);
+  writer(ctx.config.direct_mode());
+  writer(ctx.config.run_second_cpp());
+  writer(ctx.config.cpp_extension());
+  writer.write_count(input_index);
+  writer(common_hash.state());
+  return payload;
+}
+
+void
+ArgsTemplate::store(bool confirmed, const util::Bytes& payload) const
+{
+  util::Bytes data;
+  core::CacheEntryDataWriter writer(data);
+  writer.write_int(k_format_version);
+  writer.write_int<uint8_t>(confirmed);
+  writer.write_int(static_cast<uint16_t>(m_name.length()));
+  writer.write_str(m_name);
+  writer.write_bytes(payload);
+  try {
+    core::AtomicFile file(m_path, core::AtomicFile::Mode::binary);
+    file.write(data);
+    file.commit();
+  } catch (const core::Error& e) {
+    LOG("Failed to write argument template {}: {}", m_path, e.what());
+  }
+}
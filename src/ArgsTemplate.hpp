@@ -0,0 +1,82 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#pragma once
+
+#include "argprocessing.hpp"
+
+#include <util/Bytes.hpp>
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+class Context;
+class Hash;
+
+// This class remembers the result of process_args and the common part of the
+// hash for command lines that only differ in the name of the source file and
+// the output files named after it, e.g.:
+//
+//   cc -MD -MT dir/foo.o -MF dir/foo.o.d -o dir/foo.o -c src/foo.c
+//   cc -MD -MT dir/bar.o -MF dir/bar.o.d -o dir/bar.o -c src/bar.c
+//
+// The name ("foo" and "bar" above) is replaced by a placeholder in the
+// template, which is keyed by the resulting command line, the working
+// directory, the configuration, the environment and the compiler file. Just
+// like hashes of include files, templates are only trusted in a build session
+// (see Config::build_session). A template is only used after two compilations
+// with different names have produced the same template, which catches
+// arguments that are processed differently depending on the name.
+class ArgsTemplate
+{
+public:
+  // Compute the template key for ctx.orig_args and read any stored template.
+  // Must be called before process_args.
+  explicit ArgsTemplate(const Context& ctx);
+
+  // Restore the result of process_args (including ctx.args_info and the
+  // configuration items process_args sets) and the state of `common_hash`
+  // after hash_common_info from a usable template.
+  std::optional<ProcessArgsResult> apply(Context& ctx, Hash& common_hash) const;
+
+  // Store or confirm a template from the result of a successful process_args
+  // and hash_common_info call.
+  void update(const Context& ctx,
+              const ProcessArgsResult& processed,
+              const Hash& common_hash) const;
+
+  // Replace `name` with a placeholder if the last path component of `value`
+  // starts with `name` followed by a period.
+  static std::string templatize(std::string_view value, std::string_view name);
+
+  // Replace the placeholder in `value` with `name`.
+  static std::string instantiate(std::string_view value, std::string_view name);
+
+private:
+  std::string m_path;
+  std::string m_name;
+  std::optional<util::Bytes> m_stored;
+
+  util::Bytes serialize(const Context& ctx,
+                        const ProcessArgsResult& processed,
+                        const Hash& common_hash,
+                        size_t input_index) const;
+  void store(bool confirmed, const util::Bytes& payload) const;
+};
@@ -22,6 +22,7 @@
 #include "Util.hpp"
 
 #include <core/AtomicFile.hpp>
+#include <core/Result.hpp>
 #include <core/common.hpp>
 #include <core/exceptions.hpp>
 #include <core/types.hpp>
@@ -70,8 +71,12 @@ namespace {
 
 enum class ConfigItem {
   absolute_paths_in_stderr,
+  base_cache_dir,
   base_dir,
+  build_session,
   cache_dir,
+  cold_cache_dir,
+  cold_max_size,
   compiler,
   compiler_check,
   compiler_type,
@@ -81,10 +86,14 @@ enum class ConfigItem {
   debug,
   debug_dir,
   debug_level,
+  deduplicate,
+  delta_chain_length,
   depend_mode,
   direct_mode,
   disable,
+  eviction_policy,
   extra_files_to_hash,
+  fast_cpp,
   file_clone,
   hard_link,
   hash_dir,
@@ -108,7 +117,9 @@ enum class ConfigItem {
   remote_storage,
   reshare,
   run_second_cpp,
+  scan_includes,
   sloppiness,
+  speculative_compilation,
   stats,
   stats_log,
   temporary_dir,
@@ -126,8 +137,12 @@ struct ConfigKeyTableEntry
 const std::unordered_map<std::string, ConfigKeyTableEntry> k_config_key_table =
   {
     {"absolute_paths_in_stderr", {ConfigItem::absolute_paths_in_stderr}},
+    {"base_cache_dir", {ConfigItem::base_cache_dir}},
     {"base_dir", {ConfigItem::base_dir}},
+    {"build_session", {ConfigItem::build_session}},
     {"cache_dir", {ConfigItem::cache_dir}},
+    {"cold_cache_dir", {ConfigItem::cold_cache_dir}},
+    {"cold_max_size", {ConfigItem::cold_max_size}},
     {"compiler", {ConfigItem::compiler}},
     {"compiler_check", {ConfigItem::compiler_check}},
     {"compiler_type", {ConfigItem::compiler_type}},
@@ -137,10 +152,14 @@ const std::unordered_map<std::string, ConfigKeyTableEntry> k_config_key_table =
     {"debug", {ConfigItem::debug}},
     {"debug_dir", {ConfigItem::debug_dir}},
     {"debug_level", {ConfigItem::debug_level}},
+    {"deduplicate", {ConfigItem::deduplicate}},
+    {"delta_chain_length", {ConfigItem::delta_chain_length}},
     {"depend_mode", {ConfigItem::depend_mode}},
     {"direct_mode", {ConfigItem::direct_mode}},
     {"disable", {ConfigItem::disable}},
+    {"eviction_policy", {ConfigItem::eviction_policy}},
     {"extra_files_to_hash", {ConfigItem::extra_files_to_hash}},
+    {"fast_cpp", {ConfigItem::fast_cpp}},
     {"file_clone", {ConfigItem::file_clone}},
     {"hard_link", {ConfigItem::hard_link}},
     {"hash_dir", {ConfigItem::hash_dir}},
@@ -164,8 +183,10 @@ const std::unordered_map<std::string, ConfigKeyTableEntry> k_config_key_table =
     {"remote_storage", {ConfigItem::remote_storage}},
     {"reshare", {ConfigItem::reshare}},
     {"run_second_cpp", {ConfigItem::run_second_cpp}},
+    {"scan_includes", {ConfigItem::scan_includes}},
     {"secondary_storage", {ConfigItem::remote_storage, "remote_storage"}},
     {"sloppiness", {ConfigItem::sloppiness}},
+    {"speculative_compilation", {ConfigItem::speculative_compilation}},
     {"stats", {ConfigItem::stats}},
     {"stats_log", {ConfigItem::stats_log}},
     {"temporary_dir", {ConfigItem::temporary_dir}},
@@ -174,8 +195,12 @@ const std::unordered_map<std::string, ConfigKeyTableEntry> k_config_key_table =
 
 const std::unordered_map<std::string, std::string> k_env_variable_table = {
   {"ABSSTDERR", "absolute_paths_in_stderr"},
+  {"BASECACHEDIR", "base_cache_dir"},
   {"BASEDIR", "base_dir"},
+  {"BUILDSESSION", "build_session"},
   {"CC", "compiler"}, // Alias for CCACHE_COMPILER
+  {"COLDDIR", "cold_cache_dir"},
+  {"COLDMAXSIZE", "cold_max_size"},
   {"COMMENTS", "keep_comments_cpp"},
   {"COMPILER", "compiler"},
   {"COMPILERCHECK", "compiler_check"},
@@ -186,12 +211,16 @@ const std::unordered_map<std::string, std::string> k_env_variable_table = {
   {"DEBUG", "debug"},
   {"DEBUGDIR", "debug_dir"},
   {"DEBUGLEVEL", "debug_level"},
+  {"DEDUPLICATE", "deduplicate"},
+  {"DELTACHAINLENGTH", "delta_chain_length"},
   {"DEPEND", "depend_mode"},
   {"DIR", "cache_dir"},
   {"DIRECT", "direct_mode"},
   {"DISABLE", "disable"},
+  {"EVICTIONPOLICY", "eviction_policy"},
   {"EXTENSION", "cpp_extension"},
   {"EXTRAFILES", "extra_files_to_hash"},
+  {"FASTCPP", "fast_cpp"},
   {"FILECLONE", "file_clone"},
   {"HARDLINK", "hard_link"},
   {"HASHDIR", "hash_dir"},
@@ -213,8 +242,10 @@ const std::unordered_map<std::string, std::string> k_env_variable_table = {
   {"REMOTE_ONLY", "remote_only"},
   {"REMOTE_STORAGE", "remote_storage"},
   {"RESHARE", "reshare"},
+  {"SCANINCLUDES", "scan_includes"},
   {"SECONDARY_STORAGE", "remote_storage"}, // Alias for CCACHE_REMOTE_STORAGE
   {"SLOPPINESS", "sloppiness"},
+  {"SPECULATIVE", "speculative_compilation"},
   {"STATS", "stats"},
   {"STATSLOG", "stats_log"},
   {"TEMPDIR", "temporary_dir"},
@@ -283,6 +314,20 @@ parse_compiler_type(const std::string& value)
   }
 }
 
+EvictionPolicy
+parse_eviction_policy(const std::string& value)
+{
+  if (value == "lru") {
+    return EvictionPolicy::lru;
+  } else if (value == "gdsf") {
+    return EvictionPolicy::gdsf;
+  } else if (value == "arc") {
+    return EvictionPolicy::arc;
+  } else {
+    throw core::Error(FMT("unknown eviction policy \"{}\"", value));
+  }
+}
+
 core::Sloppiness
 parse_sloppiness(const std::string& value)
 {
@@ -541,6 +586,21 @@ compiler_type_to_string(CompilerType compiler_type)
   ASSERT(false);
 }
 
+std::string
+eviction_policy_to_string(EvictionPolicy eviction_policy)
+{
+  switch (eviction_policy) {
+  case EvictionPolicy::lru:
+    return "lru";
+  case EvictionPolicy::gdsf:
+    return "gdsf";
+  case EvictionPolicy::arc:
+    return "arc";
+  }
+
+  ASSERT(false);
+}
+
 void
 Config::read(const std::vector<std::string>& cmdline_config_settings)
 {
@@ -757,12 +817,31 @@ Config::get_string_value(const std::string& key) const
   case ConfigItem::absolute_paths_in_stderr:
     return format_bool(m_absolute_paths_in_stderr);
 
+  case ConfigItem::base_cache_dir:
+    return m_base_cache_dir;
+
   case ConfigItem::base_dir:
     return m_base_dir;
 
+  case ConfigItem::build_session:
+    return m_build_session;
+
   case ConfigItem::cache_dir:
     return m_cache_dir;
 
+  case ConfigItem::cold_cache_dir:
+    return m_cold_cache_dir;
+
+  case ConfigItem::cold_max_size: {
+    auto result =
+      util::format_human_readable_size(m_cold_max_size, m_size_prefix_type);
+    if (util::ends_with(result, " bytes")) {
+      // Special case to make the output parsable by util::parse_size.
+      result.resize(result.size() - 6);
+    }
+    return result;
+  }
+
   case ConfigItem::compiler:
     return m_compiler;
 
@@ -790,6 +869,12 @@ Config::get_string_value(const std::string& key) const
   case ConfigItem::debug_level:
     return FMT("{}", m_debug_level);
 
+  case ConfigItem::deduplicate:
+    return format_bool(m_deduplicate);
+
+  case ConfigItem::delta_chain_length:
+    return FMT("{}", m_delta_chain_length);
+
   case ConfigItem::depend_mode:
     return format_bool(m_depend_mode);
 
@@ -799,9 +884,15 @@ Config::get_string_value(const std::string& key) const
   case ConfigItem::disable:
     return format_bool(m_disable);
 
+  case ConfigItem::eviction_policy:
+    return eviction_policy_to_string(m_eviction_policy);
+
   case ConfigItem::extra_files_to_hash:
     return m_extra_files_to_hash;
 
+  case ConfigItem::fast_cpp:
+    return format_bool(m_fast_cpp);
+
   case ConfigItem::file_clone:
     return format_bool(m_file_clone);
 
@@ -876,11 +967,17 @@ Config::get_string_value(const std::string& key) const
     return format_bool(m_reshare);
 
   case ConfigItem::run_second_cpp:
-    return format_bool(m_run_second_cpp);
+    return m_run_second_cpp_auto ? "auto" : format_bool(m_run_second_cpp);
+
+  case ConfigItem::scan_includes:
+    return format_bool(m_scan_includes);
 
   case ConfigItem::sloppiness:
     return format_sloppiness(m_sloppiness);
 
+  case ConfigItem::speculative_compilation:
+    return format_bool(m_speculative_compilation);
+
   case ConfigItem::stats:
     return format_bool(m_stats);
 
@@ -983,6 +1080,10 @@ Config::set_item(const std::string& key,
     m_absolute_paths_in_stderr = parse_bool(value, env_var_key, negate);
     break;
 
+  case ConfigItem::base_cache_dir:
+    m_base_cache_dir = value;
+    break;
+
   case ConfigItem::base_dir:
     m_base_dir = value;
     if (!m_base_dir.empty()) { // The empty string means "disable"
@@ -991,10 +1092,23 @@ Config::set_item(const std::string& key,
     }
     break;
 
+  case ConfigItem::build_session:
+    m_build_session = value;
+    break;
+
   case ConfigItem::cache_dir:
     set_cache_dir(value);
     break;
 
+  case ConfigItem::cold_cache_dir:
+    m_cold_cache_dir = value;
+    break;
+
+  case ConfigItem::cold_max_size:
+    m_cold_max_size =
+      util::value_or_throw<core::Error>(util::parse_size(value)).first;
+    break;
+
   case ConfigItem::compiler:
     m_compiler = value;
     break;
@@ -1033,6 +1147,19 @@ Config::set_item(const std::string& key,
       util::parse_unsigned(value, 0, UINT8_MAX, "debug level")));
     break;
 
+  case ConfigItem::deduplicate:
+    m_deduplicate = parse_bool(value, env_var_key, negate);
+    break;
+
+  case ConfigItem::delta_chain_length:
+    m_delta_chain_length = static_cast<uint8_t>(
+      util::value_or_throw<core::Error>(
+        util::parse_unsigned(value,
+                             0,
+                             core::Result::k_max_delta_chain_length,
+                             "delta_chain_length")));
+    break;
+
   case ConfigItem::depend_mode:
     m_depend_mode = parse_bool(value, env_var_key, negate);
     break;
@@ -1045,10 +1172,18 @@ Config::set_item(const std::string& key,
     m_disable = parse_bool(value, env_var_key, negate);
     break;
 
+  case ConfigItem::eviction_policy:
+    m_eviction_policy = parse_eviction_policy(value);
+    break;
+
   case ConfigItem::extra_files_to_hash:
     m_extra_files_to_hash = value;
     break;
 
+  case ConfigItem::fast_cpp:
+    m_fast_cpp = parse_bool(value, env_var_key, negate);
+    break;
+
   case ConfigItem::file_clone:
     m_file_clone = parse_bool(value, env_var_key, negate);
     break;
@@ -1143,13 +1278,23 @@ Config::set_item(const std::string& key,
     break;
 
   case ConfigItem::run_second_cpp:
-    m_run_second_cpp = parse_bool(value, env_var_key, negate);
+    m_run_second_cpp_auto = !negate && value == "auto";
+    m_run_second_cpp =
+      m_run_second_cpp_auto || parse_bool(value, env_var_key, negate);
+    break;
+
+  case ConfigItem::scan_includes:
+    m_scan_includes = parse_bool(value, env_var_key, negate);
     break;
 
   case ConfigItem::sloppiness:
     m_sloppiness = parse_sloppiness(value);
     break;
 
+  case ConfigItem::speculative_compilation:
+    m_speculative_compilation = parse_bool(value, env_var_key, negate);
+    break;
+
   case ConfigItem::stats:
     m_stats = parse_bool(value, env_var_key, negate);
     break;
@@ -46,6 +46,10 @@ enum class CompilerType {
 
 std::string compiler_type_to_string(CompilerType compiler_type);
 
+enum class EvictionPolicy { lru, gdsf, arc };
+
+std::string eviction_policy_to_string(EvictionPolicy eviction_policy);
+
 class Config : util::NonCopyable
 {
 public:
@@ -54,8 +58,12 @@ public:
   void read(const std::vector<std::string>& cmdline_config_settings = {});
 
   bool absolute_paths_in_stderr() const;
+  const std::string& base_cache_dir() const;
   const std::string& base_dir() const;
+  const std::string& build_session() const;
   const std::string& cache_dir() const;
+  const std::string& cold_cache_dir() const;
+  uint64_t cold_max_size() const;
   const std::string& compiler() const;
   const std::string& compiler_check() const;
   CompilerType compiler_type() const;
@@ -65,10 +73,14 @@ public:
   bool debug() const;
   const std::filesystem::path& debug_dir() const;
   uint8_t debug_level() const;
+  bool deduplicate() const;
+  uint8_t delta_chain_length() const;
   bool depend_mode() const;
   bool direct_mode() const;
   bool disable() const;
+  EvictionPolicy eviction_policy() const;
   const std::string& extra_files_to_hash() const;
+  bool fast_cpp() const;
   bool file_clone() const;
   bool hard_link() const;
   bool hash_dir() const;
@@ -91,7 +103,10 @@ public:
   const std::string& remote_storage() const;
   bool reshare() const;
   bool run_second_cpp() const;
+  bool run_second_cpp_auto() const;
+  bool scan_includes() const;
   core::Sloppiness sloppiness() const;
+  bool speculative_compilation() const;
   bool stats() const;
   const std::string& stats_log() const;
   const std::string& namespace_() const;
@@ -108,6 +123,7 @@ public:
   std::string default_temporary_dir() const;
 
   void set_base_dir(const std::string& value);
+  void set_build_session(const std::string& value);
   void set_cache_dir(const std::string& value);
   void set_compiler(const std::string& value);
   void set_compiler_type(CompilerType value);
@@ -169,8 +185,12 @@ private:
   std::string m_system_config_path;
 
   bool m_absolute_paths_in_stderr = false;
+  std::string m_base_cache_dir;
   std::string m_base_dir;
+  std::string m_build_session;
   std::string m_cache_dir;
+  std::string m_cold_cache_dir;
+  uint64_t m_cold_max_size = 0;
   std::string m_compiler;
   std::string m_compiler_check = "mtime";
   CompilerType m_compiler_type = CompilerType::auto_guess;
@@ -180,10 +200,14 @@ private:
   bool m_debug = false;
   std::filesystem::path m_debug_dir;
   uint8_t m_debug_level = 2;
+  bool m_deduplicate = false;
+  uint8_t m_delta_chain_length = 0;
   bool m_depend_mode = false;
   bool m_direct_mode = true;
   bool m_disable = false;
+  EvictionPolicy m_eviction_policy = EvictionPolicy::lru;
   std::string m_extra_files_to_hash;
+  bool m_fast_cpp = false;
   bool m_file_clone = false;
   bool m_hard_link = false;
   bool m_hash_dir = true;
@@ -204,9 +228,12 @@ private:
   bool m_recache = false;
   bool m_reshare = false;
   bool m_run_second_cpp = true;
+  bool m_run_second_cpp_auto = false;
+  bool m_scan_includes = false;
   bool m_remote_only = false;
   std::string m_remote_storage;
   core::Sloppiness m_sloppiness;
+  bool m_speculative_compilation = false;
   bool m_stats = true;
   std::string m_stats_log;
   std::string m_namespace;
@@ -232,18 +259,42 @@ Config::absolute_paths_in_stderr() const
   return m_absolute_paths_in_stderr;
 }
 
+inline const std::string&
+Config::base_cache_dir() const
+{
+  return m_base_cache_dir;
+}
+
 inline const std::string&
 Config::base_dir() const
 {
   return m_base_dir;
 }
 
+inline const std::string&
+Config::build_session() const
+{
+  return m_build_session;
+}
+
 inline const std::string&
 Config::cache_dir() const
 {
   return m_cache_dir;
 }
 
+inline const std::string&
+Config::cold_cache_dir() const
+{
+  return m_cold_cache_dir;
+}
+
+inline uint64_t
+Config::cold_max_size() const
+{
+  return m_cold_max_size;
+}
+
 inline const std::string&
 Config::compiler() const
 {
@@ -313,6 +364,18 @@ Config::debug_level() const
   return m_debug_level;
 }
 
+inline bool
+Config::deduplicate() const
+{
+  return m_deduplicate;
+}
+
+inline uint8_t
+Config::delta_chain_length() const
+{
+  return m_delta_chain_length;
+}
+
 inline bool
 Config::depend_mode() const
 {
@@ -331,12 +394,24 @@ Config::disable() const
   return m_disable;
 }
 
+inline EvictionPolicy
+Config::eviction_policy() const
+{
+  return m_eviction_policy;
+}
+
 inline const std::string&
 Config::extra_files_to_hash() const
 {
   return m_extra_files_to_hash;
 }
 
+inline bool
+Config::fast_cpp() const
+{
+  return m_fast_cpp;
+}
+
 inline bool
 Config::file_clone() const
 {
@@ -457,6 +532,18 @@ Config::run_second_cpp() const
   return m_run_second_cpp;
 }
 
+inline bool
+Config::run_second_cpp_auto() const
+{
+  return m_run_second_cpp_auto;
+}
+
+inline bool
+Config::scan_includes() const
+{
+  return m_scan_includes;
+}
+
 inline bool
 Config::remote_only() const
 {
@@ -475,6 +562,12 @@ Config::sloppiness() const
   return m_sloppiness;
 }
 
+inline bool
+Config::speculative_compilation() const
+{
+  return m_speculative_compilation;
+}
+
 inline bool
 Config::stats() const
 {
@@ -517,6 +610,12 @@ Config::set_base_dir(const std::string& value)
   m_base_dir = value;
 }
 
+inline void
+Config::set_build_session(const std::string& value)
+{
+  m_build_session = value;
+}
+
 inline void
 Config::set_cache_dir(const std::string& value)
 {
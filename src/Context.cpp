@@ -44,6 +44,7 @@ Context::Context()
     storage(config),
 #ifdef INODE_CACHE_SUPPORTED
     inode_cache(config),
+    header_watcher(config),
 #endif
     time_of_invocation(util::TimePoint::now())
 {
@@ -25,14 +25,17 @@
 
 #include <util/FileStream.hpp>
 #include <util/NonCopyable.hpp>
+#include <util/StringInterner.hpp>
 
 #ifdef INODE_CACHE_SUPPORTED
+#  include "HeaderWatcher.hpp"
 #  include "InodeCache.hpp"
 #endif
 
 #include <Hash.hpp>
 #include <core/Manifest.hpp>
 #include <storage/Storage.hpp>
+#include <util/Duration.hpp>
 #include <util/TimePoint.hpp>
 
 #include <ctime>
@@ -67,12 +70,20 @@ public:
   // The original argument list.
   Args orig_args;
 
-  // Files included by the preprocessor and their hashes.
-  std::unordered_map<std::string, Hash::Digest> included_files;
+  // Paths of included files, stored once per invocation.
+  util::StringInterner interned_paths;
+
+  // Files included by the preprocessor and their hashes. Keys are interned in
+  // interned_paths.
+  std::unordered_map<std::string_view, Hash::Digest> included_files;
 
   // Have we tried and failed to get colored diagnostics?
   bool diagnostics_color_failed = false;
 
+  // Content of the dependency file written by the compiler, if read. Kept so
+  // that the file only needs to be read once.
+  std::optional<std::string> output_dep_content;
+
   // The name of the temporary preprocessed file.
   std::string i_tmpfile;
 
@@ -91,15 +102,24 @@ public:
 #ifdef INODE_CACHE_SUPPORTED
   // InodeCache that caches source file hashes when enabled.
   mutable InodeCache inode_cache;
+
+  // Client of the header watcher, if running.
+  mutable HeaderWatcher header_watcher;
 #endif
 
   // Time of ccache invocation.
   util::TimePoint time_of_invocation;
 
+  // Wall time spent executing the compiler to produce the result, if any.
+  util::Duration compiler_wall_time;
+
   // PID of currently executing compiler that we have started, if any. 0 means
   // no ongoing compilation.
   pid_t compiler_pid = 0;
 
+  // PID of a speculative compilation running in its own process group, if any.
+  pid_t speculative_compiler_pid = 0;
+
   // Files used by the hash debugging functionality.
   std::vector<util::FileStream> hash_debug_files;
 
@@ -124,29 +124,48 @@ rewrite_source_paths(const Context& ctx, std::string_view file_content)
   }
 }
 
-// Replace absolute paths with relative paths in the provided dependency file.
-void
-make_paths_relative_in_output_dep(const Context& ctx)
+bool
+read_output_dep(Context& ctx)
 {
-  if (ctx.config.base_dir().empty()) {
-    LOG_RAW("Base dir not set, skip using relative paths");
-    return; // nothing to do
+  if (ctx.output_dep_content) {
+    return true;
   }
-
   const std::string& output_dep = ctx.args_info.output_dep;
-  const auto file_content = util::read_file<std::string>(output_dep);
+  auto file_content = util::read_file<std::string>(output_dep);
   if (!file_content) {
     LOG("Failed to read dependency file {}: {}",
         output_dep,
         file_content.error());
+    return false;
+  }
+  ctx.output_dep_content = std::move(*file_content);
+  return true;
+}
+
+void
+make_paths_relative_in_output_dep(Context& ctx)
+{
+  if (ctx.config.base_dir().empty()) {
+    LOG_RAW("Base dir not set, skip using relative paths");
+    return; // nothing to do
+  }
+
+  if (!read_output_dep(ctx)) {
     return;
   }
-  const auto new_content = rewrite_source_paths(ctx, *file_content);
-  if (new_content) {
-    util::write_file(output_dep, *new_content);
-  } else {
+  const std::string& output_dep = ctx.args_info.output_dep;
+  auto new_content = rewrite_source_paths(ctx, *ctx.output_dep_content);
+  if (!new_content) {
     LOG("No paths in dependency file {} made relative", output_dep);
+    return;
+  }
+  if (const auto result = util::write_file(output_dep, *new_content);
+      !result) {
+    LOG("Failed to write dependency file {}: {}", output_dep, result.error());
+    ctx.output_dep_content.reset();
+    return;
   }
+  ctx.output_dep_content = std::move(*new_content);
 }
 
 std::vector<std::string>
@@ -33,7 +33,13 @@ std::string escape_filename(std::string_view filename);
 std::optional<std::string> rewrite_source_paths(const Context& ctx,
                                                 std::string_view file_content);
 
-void make_paths_relative_in_output_dep(const Context& ctx);
+// Read the dependency file into ctx.output_dep_content unless already done.
+// Returns false if the file could not be read.
+bool read_output_dep(Context& ctx);
+
+// Replace absolute paths with relative paths in the dependency file and in
+// ctx.output_dep_content.
+void make_paths_relative_in_output_dep(Context& ctx);
 
 // Tokenize `file_content` into a list of files, where the first token is the
 // target and ends with a colon.
@@ -29,6 +29,8 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <cstring>
+
 #ifdef HAVE_UNISTD_H
 #  include <unistd.h>
 #endif
@@ -37,6 +39,8 @@ const uint8_t HASH_DELIMITER[] = {0, 'c', 'C', 'a', 'C', 'h', 'E', 0};
 
 Hash::Hash()
 {
+  // Clear unused parts of the hasher so that state() is deterministic.
+  memset(&m_hasher, 0, sizeof(m_hasher));
   blake3_hasher_init(&m_hasher);
 }
 
@@ -63,6 +67,22 @@ Hash::digest() const
   return digest;
 }
 
+nonstd::span<const uint8_t>
+Hash::state() const
+{
+  return {reinterpret_cast<const uint8_t*>(&m_hasher), sizeof(m_hasher)};
+}
+
+bool
+Hash::set_state(nonstd::span<const uint8_t> state)
+{
+  if (state.size() != sizeof(m_hasher)) {
+    return false;
+  }
+  memcpy(&m_hasher, state.data(), sizeof(m_hasher));
+  return true;
+}
+
 Hash&
 Hash::hash_delimiter(std::string_view type)
 {
@@ -46,6 +46,14 @@ public:
   // Retrieve the digest.
   Digest digest() const;
 
+  // Retrieve the internal hash state. It can be restored with set_state() by
+  // the same ccache version to continue hashing, also in another process.
+  nonstd::span<const uint8_t> state() const;
+
+  // Restore a hash state retrieved with state(). Returns false if `state` has
+  // the wrong size.
+  bool set_state(nonstd::span<const uint8_t> state);
+
   // Hash some data that is unlikely to occur in the input. The idea is twofold:
   //
   // - Delimit things like arguments from each other (e.g., so that -I -O2 and
@@ -0,0 +1,474 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "HeaderWatcher.hpp"
+
+#include "Config.hpp"
+
+#include <core/exceptions.hpp>
+#include <util/TemporaryFile.hpp>
+#include <util/TimePoint.hpp>
+#include <util/XXH3_64.hpp>
+#include <util/file.hpp>
+#include <util/filesystem.hpp>
+#include <util/fmtmacros.hpp>
+#include <util/logging.hpp>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_INOTIFY_H
+#  include <sys/inotify.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+// The shared table is an open addressing hash table of directory slots. A
+// ccache process claims a free slot for a directory by setting its key, writes
+// the path and then marks the slot as requested. The watcher service adds an
+// inotify watch for requested slots and then increments the slot's generation
+// on each change in the directory.
+//
+// The table is created by the watcher service when it starts and removed when
+// it stops. The instance number changes each time, so digests recorded for a
+// previous watcher are never trusted.
+//
+// To synchronize with the service, a ccache process increments the table's
+// sync request counter and then touches the sync file, which the service also
+// watches. Since inotify queues events in order, all changes made before the
+// touch have been processed when the service handles the sync file event, and
+// it then publishes the request counter it sees as the synced counter.
+
+namespace fs = util::filesystem;
+
+namespace {
+
+// Note: Increment the version number if the format of the shared region or the
+// meaning of generations is changed.
+const uint32_t k_version = 2;
+
+const uint32_t k_num_slots = 8 * 1024;
+const uint32_t k_max_probes = 16;
+const size_t k_max_path_length = 255;
+
+// Slot generations below k_first_generation are states of unwatched slots.
+const uint64_t k_claimed = 0;
+const uint64_t k_requested = 1;
+const uint64_t k_unwatchable = 2;
+const uint64_t k_first_generation = 3;
+
+// How long a ccache process waits for the service to process the sync file
+// event.
+const util::Duration k_sync_timeout(0, 10'000'000);
+
+const void* MMAP_FAILED = reinterpret_cast<void*>(-1); // NOLINT: Must cast here
+
+uint64_t
+path_key(std::string_view path)
+{
+  util::XXH3_64 hash;
+  hash.update(path.data(), path.size());
+  return std::max(hash.digest(), uint64_t(1)); // 0 means free slot
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+const uint32_t k_watch_mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE
+                              | IN_DELETE_SELF | IN_MODIFY | IN_MOVE_SELF
+                              | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+volatile sig_atomic_t g_stop_requested = 0;
+
+void
+request_stop(int /*signum*/)
+{
+  g_stop_requested = 1;
+}
+
+#endif
+
+} // namespace
+
+struct HeaderWatcher::Slot
+{
+  std::atomic<uint64_t> key;
+  std::atomic<uint64_t> generation;
+  char path[k_max_path_length + 1];
+};
+
+struct HeaderWatcher::SharedRegion
+{
+  uint32_t version;
+  std::atomic<pid_t> watcher_pid;
+  uint64_t instance;
+  std::atomic<uint64_t> sync_requests;
+  std::atomic<uint64_t> synced;
+  Slot slots[k_num_slots];
+};
+
+HeaderWatcher::HeaderWatcher(const Config& config) : m_config(config)
+{
+}
+
+HeaderWatcher::~HeaderWatcher()
+{
+  if (m_sr) {
+    munmap(m_sr, sizeof(SharedRegion));
+  }
+}
+
+bool
+HeaderWatcher::initialize()
+{
+  if (m_sr) {
+    return true;
+  }
+  if (m_failed) {
+    return false;
+  }
+  m_failed = true;
+
+  const auto path = get_file(m_config);
+  m_fd = util::Fd(open(path.c_str(), O_RDWR));
+  if (!m_fd) {
+    return false;
+  }
+  void* sr = mmap(nullptr,
+                  sizeof(SharedRegion),
+                  PROT_READ | PROT_WRITE,
+                  MAP_SHARED,
+                  *m_fd,
+                  0);
+  if (sr == MMAP_FAILED) {
+    LOG("Failed to mmap {}: {}", path, strerror(errno));
+    return false;
+  }
+  m_sr = static_cast<SharedRegion*>(sr);
+
+  const pid_t watcher_pid = m_sr->watcher_pid.load();
+  if (m_sr->version != k_version || watcher_pid == 0
+      || (kill(watcher_pid, 0) != 0 && errno != EPERM)) {
+    LOG("Not using stale header watcher table {}", path);
+    munmap(m_sr, sizeof(SharedRegion));
+    m_sr = nullptr;
+    return false;
+  }
+
+  LOG("Using header watcher with PID {}", watcher_pid);
+  m_failed = false;
+  m_synchronized = synchronize();
+  return true;
+}
+
+bool
+HeaderWatcher::synchronize()
+{
+  const uint64_t request = m_sr->sync_requests.fetch_add(1) + 1;
+  const auto sync_file = get_sync_file(m_config);
+  if (utimensat(AT_FDCWD, sync_file.c_str(), nullptr, 0) != 0) {
+    LOG("Failed to touch {}: {}", sync_file, strerror(errno));
+    return false;
+  }
+  const auto deadline = util::TimePoint::now() + k_sync_timeout;
+  while (m_sr->synced.load(std::memory_order_acquire) < request) {
+    if (util::TimePoint::now() > deadline) {
+      LOG_RAW("Header watcher did not synchronize in time");
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(10));
+  }
+  return true;
+}
+
+std::optional<std::string>
+HeaderWatcher::get_directory_state(std::string_view dir)
+{
+  if (dir.size() > k_max_path_length || !initialize()) {
+    return std::nullopt;
+  }
+
+  const uint64_t key = path_key(dir);
+  for (uint32_t i = 0; i < k_max_probes; ++i) {
+    Slot& slot = m_sr->slots[(key + i) % k_num_slots];
+    uint64_t slot_key = slot.key.load(std::memory_order_acquire);
+    if (slot_key == 0) {
+      if (slot.key.compare_exchange_strong(slot_key, key)) {
+        memcpy(slot.path, dir.data(), dir.size());
+        slot.path[dir.size()] = '\0';
+        slot.generation.store(k_requested, std::memory_order_release);
+        LOG("Requested header watcher to watch {}", dir);
+        return std::nullopt;
+      }
+      // Another process claimed the slot; slot_key is now its key.
+    }
+    if (slot_key == key) {
+      const uint64_t generation =
+        slot.generation.load(std::memory_order_acquire);
+      if (generation < k_first_generation || dir != slot.path) {
+        return std::nullopt;
+      }
+      return FMT("{}.{}", m_sr->instance, generation);
+    }
+  }
+  return std::nullopt;
+}
+
+bool
+HeaderWatcher::is_synchronized() const
+{
+  return m_synchronized;
+}
+
+bool
+HeaderWatcher::supported()
+{
+#ifdef HAVE_SYS_INOTIFY_H
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::string
+HeaderWatcher::get_file(const Config& config)
+{
+  return FMT("{}/header-watcher.v{}", config.temporary_dir(), k_version);
+}
+
+std::string
+HeaderWatcher::get_sync_file(const Config& config)
+{
+  return FMT("{}.sync", get_file(config));
+}
+
+HeaderWatcher::Service::Service(const Config& config)
+  : m_config(config),
+    m_last_generation(k_num_slots, 0)
+{
+}
+
+HeaderWatcher::Service::~Service()
+{
+  if (!m_sr) {
+    return;
+  }
+  m_sr->watcher_pid = 0;
+  munmap(m_sr, sizeof(SharedRegion));
+
+  // Only remove the table if it hasn't been replaced by another watcher.
+  const auto path = get_file(m_config);
+  struct stat own_st;
+  struct stat path_st;
+  if (fstat(*m_fd, &own_st) == 0 && stat(path.c_str(), &path_st) == 0
+      && own_st.st_dev == path_st.st_dev && own_st.st_ino == path_st.st_ino) {
+    util::remove(path);
+    util::remove(get_sync_file(m_config));
+  }
+}
+
+void
+HeaderWatcher::Service::start()
+{
+#ifdef HAVE_SYS_INOTIFY_H
+  m_inotify_fd = util::Fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+  if (!m_inotify_fd) {
+    throw core::Error(FMT("Failed to initialize inotify: {}", strerror(errno)));
+  }
+
+  const auto sync_file = get_sync_file(m_config);
+  if (const auto result = util::write_file(sync_file, ""); !result) {
+    throw core::Error(FMT("Failed to write {}: {}", sync_file, result.error()));
+  }
+  m_sync_wd = inotify_add_watch(*m_inotify_fd, sync_file.c_str(), IN_ATTRIB);
+  if (m_sync_wd < 0) {
+    throw core::Error(
+      FMT("Failed to watch {}: {}", sync_file, strerror(errno)));
+  }
+
+  // Create the table under a temporary name so that no process maps it before
+  // it's initialized, then replace any stale table.
+  const auto path = get_file(m_config);
+  auto tmp_file = util::TemporaryFile::create(path);
+  if (!tmp_file) {
+    throw core::Error(tmp_file.error());
+  }
+  if (auto result = util::fallocate(*tmp_file->fd, sizeof(SharedRegion));
+      !result) {
+    util::remove(tmp_file->path);
+    throw core::Error(
+      FMT("Failed to allocate {}: {}", tmp_file->path, result.error()));
+  }
+  void* sr = mmap(nullptr,
+                  sizeof(SharedRegion),
+                  PROT_READ | PROT_WRITE,
+                  MAP_SHARED,
+                  *tmp_file->fd,
+                  0);
+  if (sr == MMAP_FAILED) {
+    util::remove(tmp_file->path);
+    throw core::Error(
+      FMT("Failed to mmap {}: {}", tmp_file->path, strerror(errno)));
+  }
+  m_sr = static_cast<SharedRegion*>(sr);
+  m_fd = std::move(tmp_file->fd);
+
+  m_sr->version = k_version;
+  m_sr->instance = static_cast<uint64_t>(util::TimePoint::now().nsec());
+  m_sr->watcher_pid = getpid();
+
+  if (const auto result = fs::rename(tmp_file->path, path); !result) {
+    util::remove(tmp_file->path);
+    throw core::Error(
+      FMT("Failed to rename {} to {}: {}",
+          tmp_file->path,
+          path,
+          result.error().message()));
+  }
+  LOG("Started header watcher {}", path);
+#else
+  throw core::Error("The header watcher is not supported on this system");
+#endif
+}
+
+void
+HeaderWatcher::Service::run()
+{
+#ifdef HAVE_SYS_INOTIFY_H
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = request_stop;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+
+  while (!g_stop_requested) {
+    process(util::Duration(0, 100'000'000));
+  }
+  LOG_RAW("Stopping header watcher");
+#endif
+}
+
+void
+HeaderWatcher::Service::process(util::Duration timeout)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+  watch_requested_directories();
+
+  pollfd pfd{*m_inotify_fd, POLLIN, 0};
+  const auto timeout_ms = static_cast<int>(timeout.nsec() / 1'000'000);
+  if (poll(&pfd, 1, timeout_ms) > 0) {
+    handle_events();
+  }
+#else
+  (void)timeout;
+#endif
+}
+
+void
+HeaderWatcher::Service::watch_requested_directories()
+{
+#ifdef HAVE_SYS_INOTIFY_H
+  for (uint32_t i = 0; i < k_num_slots; ++i) {
+    Slot& slot = m_sr->slots[i];
+    if (slot.generation.load(std::memory_order_acquire) != k_requested) {
+      continue;
+    }
+    const int wd = inotify_add_watch(*m_inotify_fd, slot.path, k_watch_mask);
+    if (wd < 0) {
+      LOG("Failed to watch {}: {}", slot.path, strerror(errno));
+      slot.generation.store(k_unwatchable, std::memory_order_release);
+      continue;
+    }
+    LOG("Watching {}", slot.path);
+    m_watched_slots[wd].push_back(i);
+    bump_generation(i);
+  }
+#endif
+}
+
+void
+HeaderWatcher::Service::handle_events()
+{
+#ifdef HAVE_SYS_INOTIFY_H
+  alignas(inotify_event) char buffer[64 * 1024];
+  while (true) {
+    const auto size = read(*m_inotify_fd, buffer, sizeof(buffer));
+    if (size <= 0) {
+      break;
+    }
+    for (const char* p = buffer; p < buffer + size;) {
+      const auto* event = reinterpret_cast<const inotify_event*>(p);
+      p += sizeof(inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        LOG_RAW("inotify queue overflow, invalidating all directories");
+        for (const auto& [wd, slot_indexes] : m_watched_slots) {
+          for (const auto slot_index : slot_indexes) {
+            bump_generation(slot_index);
+          }
+        }
+        continue;
+      }
+
+      if (event->wd == m_sync_wd) {
+        // Events queued before the sync file event have been handled above.
+        // Also watch directories requested before the sync request.
+        watch_requested_directories();
+        m_sr->synced.store(m_sr->sync_requests.load(),
+                           std::memory_order_release);
+        continue;
+      }
+
+      const auto it = m_watched_slots.find(event->wd);
+      if (it == m_watched_slots.end()) {
+        continue;
+      }
+      for (const auto slot_index : it->second) {
+        bump_generation(slot_index);
+      }
+      if (event->mask & IN_IGNORED) {
+        // The directory was removed or moved away, so watch the path again.
+        for (const auto slot_index : it->second) {
+          m_sr->slots[slot_index].generation.store(k_requested,
+                                                   std::memory_order_release);
+        }
+        m_watched_slots.erase(it);
+      } else if (event->mask & IN_MOVE_SELF) {
+        // Results in IN_IGNORED.
+        inotify_rm_watch(*m_inotify_fd, event->wd);
+      }
+    }
+  }
+#endif
+}
+
+void
+HeaderWatcher::Service::bump_generation(uint32_t slot_index)
+{
+  uint64_t& generation = m_last_generation[slot_index];
+  generation = std::max(generation + 1, k_first_generation);
+  m_sr->slots[slot_index].generation.store(generation,
+                                           std::memory_order_release);
+}
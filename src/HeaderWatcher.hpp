@@ -0,0 +1,115 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#pragma once
+
+#include <util/Duration.hpp>
+#include <util/Fd.hpp>
+#include <util/NonCopyable.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class Config;
+
+// The header watcher is a long-running process, started with `ccache
+// --watch-headers`, that tracks changes to directories of include files using
+// inotify. ccache processes ask it to watch directories and read a generation
+// number per directory, which changes when any file in the directory changes,
+// from a file mapped into shared memory. When a ccache process first uses the
+// watcher, it waits until the watcher has processed all changes made before
+// that. After that, a file digest recorded for a generation can be trusted
+// without accessing the file as long as the generation stays the same.
+class HeaderWatcher : util::NonCopyable
+{
+  struct SharedRegion;
+  struct Slot;
+
+public:
+  explicit HeaderWatcher(const Config& config);
+  ~HeaderWatcher();
+
+  // Return a string that identifies the current state of the files in the
+  // directory `dir` (an absolute path), or std::nullopt if no watcher is
+  // running or `dir` is not watched. In the latter case the watcher is asked to
+  // start watching `dir`.
+  std::optional<std::string> get_directory_state(std::string_view dir);
+
+  // Return whether the watcher had processed all changes made before the first
+  // call to get_directory_state. If not, a directory state may be outdated, so
+  // the files must be checked as well.
+  bool is_synchronized() const;
+
+  // Return whether the watcher service can run on this system.
+  static bool supported();
+
+  // The watcher service.
+  class Service : util::NonCopyable
+  {
+  public:
+    explicit Service(const Config& config);
+    ~Service();
+
+    // Create a new shared table and announce the service in it. Throws
+    // core::Error on failure.
+    void start();
+
+    // Start watching requested directories and process changes, waiting at
+    // most `timeout` for a change.
+    void process(util::Duration timeout);
+
+    // Call process() until SIGINT or SIGTERM is received.
+    void run();
+
+  private:
+    const Config& m_config;
+    util::Fd m_inotify_fd;
+    util::Fd m_fd;
+    SharedRegion* m_sr = nullptr;
+    int m_sync_wd = -1;
+
+    // Slot indexes by watch descriptor. Several slots may refer to the same
+    // directory via different paths.
+    std::unordered_map<int, std::vector<uint32_t>> m_watched_slots;
+
+    // Last generation used per slot so that a rewatched directory never gets
+    // an old generation back.
+    std::vector<uint64_t> m_last_generation;
+
+    void watch_requested_directories();
+    void handle_events();
+    void bump_generation(uint32_t slot_index);
+  };
+
+private:
+  const Config& m_config;
+  util::Fd m_fd;
+  SharedRegion* m_sr = nullptr;
+  bool m_failed = false;
+  bool m_synchronized = false;
+
+  bool initialize();
+  bool synchronize();
+
+  static std::string get_file(const Config& config);
+  static std::string get_sync_file(const Config& config);
+};
@@ -0,0 +1,484 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "IncludeScanner.hpp"
+
+#include "Args.hpp"
+#include "Context.hpp"
+#include "compopt.hpp"
+
+#include <core/Sloppiness.hpp>
+#include <util/DirEntry.hpp>
+#include <util/file.hpp>
+#include <util/filesystem.hpp>
+#include <util/fmtmacros.hpp>
+#include <util/logging.hpp>
+#include <util/string.hpp>
+
+#include <cctype>
+#include <cstdlib>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace fs = util::filesystem;
+
+using util::DirEntry;
+
+namespace {
+
+struct SearchDirs
+{
+  std::vector<std::string> quote;   // -iquote
+  std::vector<std::string> bracket; // -I
+  std::vector<std::string> system;  // -isystem
+  std::vector<std::string> forced_includes;
+};
+
+bool
+is_digit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+bool
+is_identifier_char(char c)
+{
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+bool
+is_horizontal_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+std::string
+remove_line_continuations(std::string_view code)
+{
+  std::string result;
+  result.reserve(code.size());
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (code[i] == '\\') {
+      size_t j = i + 1;
+      while (j < code.size() && is_horizontal_space(code[j])) {
+        ++j;
+      }
+      if (j < code.size() && code[j] == '\n') {
+        i = j;
+        continue;
+      }
+    }
+    result.push_back(code[i]);
+  }
+  return result;
+}
+
+// Skip spaces and comments, but not newlines.
+void
+skip_space(std::string_view code, size_t& i)
+{
+  while (i < code.size()) {
+    if (is_horizontal_space(code[i])) {
+      ++i;
+    } else if (code.substr(i, 2) == "/*") {
+      const size_t end = code.find("*/", i + 2);
+      i = end == std::string_view::npos ? code.size() : end + 2;
+    } else {
+      return;
+    }
+  }
+}
+
+// Skip a string or character literal. An unterminated literal ends at the
+// newline.
+void
+skip_quoted(std::string_view code, size_t& i)
+{
+  const char quote = code[i];
+  ++i;
+  while (i < code.size() && code[i] != '\n') {
+    if (code[i] == '\\') {
+      i += 2;
+    } else if (code[i++] == quote) {
+      return;
+    }
+  }
+}
+
+// Skip a raw string literal starting with the quote at `i`. Returns false if
+// the literal is unterminated.
+bool
+skip_raw_string(std::string_view code, size_t& i)
+{
+  const size_t paren = code.find('(', i + 1);
+  if (paren == std::string_view::npos || paren - i - 1 > 16) {
+    return false;
+  }
+  const std::string terminator =
+    FMT("){}\"", code.substr(i + 1, paren - i - 1));
+  const size_t end = code.find(terminator, paren + 1);
+  if (end == std::string_view::npos) {
+    return false;
+  }
+  i = end + terminator.size();
+  return true;
+}
+
+// Skip a preprocessing number, including digit separators.
+void
+skip_number(std::string_view code, size_t& i)
+{
+  ++i;
+  while (i < code.size()) {
+    const char c = code[i];
+    const char prev = code[i - 1];
+    if (is_identifier_char(c) || c == '.'
+        || ((c == '+' || c == '-')
+            && (prev == 'e' || prev == 'E' || prev == 'p' || prev == 'P'))) {
+      ++i;
+    } else if (c == '\'' && i + 1 < code.size()
+               && is_identifier_char(code[i + 1])) {
+      i += 2;
+    } else {
+      return;
+    }
+  }
+}
+
+std::string
+join_path(std::string_view dir, std::string_view name)
+{
+  if (dir.empty()) {
+    return std::string(name);
+  }
+  return FMT("{}{}{}", dir, dir.back() == '/' ? "" : "/", name);
+}
+
+std::optional<SearchDirs>
+parse_args(const Args& args)
+{
+  SearchDirs dirs;
+  for (size_t i = 1; i < args.size(); ++i) {
+    const std::string& arg = args[i];
+
+    std::vector<std::string>* dest = nullptr;
+    size_t option_length = 0;
+    if (util::starts_with(arg, "-I") && arg != "-I-") {
+      dest = &dirs.bracket;
+      option_length = 2;
+    } else if (util::starts_with(arg, "-iquote")) {
+      dest = &dirs.quote;
+      option_length = 7;
+    } else if (util::starts_with(arg, "-isystem")) {
+      dest = &dirs.system;
+      option_length = 8;
+    } else if (util::starts_with(arg, "-include")
+               && !util::starts_with(arg, "-include-")) {
+      dest = &dirs.forced_includes;
+      option_length = 8;
+    }
+
+    if (dest) {
+      std::string value;
+      if (arg.size() > option_length) {
+        value = arg.substr(option_length);
+      } else if (i + 1 < args.size()) {
+        ++i;
+        value = args[i];
+      }
+      if (value.empty() || value[0] == '='
+          || util::starts_with(value, "$SYSROOT")) {
+        LOG("Include scanner does not support {} {}", arg, value);
+        return std::nullopt;
+      }
+      dest->push_back(std::move(value));
+      continue;
+    }
+
+    // Options that add other kinds of include directories or files, or that
+    // can hide such options from us.
+    if (arg == "-I-"
+        || (util::starts_with(arg, "-i")
+            && !util::starts_with(arg, "-isysroot"))
+        || util::starts_with(arg, "--include") || util::starts_with(arg, "-F")
+        || util::starts_with(arg, "-fmodule") || util::starts_with(arg, "-Wp,")
+        || arg == "-Xclang" || arg == "-Xpreprocessor") {
+      LOG("Include scanner does not support {}", arg);
+      return std::nullopt;
+    }
+
+    if (compopt_takes_arg(arg)) {
+      ++i;
+    }
+  }
+  return dirs;
+}
+
+class Scanner
+{
+public:
+  explicit Scanner(const SearchDirs& dirs) : m_dirs(dirs)
+  {
+  }
+
+  // Find the file that `include` refers to when included from a file in `dir`.
+  std::optional<IncludeScanner::IncludeFile>
+  resolve(const IncludeScanner::Include& include,
+          const std::string& dir,
+          bool includer_is_system);
+
+private:
+  const SearchDirs& m_dirs;
+  std::unordered_map<std::string, bool> m_is_file;
+
+  bool is_file(const std::string& path);
+};
+
+std::optional<IncludeScanner::IncludeFile>
+Scanner::resolve(const IncludeScanner::Include& include,
+                 const std::string& dir,
+                 bool includer_is_system)
+{
+  if (fs::path(include.name).is_absolute()) {
+    if (is_file(include.name)) {
+      return IncludeScanner::IncludeFile{include.name, false};
+    }
+    return std::nullopt;
+  }
+
+  const auto find_in =
+    [&](const std::vector<std::string>& dirs) -> std::optional<std::string> {
+    for (const auto& include_dir : dirs) {
+      std::string path = join_path(include_dir, include.name);
+      if (is_file(path)) {
+        return path;
+      }
+    }
+    return std::nullopt;
+  };
+
+  if (!include.angle) {
+    std::string path = join_path(dir, include.name);
+    if (is_file(path)) {
+      // Files found relative to a system header are system headers as well.
+      return IncludeScanner::IncludeFile{std::move(path), includer_is_system};
+    }
+    if (auto found = find_in(m_dirs.quote)) {
+      return IncludeScanner::IncludeFile{std::move(*found), false};
+    }
+  }
+  if (auto found = find_in(m_dirs.bracket)) {
+    return IncludeScanner::IncludeFile{std::move(*found), false};
+  }
+  if (auto found = find_in(m_dirs.system)) {
+    return IncludeScanner::IncludeFile{std::move(*found), true};
+  }
+  return std::nullopt;
+}
+
+bool
+Scanner::is_file(const std::string& path)
+{
+  const auto it = m_is_file.find(path);
+  if (it != m_is_file.end()) {
+    return it->second;
+  }
+  const bool result = DirEntry(path).is_regular_file();
+  m_is_file.emplace(path, result);
+  return result;
+}
+
+} // namespace
+
+namespace IncludeScanner {
+
+std::optional<std::vector<Include>>
+find_includes(std::string_view code)
+{
+  // Note: Intentionally not using the string form to avoid false positive
+  // match by ccache itself.
+  static const char incbin_directive[] = {'.', 'i', 'n', 'c', 'b', 'i', 'n'};
+  if (code.find(std::string_view(incbin_directive, sizeof(incbin_directive)))
+        != std::string_view::npos
+      || code.find("?\?=") != std::string_view::npos) {
+    return std::nullopt;
+  }
+
+  std::string joined_code;
+  if (code.find("\\\n") != std::string_view::npos
+      || code.find("\\\r\n") != std::string_view::npos) {
+    joined_code = remove_line_continuations(code);
+    code = joined_code;
+  }
+
+  std::vector<Include> includes;
+  bool at_line_start = true;
+  size_t i = 0;
+  while (i < code.size()) {
+    const char c = code[i];
+    const char next = i + 1 < code.size() ? code[i + 1] : '\0';
+
+    if (c == '\n') {
+      at_line_start = true;
+      ++i;
+    } else if (is_horizontal_space(c) || (c == '/' && next == '*')) {
+      skip_space(code, i);
+    } else if (c == '/' && next == '/') {
+      i = code.find('\n', i);
+    } else if (at_line_start && (c == '#' || (c == '%' && next == ':'))) {
+      at_line_start = false;
+      i += c == '#' ? 1 : 2;
+      skip_space(code, i);
+      const size_t start = i;
+      while (i < code.size() && is_identifier_char(code[i])) {
+        ++i;
+      }
+      const auto directive = code.substr(start, i - start);
+      if (directive == "include" || directive == "import") {
+        skip_space(code, i);
+        const char open = i < code.size() ? code[i] : '\0';
+        if (open != '"' && open != '<') {
+          // Computed include.
+          return std::nullopt;
+        }
+        const char close = open == '<' ? '>' : '"';
+        const size_t end =
+          code.find_first_of(close == '>' ? ">\n" : "\"\n", i + 1);
+        if (end == std::string_view::npos || code[end] != close) {
+          return std::nullopt;
+        }
+        includes.push_back(
+          Include{std::string(code.substr(i + 1, end - i - 1)), open == '<'});
+        i = end + 1;
+      } else if (directive == "include_next" || directive == "embed") {
+        return std::nullopt;
+      }
+    } else if (c == '"' || c == '\'') {
+      at_line_start = false;
+      skip_quoted(code, i);
+    } else if (is_digit(c) || (c == '.' && is_digit(next))) {
+      at_line_start = false;
+      skip_number(code, i);
+    } else if (is_identifier_char(c)) {
+      at_line_start = false;
+      const size_t start = i;
+      while (i < code.size() && is_identifier_char(code[i])) {
+        ++i;
+      }
+      const auto identifier = code.substr(start, i - start);
+      if (i < code.size() && code[i] == '"'
+          && (identifier == "R" || identifier == "LR" || identifier == "uR"
+              || identifier == "UR" || identifier == "u8R")) {
+        if (!skip_raw_string(code, i)) {
+          return std::nullopt;
+        }
+      } else if (identifier == "__has_include"
+                 || identifier == "__has_include_next") {
+        return std::nullopt;
+      }
+    } else {
+      at_line_start = false;
+      ++i;
+    }
+  }
+
+  return includes;
+}
+
+std::optional<ScanResult>
+scan(const Context& ctx, const Args& args)
+{
+  for (const char* name :
+       {"CPATH", "C_INCLUDE_PATH", "CPLUS_INCLUDE_PATH", "OBJC_INCLUDE_PATH"}) {
+    const char* value = getenv(name);
+    if (value && *value) {
+      LOG("Include scanner does not support {}", name);
+      return std::nullopt;
+    }
+  }
+
+  const auto dirs = parse_args(args);
+  if (!dirs) {
+    return std::nullopt;
+  }
+
+  const bool accept_unresolved =
+    ctx.config.sloppiness().contains(core::Sloppy::system_headers);
+
+  Scanner scanner(*dirs);
+  ScanResult result;
+  std::unordered_set<std::string> seen_paths;
+  std::unordered_set<std::string> seen_unresolved;
+  std::vector<IncludeFile> to_scan;
+
+  const auto add_include = [&](const Include& include,
+                               const std::string& dir,
+                               bool includer_is_system) {
+    auto file = scanner.resolve(include, dir, includer_is_system);
+    if (!file) {
+      std::string name = include.angle ? FMT("<{}>", include.name)
+                                       : FMT("\"{}\"", include.name);
+      if (!accept_unresolved) {
+        LOG("Include scanner could not find {}", name);
+        return false;
+      }
+      if (seen_unresolved.insert(name).second) {
+        result.unresolved.push_back(std::move(name));
+      }
+    } else if (seen_paths.insert(file->path).second) {
+      to_scan.push_back(*file);
+      result.files.push_back(std::move(*file));
+    }
+    return true;
+  };
+
+  // Files included with -include are searched for in the working directory
+  // first.
+  for (const auto& name : dirs->forced_includes) {
+    if (!add_include(Include{name, false}, "", false)) {
+      return std::nullopt;
+    }
+  }
+
+  to_scan.push_back(IncludeFile{ctx.args_info.input_file, false});
+  while (!to_scan.empty()) {
+    const IncludeFile file = std::move(to_scan.back());
+    to_scan.pop_back();
+
+    const auto code = util::read_file<std::string>(file.path);
+    if (!code) {
+      LOG("Failed to read {}: {}", file.path, code.error());
+      return std::nullopt;
+    }
+    const auto includes = find_includes(*code);
+    if (!includes) {
+      LOG("Include scanner can't handle {}", file.path);
+      return std::nullopt;
+    }
+    const std::string dir = fs::path(file.path).parent_path().string();
+    for (const auto& include : *includes) {
+      if (!add_include(include, dir, file.system)) {
+        return std::nullopt;
+      }
+    }
+  }
+
+  return result;
+}
+
+} // namespace IncludeScanner
@@ -0,0 +1,69 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#pragma once
+
+class Args;
+class Context;
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A conservative scanner that finds the files a source file may include without
+// running the preprocessor. Conditional directives are not evaluated, so the
+// result is a superset of the files that the preprocessor would include.
+namespace IncludeScanner {
+
+struct Include
+{
+  std::string name;
+  bool angle = false; // <name> instead of "name"
+};
+
+// Find the include directives in the source code `code`, also in conditional
+// sections but not in comments. Returns std::nullopt if the code contains
+// something that makes the included files impossible to know without
+// preprocessing, e.g. a computed include or __has_include.
+std::optional<std::vector<Include>> find_includes(std::string_view code);
+
+struct IncludeFile
+{
+  std::string path;
+  bool system = false;
+};
+
+struct ScanResult
+{
+  // Found files, not including the input file.
+  std::vector<IncludeFile> files;
+
+  // Include names (with quotes or angle brackets) not found in any include
+  // directory, which are assumed to be system headers.
+  std::vector<std::string> unresolved;
+};
+
+// Find the files that may be included when compiling ctx.args_info.input_file
+// with the preprocessor arguments `args`, resolving include names against the
+// -I, -iquote and -isystem directories. Unresolved names are only accepted with
+// the system_headers sloppiness. Returns std::nullopt if the result can't be
+// proven complete.
+std::optional<ScanResult> scan(const Context& ctx, const Args& args);
+
+} // namespace IncludeScanner
@@ -46,6 +46,7 @@
 #endif
 
 #include <atomic>
+#include <iterator>
 #include <type_traits>
 #include <vector>
 
@@ -57,6 +58,9 @@
 //
 // Concurrent access is guarded by a mutex in each bucket.
 //
+// A second table with the same structure maps paths of include files to their
+// normalized form, keyed by the state of the directory containing the path.
+//
 // Current cache size is fixed and the given constants are considered large
 // enough for most projects. The size could be made configurable if there is a
 // demand for it.
@@ -69,12 +73,15 @@ namespace {
 // Note: The key is hashed using the main hash algorithm, so the version number
 // does not need to be incremented if said algorithm is changed (except if the
 // digest size changes since that affects the entry format).
-const uint32_t k_version = 2;
+const uint32_t k_version = 3;
 
 // Note: Increment the version number if constants affecting storage size are
 // changed.
 const uint32_t k_num_buckets = 32 * 1024;
 const uint32_t k_num_entries = 4;
+const uint32_t k_num_path_buckets = 2 * 1024;
+const uint32_t k_num_path_entries = 4;
+const size_t k_max_normalized_path_length = 234;
 
 // Maximum time the spin lock loop will try before giving up.
 const auto k_max_lock_duration = util::Duration(5);
@@ -196,6 +203,23 @@ spin_unlock(std::atomic<pid_t>& owner_pid)
   owner_pid.store(0, std::memory_order_release);
 }
 
+// Session entries share the hash table with inode entries but are keyed by
+// session and path instead of by inode.
+Hash::Digest
+session_key_digest(std::string_view session,
+                   std::string_view path,
+                   InodeCache::ContentType type)
+{
+  Hash hash;
+  hash.hash_delimiter("build session");
+  hash.hash(session);
+  hash.hash_delimiter("path");
+  hash.hash(path);
+  hash.hash_delimiter("type");
+  hash.hash(static_cast<int64_t>(type));
+  return hash.digest();
+}
+
 } // namespace
 
 struct InodeCache::Key
@@ -222,6 +246,19 @@ struct InodeCache::Bucket
   Entry entries[k_num_entries];
 };
 
+struct InodeCache::PathEntry
+{
+  Hash::Digest key_digest; // Hashed context, path and directory state
+  uint16_t length;         // Length of normalized_path
+  char normalized_path[k_max_normalized_path_length];
+};
+
+struct InodeCache::PathBucket
+{
+  std::atomic<pid_t> owner_pid;
+  PathEntry entries[k_num_path_entries];
+};
+
 struct InodeCache::SharedRegion
 {
   uint32_t version;
@@ -229,6 +266,7 @@ struct InodeCache::SharedRegion
   std::atomic<int64_t> misses;
   std::atomic<int64_t> errors;
   Bucket buckets[k_num_buckets];
+  PathBucket path_buckets[k_num_path_buckets];
 };
 
 bool
@@ -312,13 +350,51 @@ InodeCache::hash_inode(const std::string& path,
 }
 
 bool
-InodeCache::with_bucket(const Hash::Digest& key_digest,
-                        const BucketHandler& bucket_handler)
+InodeCache::hash_directory_of(std::string_view context,
+                              const std::string& path,
+                              Hash::Digest& digest)
+{
+  const auto slash = path.rfind('/');
+  if (slash == std::string::npos) {
+    return false;
+  }
+  const std::string dir = slash == 0 ? "/" : path.substr(0, slash);
+  util::DirEntry de(dir);
+  if (!de.is_directory()) {
+    return false;
+  }
+
+  // The directory changes when entries are added, removed or renamed. See
+  // comment for InodeCache::InodeCache why the age check is done.
+  auto now = util::TimePoint::now();
+  if (now - de.ctime() < m_min_age || now - de.mtime() < m_min_age) {
+    return false;
+  }
+
+  Hash hash;
+  hash.hash_delimiter("normalized path");
+  hash.hash(context);
+  hash.hash_delimiter("path");
+  hash.hash(path);
+  hash.hash_delimiter("dir");
+  hash.hash(static_cast<int64_t>(de.device()));
+  hash.hash(static_cast<int64_t>(de.inode()));
+  hash.hash(de.mtime().nsec());
+  hash.hash(de.ctime().nsec());
+  digest = hash.digest();
+  return true;
+}
+
+template<typename T, size_t N, typename Handler>
+bool
+InodeCache::with_bucket(T (SharedRegion::*buckets)[N],
+                        const Hash::Digest& key_digest,
+                        const Handler& bucket_handler)
 {
   uint32_t hash;
   util::big_endian_to_int(key_digest.data(), hash);
-  const uint32_t index = hash % k_num_buckets;
-  Bucket* bucket = &m_sr->buckets[index];
+  const uint32_t index = hash % N;
+  T* bucket = &(m_sr->*buckets)[index];
   bool acquired_lock = spin_lock(bucket->owner_pid, m_self_pid);
   while (!acquired_lock) {
     LOG("Dropping inode cache file because of stale mutex at index {}", index);
@@ -328,7 +404,7 @@ InodeCache::with_bucket(const Hash::Digest& key_digest,
     if (m_config.debug()) {
       ++m_sr->errors;
     }
-    bucket = &m_sr->buckets[index];
+    bucket = &(m_sr->*buckets)[index];
     acquired_lock = spin_lock(bucket->owner_pid, m_self_pid);
   }
   try {
@@ -341,6 +417,36 @@ InodeCache::with_bucket(const Hash::Digest& key_digest,
   return true;
 }
 
+template<typename T>
+auto
+InodeCache::find_entry(T* bucket, const Hash::Digest& key_digest)
+{
+  const size_t num_entries = std::size(bucket->entries);
+  for (size_t i = 0; i < num_entries; ++i) {
+    if (bucket->entries[i].key_digest == key_digest) {
+      if (i > 0) {
+        auto tmp = bucket->entries[i];
+        memmove(&bucket->entries[1],
+                &bucket->entries[0],
+                sizeof(bucket->entries[0]) * i);
+        bucket->entries[0] = tmp;
+      }
+      return &bucket->entries[0];
+    }
+  }
+  return static_cast<decltype(&bucket->entries[0])>(nullptr);
+}
+
+template<typename T, typename E>
+void
+InodeCache::insert_entry(T* bucket, const E& entry)
+{
+  memmove(&bucket->entries[1],
+          &bucket->entries[0],
+          sizeof(E) * (std::size(bucket->entries) - 1));
+  bucket->entries[0] = entry;
+}
+
 bool
 InodeCache::create_new_file(const std::string& filename)
 {
@@ -381,6 +487,10 @@ InodeCache::create_new_file(const std::string& filename)
     bucket.owner_pid = 0;
     memset(bucket.entries, 0, sizeof(Bucket::entries));
   }
+  for (auto& bucket : sr->path_buckets) {
+    bucket.owner_pid = 0;
+    memset(bucket.entries, 0, sizeof(PathBucket::entries));
+  }
 
   munmap(sr, sizeof(SharedRegion));
   tmp_file->fd.close();
@@ -490,22 +600,13 @@ InodeCache::get(const std::string& path, ContentType type)
 
   std::optional<HashSourceCodeResult> result;
   Hash::Digest file_digest;
-  const bool success = with_bucket(key_digest, [&](const auto bucket) {
-    for (uint32_t i = 0; i < k_num_entries; ++i) {
-      if (bucket->entries[i].key_digest == key_digest) {
-        if (i > 0) {
-          Entry tmp = bucket->entries[i];
-          memmove(&bucket->entries[1], &bucket->entries[0], sizeof(Entry) * i);
-          bucket->entries[0] = tmp;
-        }
-
-        file_digest = bucket->entries[0].file_digest;
-        result =
-          HashSourceCodeResult::from_bitmask(bucket->entries[0].return_value);
-        break;
+  const bool success =
+    with_bucket(&SharedRegion::buckets, key_digest, [&](const auto bucket) {
+      if (const Entry* entry = find_entry(bucket, key_digest)) {
+        file_digest = entry->file_digest;
+        result = HashSourceCodeResult::from_bitmask(entry->return_value);
       }
-    }
-  });
+    });
   if (!success) {
     return std::nullopt;
   }
@@ -540,15 +641,11 @@ InodeCache::put(const std::string& path,
     return false;
   }
 
-  const bool success = with_bucket(key_digest, [&](const auto bucket) {
-    memmove(&bucket->entries[1],
-            &bucket->entries[0],
-            sizeof(Entry) * (k_num_entries - 1));
-
-    bucket->entries[0].key_digest = key_digest;
-    bucket->entries[0].file_digest = file_digest;
-    bucket->entries[0].return_value = return_value.to_bitmask();
-  });
+  const bool success =
+    with_bucket(&SharedRegion::buckets, key_digest, [&](const auto bucket) {
+      insert_entry(bucket,
+                   Entry{key_digest, file_digest, return_value.to_bitmask()});
+    });
 
   if (!success) {
     return false;
@@ -560,6 +657,136 @@ InodeCache::put(const std::string& path,
   return true;
 }
 
+std::optional<Hash::Digest>
+InodeCache::get_session_digest(std::string_view session,
+                               std::string_view path,
+                               ContentType type)
+{
+  if (!initialize()) {
+    return std::nullopt;
+  }
+
+  const auto key_digest = session_key_digest(session, path, type);
+  std::optional<Hash::Digest> file_digest;
+  const bool success =
+    with_bucket(&SharedRegion::buckets, key_digest, [&](const auto bucket) {
+      if (const Entry* entry = find_entry(bucket, key_digest)) {
+        file_digest = entry->file_digest;
+      }
+    });
+  if (!success) {
+    return std::nullopt;
+  }
+
+  if (m_config.debug()) {
+    LOG("Inode cache session {}: {}", file_digest ? "hit" : "miss", path);
+    if (file_digest) {
+      ++m_sr->hits;
+    } else {
+      ++m_sr->misses;
+    }
+  }
+  return file_digest;
+}
+
+bool
+InodeCache::put_session_digest(std::string_view session,
+                               std::string_view path,
+                               ContentType type,
+                               const Hash::Digest& file_digest)
+{
+  if (!initialize()) {
+    return false;
+  }
+
+  const auto key_digest = session_key_digest(session, path, type);
+  const bool success =
+    with_bucket(&SharedRegion::buckets, key_digest, [&](const auto bucket) {
+      insert_entry(bucket, Entry{key_digest, file_digest, 0});
+    });
+
+  if (!success) {
+    return false;
+  }
+
+  if (m_config.debug()) {
+    LOG("Inode cache session insert: {}", path);
+  }
+  return true;
+}
+
+std::optional<std::string>
+InodeCache::get_normalized_path(std::string_view context,
+                                const std::string& path)
+{
+  if (!initialize()) {
+    return std::nullopt;
+  }
+
+  Hash::Digest key_digest;
+  if (!hash_directory_of(context, path, key_digest)) {
+    return std::nullopt;
+  }
+
+  std::optional<std::string> normalized_path;
+  const bool success = with_bucket(
+    &SharedRegion::path_buckets, key_digest, [&](const auto bucket) {
+      if (const PathEntry* entry = find_entry(bucket, key_digest)) {
+        normalized_path.emplace(entry->normalized_path, entry->length);
+      }
+    });
+  if (!success) {
+    return std::nullopt;
+  }
+
+  if (m_config.debug()) {
+    LOG("Inode cache path {}: {}", normalized_path ? "hit" : "miss", path);
+    if (normalized_path) {
+      ++m_sr->hits;
+    } else {
+      ++m_sr->misses;
+    }
+  }
+  return normalized_path;
+}
+
+bool
+InodeCache::put_normalized_path(std::string_view context,
+                                const std::string& path,
+                                std::string_view normalized_path)
+{
+  if (normalized_path.length() > k_max_normalized_path_length) {
+    return false;
+  }
+  if (!initialize()) {
+    return false;
+  }
+
+  Hash::Digest key_digest;
+  if (!hash_directory_of(context, path, key_digest)) {
+    return false;
+  }
+
+  PathEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.key_digest = key_digest;
+  entry.length = static_cast<uint16_t>(normalized_path.length());
+  memcpy(entry.normalized_path, normalized_path.data(), entry.length);
+  const bool success = with_bucket(
+    &SharedRegion::path_buckets, key_digest, [&](const auto bucket) {
+      insert_entry(bucket, entry);
+    });
+
+  if (!success) {
+    return false;
+  }
+
+  if (m_config.debug()) {
+    LOG("Inode cache path insert: {}", path);
+  }
+  return true;
+}
+
 bool
 InodeCache::drop()
 {
@@ -24,10 +24,11 @@
 #include <util/Fd.hpp>
 #include <util/TimePoint.hpp>
 
+#include <cstddef>
 #include <cstdint>
-#include <functional>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
 
 class Config;
@@ -88,6 +89,37 @@ public:
            const Hash::Digest& file_digest,
            HashSourceCodeResult return_value);
 
+  // Get the digest stored with put_session_digest() for `path` in the build
+  // session `session`. Unlike get(), this does not access the file at all.
+  std::optional<Hash::Digest> get_session_digest(std::string_view session,
+                                                 std::string_view path,
+                                                 ContentType type);
+
+  // Record that `path` had the digest `file_digest` in the build session
+  // `session`, i.e. that it can be assumed to have that content until the
+  // session ends.
+  //
+  // Returns true if the value could be stored in the cache, false otherwise.
+  bool put_session_digest(std::string_view session,
+                          std::string_view path,
+                          ContentType type,
+                          const Hash::Digest& file_digest);
+
+  // Get the normalized form of `path` stored with put_normalized_path() for the
+  // same `context`, provided that the directory containing `path` has not
+  // changed since then.
+  std::optional<std::string> get_normalized_path(std::string_view context,
+                                                 const std::string& path);
+
+  // Record that `normalized_path` is the normalized form of `path`. `context`
+  // should identify everything except the file system that the normalization
+  // depends on, e.g. base directory and current working directory.
+  //
+  // Returns true if the value could be stored in the cache, false otherwise.
+  bool put_normalized_path(std::string_view context,
+                           const std::string& path,
+                           std::string_view normalized_path);
+
   // Unmaps the current cache and removes the mapped file from disk.
   //
   // Returns true on success, false otherwise.
@@ -118,16 +150,33 @@ private:
   struct Bucket;
   struct Entry;
   struct Key;
+  struct PathBucket;
+  struct PathEntry;
   struct SharedRegion;
-  using BucketHandler = std::function<void(Bucket* bucket)>;
 
   bool mmap_file(const std::string& inode_cache_file);
 
   bool
   hash_inode(const std::string& path, ContentType type, Hash::Digest& digest);
 
-  bool with_bucket(const Hash::Digest& key_digest,
-                   const BucketHandler& bucket_handler);
+  bool hash_directory_of(std::string_view context,
+                         const std::string& path,
+                         Hash::Digest& digest);
+
+  // Lock the bucket for `key_digest` in the table `buckets` (Bucket or
+  // PathBucket) and call `bucket_handler` with it.
+  template<typename T, size_t N, typename Handler>
+  bool with_bucket(T (SharedRegion::*buckets)[N],
+                   const Hash::Digest& key_digest,
+                   const Handler& bucket_handler);
+
+  // Find the entry for `key_digest` in `bucket` and move it first in LRU order.
+  template<typename T>
+  static auto find_entry(T* bucket, const Hash::Digest& key_digest);
+
+  // Insert an entry first in LRU order in `bucket`, evicting the last one.
+  template<typename T, typename E>
+  static void insert_entry(T* bucket, const E& entry);
 
   static bool create_new_file(const std::string& filename);
 
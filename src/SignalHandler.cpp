@@ -110,6 +110,13 @@ SignalHandler::on_signal(int signum)
     kill(ctx.compiler_pid, signum);
   }
 
+  // The output of a speculative compilation is never used after a signal, and
+  // the compiler is not reached by signals sent to our process group.
+  if (ctx.speculative_compiler_pid != 0) {
+    kill(-ctx.speculative_compiler_pid, SIGTERM);
+    waitpid(ctx.speculative_compiler_pid, nullptr, 0);
+  }
+
   ctx.unlink_pending_tmp_files_signal_safe();
 
   if (ctx.compiler_pid != 0) {
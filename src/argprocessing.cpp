@@ -37,7 +37,11 @@
 #  include <unistd.h>
 #endif
 
+#include <algorithm>
 #include <cassert>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <vector>
 
 namespace fs = util::filesystem;
@@ -1208,6 +1212,69 @@ get_default_object_file_extension(const Config& config)
   return config.is_compiler_group_msvc() ? ".obj" : ".o";
 }
 
+// Warnings that GCC and Clang report the same way regardless of whether the
+// code comes from a macro expansion, so they can be made errors when compiling
+// preprocessed code. Other warnings can be suppressed in code expanded from
+// macros, e.g. from system headers, which the compiler no longer knows about
+// when compiling preprocessed code.
+const std::string_view k_macro_independent_warnings[] = {
+  "format-security",
+  "implicit-function-declaration",
+  "implicit-int",
+  "incompatible-pointer-types",
+  "int-conversion",
+  "missing-declarations",
+  "missing-prototypes",
+  "return-type",
+  "vla",
+};
+
+// Return why compiling the preprocessed code instead of the source code could
+// change the diagnostics, or std::nullopt if it can't.
+std::optional<std::string>
+get_reason_to_run_second_cpp(const Config& config,
+                             const Args& args,
+                             const ArgumentProcessingState& state)
+{
+  if (state.found_directives_only || state.found_rewrite_includes) {
+    // The preprocessed code is then not fully preprocessed.
+    return "-fdirectives-only or -frewrite-includes used";
+  }
+
+  bool warnings_disabled = false;
+  for (size_t i = 1; i < args.size(); ++i) {
+    const std::string_view arg = args[i];
+    if (arg == "-w") {
+      warnings_disabled = true;
+    } else if (arg == "-Werror" || arg == "-pedantic-errors") {
+      return FMT("{} used", arg);
+    } else if (util::starts_with(arg, "-Werror=")) {
+      const auto warning = arg.substr(8);
+      if (std::find(std::begin(k_macro_independent_warnings),
+                    std::end(k_macro_independent_warnings),
+                    warning)
+          == std::end(k_macro_independent_warnings)) {
+        return FMT("{} used", arg);
+      }
+    }
+  }
+
+  if (config.compiler_type() != CompilerType::gcc
+      && config.compiler_type() != CompilerType::clang) {
+    return FMT("Compiler type {} used",
+               compiler_type_to_string(config.compiler_type()));
+  }
+
+  // Both GCC and Clang suppress some warnings in code expanded from macros
+  // (e.g. -Wparentheses-equality for Clang and -Wmisleading-indentation for
+  // GCC) but report them for the same code in preprocessed form.
+  if (!warnings_disabled) {
+    return "-w not used";
+  }
+
+  return std::nullopt;
+}
+
 } // namespace
 
 ProcessArgsResult
@@ -1226,6 +1293,12 @@ process_args(Context& ctx)
 
   state.common_args.push_back(args[0]); // Compiler
 
+  // With run_second_cpp = auto, compile the preprocessed code unless it turns
+  // out to be unsafe below.
+  if (config.run_second_cpp_auto()) {
+    config.set_run_second_cpp(false);
+  }
+
   std::optional<Statistic> argument_error;
   for (size_t i = 1; i < args.size(); i++) {
     const auto error = process_arg(ctx, args_info, ctx.config, args, i, state);
@@ -1426,6 +1499,16 @@ process_args(Context& ctx)
     config.set_run_second_cpp(true);
   }
 
+  if (config.run_second_cpp_auto() && !config.run_second_cpp()) {
+    const auto reason = get_reason_to_run_second_cpp(config, args, state);
+    if (reason) {
+      LOG("{}; not compiling preprocessed code", *reason);
+      config.set_run_second_cpp(true);
+    } else {
+      LOG_RAW("Compiling preprocessed code");
+    }
+  }
+
   if (config.cpp_extension().empty()) {
     std::string p_language = p_language_for_language(args_info.actual_language);
     config.set_cpp_extension(extension_for_language(p_language).substr(1));
@@ -21,9 +21,11 @@
 
 #include "Args.hpp"
 #include "ArgsInfo.hpp"
+#include "ArgsTemplate.hpp"
 #include "Context.hpp"
 #include "Depfile.hpp"
 #include "Hash.hpp"
+#include "IncludeScanner.hpp"
 #include "MiniTrace.hpp"
 #include "SignalHandler.hpp"
 #include "Util.hpp"
@@ -45,12 +47,16 @@
 #include <core/mainoptions.hpp>
 #include <core/types.hpp>
 #include <storage/Storage.hpp>
+#include <util/Duration.hpp>
 #include <util/Fd.hpp>
 #include <util/FileStream.hpp>
 #include <util/Finalizer.hpp>
+#include <util/NonCopyable.hpp>
 #include <util/PathString.hpp>
 #include <util/TemporaryFile.hpp>
+#include <util/TimePoint.hpp>
 #include <util/UmaskScope.hpp>
+#include <util/conversion.hpp>
 #include <util/environment.hpp>
 #include <util/expected.hpp>
 #include <util/file.hpp>
@@ -74,6 +80,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <csignal>
 #include <cstring>
 #include <limits>
 #include <memory>
@@ -96,6 +103,11 @@ const char HASH_PREFIX[] = "4";
 // k_ccache_disable_search_limit bytes of the input file.
 const size_t k_ccache_disable_search_limit = 4096;
 
+// Number of manifest delta records that triggers compaction into the manifest
+// when read on a cache miss. Delta records are always compacted when read on a
+// cache hit.
+const size_t k_manifest_delta_compaction_threshold = 8;
+
 // String to look for when checking whether to disable ccache for the input
 // file.
 const char k_ccache_disable_token[] = {
@@ -412,7 +424,7 @@ remember_include_file(Context& ctx,
     }
   }
 
-  ctx.included_files.emplace(path, file_digest);
+  ctx.included_files.emplace(ctx.interned_paths.intern(path), file_digest);
 
   return {};
 }
@@ -425,6 +437,37 @@ print_included_files(const Context& ctx, FILE* fp)
   }
 }
 
+// Return the normalized, possibly relative, form of an include file path found
+// in preprocessed output. Normalizations that need to access the file system
+// are cached in the inode cache so that they are shared between compilations.
+static std::string
+normalize_include_path(Context& ctx, const std::string& path)
+{
+  const auto& base_dir = ctx.config.base_dir();
+  if (Util::normalize_abstract_absolute_path(path) == path
+      && (base_dir.empty() || !util::path_starts_with(path, base_dir))) {
+    // Nothing to do and no system calls needed to find out.
+    return path;
+  }
+
+#ifdef INODE_CACHE_SUPPORTED
+  const auto context =
+    FMT("{}\n{}\n{}", base_dir, ctx.actual_cwd, ctx.apparent_cwd);
+  if (auto cached = ctx.inode_cache.get_normalized_path(context, path)) {
+    return *cached;
+  }
+#endif
+
+  auto normalized_path = Util::make_relative_path(
+    ctx, Util::normalize_concrete_absolute_path(path));
+
+#ifdef INODE_CACHE_SUPPORTED
+  ctx.inode_cache.put_normalized_path(context, path, normalized_path);
+#endif
+
+  return normalized_path;
+}
+
 // This function reads and hashes a file. While doing this, it also does these
 // things:
 //
@@ -440,7 +483,9 @@ process_preprocessed_file(Context& ctx, Hash& hash, const std::string& path)
     return tl::unexpected(Statistic::internal_error);
   }
 
-  std::unordered_map<std::string, std::string> relative_inc_path_cache;
+  // Normalized include file paths by path in linemarkers, all interned.
+  std::unordered_map<std::string_view, std::string_view>
+    relative_inc_path_cache;
 
   // Bytes between p and q are pending to be hashed.
   char* q = &(*data)[0];
@@ -546,13 +591,14 @@ process_preprocessed_file(Context& ctx, Hash& hash, const std::string& path)
       }
 
       // p and q span the include file path.
-      std::string inc_path(p, q - p);
+      std::string_view inc_path(p, q - p);
       auto it = relative_inc_path_cache.find(inc_path);
       if (it == relative_inc_path_cache.end()) {
-        auto rel_inc_path = Util::make_relative_path(
-          ctx, Util::normalize_concrete_absolute_path(inc_path));
-        relative_inc_path_cache.emplace(inc_path, rel_inc_path);
-        inc_path = std::move(rel_inc_path);
+        const auto rel_inc_path = ctx.interned_paths.intern(
+          normalize_include_path(ctx, std::string(inc_path)));
+        relative_inc_path_cache.emplace(ctx.interned_paths.intern(inc_path),
+                                        rel_inc_path);
+        inc_path = rel_inc_path;
       } else {
         inc_path = it->second;
       }
@@ -561,7 +607,12 @@ process_preprocessed_file(Context& ctx, Hash& hash, const std::string& path)
         hash.hash(inc_path);
       }
 
-      TRY(remember_include_file(ctx, inc_path, hash, system, nullptr));
+      // Include files typically appear in many linemarkers, so don't create a
+      // new path string for already known files.
+      if (ctx.included_files.find(inc_path) == ctx.included_files.end()) {
+        TRY(remember_include_file(
+          ctx, std::string(inc_path), hash, system, nullptr));
+      }
       p = q; // Everything of interest between p and q has been hashed now.
     } else if (strncmp(q, incbin_directive, sizeof(incbin_directive)) == 0
                && ((q[7] == ' '
@@ -625,16 +676,11 @@ result_key_from_depfile(Context& ctx, Hash& hash)
   // file is empty).
   hash.hash_delimiter("result");
 
-  const auto file_content =
-    util::read_file<std::string>(ctx.args_info.output_dep);
-  if (!file_content) {
-    LOG("Failed to read dependency file {}: {}",
-        ctx.args_info.output_dep,
-        file_content.error());
+  if (!Depfile::read_output_dep(ctx)) {
     return tl::unexpected(Statistic::bad_input_file);
   }
 
-  for (std::string_view token : Depfile::tokenize(*file_content)) {
+  for (std::string_view token : Depfile::tokenize(*ctx.output_dep_content)) {
     if (util::ends_with(token, ":")) {
       continue;
     }
@@ -660,34 +706,13 @@ result_key_from_depfile(Context& ctx, Hash& hash)
   return hash.digest();
 }
 
-struct GetTmpFdResult
-{
-  util::Fd fd;
-  fs::path path;
-};
-
-static GetTmpFdResult
-get_tmp_fd(Context& ctx,
-           const std::string_view description,
-           const bool capture_output)
-{
-  if (capture_output) {
-    auto tmp_stdout =
-      util::value_or_throw<core::Fatal>(util::TemporaryFile::create(
-        FMT("{}/{}", ctx.config.temporary_dir(), description)));
-    ctx.register_pending_tmp_file(pstr(tmp_stdout.path));
-    return {std::move(tmp_stdout.fd), std::move(tmp_stdout.path)};
-  } else {
-    const auto dev_null_path = util::get_dev_null_path();
-    return {util::Fd(open(dev_null_path, O_WRONLY | O_BINARY)), dev_null_path};
-  }
-}
-
 struct DoExecuteResult
 {
   int exit_status;
   util::Bytes stdout_data;
   util::Bytes stderr_data;
+  util::Duration wall_time = util::Duration(0);
+  util::Duration cpu_time = util::Duration(0);
 };
 
 // Extract the used includes from /showIncludes output in stdout. Note that we
@@ -720,6 +745,61 @@ result_key_from_includes(Context& ctx, Hash& hash, std::string_view stdout_data)
   return hash.digest();
 }
 
+// Return whether the include files should be found with the include scanner
+// instead of the preprocessor after a direct mode miss.
+static bool
+should_scan_includes(const Context& ctx)
+{
+  return ctx.config.scan_includes() && ctx.config.direct_mode()
+         && !ctx.config.depend_mode() && ctx.config.run_second_cpp()
+         && (ctx.config.compiler_type() == CompilerType::gcc
+             || ctx.config.compiler_type() == CompilerType::clang)
+         && !ctx.args_info.direct_i_file
+         && !ctx.args_info.output_is_precompiled_header
+         && !ctx.args_info.using_precompiled_header;
+}
+
+// Extend the direct mode hash with the files found by the include scanner. Also
+// updates ctx.included_files. Returns std::nullopt if the scanner couldn't
+// prove that it found all files, in which case the preprocessor must be used.
+static std::optional<Hash::Digest>
+result_key_from_include_scan(Context& ctx, const Args& args, Hash& hash)
+{
+  const auto scan_result = IncludeScanner::scan(ctx, args);
+  if (!scan_result) {
+    return std::nullopt;
+  }
+
+  // Make sure that the result key differs from the manifest key and from
+  // result keys calculated in the depend mode.
+  hash.hash_delimiter("result");
+  hash.hash_delimiter("include scan");
+
+  for (const auto& file : scan_result->files) {
+    hash.hash_delimiter("include");
+    hash.hash(file.path);
+    if (!remember_include_file(ctx, file.path, hash, file.system, &hash)) {
+      ctx.included_files.clear();
+      return std::nullopt;
+    }
+  }
+  for (const auto& name : scan_result->unresolved) {
+    hash.hash_delimiter("unresolved include");
+    hash.hash(name);
+  }
+
+  if (!ctx.config.direct_mode()) {
+    // __TIME__ was found in an include file.
+    ctx.included_files.clear();
+    return std::nullopt;
+  }
+
+  LOG("Include scanner found {} include files and {} unresolved includes",
+      scan_result->files.size(),
+      scan_result->unresolved.size());
+  return hash.digest();
+}
+
 // Execute the compiler/preprocessor, with logic to retry without requesting
 // colored diagnostics messages if that fails.
 static tl::expected<DoExecuteResult, Failure>
@@ -732,17 +812,25 @@ do_execute(Context& ctx, Args& args, const bool capture_stdout = true)
     args.erase_last("-fdiagnostics-color");
   }
 
-  auto tmp_stdout = get_tmp_fd(ctx, "stdout", capture_stdout);
-  auto tmp_stderr = get_tmp_fd(ctx, "stderr", true);
-
-  int status = execute(ctx,
-                       args.to_argv().data(),
-                       std::move(tmp_stdout.fd),
-                       std::move(tmp_stderr.fd));
-  if (status != 0 && !ctx.diagnostics_color_failed
+  util::Bytes stdout_data;
+  util::Bytes stderr_data;
+  const auto start_time = util::TimePoint::now();
+  util::Duration cpu_time;
+  const auto status =
+    execute_and_capture(ctx,
+                        args.to_argv().data(),
+                        capture_stdout ? &stdout_data : nullptr,
+                        stderr_data,
+                        &cpu_time);
+  const auto wall_time = util::TimePoint::now() - start_time;
+  if (!status) {
+    LOG("{} (cleanup in progress?)", status.error());
+    return tl::unexpected(Statistic::missing_cache_file);
+  }
+  if (*status != 0 && !ctx.diagnostics_color_failed
       && ctx.config.compiler_type() == CompilerType::gcc) {
-    const auto errors = util::read_file<std::string>(tmp_stderr.path);
-    if (errors && errors->find("fdiagnostics-color") != std::string::npos) {
+    const std::string_view errors = util::to_string_view(stderr_data);
+    if (errors.find("fdiagnostics-color") != std::string_view::npos) {
       // GCC versions older than 4.9 don't understand -fdiagnostics-color, and
       // non-GCC compilers misclassified as CompilerType::gcc might not do it
       // either. We assume that if the error message contains
@@ -758,41 +846,225 @@ do_execute(Context& ctx, Args& args, const bool capture_stdout = true)
     }
   }
 
-  util::Bytes stdout_data;
-  if (capture_stdout) {
-    auto stdout_data_result = util::read_file<util::Bytes>(tmp_stdout.path);
-    if (!stdout_data_result) {
-      LOG("Failed to read {} (cleanup in progress?): {}",
-          tmp_stdout.path,
-          stdout_data_result.error());
-      return tl::unexpected(Statistic::missing_cache_file);
-    }
-    stdout_data = *stdout_data_result;
-  }
-
-  auto stderr_data_result = util::read_file<util::Bytes>(tmp_stderr.path);
-  if (!stderr_data_result) {
-    LOG("Failed to read {} (cleanup in progress?): {}",
-        tmp_stderr.path,
-        stderr_data_result.error());
-    return tl::unexpected(Statistic::missing_cache_file);
+  return DoExecuteResult{*status,
+                         std::move(stdout_data),
+                         std::move(stderr_data),
+                         wall_time,
+                         cpu_time};
+}
+
+#ifndef _WIN32
+// A compilation started before the preprocessor mode lookup has finished. The
+// object file is written to a private location and is only moved in place by
+// finish(). The compiler is killed if the object is destroyed before that, e.g.
+// on a preprocessor mode hit.
+class SpeculativeCompilation : util::NonCopyable
+{
+public:
+  // Start compiling with `compiler_args`, which don't include the output and
+  // input files. Returns nullptr on failure.
+  static std::unique_ptr<SpeculativeCompilation>
+  start(Context& ctx, const Args& compiler_args);
+
+  ~SpeculativeCompilation();
+
+  // Wait for the compiler and move the object file in place if it succeeded.
+  // Returns std::nullopt if the compilation has to be redone.
+  std::optional<DoExecuteResult> finish();
+
+private:
+  SpeculativeCompilation(Context& ctx) : m_ctx(ctx)
+  {
+  }
+
+  Context& m_ctx;
+  fs::path m_output_obj;
+  fs::path m_stdout_path;
+  fs::path m_stderr_path;
+  util::TimePoint m_start_time;
+};
+
+std::unique_ptr<SpeculativeCompilation>
+SpeculativeCompilation::start(Context& ctx, const Args& compiler_args)
+{
+  // The object file is put next to the real one so that it can be renamed.
+  auto tmp_obj = util::TemporaryFile::create(ctx.args_info.output_obj);
+  if (!tmp_obj) {
+    LOG("Not compiling speculatively: {}", tmp_obj.error());
+    return nullptr;
+  }
+  ctx.register_pending_tmp_file(pstr(tmp_obj->path));
+  // Let the compiler create the file so that it gets the usual permissions.
+  tmp_obj->fd.close();
+  util::remove(tmp_obj->path);
+
+  auto tmp_stdout = util::TemporaryFile::create(
+    FMT("{}/speculative_stdout", ctx.config.temporary_dir()));
+  auto tmp_stderr = util::TemporaryFile::create(
+    FMT("{}/speculative_stderr", ctx.config.temporary_dir()));
+  if (!tmp_stdout || !tmp_stderr) {
+    LOG("Not compiling speculatively: {}",
+        tmp_stdout ? tmp_stderr.error() : tmp_stdout.error());
+    return nullptr;
+  }
+  ctx.register_pending_tmp_file(pstr(tmp_stdout->path));
+  ctx.register_pending_tmp_file(pstr(tmp_stderr->path));
+
+  std::unique_ptr<SpeculativeCompilation> speculation(
+    new SpeculativeCompilation(ctx));
+  speculation->m_output_obj = tmp_obj->path;
+  speculation->m_stdout_path = tmp_stdout->path;
+  speculation->m_stderr_path = tmp_stderr->path;
+
+  Args args = compiler_args;
+  add_prefix(args, ctx.config.prefix_command());
+  args.push_back("-o");
+  args.push_back(pstr(tmp_obj->path).str());
+  if (ctx.args_info.seen_double_dash) {
+    args.push_back("--");
+  }
+  args.push_back(ctx.args_info.input_file);
+
+  LOG_RAW("Starting speculative compilation");
+  util::UmaskScope umask_scope(ctx.original_umask);
+  speculation->m_start_time = util::TimePoint::now();
+  if (!execute_async(ctx.speculative_compiler_pid,
+                     args.to_argv().data(),
+                     std::move(tmp_stdout->fd),
+                     std::move(tmp_stderr->fd))) {
+    LOG_RAW("Not compiling speculatively: failed to start the compiler");
+    return nullptr;
+  }
+  return speculation;
+}
+
+SpeculativeCompilation::~SpeculativeCompilation()
+{
+  if (m_ctx.speculative_compiler_pid == 0) {
+    return;
   }
+  LOG_RAW("Killing speculative compilation");
+  kill(-m_ctx.speculative_compiler_pid, SIGTERM);
+  try {
+    wait_for_process(m_ctx.speculative_compiler_pid);
+  } catch (const core::Fatal& e) {
+    LOG("Failed to wait for speculative compilation: {}", e.what());
+  }
+}
 
-  return DoExecuteResult{status, stdout_data, *stderr_data_result};
+std::optional<DoExecuteResult>
+SpeculativeCompilation::finish()
+{
+  util::Duration cpu_time;
+  const int status =
+    wait_for_process(m_ctx.speculative_compiler_pid, &cpu_time);
+  const auto wall_time = util::TimePoint::now() - m_start_time;
+
+  auto stdout_data = util::read_file<util::Bytes>(m_stdout_path);
+  auto stderr_data = util::read_file<util::Bytes>(m_stderr_path);
+  if (!stdout_data || !stderr_data) {
+    LOG("Failed to read output of speculative compilation: {}",
+        stdout_data ? stderr_data.error() : stdout_data.error());
+    return std::nullopt;
+  }
+
+  if (status != 0) {
+    if (m_ctx.config.compiler_type() == CompilerType::gcc
+        && util::to_string_view(*stderr_data).find("fdiagnostics-color")
+             != std::string_view::npos) {
+      // Let do_execute retry without -fdiagnostics-color.
+      return std::nullopt;
+    }
+  } else {
+    const auto renamed = fs::rename(m_output_obj, m_ctx.args_info.output_obj);
+    if (!renamed) {
+      LOG("Failed to rename {} to {}: {}",
+          m_output_obj,
+          m_ctx.args_info.output_obj,
+          renamed.error().message());
+      return std::nullopt;
+    }
+  }
+
+  LOG_RAW("Using result of speculative compilation");
+  return DoExecuteResult{status,
+                         std::move(*stdout_data),
+                         std::move(*stderr_data),
+                         wall_time,
+                         cpu_time};
 }
+#endif
 
+// Read a manifest cache entry. If the payload is stored uncompressed, the
+// manifest refers to `cache_entry_data`, which `data_owner` keeps valid.
 static void
-read_manifest(Context& ctx, nonstd::span<const uint8_t> cache_entry_data)
+read_manifest(Context& ctx,
+              nonstd::span<const uint8_t> cache_entry_data,
+              const std::shared_ptr<const void>& data_owner)
 {
   try {
     core::CacheEntry cache_entry(cache_entry_data);
     cache_entry.verify_checksum();
-    ctx.manifest.read(cache_entry.payload());
+    ctx.manifest.read(cache_entry.payload(),
+                      cache_entry.header().compression_type
+                          == core::CompressionType::none
+                        ? data_owner
+                        : nullptr);
   } catch (const core::Error& e) {
     LOG("Error reading manifest: {}", e.what());
   }
 }
 
+// Merge manifest delta records, i.e. a sequence of uncompressed manifest cache
+// entries, and return the number of merged records. A truncated or corrupt
+// record, e.g. from concurrent appends on NFS, is skipped by searching for the
+// next record header, which is then verified by its checksum.
+static size_t
+read_manifest_deltas(Context& ctx, nonstd::span<const uint8_t> data)
+{
+  const uint8_t magic[] = {core::k_ccache_magic >> 8,
+                           core::k_ccache_magic & 0xFF};
+  size_t count = 0;
+  while (!data.empty()) {
+    size_t record_size = 0;
+    try {
+      core::CacheEntry::Header header(data);
+      if (header.entry_type != core::CacheEntryType::manifest
+          || header.compression_type != core::CompressionType::none
+          || header.entry_size > data.size()) {
+        throw core::Error("Bad manifest delta record");
+      }
+      core::CacheEntry cache_entry(data.first(header.entry_size));
+      cache_entry.verify_checksum();
+      ctx.manifest.read(cache_entry.payload());
+      record_size = header.entry_size;
+      ++count;
+    } catch (const core::Error& e) {
+      LOG("Error reading manifest delta: {}", e.what());
+      const auto next =
+        std::search(data.begin() + 1, data.end(), magic, magic + 2);
+      record_size = static_cast<size_t>(next - data.begin());
+    }
+    data = data.subspan(record_size);
+  }
+  return count;
+}
+
+// Serialize a cache entry and record the time spent, which is dominated by
+// compression.
+static util::Bytes
+serialize_cache_entry(Context& ctx,
+                      const core::CacheEntry::Header& header,
+                      core::Serializer& payload_serializer)
+{
+  const auto start = util::TimePoint::now();
+  auto cache_entry_data =
+    core::CacheEntry::serialize(header, payload_serializer);
+  ctx.storage.local.record_latency(Statistic::compression_histogram_base,
+                                   util::TimePoint::now() - start);
+  return cache_entry_data;
+}
+
 static void
 update_manifest(Context& ctx,
                 const Hash::Digest& manifest_key,
@@ -817,7 +1089,7 @@ update_manifest(Context& ctx,
     || ctx.args_info.output_is_precompiled_header;
 
   const bool added = ctx.manifest.add_result(
-    result_key, ctx.included_files, [&](const std::string& path) {
+    result_key, ctx.included_files, [&](std::string_view path) {
       DirEntry de(path, DirEntry::LogOnError::yes);
       bool cache_time =
         save_timestamp
@@ -831,9 +1103,17 @@ update_manifest(Context& ctx,
   if (added) {
     LOG("Added result key to manifest {}", util::format_digest(manifest_key));
     core::CacheEntry::Header header(ctx.config, core::CacheEntryType::manifest);
-    ctx.storage.put(manifest_key,
-                    core::CacheEntryType::manifest,
-                    core::CacheEntry::serialize(header, ctx.manifest));
+    if (!ctx.config.remote_only()) {
+      // Append only the new result locally. Rewriting the whole manifest would
+      // make concurrent updates wait for each other and lose all but the last.
+      auto delta = ctx.manifest.extract(result_key);
+      ctx.storage.local.append_manifest_delta(
+        manifest_key, serialize_cache_entry(ctx, header, delta));
+    }
+    if (ctx.storage.has_remote_storage()) {
+      ctx.storage.put_in_remote_storage(
+        manifest_key, serialize_cache_entry(ctx, header, ctx.manifest), false);
+    }
   } else {
     LOG("Did not add result key to manifest {}",
         util::format_digest(manifest_key));
@@ -878,12 +1158,65 @@ find_coverage_file(const Context& ctx)
   return {true, found_file, found_file == mangled_form};
 }
 
+static uint32_t
+to_milliseconds(const util::Duration& duration)
+{
+  return static_cast<uint32_t>(std::clamp(
+    duration.nsec() / 1'000'000, int64_t(0), int64_t(UINT32_MAX)));
+}
+
+// Use the object file of the newest result in the manifest, which is most
+// likely a previous compilation of the same source file, as delta base for the
+// new object file.
+static void
+set_object_delta_base(Context& ctx,
+                      const Hash::Digest& result_key,
+                      core::Result::Serializer& serializer)
+{
+  // Object files stored as raw files are never stored as deltas, so don't
+  // read the base for nothing.
+  if (ctx.config.delta_chain_length() == 0 || ctx.config.remote_only()
+      || core::Result::Serializer::use_raw_files(ctx.config)) {
+    return;
+  }
+  const auto base_key = ctx.manifest.newest_result_key();
+  if (!base_key || *base_key == result_key) {
+    return;
+  }
+
+  // Only use a base that exists locally so that the write stays cheap.
+  const auto get_entry =
+    [&](const Hash::Digest& key,
+        core::CacheEntryType type) -> std::optional<util::Bytes> {
+    const auto value = ctx.storage.local.get(key, type);
+    if (!value) {
+      return std::nullopt;
+    }
+    return util::Bytes(value->data());
+  };
+  try {
+    uint8_t base_depth;
+    auto base_data = core::Result::read_file(
+      get_entry, *base_key, core::Result::FileType::object, base_depth);
+    serializer.set_delta_base(core::Result::FileType::object,
+                              *base_key,
+                              std::move(base_data),
+                              base_depth);
+  } catch (const core::Error& e) {
+    LOG("Not using result {} as delta base: {}",
+        util::format_digest(*base_key),
+        e.what());
+  }
+}
+
 [[nodiscard]] static bool
 write_result(Context& ctx,
              const Hash::Digest& result_key,
-             const util::Bytes& stdout_data,
-             const util::Bytes& stderr_data)
+             const DoExecuteResult& execute_result)
 {
+  const auto& stdout_data = execute_result.stdout_data;
+  const auto& stderr_data = execute_result.stderr_data;
+
   core::Result::Serializer serializer(ctx.config);
 
   if (!stderr_data.empty()) {
@@ -894,6 +1227,9 @@ write_result(Context& ctx,
   if (!stdout_data.empty()) {
     serializer.add_data(core::Result::FileType::stdout_output, stdout_data);
   }
+  if (ctx.args_info.expect_output_obj) {
+    set_object_delta_base(ctx, result_key, serializer);
+  }
   if (ctx.args_info.expect_output_obj
       && !serializer.add_file(core::Result::FileType::object,
                               ctx.args_info.output_obj)) {
@@ -905,11 +1241,15 @@ write_result(Context& ctx,
                               ctx.args_info.included_pch_file)) {
     LOG("PCH file {} missing", ctx.args_info.included_pch_file);
   }
-  if (ctx.args_info.generating_dependencies
-      && !serializer.add_file(core::Result::FileType::dependency,
-                              ctx.args_info.output_dep)) {
-    LOG("Dependency file {} missing", ctx.args_info.output_dep);
-    return false;
+  if (ctx.args_info.generating_dependencies) {
+    if (ctx.output_dep_content) {
+      serializer.add_data(core::Result::FileType::dependency,
+                          util::to_span(*ctx.output_dep_content));
+    } else if (!serializer.add_file(core::Result::FileType::dependency,
+                                    ctx.args_info.output_dep)) {
+      LOG("Dependency file {} missing", ctx.args_info.output_dep);
+      return false;
+    }
   }
   if (ctx.args_info.generating_coverage) {
     const auto coverage_file = find_coverage_file(ctx);
@@ -954,7 +1294,29 @@ write_result(Context& ctx,
   }
 
   core::CacheEntry::Header header(ctx.config, core::CacheEntryType::result);
-  const auto cache_entry_data = core::CacheEntry::serialize(header, serializer);
+  header.compile_time_ms = to_milliseconds(execute_result.wall_time);
+  header.compile_cpu_time_ms = to_milliseconds(execute_result.cpu_time);
+  const auto cache_entry_data = serialize_cache_entry(ctx, header, serializer);
+
+  // Store chunks of deduplicated files before the result that refers to them.
+  // Chunks that already exist are only marked as used, which also keeps them
+  // from being evicted before the result.
+  const auto chunks = serializer.get_chunks();
+  if (!chunks.empty()) {
+    const core::CacheEntry::Header chunk_header(ctx.config,
+                                                core::CacheEntryType::chunk);
+    for (const auto& chunk : chunks) {
+      if (!ctx.config.remote_only()
+          && ctx.storage.local.touch(chunk.digest,
+                                     core::CacheEntryType::chunk)) {
+        continue;
+      }
+      ctx.storage.put(chunk.digest,
+                      core::CacheEntryType::chunk,
+                      core::CacheEntry::serialize(chunk_header, chunk.data),
+                      true);
+    }
+  }
 
   if (!ctx.config.remote_only()) {
     const auto& raw_files = serializer.get_raw_files();
@@ -1064,13 +1426,47 @@ source_file_is_too_new(const Context& ctx, const fs::path& path)
   return false;
 }
 
-// Run the real compiler and put the result in cache. Returns the result key.
+// Return whether the compiler should be started in parallel with the
+// preprocessor mode lookup after a direct mode miss.
+static bool
+should_compile_speculatively(const Context& ctx)
+{
+  if (!ctx.config.speculative_compilation() || !ctx.config.direct_mode()
+      || ctx.config.depend_mode() || ctx.config.read_only()
+      || !ctx.config.run_second_cpp() || ctx.config.is_compiler_group_msvc()) {
+    return false;
+  }
+
+  // Only the object file can be written to a private location.
+  const auto& args_info = ctx.args_info;
+  if (!args_info.expect_output_obj
+      || util::is_dev_null_path(args_info.output_obj)
+      || args_info.generating_dependencies || args_info.generating_includes
+      || args_info.generating_diagnostics || args_info.generating_coverage
+      || args_info.generating_stackusage || args_info.generating_pch
+      || args_info.seen_split_dwarf || args_info.profile_arcs) {
+    return false;
+  }
+
+  // Earlier preprocessor mode hits for the source file are recorded in the
+  // manifest. Only speculate if at most half of the direct mode misses were
+  // followed by such a hit.
+  const auto counts = ctx.manifest.count_results();
+  LOG("Manifest has {} results of which {} were found in preprocessor mode",
+      counts.results,
+      counts.reused_keys);
+  return 2 * counts.reused_keys <= counts.results;
+}
+
+// Run the real compiler and put the result in cache. Returns the result key. If
+// `speculative_result` is set, the compiler has already been run.
 static tl::expected<Hash::Digest, Failure>
 to_cache(Context& ctx,
          Args& args,
          std::optional<Hash::Digest> result_key,
          const Args& depend_extra_args,
-         Hash* depend_mode_hash)
+         Hash* depend_mode_hash,
+         std::optional<DoExecuteResult>&& speculative_result)
 {
   if (ctx.config.is_compiler_group_msvc()) {
     args.push_back(fmt::format("-Fo{}", ctx.args_info.output_obj));
@@ -1118,7 +1514,9 @@ to_cache(Context& ctx,
   MTR_BEGIN("execute", "compiler");
 
   tl::expected<DoExecuteResult, Failure> result;
-  if (!ctx.config.depend_mode()) {
+  if (speculative_result) {
+    result = std::move(*speculative_result);
+  } else if (!ctx.config.depend_mode()) {
     result = do_execute(ctx, args);
     args.pop_back(3);
   } else {
@@ -1138,6 +1536,7 @@ to_cache(Context& ctx,
   if (!result) {
     return tl::unexpected(result.error());
   }
+  ctx.compiler_wall_time = result->wall_time;
 
   // Merge stderr from the preprocessor (if any) and stderr from the real
   // compiler.
@@ -1220,8 +1619,7 @@ to_cache(Context& ctx,
   }
 
   MTR_BEGIN("result", "result_put");
-  if (!write_result(
-        ctx, *result_key, result->stdout_data, result->stderr_data)) {
+  if (!write_result(ctx, *result_key, *result)) {
     return tl::unexpected(Statistic::compiler_produced_no_output);
   }
   MTR_END("result", "result_put");
@@ -1239,6 +1637,40 @@ to_cache(Context& ctx,
   return *result_key;
 }
 
+// Return the option that makes the preprocessor inline include files without
+// expanding macros, or std::nullopt if the fast_cpp mode can't be used.
+static std::optional<std::string_view>
+get_fast_cpp_option(const Context& ctx, const Args& args)
+{
+  if (!ctx.config.fast_cpp() || !ctx.config.run_second_cpp()
+      || ctx.args_info.output_is_precompiled_header
+      || ctx.args_info.using_precompiled_header) {
+    return std::nullopt;
+  }
+
+  std::string_view option;
+  if (ctx.config.compiler_type() == CompilerType::gcc) {
+    option = "-fdirectives-only";
+  } else if (ctx.config.compiler_type() == CompilerType::clang) {
+    option = "-frewrite-includes";
+  } else {
+    return std::nullopt;
+  }
+
+  for (size_t i = 1; i < args.size(); ++i) {
+    // Macros from -imacros files never end up in the output and Clang doesn't
+    // inline -include files.
+    if (util::starts_with(args[i], "-imacros")
+        || (option == "-frewrite-includes"
+            && util::starts_with(args[i], "-include"))) {
+      LOG("Not using fast_cpp due to {}", args[i]);
+      return std::nullopt;
+    }
+  }
+
+  return option;
+}
+
 // Find the result key by running the compiler in preprocessor mode and
 // hashing the result.
 static tl::expected<Hash::Digest, Failure>
@@ -1246,6 +1678,7 @@ get_result_key_from_cpp(Context& ctx, Args& args, Hash& hash)
 {
   std::string preprocessed_path;
   util::Bytes cpp_stderr_data;
+  std::optional<std::string_view> fast_cpp_option;
 
   if (ctx.args_info.direct_i_file) {
     // We are compiling a .i or .ii file - that means we can skip the cpp stage
@@ -1264,41 +1697,68 @@ get_result_key_from_cpp(Context& ctx, Args& args, Hash& hash)
     tmp_stdout.fd.close(); // We're only using the path.
     ctx.register_pending_tmp_file(preprocessed_path);
 
-    const size_t orig_args_size = args.size();
+    fast_cpp_option = get_fast_cpp_option(ctx, args);
 
-    if (ctx.config.keep_comments_cpp()) {
-      args.push_back("-C");
-    }
+    while (true) {
+      Args cpp_args = args;
 
-    // Send preprocessor output to a file instead of stdout to work around
-    // compilers that don't exit with a proper status on write error to stdout.
-    // See also <https://github.com/llvm/llvm-project/issues/56499>.
-    if (ctx.config.is_compiler_group_msvc()) {
-      args.push_back("-P");
-      args.push_back(FMT("-Fi{}", preprocessed_path));
-    } else {
-      args.push_back("-E");
-      args.push_back("-o");
-      args.push_back(preprocessed_path);
-    }
+      if (fast_cpp_option) {
+        cpp_args.push_back(std::string(*fast_cpp_option));
+      }
 
-    args.push_back(ctx.args_info.input_file);
+      if (ctx.config.keep_comments_cpp()) {
+        cpp_args.push_back("-C");
+      }
 
-    add_prefix(args, ctx.config.prefix_command_cpp());
-    LOG_RAW("Running preprocessor");
-    MTR_BEGIN("execute", "preprocessor");
-    const auto result = do_execute(ctx, args, false);
-    MTR_END("execute", "preprocessor");
-    args.pop_back(args.size() - orig_args_size);
+      // Send preprocessor output to a file instead of stdout to work around
+      // compilers that don't exit with a proper status on write error to
+      // stdout. See also <https://github.com/llvm/llvm-project/issues/56499>.
+      if (ctx.config.is_compiler_group_msvc()) {
+        cpp_args.push_back("-P");
+        cpp_args.push_back(FMT("-Fi{}", preprocessed_path));
+      } else {
+        cpp_args.push_back("-E");
+        cpp_args.push_back("-o");
+        cpp_args.push_back(preprocessed_path);
+      }
 
-    if (!result) {
-      return tl::unexpected(result.error());
-    } else if (result->exit_status != 0) {
-      LOG("Preprocessor gave exit status {}", result->exit_status);
-      return tl::unexpected(Statistic::preprocessor_error);
-    }
+      cpp_args.push_back(ctx.args_info.input_file);
+
+      add_prefix(cpp_args, ctx.config.prefix_command_cpp());
+      LOG_RAW("Running preprocessor");
+      MTR_BEGIN("execute", "preprocessor");
+      const auto result = do_execute(ctx, cpp_args, false);
+      MTR_END("execute", "preprocessor");
+
+      if (!result) {
+        return tl::unexpected(result.error());
+      } else if (result->exit_status != 0 && fast_cpp_option) {
+        LOG("Preprocessor with {} gave exit status {}, retrying without it",
+            *fast_cpp_option,
+            result->exit_status);
+        fast_cpp_option = std::nullopt;
+        continue;
+      } else if (result->exit_status != 0) {
+        LOG("Preprocessor gave exit status {}", result->exit_status);
+        return tl::unexpected(Statistic::preprocessor_error);
+      }
+
+      if (fast_cpp_option) {
+        // Temporal macros are not expanded, so the output would not change
+        // when their values do.
+        const auto data = util::read_file<std::string>(preprocessed_path);
+        if (!data || !check_for_temporal_macros(*data).empty()) {
+          LOG("Found temporal macro in output of preprocessor with {},"
+              " retrying without it",
+              *fast_cpp_option);
+          fast_cpp_option = std::nullopt;
+          continue;
+        }
+      }
 
-    cpp_stderr_data = result->stderr_data;
+      cpp_stderr_data = result->stderr_data;
+      break;
+    }
   }
 
   hash.hash_delimiter("cpp");
@@ -1307,6 +1767,41 @@ get_result_key_from_cpp(Context& ctx, Args& args, Hash& hash)
   hash.hash_delimiter("cppstderr");
   hash.hash(util::to_string_view(cpp_stderr_data));
 
+  if (fast_cpp_option) {
+    // Macros were not expanded (and trigraphs not converted), so the output
+    // doesn't necessarily reflect options like -D, -U and -trigraphs. Hash all
+    // options that hash_argument skips since they affect the preprocessor
+    // output, except the include path options since the included files are
+    // part of the output.
+    hash.hash_delimiter("fastcpp");
+    hash.hash(*fast_cpp_option);
+    for (size_t i = 1; i < args.size(); ++i) {
+      std::string_view option = args[i];
+      if (!compopt_affects_cpp_output(option)) {
+        option = option.substr(0, 2);
+        if (!compopt_affects_cpp_output(option)) {
+          if (util::starts_with(args[i], "-Wp,")) {
+            hash.hash_delimiter("arg");
+            hash.hash(args[i]);
+          }
+          continue;
+        }
+      }
+      const bool separate_arg =
+        option == args[i] && compopt_takes_arg(option) && i + 1 < args.size();
+      if (!compopt_takes_path(option)) {
+        hash.hash_delimiter("arg");
+        hash.hash(args[i]);
+        if (separate_arg) {
+          hash.hash(args[i + 1]);
+        }
+      }
+      if (separate_arg) {
+        ++i;
+      }
+    }
+  }
+
   ctx.i_tmpfile = preprocessed_path;
 
   if (!ctx.config.run_second_cpp()) {
@@ -1968,32 +2463,96 @@ get_result_key_from_manifest(Context& ctx, const Hash::Digest& manifest_key)
   MTR_BEGIN("manifest", "manifest_get");
   std::optional<Hash::Digest> result_key;
   size_t read_manifests = 0;
-  ctx.storage.get(
-    manifest_key, core::CacheEntryType::manifest, [&](util::Bytes&& value) {
-      try {
-        read_manifest(ctx, value);
+
+  // Local manifest updates are stored as delta records, see update_manifest.
+  // They are merged after the first manifest since they are newer than it.
+  std::optional<util::Bytes> deltas;
+  size_t read_deltas = 0;
+  if (!ctx.config.remote_only()) {
+    deltas = ctx.storage.local.get_manifest_deltas(manifest_key);
+  }
+
+  const auto look_up = [&](nonstd::span<const uint8_t> value,
+                           const std::shared_ptr<const void>& value_owner) {
+    const auto start = util::TimePoint::now();
+    try {
+      if (!value.empty()) {
+        read_manifest(ctx, value, value_owner);
         ++read_manifests;
-        result_key = ctx.manifest.look_up_result_digest(ctx);
-      } catch (const core::Error& e) {
-        LOG("Failed to look up result key in manifest: {}", e.what());
       }
-      if (result_key) {
-        LOG_RAW("Got result key from manifest");
-        return true;
-      } else {
-        LOG_RAW("Did not find result key in manifest");
-        return false;
+    } catch (const core::Error& e) {
+      LOG("Failed to read manifest: {}", e.what());
+    }
+    try {
+      if (deltas) {
+        read_deltas = read_manifest_deltas(ctx, *deltas);
+        deltas.reset();
       }
-    });
+      result_key = ctx.manifest.look_up_result_digest(ctx);
+    } catch (const core::Error& e) {
+      LOG("Failed to look up result key in manifest: {}", e.what());
+    }
+    ctx.storage.local.record_latency(Statistic::manifest_lookup_histogram_base,
+                                     util::TimePoint::now() - start);
+    if (result_key) {
+      LOG_RAW("Got result key from manifest");
+      return true;
+    } else {
+      LOG_RAW("Did not find result key in manifest");
+      return false;
+    }
+  };
+
+  ctx.storage.get(manifest_key,
+                  core::CacheEntryType::manifest,
+                  storage::Storage::SharedEntryReceiver(look_up));
+  if (deltas) {
+    // No manifest, only delta records.
+    look_up({}, nullptr);
+  }
   MTR_END("manifest", "manifest_get");
-  if (read_manifests > 1 && !ctx.config.remote_only()) {
+
+  const bool writable =
+    !ctx.config.read_only() && !ctx.config.read_only_direct();
+
+  // Refresh the result's time of last use so that it's not evicted from the
+  // manifest before less recently used results.
+  const bool touched =
+    result_key && writable
+    && ctx.manifest.touch(*result_key, ctx.time_of_invocation);
+
+  const bool compact =
+    writable && read_deltas > 0
+    && (result_key || read_deltas >= k_manifest_delta_compaction_threshold);
+
+  if ((read_manifests > 1 || touched || compact) && !ctx.config.remote_only()) {
     MTR_SCOPE("manifest", "merge");
-    LOG("Storing merged manifest {} locally",
+    LOG("Storing {} manifest {} locally",
+        read_manifests > 1 ? "merged"
+        : compact          ? "compacted"
+                           : "updated",
         util::format_digest(manifest_key));
-    core::CacheEntry::Header header(ctx.config, core::CacheEntryType::manifest);
-    ctx.storage.local.put(manifest_key,
-                          core::CacheEntryType::manifest,
-                          core::CacheEntry::serialize(header, ctx.manifest));
+    // The manifest and delta records may have been changed by others since
+    // they were read, so merge them again. The stored manifest then includes
+    // the delta records, so they are removed.
+    ctx.storage.local.compact_manifest(
+      manifest_key,
+      [&](nonstd::span<const uint8_t> stored_manifest,
+          nonstd::span<const uint8_t> stored_deltas) {
+        if (!stored_manifest.empty()) {
+          try {
+            core::CacheEntry cache_entry(stored_manifest);
+            cache_entry.verify_checksum();
+            ctx.manifest.read(cache_entry.payload());
+          } catch (const core::Error& e) {
+            LOG("Error merging stored manifest: {}", e.what());
+          }
+        }
+        read_manifest_deltas(ctx, stored_deltas);
+        core::CacheEntry::Header header(ctx.config,
+                                        core::CacheEntryType::manifest);
+        return serialize_cache_entry(ctx, header, ctx.manifest);
+      });
   }
 
   return result_key;
@@ -2138,38 +2697,47 @@ from_cache(Context& ctx, FromCacheCallMode mode, const Hash::Digest& result_key)
 
   MTR_SCOPE("cache", "from_cache");
 
-  // Get result from cache.
-  util::Bytes cache_entry_data;
+  // Get result from cache. The entry data may be memory-mapped and is only
+  // valid in the receiver, so the result is retrieved there. The checksum is
+  // computed while decompressing and verified before any file is written.
+  tl::expected<bool, Failure> result = false;
   ctx.storage.get(
-    result_key, core::CacheEntryType::result, [&](util::Bytes&& value) {
-      cache_entry_data = std::move(value);
+    result_key,
+    core::CacheEntryType::result,
+    [&](nonstd::span<const uint8_t> value) {
+      try {
+        core::CacheEntry cache_entry(value);
+        cache_entry.verify_checksum();
+        core::Result::Deserializer deserializer(cache_entry.payload());
+        core::ResultRetriever result_retriever(ctx, result_key);
+        util::UmaskScope umask_scope(ctx.original_umask);
+        deserializer.visit(result_retriever);
+
+        ctx.storage.local.increment_statistic(
+          Statistic::compile_time_saved_ms,
+          cache_entry.header().compile_time_ms);
+        ctx.storage.local.increment_statistic(
+          Statistic::compile_cpu_time_saved_ms,
+          cache_entry.header().compile_cpu_time_ms);
+        result = true;
+      } catch (core::ResultRetriever::WriteError& e) {
+        LOG("Write error when retrieving result from {}: {}",
+            util::format_digest(result_key),
+            e.what());
+        result = tl::unexpected(Failure(Statistic::bad_output_file));
+      } catch (core::Error& e) {
+        LOG("Failed to get result from {}: {}",
+            util::format_digest(result_key),
+            e.what());
+        result = false;
+      }
       return true;
     });
-  if (cache_entry_data.empty()) {
-    return false;
-  }
 
-  try {
-    core::CacheEntry cache_entry(cache_entry_data);
-    cache_entry.verify_checksum();
-    core::Result::Deserializer deserializer(cache_entry.payload());
-    core::ResultRetriever result_retriever(ctx, result_key);
-    util::UmaskScope umask_scope(ctx.original_umask);
-    deserializer.visit(result_retriever);
-  } catch (core::ResultRetriever::WriteError& e) {
-    LOG("Write error when retrieving result from {}: {}",
-        util::format_digest(result_key),
-        e.what());
-    return tl::unexpected(Statistic::bad_output_file);
-  } catch (core::Error& e) {
-    LOG("Failed to get result from {}: {}",
-        util::format_digest(result_key),
-        e.what());
-    return false;
+  if (result && *result) {
+    LOG_RAW("Succeeded getting cached result");
   }
-
-  LOG_RAW("Succeeded getting cached result");
-  return true;
+  return result;
 }
 
 // Find the real compiler and put it into ctx.orig_args[0]. We just search the
@@ -2386,6 +2954,16 @@ cache_compilation(int argc, const char* const* argv)
                                                   : result.error().counters());
     const auto& counters = ctx.storage.local.get_statistics_updates();
 
+    const auto elapsed = util::TimePoint::now() - ctx.time_of_invocation;
+    if (counters.get(Statistic::cache_miss) > 0) {
+      ctx.storage.local.record_latency(Statistic::miss_overhead_histogram_base,
+                                       elapsed - ctx.compiler_wall_time);
+    } else if (counters.get(Statistic::direct_cache_hit) > 0
+               || counters.get(Statistic::preprocessed_cache_hit) > 0) {
+      ctx.storage.local.record_latency(Statistic::hit_latency_histogram_base,
+                                       elapsed);
+    }
+
     if (counters.get(Statistic::cache_miss) > 0) {
       if (!ctx.config.remote_only()) {
         ctx.storage.local.increment_statistic(Statistic::local_storage_miss);
@@ -2458,7 +3036,11 @@ do_cache_compilation(Context& ctx)
   util::setenv("CCACHE_DISABLE", "1");
 
   MTR_BEGIN("main", "process_args");
-  ProcessArgsResult processed = process_args(ctx);
+  const ArgsTemplate args_template(ctx);
+  Hash template_common_hash;
+  auto from_template = args_template.apply(ctx, template_common_hash);
+  ProcessArgsResult processed =
+    from_template ? std::move(*from_template) : process_args(ctx);
   MTR_END("main", "process_args");
 
   if (processed.error) {
@@ -2561,10 +3143,13 @@ do_cache_compilation(Context& ctx)
     return tl::unexpected(Statistic::disabled);
   }
 
-  {
+  if (from_template) {
+    common_hash = template_common_hash;
+  } else {
     MTR_SCOPE("hash", "common_hash");
     TRY(hash_common_info(
       ctx, processed.preprocessor_args, common_hash, ctx.args_info));
+    args_template.update(ctx, processed, common_hash);
   }
 
   if (processed.hash_actual_cwd) {
@@ -2580,6 +3165,7 @@ do_cache_compilation(Context& ctx)
   args_to_hash.push_back(processed.extra_args_to_hash);
 
   bool put_result_in_manifest = false;
+  bool scanned_includes = false;
   std::optional<Hash::Digest> result_key;
   std::optional<Hash::Digest> result_key_from_manifest;
   std::optional<Hash::Digest> manifest_key;
@@ -2612,6 +3198,28 @@ do_cache_compilation(Context& ctx)
     } else {
       // Add result to manifest later.
       put_result_in_manifest = true;
+
+      if (manifest_key && should_scan_includes(ctx)) {
+        Hash scan_hash = direct_hash;
+        MTR_BEGIN("hash", "include_scan");
+        result_key = result_key_from_include_scan(
+          ctx, processed.preprocessor_args, scan_hash);
+        MTR_END("hash", "include_scan");
+        if (result_key) {
+          LOG("Result key from include scan: {}",
+              util::format_digest(*result_key));
+          scanned_includes = true;
+          const auto from_cache_result =
+            from_cache(ctx, FromCacheCallMode::direct, *result_key);
+          if (!from_cache_result) {
+            return tl::unexpected(from_cache_result.error());
+          } else if (*from_cache_result) {
+            MTR_SCOPE("cache", "update_manifest");
+            update_manifest(ctx, *manifest_key, *result_key);
+            return Statistic::direct_cache_hit;
+          }
+        }
+      }
     }
 
     if (!ctx.config.recache()) {
@@ -2624,7 +3232,14 @@ do_cache_compilation(Context& ctx)
     return tl::unexpected(Statistic::cache_miss);
   }
 
-  if (!ctx.config.depend_mode()) {
+#ifndef _WIN32
+  std::unique_ptr<SpeculativeCompilation> speculation;
+  if (!scanned_includes && should_compile_speculatively(ctx)) {
+    speculation = SpeculativeCompilation::start(ctx, processed.compiler_args);
+  }
+#endif
+
+  if (!ctx.config.depend_mode() && !scanned_includes) {
     // Find the hash using the preprocessed output. Also updates
     // ctx.included_files.
     Hash cpp_hash = common_hash;
@@ -2687,6 +3302,13 @@ do_cache_compilation(Context& ctx)
     return tl::unexpected(Statistic::cache_miss);
   }
 
+  std::optional<DoExecuteResult> speculative_result;
+#ifndef _WIN32
+  if (speculation) {
+    speculative_result = speculation->finish();
+  }
+#endif
+
   add_prefix(processed.compiler_args, ctx.config.prefix_command());
 
   // In depend_mode, extend the direct hash.
@@ -2698,7 +3320,8 @@ do_cache_compilation(Context& ctx)
                                processed.compiler_args,
                                result_key,
                                ctx.args_info.depend_extra_args,
-                               depend_mode_hash);
+                               depend_mode_hash,
+                               std::move(speculative_result));
   MTR_END("cache", "to_cache");
   if (!digest) {
     return tl::unexpected(digest.error());
@@ -19,29 +19,36 @@
 #include "compopt.hpp"
 
 #include <util/fmtmacros.hpp>
+#include <util/string.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
 
 // The option it too hard to handle at all.
-int TOO_HARD = 1 << 0;
+const int TOO_HARD = 1 << 0;
 
 // The option it too hard for the direct mode.
-int TOO_HARD_DIRECT = 1 << 1;
+const int TOO_HARD_DIRECT = 1 << 1;
 
 // The option takes a separate argument, e.g. "-D FOO=1".
-int TAKES_ARG = 1 << 2;
+const int TAKES_ARG = 1 << 2;
 
 // The option takes a concatenated argument, e.g. "-DFOO=1".
-int TAKES_CONCAT_ARG = 1 << 3;
+const int TAKES_CONCAT_ARG = 1 << 3;
 
 // The argument to the option is a path that may be rewritten if base_dir is
 // used.
-int TAKES_PATH = 1 << 4;
+const int TAKES_PATH = 1 << 4;
 
 // The option only affects preprocessing; not passed to the compiler if
 // run_second_cpp is false.
-int AFFECTS_CPP = 1 << 5;
+const int AFFECTS_CPP = 1 << 5;
 
 // The option only affects compilation; not passed to the preprocessor.
-int AFFECTS_COMP = 1 << 6;
+const int AFFECTS_COMP = 1 << 6;
 
 struct CompOpt
 {
@@ -49,7 +56,7 @@ struct CompOpt
   int type;
 };
 
-const CompOpt compopts[] = {
+constexpr CompOpt compopts[] = {
   {"--Werror", TAKES_ARG | AFFECTS_COMP},              // nvcc
   {"--analyzer-output", TOO_HARD},                     // Clang
   {"--compiler-bindir", AFFECTS_CPP | TAKES_ARG},      // nvcc
@@ -170,45 +177,101 @@ const CompOpt compopts[] = {
   {"-z", TAKES_ARG | TAKES_CONCAT_ARG | AFFECTS_COMP},
 };
 
-static int
-compare_compopts(const void* key1, const void* key2)
+// Option names are looked up in an open addressing hash table that is built at
+// compile time, so an exact lookup only needs to hash the argument once and
+// typically compare it with a single table entry.
+
+const size_t k_table_size = 512; // Must be a power of two.
+const uint32_t k_fnv_offset_basis = 2166136261U;
+const uint32_t k_fnv_prime = 16777619U;
+
+constexpr uint32_t
+hash_name(std::string_view name)
 {
-  const CompOpt* opt1 = static_cast<const CompOpt*>(key1);
-  const CompOpt* opt2 = static_cast<const CompOpt*>(key2);
-  return opt1->name.compare(opt2->name);
+  uint32_t hash = k_fnv_offset_basis;
+  for (char c : name) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * k_fnv_prime;
+  }
+  return hash;
 }
 
-static int
-compare_prefix_compopts(const void* key1, const void* key2)
+struct NameTable
+{
+  uint16_t slots[k_table_size]; // Index + 1 of an option, 0 if empty slot.
+  size_t used_slots;
+  size_t max_length;
+};
+
+constexpr NameTable
+build_name_table()
 {
-  const CompOpt* opt1 = static_cast<const CompOpt*>(key1);
-  const CompOpt* opt2 = static_cast<const CompOpt*>(key2);
-  return opt1->name.substr(0, opt2->name.length()).compare(opt2->name);
+  NameTable table{};
+  for (size_t i = 0; i < std::size(compopts); ++i) {
+    const auto name = compopts[i].name;
+    if (name.length() > table.max_length) {
+      table.max_length = name.length();
+    }
+    size_t index = hash_name(name) % k_table_size;
+    while (table.slots[index] != 0) {
+      index = (index + 1) % k_table_size;
+    }
+    table.slots[index] = static_cast<uint16_t>(i + 1);
+    ++table.used_slots;
+  }
+  return table;
 }
 
+constexpr NameTable k_name_table = build_name_table();
+
+static_assert(k_name_table.used_slots < k_table_size / 2,
+              "Increase k_table_size to keep the hash table sparse");
+
 static const CompOpt*
 find(std::string_view option)
 {
-  CompOpt key{option, 0};
-  void* result = bsearch(
-    &key, compopts, std::size(compopts), sizeof(compopts[0]), compare_compopts);
-  return static_cast<CompOpt*>(result);
+  if (option.length() > k_name_table.max_length) {
+    return nullptr;
+  }
+  size_t index = hash_name(option) % k_table_size;
+  while (k_name_table.slots[index] != 0) {
+    const CompOpt& co = compopts[k_name_table.slots[index] - 1];
+    if (co.name == option) {
+      return &co;
+    }
+    index = (index + 1) % k_table_size;
+  }
+  return nullptr;
 }
 
+// Find the longest option that is a prefix of `option`. The hashes of all
+// prefixes are computed in one pass since FNV-1a is incremental, and the
+// prefixes are then looked up in the hash table from the longest.
 static const CompOpt*
 find_prefix(std::string_view option)
 {
-  CompOpt key{option, 0};
-  void* result = bsearch(&key,
-                         compopts,
-                         std::size(compopts),
-                         sizeof(compopts[0]),
-                         compare_prefix_compopts);
-  return static_cast<CompOpt*>(result);
+  const size_t max_length = std::min(option.length(), k_name_table.max_length);
+  uint32_t hashes[k_name_table.max_length + 1];
+  hashes[0] = k_fnv_offset_basis;
+  for (size_t i = 0; i < max_length; ++i) {
+    hashes[i + 1] = (hashes[i] ^ static_cast<uint8_t>(option[i])) * k_fnv_prime;
+  }
+  for (size_t length = max_length; length > 0; --length) {
+    const auto prefix = option.substr(0, length);
+    size_t index = hashes[length] % k_table_size;
+    while (k_name_table.slots[index] != 0) {
+      const CompOpt& co = compopts[k_name_table.slots[index] - 1];
+      if (co.name == prefix) {
+        return &co;
+      }
+      index = (index + 1) % k_table_size;
+    }
+  }
+  return nullptr;
 }
 
 // Used by unittest/test_compopt.cpp.
 bool compopt_verify_sortedness_and_flags();
+bool compopt_verify_lookups();
 
 // For test purposes.
 bool
@@ -237,6 +300,58 @@ compopt_verify_sortedness_and_flags()
   return true;
 }
 
+static int
+compare_compopts(const void* key1, const void* key2)
+{
+  const auto* opt1 = static_cast<const CompOpt*>(key1);
+  const auto* opt2 = static_cast<const CompOpt*>(key2);
+  return opt1->name.compare(opt2->name);
+}
+
+// For test purposes: verify that find gives the same result as bsearch(3) and
+// find_prefix the same result as a linear search for the longest prefix, for
+// all options, all their prefixes and some typical arguments.
+bool
+compopt_verify_lookups()
+{
+  std::vector<std::string> options;
+  for (const auto& co : compopts) {
+    for (size_t i = 0; i <= co.name.length(); ++i) {
+      options.emplace_back(co.name.substr(0, i));
+    }
+    options.push_back(FMT("{}x", co.name));
+    options.push_back(FMT("{}=foo", co.name));
+    options.push_back(FMT("{}foo.h", co.name));
+  }
+
+  for (const auto& option : options) {
+    const CompOpt* expected_prefix = nullptr;
+    for (const auto& co : compopts) {
+      if (util::starts_with(option, co.name)
+          && (!expected_prefix
+              || co.name.length() > expected_prefix->name.length())) {
+        expected_prefix = &co;
+      }
+    }
+    if (find_prefix(option) != expected_prefix) {
+      PRINT(stderr, "compopt_verify_lookups: prefix mismatch for {}\n", option);
+      return false;
+    }
+    CompOpt key;
+    key.name = option;
+    const void* expected = bsearch(&key,
+                                   compopts,
+                                   std::size(compopts),
+                                   sizeof(compopts[0]),
+                                   compare_compopts);
+    if (find(option) != expected) {
+      PRINT(stderr, "compopt_verify_lookups: mismatch for {}\n", option);
+      return false;
+    }
+  }
+  return true;
+}
+
 bool
 compopt_affects_cpp_output(std::string_view option)
 {
@@ -45,6 +45,8 @@ const size_t k_static_header_fields_size =
   + sizeof(core::CacheEntry::Header::compression_level)
   + sizeof(core::CacheEntry::Header::self_contained)
   + sizeof(core::CacheEntry::Header::creation_time)
+  + sizeof(core::CacheEntry::Header::compile_time_ms)
+  + sizeof(core::CacheEntry::Header::compile_cpu_time_ms)
   + sizeof(core::CacheEntry::Header::entry_size)
   // ccache_version length field:
   + 1
@@ -63,6 +65,9 @@ cache_entry_type_from_int(const uint8_t entry_type)
   case 1:
     return core::CacheEntryType::manifest;
     break;
+  case 2:
+    return core::CacheEntryType::chunk;
+    break;
   default:
     throw core::Error(FMT("Unknown entry type: {}", entry_type));
   }
@@ -79,18 +84,37 @@ namespace core {
 //   - The checksum is now for the (potentially) compressed payload instead of
 //     the uncompressed payload, and the checksum is now always stored
 //     uncompressed.
-const uint8_t CacheEntry::k_format_version = 1;
+// Version 2:
+//   - Added compile_time and compile_cpu_time fields. Version 1 entries are
+//     still readable and get zero compile times.
+const uint8_t CacheEntry::k_format_version = 2;
+
+// Size of fields not present in older entry format versions.
+static size_t
+missing_fields_size(const uint8_t entry_format_version)
+{
+  return entry_format_version < 2
+           ? sizeof(CacheEntry::Header::compile_time_ms)
+               + sizeof(CacheEntry::Header::compile_cpu_time_ms)
+           : 0;
+}
 
 CacheEntry::Header::Header(const Config& config,
                            core::CacheEntryType entry_type_)
   : magic(k_ccache_magic),
     entry_format_version(k_format_version),
     entry_type(entry_type_),
-    compression_type(compression_type_from_config(config)),
+    // Manifests are stored uncompressed so that they can be used directly
+    // without decompression, see core::Manifest.
+    compression_type(entry_type == CacheEntryType::manifest
+                       ? CompressionType::none
+                       : compression_type_from_config(config)),
     compression_level(compression_level_from_config(config)),
     self_contained(entry_type != CacheEntryType::result
                    || !core::Result::Serializer::use_raw_files(config)),
     creation_time(util::TimePoint::now().sec()),
+    compile_time_ms(0),
+    compile_cpu_time_ms(0),
     ccache_version(CCACHE_VERSION),
     namespace_(config.namespace_()),
     entry_size(0)
@@ -125,6 +149,8 @@ CacheEntry::Header::inspect() const
   result += FMT("Compression level: {}\n", compression_level);
   result += FMT("Self-contained: {}\n", self_contained ? "yes" : "no");
   result += FMT("Creation time: {}\n", creation_time);
+  result += FMT("Compile time: {} ms\n", compile_time_ms);
+  result += FMT("Compile CPU time: {} ms\n", compile_cpu_time_ms);
   result += FMT("Ccache version: {}\n", ccache_version);
   result += FMT("Namespace: {}\n", namespace_);
   result += FMT("Entry size: {}\n", entry_size);
@@ -141,7 +167,7 @@ CacheEntry::Header::parse(nonstd::span<const uint8_t> data)
   }
 
   reader.read_int(entry_format_version);
-  if (entry_format_version != k_format_version) {
+  if (entry_format_version < 1 || entry_format_version > k_format_version) {
     throw core::Error(
       FMT("Unknown entry format version: {}", entry_format_version));
   }
@@ -151,6 +177,13 @@ CacheEntry::Header::parse(nonstd::span<const uint8_t> data)
   reader.read_int(compression_level);
   self_contained = bool(reader.read_int<uint8_t>());
   reader.read_int(creation_time);
+  if (entry_format_version >= 2) {
+    reader.read_int(compile_time_ms);
+    reader.read_int(compile_cpu_time_ms);
+  } else {
+    compile_time_ms = 0;
+    compile_cpu_time_ms = 0;
+  }
   ccache_version = reader.read_str(reader.read_int<uint8_t>());
   namespace_ = reader.read_str(reader.read_int<uint8_t>());
   reader.read_int(entry_size);
@@ -159,8 +192,8 @@ CacheEntry::Header::parse(nonstd::span<const uint8_t> data)
 size_t
 CacheEntry::Header::serialized_size() const
 {
-  return k_static_header_fields_size + ccache_version.length()
-         + namespace_.length();
+  return k_static_header_fields_size - missing_fields_size(entry_format_version)
+         + ccache_version.length() + namespace_.length();
 }
 
 void
@@ -174,6 +207,10 @@ CacheEntry::Header::serialize(util::Bytes& output) const
   writer.write_int(compression_level);
   writer.write_int<uint8_t>(self_contained);
   writer.write_int(creation_time);
+  if (entry_format_version >= 2) {
+    writer.write_int(compile_time_ms);
+    writer.write_int(compile_cpu_time_ms);
+  }
   writer.write_int(static_cast<uint8_t>(ccache_version.length()));
   writer.write_str(ccache_version);
   writer.write_int(static_cast<uint8_t>(namespace_.length()));
@@ -199,35 +236,36 @@ CacheEntry::CacheEntry(nonstd::span<const uint8_t> data) : m_header(data)
     data.subspan(m_header.serialized_size(), data.size() - non_payload_size);
   m_checksum = data.last(k_epilogue_fields_size);
 
+  // Compute the checksum in the same pass as the decompression so that the
+  // payload, which may be memory-mapped, only needs to be read once.
+  util::XXH3_128 checksum;
+  checksum.update(data.first(m_header.serialized_size()));
+
   switch (m_header.compression_type) {
   case CompressionType::none:
+    checksum.update(m_payload);
     break;
 
   case CompressionType::zstd:
-    m_uncompressed_payload.reserve(m_header.uncompressed_payload_size());
     util::throw_on_error<core::Error>(
       util::zstd_decompress(
-        m_payload, m_uncompressed_payload, m_uncompressed_payload.capacity()),
+        m_payload,
+        m_uncompressed_payload,
+        m_header.uncompressed_payload_size(),
+        [&](nonstd::span<const uint8_t> chunk) { checksum.update(chunk); }),
       "Cache entry payload decompression error: ");
-
     break;
   }
+
+  m_actual_checksum = checksum.digest();
 }
 
 void
 CacheEntry::verify_checksum() const
 {
-  util::Bytes header_data;
-  m_header.serialize(header_data);
-
-  util::XXH3_128 checksum;
-  checksum.update(header_data);
-  checksum.update(m_payload);
-  const auto actual = checksum.digest();
-
-  if (actual != m_checksum) {
+  if (m_actual_checksum != m_checksum) {
     throw core::Error(FMT("Incorrect checksum (actual {}, expected {})",
-                          util::format_base16(actual),
+                          util::format_base16(m_actual_checksum),
                           util::format_base16(m_checksum)));
   }
 }
@@ -37,19 +37,25 @@
 //
 // <entry>            ::= <header> <payload> <epilogue>
 // <header>           ::= <magic> <format_ver> <entry_type> <compr_type>
-//                        <compr_level> <creation_time> <ccache_ver> <namespace>
+//                        <compr_level> <creation_time> <compile_time>
+//                        <compile_cpu_time> <ccache_ver> <namespace>
 //                        <entry_size>
 // <magic>            ::= uint16_t (0xccac)
 // <format_ver>       ::= uint8_t
-// <entry_type>       ::= <result_entry> | <manifest_entry>
+// <entry_type>       ::= <result_entry> | <manifest_entry> | <chunk_entry>
 // <result_entry>     ::= 0 (uint8_t)
 // <manifest_entry>   ::= 1 (uint8_t)
+// <chunk_entry>      ::= 2 (uint8_t) ; part of a deduplicated result file
 // <self_contained>   ::= 0/1 (uint8_t) ; whether suitable for remote storage
 // <compr_type>       ::= <compr_none> | <compr_zstd>
 // <compr_none>       ::= 0 (uint8_t)
 // <compr_zstd>       ::= 1 (uint8_t)
 // <compr_level>      ::= int8_t
 // <creation_time>    ::= uint64_t (Unix epoch time when entry was created)
+// <compile_time>     ::= uint32_t (wall time in milliseconds spent by the
+//                        compiler to produce the entry, 0 if unknown)
+// <compile_cpu_time> ::= uint32_t (user + system CPU time in milliseconds
+//                        spent by the compiler, 0 if unknown)
 // <ccache_ver>       ::= string length (uint8_t) + string data
 // <namespace>        ::= string length (uint8_t) + string data
 // <entry_size>       ::= uint64_t ; = size of entry in uncompressed form
@@ -86,6 +92,8 @@ public:
     int8_t compression_level;
     bool self_contained;
     uint64_t creation_time;
+    uint32_t compile_time_ms;
+    uint32_t compile_cpu_time_ms;
     std::string ccache_version;
     std::string namespace_;
     uint64_t entry_size;
@@ -98,6 +106,8 @@ public:
     void parse(nonstd::span<const uint8_t> data);
   };
 
+  // Parse and decompress `data`, which must outlive the CacheEntry. The
+  // checksum is computed in the same pass but only checked by verify_checksum.
   explicit CacheEntry(nonstd::span<const uint8_t> data);
 
   void verify_checksum() const;
@@ -115,6 +125,7 @@ private:
   Header m_header;
   nonstd::span<const uint8_t> m_payload; // Potentially compressed
   util::Bytes m_checksum;
+  util::Bytes m_actual_checksum;
 
   mutable util::Bytes m_uncompressed_payload;
 
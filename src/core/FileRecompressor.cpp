@@ -40,9 +40,14 @@ FileRecompressor::recompress(const DirEntry& dir_entry,
     level ? (*level == 0 ? core::CacheEntry::default_compression_level : *level)
           : 0;
 
+  // Manifests are always stored uncompressed so that they can be read in
+  // place, see core::Manifest.
+  const bool is_manifest = header.entry_type == CacheEntryType::manifest;
+
   std::optional<DirEntry> new_dir_entry;
 
-  if (header.compression_level != wanted_level) {
+  if (is_manifest ? header.compression_type != CompressionType::none
+                  : header.compression_level != wanted_level) {
     const auto cache_file_data = util::value_or_throw<core::Error>(
       util::read_file<util::Bytes>(dir_entry.path()),
       FMT("Failed to read {}: ", dir_entry.path()));
@@ -50,9 +55,12 @@ FileRecompressor::recompress(const DirEntry& dir_entry,
     cache_entry.verify_checksum();
 
     header.entry_format_version = core::CacheEntry::k_format_version;
-    header.compression_type =
-      level ? core::CompressionType::zstd : core::CompressionType::none;
-    header.compression_level = wanted_level;
+    header.compression_type = level && !is_manifest
+                                ? core::CompressionType::zstd
+                                : core::CompressionType::none;
+    if (!is_manifest) {
+      header.compression_level = wanted_level;
+    }
 
     AtomicFile new_cache_file(dir_entry.path(), AtomicFile::Mode::binary);
     new_cache_file.write(
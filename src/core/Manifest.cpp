@@ -1,4 +1,4 @@
-// Copyright (C) 2009-2023 Joel Rosdahl and other contributors
+// Copyright (C) 2009-2024 Joel Rosdahl and other contributors
 //
 // See doc/AUTHORS.adoc for a complete list of contributors.
 //
@@ -20,45 +20,90 @@
 
 #include <Context.hpp>
 #include <Hash.hpp>
-#include <core/CacheEntryDataReader.hpp>
 #include <core/CacheEntryDataWriter.hpp>
 #include <core/exceptions.hpp>
 #include <hashutil.hpp>
 #include <util/XXH3_64.hpp>
+#include <util/conversion.hpp>
 #include <util/fmtmacros.hpp>
 #include <util/logging.hpp>
 #include <util/string.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <tuple>
+
 // Manifest data format
 // ====================
 //
-// Integers are big-endian.
+// Integers are big-endian. The format is designed to be used directly from a
+// (potentially memory-mapped) buffer without parsing: all entries have fixed
+// sizes, are located through the counts in the header and are aligned to
+// their largest integer field.
+//
+// <payload>        ::= <format_ver> <padding> <counts> <padding> <paths>
+//                      <includes> <results> <nodes> <children> <path_data>
+// <format_ver>     ::= uint8_t
+// <padding>        ::= zero bytes up to the next multiple of 4 or 8 bytes
+// <counts>         ::= <n_paths> <n_includes> <n_results> <n_nodes>
+//                      <n_children> <path_data_size>
+// <n_paths>        ::= uint32_t
+// <n_includes>     ::= uint32_t
+// <n_results>      ::= uint32_t
+// <n_nodes>        ::= uint32_t ; at least 1, node 0 is the root
+// <n_children>     ::= uint32_t
+// <path_data_size> ::= uint32_t
+// <paths>          ::= <path_entry>*
+// <path_entry>     ::= <path_offset> <path_len>
+// <path_offset>    ::= uint32_t ; offset in path_data
+// <path_len>       ::= uint32_t
+// <includes>       ::= <include_entry>*
+// <include_entry>  ::= <path_index> <digest> <fsize> <mtime> <ctime>
+// <path_index>     ::= uint32_t
+// <digest>         ::= Hash::Digest::size() bytes
+// <fsize>          ::= uint64_t ; file size
+// <mtime>          ::= int64_t ; modification time (ns), 0 = not recorded
+// <ctime>          ::= int64_t ; status change time (ns), 0 = not recorded
+// <results>        ::= <result>*
+// <result>         ::= <result_key> <padding> <last_used>
+// <result_key>     ::= Hash::Digest::size() bytes
+// <last_used>      ::= int64_t ; time of last use (s)
+// <nodes>          ::= <node>*
+// <node>           ::= <include_index> <result_index> <newest_result>
+//                      <first_child> <child_count>
+// <include_index>  ::= uint32_t ; UINT32_MAX for the root
+// <result_index>   ::= uint32_t ; UINT32_MAX if no result ends at the node
+// <newest_result>  ::= uint32_t ; highest result index in the subtree
+// <first_child>    ::= uint32_t ; index in children
+// <child_count>    ::= uint32_t
+// <children>       ::= <child>*
+// <child>          ::= uint32_t ; node index, larger than the parent's
+// <path_data>      ::= path_data_size bytes
 //
-// <payload>       ::= <format_ver> <paths> <includes> <results>
-// <format_ver>    ::= uint8_t
-// <paths>         ::= <n_paths> <path_entry>*
-// <n_paths>       ::= uint32_t
-// <path_entry>    ::= <path_len> <path>
-// <path_len>      ::= uint16_t
-// <path>          ::= path_len bytes
-// <includes>      ::= <n_includes> <include_entry>*
-// <n_includes>    ::= uint32_t
-// <include_entry> ::= <path_index> <digest> <fsize> <mtime> <ctime>
-// <path_index>    ::= uint32_t
-// <digest>        ::= Hash::Digest::size() bytes
-// <fsize>         ::= uint64_t ; file size
-// <mtime>         ::= int64_t ; modification time (ns), 0 = not recorded
-// <ctime>         ::= int64_t ; status change time (ns), 0 = not recorded
-// <results>       ::= <n_results> <result>*
-// <n_results>     ::= uint32_t
-// <result>        ::= <n_indexes> <include_index>* <key>
-// <n_indexes>     ::= uint32_t
-// <include_index> ::= uint32_t
-// <result_key>    ::= Hash::Digest::size() bytes
+// The nodes form a decision trie. The includes of a result are the
+// include_index values on the path from the root to the node that refers to
+// the result. Children are ordered by descending newest_result.
 
 const uint32_t k_max_manifest_entries = 100;
 const uint32_t k_max_manifest_file_info_entries = 10000;
 
+// Minimum age of a result's time of last use before it's updated on a hit.
+const util::Duration k_last_used_update_interval(24 * 60 * 60);
+
+const size_t k_digest_size = std::tuple_size<Hash::Digest>();
+const size_t k_counts_offset = 4;
+const size_t k_header_size = 32;
+const size_t k_path_entry_size = 4 + 4;
+const size_t k_include_entry_size = 4 + k_digest_size + 8 + 8 + 8;
+const size_t k_result_entry_size = k_digest_size + 4 + 8;
+const size_t k_node_size = 5 * 4;
+const size_t k_child_size = 4;
+
+static_assert(k_include_entry_size % 8 == 0);
+static_assert(k_result_entry_size % 8 == 0);
+
 namespace std {
 
 template<> struct hash<core::Manifest::FileInfo>
@@ -83,86 +128,345 @@ namespace core {
 //   - First version.
 // Version 1:
 //   - mtime and ctime are now stored with nanoseconds resolution.
-const uint8_t Manifest::k_format_version = 1;
+// Version 2:
+//   - Results are stored as a decision trie over include entries.
+//   - Time of last use is stored for each result.
+// Version 3:
+//   - Fixed-size, aligned entries that can be used without parsing.
+const uint8_t Manifest::k_format_version = 3;
 
-void
-Manifest::read(nonstd::span<const uint8_t> data)
+const uint32_t Manifest::k_no_index = std::numeric_limits<uint32_t>::max();
+
+// Accessor for a serialized manifest.
+class Manifest::View
 {
-  std::vector<std::string> files;
-  std::vector<FileInfo> file_infos;
-  std::vector<ResultEntry> results;
+public:
+  struct Node
+  {
+    uint32_t index;
+    uint32_t file_info_index;
+    uint32_t result_index;
+    uint32_t newest_result;
+    uint32_t first_child;
+    uint32_t child_count;
+  };
+
+  // Check the format version and that the sections fit in `data`.
+  explicit View(nonstd::span<const uint8_t> data);
+
+  // Check that all results are reachable in the trie. Indexes and offsets are
+  // checked by the accessors below, which throw core::Error if they are
+  // invalid.
+  void verify() const;
+
+  uint32_t path_count() const;
+  uint32_t file_info_count() const;
+  uint32_t result_count() const;
+  uint32_t node_count() const;
+
+  std::string_view path(uint32_t index) const;
+  FileInfo file_info(uint32_t index) const;
+  Hash::Digest result_key(uint32_t index) const;
+  util::TimePoint last_used(uint32_t index) const;
+  size_t last_used_offset(uint32_t index) const;
+  Node node(uint32_t index) const;
+  uint32_t child(const Node& node, uint32_t index) const;
 
-  core::CacheEntryDataReader reader(data);
+private:
+  nonstd::span<const uint8_t> m_data;
+  uint32_t m_path_count;
+  uint32_t m_file_info_count;
+  uint32_t m_result_count;
+  uint32_t m_node_count;
+  uint32_t m_child_count;
+  uint32_t m_path_data_size;
+  size_t m_paths_offset;
+  size_t m_file_infos_offset;
+  size_t m_results_offset;
+  size_t m_nodes_offset;
+  size_t m_children_offset;
+  size_t m_path_data_offset;
 
-  const auto format_version = reader.read_int<uint8_t>();
+  template<typename T> T read_int(size_t offset) const;
+};
+
+Manifest::View::View(nonstd::span<const uint8_t> data) : m_data(data)
+{
+  if (data.size() < k_header_size) {
+    throw core::Error("Manifest data underflow");
+  }
+  const auto format_version = read_int<uint8_t>(0);
   if (format_version != k_format_version) {
     throw core::Error(FMT("Unknown manifest format version: {} != {}",
                           format_version,
                           k_format_version));
   }
 
-  const auto file_count = reader.read_int<uint32_t>();
-  for (uint32_t i = 0; i < file_count; ++i) {
-    files.emplace_back(reader.read_str(reader.read_int<uint16_t>()));
+  m_path_count = read_int<uint32_t>(k_counts_offset);
+  m_file_info_count = read_int<uint32_t>(k_counts_offset + 4);
+  m_result_count = read_int<uint32_t>(k_counts_offset + 8);
+  m_node_count = read_int<uint32_t>(k_counts_offset + 12);
+  m_child_count = read_int<uint32_t>(k_counts_offset + 16);
+  m_path_data_size = read_int<uint32_t>(k_counts_offset + 20);
+
+  // 64-bit arithmetic can't overflow since all counts are 32-bit.
+  uint64_t offset = k_header_size;
+  m_paths_offset = offset;
+  offset += uint64_t{m_path_count} * k_path_entry_size;
+  m_file_infos_offset = offset;
+  offset += uint64_t{m_file_info_count} * k_include_entry_size;
+  m_results_offset = offset;
+  offset += uint64_t{m_result_count} * k_result_entry_size;
+  m_nodes_offset = offset;
+  offset += uint64_t{m_node_count} * k_node_size;
+  m_children_offset = offset;
+  offset += uint64_t{m_child_count} * k_child_size;
+  m_path_data_offset = offset;
+  offset += m_path_data_size;
+
+  if (offset != data.size()) {
+    throw core::Error(
+      FMT("Bad manifest size: {} != {}", data.size(), offset));
+  }
+  if (m_node_count == 0) {
+    throw core::Error("Missing root node in manifest");
+  }
+}
+
+void
+Manifest::View::verify() const
+{
+  std::vector<bool> seen_results(m_result_count, false);
+  for (uint32_t i = 0; i < m_node_count; ++i) {
+    const auto n = node(i);
+    if (n.result_index != k_no_index) {
+      if (seen_results[n.result_index]) {
+        throw core::Error(FMT("Bad manifest trie node {}", i));
+      }
+      seen_results[n.result_index] = true;
+    }
+  }
+  const auto missing =
+    std::find(seen_results.begin(), seen_results.end(), false);
+  if (missing != seen_results.end()) {
+    throw core::Error(FMT("Result {} missing in manifest trie",
+                          missing - seen_results.begin()));
   }
+}
 
-  const auto file_info_count = reader.read_int<uint32_t>();
-  for (uint32_t i = 0; i < file_info_count; ++i) {
-    file_infos.emplace_back();
-    auto& entry = file_infos.back();
+inline uint32_t
+Manifest::View::path_count() const
+{
+  return m_path_count;
+}
+
+inline uint32_t
+Manifest::View::file_info_count() const
+{
+  return m_file_info_count;
+}
 
-    reader.read_int(entry.index);
-    reader.read_and_copy_bytes(entry.digest);
-    reader.read_int(entry.fsize);
-    entry.mtime.set_nsec(reader.read_int<int64_t>());
-    entry.ctime.set_nsec(reader.read_int<int64_t>());
+inline uint32_t
+Manifest::View::result_count() const
+{
+  return m_result_count;
+}
+
+inline uint32_t
+Manifest::View::node_count() const
+{
+  return m_node_count;
+}
+
+inline std::string_view
+Manifest::View::path(uint32_t index) const
+{
+  if (index >= m_path_count) {
+    throw core::Error(FMT("Bad manifest path index {}", index));
+  }
+  const size_t entry = m_paths_offset + index * k_path_entry_size;
+  const uint32_t offset = read_int<uint32_t>(entry);
+  const uint32_t length = read_int<uint32_t>(entry + 4);
+  if (uint64_t{offset} + length > m_path_data_size) {
+    throw core::Error(FMT("Bad manifest path entry {}", index));
+  }
+  return {reinterpret_cast<const char*>(m_data.data()) + m_path_data_offset
+            + offset,
+          length};
+}
+
+inline Manifest::FileInfo
+Manifest::View::file_info(uint32_t index) const
+{
+  if (index >= m_file_info_count) {
+    throw core::Error(FMT("Bad manifest include index {}", index));
+  }
+  const size_t entry = m_file_infos_offset + index * k_include_entry_size;
+  FileInfo fi;
+  fi.index = read_int<uint32_t>(entry);
+  memcpy(fi.digest.data(), &m_data[entry + 4], k_digest_size);
+  fi.fsize = read_int<uint64_t>(entry + 4 + k_digest_size);
+  fi.mtime.set_nsec(read_int<int64_t>(entry + 4 + k_digest_size + 8));
+  fi.ctime.set_nsec(read_int<int64_t>(entry + 4 + k_digest_size + 16));
+  return fi;
+}
+
+inline Hash::Digest
+Manifest::View::result_key(uint32_t index) const
+{
+  if (index >= m_result_count) {
+    throw core::Error(FMT("Bad manifest result index {}", index));
+  }
+  Hash::Digest key;
+  memcpy(key.data(),
+         &m_data[m_results_offset + index * k_result_entry_size],
+         k_digest_size);
+  return key;
+}
+
+inline util::TimePoint
+Manifest::View::last_used(uint32_t index) const
+{
+  if (index >= m_result_count) {
+    throw core::Error(FMT("Bad manifest result index {}", index));
+  }
+  return util::TimePoint(read_int<int64_t>(last_used_offset(index)));
+}
+
+inline size_t
+Manifest::View::last_used_offset(uint32_t index) const
+{
+  return m_results_offset + index * k_result_entry_size + k_digest_size + 4;
+}
+
+inline Manifest::View::Node
+Manifest::View::node(uint32_t index) const
+{
+  if (index >= m_node_count) {
+    throw core::Error(FMT("Bad manifest trie node index {}", index));
+  }
+  const size_t entry = m_nodes_offset + index * k_node_size;
+  const Node node{index,
+                  read_int<uint32_t>(entry),
+                  read_int<uint32_t>(entry + 4),
+                  read_int<uint32_t>(entry + 8),
+                  read_int<uint32_t>(entry + 12),
+                  read_int<uint32_t>(entry + 16)};
+  if ((index == 0) != (node.file_info_index == k_no_index)
+      || (index > 0 && node.file_info_index >= m_file_info_count)
+      || (node.result_index != k_no_index
+          && node.result_index >= m_result_count)
+      || uint64_t{node.first_child} + node.child_count > m_child_count) {
+    throw core::Error(FMT("Bad manifest trie node {}", index));
   }
+  return node;
+}
 
-  const auto result_count = reader.read_int<uint32_t>();
-  for (uint32_t i = 0; i < result_count; ++i) {
-    results.emplace_back();
-    auto& entry = results.back();
+inline uint32_t
+Manifest::View::child(const Node& node, uint32_t index) const
+{
+  const uint32_t child = read_int<uint32_t>(
+    m_children_offset + (node.first_child + index) * k_child_size);
+  // Children come after their parent, so the trie can't have cycles.
+  if (child <= node.index || child >= m_node_count) {
+    throw core::Error(FMT("Bad manifest trie node {}", node.index));
+  }
+  return child;
+}
+
+template<typename T>
+inline T
+Manifest::View::read_int(size_t offset) const
+{
+  T value;
+  util::big_endian_to_int(&m_data[offset], value);
+  return value;
+}
 
-    const auto file_info_index_count = reader.read_int<uint32_t>();
-    for (uint32_t j = 0; j < file_info_index_count; ++j) {
-      entry.file_info_indexes.push_back(reader.read_int<uint32_t>());
+void
+Manifest::read(nonstd::span<const uint8_t> data,
+               std::shared_ptr<const void> data_owner)
+{
+  if (m_materialized && m_results.empty()) {
+    const View view(data); // Check header and size.
+    if (data_owner) {
+      m_data.clear();
+      m_borrowed_data = data;
+      m_data_owner = std::move(data_owner);
+    } else {
+      m_data = util::Bytes(data);
+      m_borrowed_data = {};
+      m_data_owner.reset();
     }
-    reader.read_and_copy_bytes(entry.key);
+    m_materialized = false;
+    m_files.clear();
+    m_file_infos.clear();
+    m_trie.clear();
+    return;
   }
 
-  if (m_results.empty()) {
-    m_files = std::move(files);
-    m_file_infos = std::move(file_infos);
-    m_results = std::move(results);
-  } else {
-    for (const auto& result : results) {
-      std::unordered_map<std::string, Hash::Digest> included_files;
-      std::unordered_map<std::string, FileStats> included_files_stats;
-      for (auto file_info_index : result.file_info_indexes) {
-        const auto& file_info = file_infos[file_info_index];
-        included_files.emplace(files[file_info.index], file_info.digest);
-        included_files_stats.emplace(
-          files[file_info.index],
-          FileStats{file_info.fsize, file_info.mtime, file_info.ctime});
-      }
-      add_result(result.key, included_files, [&](const std::string& path) {
-        return included_files_stats[path];
-      });
+  Manifest other;
+  other.read(data);
+  other.materialize();
+
+  materialize();
+  for (const auto& result : other.m_results) {
+    std::unordered_map<std::string_view, Hash::Digest> included_files;
+    std::unordered_map<std::string_view, FileStats> included_files_stats;
+    for (auto file_info_index : result.file_info_indexes) {
+      const auto& file_info = other.m_file_infos[file_info_index];
+      const auto& path = other.m_files[file_info.index];
+      included_files.emplace(path, file_info.digest);
+      included_files_stats.emplace(
+        path, FileStats{file_info.fsize, file_info.mtime, file_info.ctime});
     }
+    add_result(
+      result.key,
+      included_files,
+      [&](std::string_view path) { return included_files_stats[path]; },
+      result.last_used);
   }
 }
 
 std::optional<Hash::Digest>
 Manifest::look_up_result_digest(const Context& ctx) const
 {
-  std::unordered_map<std::string, FileStats> stated_files;
-  std::unordered_map<std::string, Hash::Digest> hashed_files;
+  std::unordered_map<std::string_view, FileStats> stated_files;
+  std::unordered_map<std::string_view, Hash::Digest> hashed_files;
+
+  const View view(data());
 
-  // Check newest result first since it's a more likely to match.
-  for (size_t i = m_results.size(); i > 0; i--) {
-    const auto& result = m_results[i - 1];
-    if (result_matches(ctx, result, stated_files, hashed_files)) {
-      return result.key;
+  // Depth-first search in the trie. Children are ordered so that the newest
+  // result is checked first since it's more likely to match. All file infos on
+  // the path to a node have matched when the node is visited, so a result at
+  // the node matches as well.
+  struct Frame
+  {
+    View::Node node;
+    uint32_t next_child;
+  };
+  std::vector<Frame> stack{{view.node(0), 0}};
+  while (!stack.empty()) {
+    auto& frame = stack.back();
+    const auto& node = frame.node;
+    if (frame.next_child == node.child_count) {
+      if (node.result_index != k_no_index) {
+        return view.result_key(node.result_index);
+      }
+      stack.pop_back();
+      continue;
+    }
+
+    const auto child = view.node(view.child(node, frame.next_child));
+    if (node.result_index != k_no_index
+        && node.result_index > child.newest_result) {
+      return view.result_key(node.result_index);
+    }
+    ++frame.next_child;
+    const auto fi = view.file_info(child.file_info_index);
+    if (file_info_matches(
+          ctx, view.path(fi.index), fi, stated_files, hashed_files)) {
+      stack.push_back({child, 0});
     }
   }
 
@@ -172,33 +476,150 @@ Manifest::look_up_result_digest(const Context& ctx) const
 bool
 Manifest::add_result(
   const Hash::Digest& result_key,
-  const std::unordered_map<std::string, Hash::Digest>& included_files,
+  const std::unordered_map<std::string_view, Hash::Digest>& included_files,
   const FileStater& stat_file_function)
 {
-  if (m_results.size() > k_max_manifest_entries) {
+  return add_result(
+    result_key, included_files, stat_file_function, util::TimePoint::now());
+}
+
+Manifest
+Manifest::extract(const Hash::Digest& result_key)
+{
+  materialize();
+
+  // Several results may have the same key, e.g. after a preprocessor mode hit.
+  // The newest one is the one that was just added.
+  Manifest manifest;
+  const auto it = std::find_if(
+    m_results.rbegin(), m_results.rend(), [&](const ResultEntry& result) {
+      return result.key == result_key;
+    });
+  if (it == m_results.rend()) {
+    return manifest;
+  }
+
+  std::unordered_map<uint32_t, uint32_t> new_file_index;
+  ResultEntry entry{{}, it->key, it->last_used};
+  for (uint32_t file_info_index : it->file_info_indexes) {
+    FileInfo fi = m_file_infos[file_info_index];
+    const auto [file_it, inserted] = new_file_index.emplace(
+      fi.index, static_cast<uint32_t>(manifest.m_files.size()));
+    if (inserted) {
+      manifest.m_files.push_back(m_files[fi.index]);
+    }
+    fi.index = file_it->second;
+    entry.file_info_indexes.push_back(
+      static_cast<uint32_t>(manifest.m_file_infos.size()));
+    manifest.m_file_infos.push_back(fi);
+  }
+  manifest.m_results.push_back(std::move(entry));
+  return manifest;
+}
+
+bool
+Manifest::touch(const Hash::Digest& result_key, const util::TimePoint& now)
+{
+  if (!m_materialized) {
+    // Update the serialized form in place.
+    own_data();
+    const View view(m_data);
+    for (uint32_t i = 0; i < view.result_count(); ++i) {
+      if (view.result_key(i) == result_key) {
+        if (now - view.last_used(i) < k_last_used_update_interval) {
+          return false;
+        }
+        util::int_to_big_endian(now.sec(), &m_data[view.last_used_offset(i)]);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  for (auto& result : m_results) {
+    if (result.key == result_key) {
+      if (now - result.last_used < k_last_used_update_interval) {
+        return false;
+      }
+      result.last_used = now;
+      m_data.clear();
+      m_borrowed_data = {};
+      m_data_owner.reset();
+      return true;
+    }
+  }
+  return false;
+}
+
+std::optional<Hash::Digest>
+Manifest::newest_result_key() const
+{
+  if (m_materialized) {
+    if (m_results.empty()) {
+      return std::nullopt;
+    }
+    return m_results.back().key;
+  }
+
+  const View view(data());
+  if (view.result_count() == 0) {
+    return std::nullopt;
+  }
+  return view.result_key(view.result_count() - 1);
+}
+
+Manifest::ResultCounts
+Manifest::count_results() const
+{
+  std::vector<Hash::Digest> keys;
+  if (m_materialized) {
+    for (const auto& result : m_results) {
+      keys.push_back(result.key);
+    }
+  } else {
+    const View view(data());
+    for (uint32_t i = 0; i < view.result_count(); ++i) {
+      keys.push_back(view.result_key(i));
+    }
+  }
+
+  std::sort(keys.begin(), keys.end());
+  const auto unique_end = std::unique(keys.begin(), keys.end());
+
+  ResultCounts counts;
+  counts.results = keys.size();
+  counts.reused_keys = keys.end() - unique_end;
+  return counts;
+}
+
+bool
+Manifest::add_result(
+  const Hash::Digest& result_key,
+  const std::unordered_map<std::string_view, Hash::Digest>& included_files,
+  const FileStater& stat_file_function,
+  const util::TimePoint& last_used)
+{
+  materialize();
+
+  if (m_results.size() >= k_max_manifest_entries
+      || m_file_infos.size() > k_max_manifest_file_info_entries) {
     // Normally, there shouldn't be many result entries in the manifest since
     // new entries are added only if an include file has changed but not the
     // source file, and you typically change source files more often than header
     // files. However, it's certainly possible to imagine cases where the
     // manifest will grow large (for instance, a generated header file that
     // changes for every build), and this must be taken care of since processing
-    // an ever growing manifest eventually will take too much time. A good way
-    // of solving this would be to maintain the result entries in LRU order and
-    // discarding the old ones. An easy way is to throw away all entries when
-    // there are too many. Let's do that for now.
-    LOG("More than {} entries in manifest file; discarding",
-        k_max_manifest_entries);
-    clear();
-  } else if (m_file_infos.size() > k_max_manifest_file_info_entries) {
-    // Rarely, FileInfo entries can grow large in pathological cases where many
-    // included files change, but the main file does not. This also puts an
-    // upper bound on the number of FileInfo entries.
-    LOG("More than {} FileInfo entries in manifest file; discarding",
-        k_max_manifest_file_info_entries);
-    clear();
-  }
-
-  std::unordered_map<std::string, uint32_t /*index*/> mf_files;
+    // an ever growing manifest eventually will take too much time. Similarly,
+    // FileInfo entries can grow large in pathological cases where many included
+    // files change, but the main file does not. Discard the least recently used
+    // results to stay within the limits.
+    evict_least_recently_used(k_max_manifest_entries - 1,
+                              k_max_manifest_file_info_entries);
+  }
+
+  // Reserve space so that views of m_files stay valid when paths are added.
+  m_files.reserve(m_files.size() + included_files.size());
+  std::unordered_map<std::string_view, uint32_t /*index*/> mf_files;
   for (uint32_t i = 0; i < m_files.size(); ++i) {
     mf_files.emplace(m_files[i], i);
   }
@@ -220,36 +641,147 @@ Manifest::add_result(
     }
     file_info_indexes.push_back(*index);
   }
+  std::sort(file_info_indexes.begin(), file_info_indexes.end());
 
-  ResultEntry entry{std::move(file_info_indexes), result_key};
-  if (std::find(m_results.begin(), m_results.end(), entry) == m_results.end()) {
-    m_results.push_back(std::move(entry));
-    return true;
-  } else {
-    return false;
+  // A result with the same include entries can't be distinguished from the new
+  // one, so replace it unless it's newer, which can happen when merging an
+  // older manifest.
+  const auto it = std::find_if(
+    m_results.begin(), m_results.end(), [&](const ResultEntry& result) {
+      return result.file_info_indexes == file_info_indexes;
+    });
+  if (it != m_results.end()) {
+    if (it->key == result_key) {
+      if (last_used > it->last_used) {
+        it->last_used = last_used;
+        modified();
+      }
+      return false;
+    }
+    if (it->last_used > last_used) {
+      return false;
+    }
+    m_results.erase(it);
   }
+
+  m_results.push_back(
+    ResultEntry{std::move(file_info_indexes), result_key, last_used});
+  modified();
+  return true;
 }
 
 uint32_t
 Manifest::serialized_size() const
 {
-  uint64_t size = 0;
+  return static_cast<uint32_t>(data().size());
+}
+
+void
+Manifest::serialize(util::Bytes& output)
+{
+  core::CacheEntryDataWriter writer(output);
+  writer.write_bytes(data());
+}
 
-  size += 1; // format_ver
-  size += 4; // n_files
+nonstd::span<const uint8_t>
+Manifest::data() const
+{
+  if (m_data_owner) {
+    return m_borrowed_data;
+  }
+  if (m_data.empty()) {
+    serialize_entries(m_data);
+  }
+  return m_data;
+}
+
+void
+Manifest::own_data()
+{
+  if (m_data_owner) {
+    m_data = util::Bytes(m_borrowed_data);
+    m_borrowed_data = {};
+    m_data_owner.reset();
+  }
+}
+
+void
+Manifest::materialize()
+{
+  if (m_materialized) {
+    return;
+  }
+
+  const View view(data());
+  view.verify();
+
+  m_files.clear();
+  m_files.reserve(view.path_count());
+  for (uint32_t i = 0; i < view.path_count(); ++i) {
+    m_files.emplace_back(view.path(i));
+  }
+
+  m_file_infos.clear();
+  m_file_infos.reserve(view.file_info_count());
+  for (uint32_t i = 0; i < view.file_info_count(); ++i) {
+    m_file_infos.push_back(view.file_info(i));
+  }
+
+  std::vector<uint32_t> parents(view.node_count(), k_no_index);
+  std::vector<uint32_t> result_nodes(view.result_count(), k_no_index);
+  for (uint32_t i = 0; i < view.node_count(); ++i) {
+    const auto node = view.node(i);
+    if (node.result_index != k_no_index) {
+      result_nodes[node.result_index] = i;
+    }
+    for (uint32_t j = 0; j < node.child_count; ++j) {
+      parents[view.child(node, j)] = i;
+    }
+  }
+
+  m_results.clear();
+  m_results.reserve(view.result_count());
+  for (uint32_t i = 0; i < view.result_count(); ++i) {
+    ResultEntry entry{{}, view.result_key(i), view.last_used(i)};
+    for (uint32_t node = result_nodes[i]; node != 0; node = parents[node]) {
+      entry.file_info_indexes.push_back(view.node(node).file_info_index);
+    }
+    std::sort(entry.file_info_indexes.begin(), entry.file_info_indexes.end());
+    m_results.push_back(std::move(entry));
+  }
+
+  m_materialized = true;
+}
+
+void
+Manifest::modified()
+{
+  m_data.clear();
+  m_borrowed_data = {};
+  m_data_owner.reset();
+  m_trie.clear();
+}
+
+void
+Manifest::serialize_entries(util::Bytes& output) const
+{
+  const auto& nodes = trie();
+
+  uint64_t path_data_size = 0;
   for (const auto& file : m_files) {
-    size += 2 + file.length();
+    path_data_size += file.length();
   }
-  size += 4; // n_file_infos
-  size +=
-    m_file_infos.size() * (4 + std::tuple_size<Hash::Digest>() + 8 + 8 + 8);
-  size += 4; // n_results
-  for (const auto& result : m_results) {
-    size += 4; // n_file_info_indexes
-    size += result.file_info_indexes.size() * 4;
-    size += std::tuple_size<Hash::Digest>();
+  uint64_t child_count = 0;
+  for (const auto& node : nodes) {
+    child_count += node.children.size();
   }
 
+  const uint64_t size =
+    k_header_size + m_files.size() * k_path_entry_size
+    + m_file_infos.size() * k_include_entry_size
+    + m_results.size() * k_result_entry_size + nodes.size() * k_node_size
+    + child_count * k_child_size + path_data_size;
+
   // In order to support 32-bit ccache builds, restrict size to uint32_t for
   // now. This restriction can be lifted when we drop 32-bit support.
   const auto max = std::numeric_limits<uint32_t>::max();
@@ -257,22 +789,27 @@ Manifest::serialized_size() const
     throw core::Error(
       FMT("Serialized manifest too large ({} > {})", size, max));
   }
-  return static_cast<uint32_t>(size);
-}
 
-void
-Manifest::serialize(util::Bytes& output)
-{
+  output.reserve(output.size() + size);
   core::CacheEntryDataWriter writer(output);
 
   writer.write_int(k_format_version);
+  writer.write_bytes(util::Bytes(k_counts_offset - 1));
   writer.write_int(static_cast<uint32_t>(m_files.size()));
+  writer.write_int(static_cast<uint32_t>(m_file_infos.size()));
+  writer.write_int(static_cast<uint32_t>(m_results.size()));
+  writer.write_int(static_cast<uint32_t>(nodes.size()));
+  writer.write_int(static_cast<uint32_t>(child_count));
+  writer.write_int(static_cast<uint32_t>(path_data_size));
+  writer.write_bytes(util::Bytes(k_header_size - k_counts_offset - 6 * 4));
+
+  uint32_t path_offset = 0;
   for (const auto& file : m_files) {
-    writer.write_int(static_cast<uint16_t>(file.length()));
-    writer.write_str(file);
+    writer.write_int(path_offset);
+    writer.write_int(static_cast<uint32_t>(file.length()));
+    path_offset += static_cast<uint32_t>(file.length());
   }
 
-  writer.write_int(static_cast<uint32_t>(m_file_infos.size()));
   for (const auto& file_info : m_file_infos) {
     writer.write_int<uint32_t>(file_info.index);
     writer.write_bytes(file_info.digest);
@@ -281,13 +818,29 @@ Manifest::serialize(util::Bytes& output)
     writer.write_int(file_info.ctime.nsec());
   }
 
-  writer.write_int(static_cast<uint32_t>(m_results.size()));
   for (const auto& result : m_results) {
-    writer.write_int(static_cast<uint32_t>(result.file_info_indexes.size()));
-    for (auto index : result.file_info_indexes) {
-      writer.write_int(index);
-    }
     writer.write_bytes(result.key);
+    writer.write_int<uint32_t>(0); // Padding.
+    writer.write_int(result.last_used.sec());
+  }
+
+  uint32_t first_child = 0;
+  for (const auto& node : nodes) {
+    writer.write_int(node.file_info_index);
+    writer.write_int(node.result_index);
+    writer.write_int(node.newest_result);
+    writer.write_int(first_child);
+    writer.write_int(static_cast<uint32_t>(node.children.size()));
+    first_child += static_cast<uint32_t>(node.children.size());
+  }
+  for (const auto& node : nodes) {
+    for (auto child : node.children) {
+      writer.write_int(child);
+    }
+  }
+
+  for (const auto& file : m_files) {
+    writer.write_str(file);
   }
 }
 
@@ -298,25 +851,159 @@ Manifest::FileInfo::operator==(const FileInfo& other) const
          && mtime == other.mtime && ctime == other.ctime;
 }
 
-bool
-Manifest::ResultEntry::operator==(const ResultEntry& other) const
+void
+Manifest::evict_least_recently_used(const size_t max_results,
+                                    const size_t max_file_infos)
+{
+  // Most recently used first. Results used at the same time are ordered by
+  // when they were added.
+  std::vector<uint32_t> order(m_results.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return std::make_tuple(m_results[a].last_used, a)
+           > std::make_tuple(m_results[b].last_used, b);
+  });
+
+  std::vector<bool> keep_result(m_results.size(), false);
+  std::vector<bool> keep_file_info(m_file_infos.size(), false);
+  size_t kept_results = 0;
+  size_t kept_file_infos = 0;
+  for (uint32_t result_index : order) {
+    const auto& indexes = m_results[result_index].file_info_indexes;
+    const auto new_file_infos =
+      std::count_if(indexes.begin(), indexes.end(), [&](uint32_t index) {
+        return !keep_file_info[index];
+      });
+    if (kept_results == max_results
+        || kept_file_infos + new_file_infos > max_file_infos) {
+      break;
+    }
+    keep_result[result_index] = true;
+    ++kept_results;
+    for (uint32_t index : indexes) {
+      keep_file_info[index] = true;
+    }
+    kept_file_infos += new_file_infos;
+  }
+
+  LOG("Evicting {} of {} results and {} of {} FileInfo entries from manifest",
+      m_results.size() - kept_results,
+      m_results.size(),
+      m_file_infos.size() - kept_file_infos,
+      m_file_infos.size());
+
+  // Drop unreferenced paths and file infos and renumber the rest.
+  std::vector<uint32_t> new_file_index(m_files.size(), k_no_index);
+  std::vector<uint32_t> new_file_info_index(m_file_infos.size(), k_no_index);
+  std::vector<std::string> files;
+  std::vector<FileInfo> file_infos;
+  for (uint32_t i = 0; i < m_file_infos.size(); ++i) {
+    if (!keep_file_info[i]) {
+      continue;
+    }
+    FileInfo fi = m_file_infos[i];
+    if (new_file_index[fi.index] == k_no_index) {
+      new_file_index[fi.index] = static_cast<uint32_t>(files.size());
+      files.push_back(std::move(m_files[fi.index]));
+    }
+    fi.index = new_file_index[fi.index];
+    new_file_info_index[i] = static_cast<uint32_t>(file_infos.size());
+    file_infos.push_back(fi);
+  }
+
+  std::vector<ResultEntry> results;
+  for (uint32_t i = 0; i < m_results.size(); ++i) {
+    if (!keep_result[i]) {
+      continue;
+    }
+    auto& result = m_results[i];
+    for (auto& index : result.file_info_indexes) {
+      index = new_file_info_index[index];
+    }
+    std::sort(result.file_info_indexes.begin(), result.file_info_indexes.end());
+    results.push_back(std::move(result));
+  }
+
+  m_files = std::move(files);
+  m_file_infos = std::move(file_infos);
+  m_results = std::move(results);
+  modified();
+}
+
+const std::vector<Manifest::TrieNode>&
+Manifest::trie() const
 {
-  return file_info_indexes == other.file_info_indexes && key == other.key;
+  if (!m_trie.empty()) {
+    return m_trie;
+  }
+
+  // Paths with fewer variants are placed closer to the root so that prefixes
+  // are shared by as many results as possible.
+  std::vector<uint32_t> variants(m_files.size(), 0);
+  for (const auto& fi : m_file_infos) {
+    ++variants[fi.index];
+  }
+  const auto decision_order = [&](uint32_t a, uint32_t b) {
+    const auto& fa = m_file_infos[a];
+    const auto& fb = m_file_infos[b];
+    return std::make_tuple(variants[fa.index], fa.index, a)
+           < std::make_tuple(variants[fb.index], fb.index, b);
+  };
+
+  m_trie.push_back(TrieNode{k_no_index, k_no_index, 0, {}});
+  std::vector<uint32_t> indexes;
+  for (uint32_t i = 0; i < m_results.size(); ++i) {
+    indexes = m_results[i].file_info_indexes;
+    std::sort(indexes.begin(), indexes.end(), decision_order);
+
+    uint32_t node = 0;
+    for (uint32_t file_info_index : indexes) {
+      const auto& children = m_trie[node].children;
+      const auto it = std::find_if(
+        children.begin(), children.end(), [&](uint32_t child) {
+          return m_trie[child].file_info_index == file_info_index;
+        });
+      if (it != children.end()) {
+        node = *it;
+      } else {
+        const auto child = static_cast<uint32_t>(m_trie.size());
+        m_trie.push_back(TrieNode{file_info_index, k_no_index, 0, {}});
+        m_trie[node].children.push_back(child);
+        node = child;
+      }
+    }
+    m_trie[node].result_index = i;
+  }
+
+  finish_trie();
+  return m_trie;
 }
 
 void
-Manifest::clear()
+Manifest::finish_trie() const
 {
-  m_files.clear();
-  m_file_infos.clear();
-  m_results.clear();
+  // Children always have higher indexes than their parent, so a reverse scan
+  // visits children before parents.
+  for (size_t i = m_trie.size(); i > 0; --i) {
+    auto& node = m_trie[i - 1];
+    node.newest_result =
+      node.result_index == k_no_index ? 0 : node.result_index;
+    for (uint32_t child : node.children) {
+      node.newest_result =
+        std::max(node.newest_result, m_trie[child].newest_result);
+    }
+    std::sort(
+      node.children.begin(), node.children.end(), [&](uint32_t a, uint32_t b) {
+        return m_trie[a].newest_result > m_trie[b].newest_result;
+      });
+  }
 }
 
 std::optional<uint32_t>
 Manifest::get_file_info_index(
-  const std::string& path,
+  std::string_view path,
   const Hash::Digest& digest,
-  const std::unordered_map<std::string, uint32_t>& mf_files,
+  const std::unordered_map<std::string_view, uint32_t>& mf_files,
   const std::unordered_map<FileInfo, uint32_t>& mf_file_infos,
   const FileStater& file_stater)
 {
@@ -328,7 +1015,7 @@ Manifest::get_file_info_index(
   } else if (m_files.size() > UINT32_MAX) {
     return std::nullopt;
   } else {
-    m_files.push_back(path);
+    m_files.emplace_back(path);
     fi.index = static_cast<uint32_t>(m_files.size() - 1);
   }
 
@@ -351,92 +1038,105 @@ Manifest::get_file_info_index(
 }
 
 bool
-Manifest::result_matches(
+Manifest::file_info_matches(
   const Context& ctx,
-  const ResultEntry& result,
-  std::unordered_map<std::string, FileStats>& stated_files,
-  std::unordered_map<std::string, Hash::Digest>& hashed_files) const
-{
-  for (uint32_t file_info_index : result.file_info_indexes) {
-    const auto& fi = m_file_infos[file_info_index];
-    const auto& path = m_files[fi.index];
-
-    auto stated_files_iter = stated_files.find(path);
-    if (stated_files_iter == stated_files.end()) {
-      util::DirEntry entry(path);
-      if (!entry) {
-        LOG("Info: {} is mentioned in a manifest entry but can't be read ({})",
-            path,
-            strerror(entry.error_number()));
-        return false;
+  const std::string_view path,
+  const FileInfo& fi,
+  std::unordered_map<std::string_view, FileStats>& stated_files,
+  std::unordered_map<std::string_view, Hash::Digest>& hashed_files) const
+{
+  // Clang stores the mtime of the included files in the precompiled header,
+  // and will error out if that header is later used without rebuilding.
+  const bool mtime_must_match =
+    (ctx.config.compiler_type() == CompilerType::clang
+     || ctx.config.compiler_type() == CompilerType::other)
+    && ctx.args_info.output_is_precompiled_header
+    && !ctx.args_info.fno_pch_timestamp;
+
+  // A file hashed earlier in the build session or since a watched directory
+  // last changed is known to be unchanged, so it doesn't need to be checked
+  // again.
+  if (!mtime_must_match) {
+    auto hashed_files_iter = hashed_files.find(path);
+    if (hashed_files_iter == hashed_files.end()) {
+      if (const auto digest = get_verified_digest(ctx, path)) {
+        hashed_files_iter = hashed_files.emplace(path, *digest).first;
       }
-      FileStats st;
-      st.size = entry.size();
-      st.mtime = entry.mtime();
-      st.ctime = entry.ctime();
-      stated_files_iter = stated_files.emplace(path, st).first;
     }
-    const FileStats& fs = stated_files_iter->second;
-
-    if (fi.fsize != fs.size) {
-      return false;
+    if (hashed_files_iter != hashed_files.end()) {
+      return fi.digest == hashed_files_iter->second;
     }
+  }
 
-    // Clang stores the mtime of the included files in the precompiled header,
-    // and will error out if that header is later used without rebuilding.
-    if ((ctx.config.compiler_type() == CompilerType::clang
-         || ctx.config.compiler_type() == CompilerType::other)
-        && ctx.args_info.output_is_precompiled_header
-        && !ctx.args_info.fno_pch_timestamp && fi.mtime != fs.mtime) {
-      LOG("Precompiled header includes {}, which has a new mtime", path);
+  auto stated_files_iter = stated_files.find(path);
+  if (stated_files_iter == stated_files.end()) {
+    util::DirEntry entry(path);
+    if (!entry) {
+      LOG("Info: {} is mentioned in a manifest entry but can't be read ({})",
+          path,
+          strerror(entry.error_number()));
       return false;
     }
+    FileStats st;
+    st.size = entry.size();
+    st.mtime = entry.mtime();
+    st.ctime = entry.ctime();
+    stated_files_iter = stated_files.emplace(path, st).first;
+  }
+  const FileStats& fs = stated_files_iter->second;
 
-    if (ctx.config.sloppiness().contains(core::Sloppy::file_stat_matches)) {
-      if (!ctx.config.sloppiness().contains(
-            core::Sloppy::file_stat_matches_ctime)) {
-        if (fi.mtime == fs.mtime && fi.ctime == fs.ctime) {
-          LOG("mtime/ctime hit for {}", path);
-          continue;
-        } else {
-          LOG("mtime/ctime miss for {}", path);
-        }
-      } else {
-        if (fi.mtime == fs.mtime) {
-          LOG("mtime hit for {}", path);
-          continue;
-        } else {
-          LOG("mtime miss for {}", path);
-        }
-      }
-    }
+  if (fi.fsize != fs.size) {
+    return false;
+  }
 
-    auto hashed_files_iter = hashed_files.find(path);
-    if (hashed_files_iter == hashed_files.end()) {
-      Hash::Digest actual_digest;
-      auto ret = hash_source_code_file(ctx, actual_digest, path, fs.size);
-      if (ret.contains(HashSourceCode::error)) {
-        LOG("Failed hashing {}", path);
-        return false;
+  if (mtime_must_match && fi.mtime != fs.mtime) {
+    LOG("Precompiled header includes {}, which has a new mtime", path);
+    return false;
+  }
+
+  if (ctx.config.sloppiness().contains(core::Sloppy::file_stat_matches)) {
+    if (!ctx.config.sloppiness().contains(
+          core::Sloppy::file_stat_matches_ctime)) {
+      if (fi.mtime == fs.mtime && fi.ctime == fs.ctime) {
+        LOG("mtime/ctime hit for {}", path);
+        return true;
+      } else {
+        LOG("mtime/ctime miss for {}", path);
       }
-      if (ret.contains(HashSourceCode::found_time)) {
-        return false;
+    } else {
+      if (fi.mtime == fs.mtime) {
+        LOG("mtime hit for {}", path);
+        return true;
+      } else {
+        LOG("mtime miss for {}", path);
       }
-
-      hashed_files_iter = hashed_files.emplace(path, actual_digest).first;
     }
+  }
 
-    if (fi.digest != hashed_files_iter->second) {
+  auto hashed_files_iter = hashed_files.find(path);
+  if (hashed_files_iter == hashed_files.end()) {
+    Hash::Digest actual_digest;
+    auto ret = hash_source_code_file(
+      ctx, actual_digest, std::string(path), fs.size);
+    if (ret.contains(HashSourceCode::error)) {
+      LOG("Failed hashing {}", path);
+      return false;
+    }
+    if (ret.contains(HashSourceCode::found_time)) {
       return false;
     }
+
+    hashed_files_iter = hashed_files.emplace(path, actual_digest).first;
   }
 
-  return true;
+  return fi.digest == hashed_files_iter->second;
 }
 
 void
-Manifest::inspect(FILE* const stream) const
+Manifest::inspect(FILE* const stream)
 {
+  materialize();
+
   PRINT(stream, "Manifest format version: {}\n", k_format_version);
 
   PRINT(stream, "File paths ({}):\n", m_files.size());
@@ -478,6 +1178,24 @@ Manifest::inspect(FILE* const stream) const
     }
     PRINT_RAW(stream, "\n");
     PRINT(stream, "    Key: {}\n", util::format_digest(m_results[i].key));
+    PRINT(stream, "    Last used: {}\n", m_results[i].last_used.sec());
+  }
+
+  const auto& nodes = trie();
+  PRINT(stream, "Decision trie nodes ({}):\n", nodes.size());
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    PRINT(stream, "  {}:\n", i);
+    if (nodes[i].file_info_index != k_no_index) {
+      PRINT(stream, "    File info index: {}\n", nodes[i].file_info_index);
+    }
+    if (nodes[i].result_index != k_no_index) {
+      PRINT(stream, "    Result index: {}\n", nodes[i].result_index);
+    }
+    PRINT_RAW(stream, "    Children:");
+    for (uint32_t child : nodes[i].children) {
+      PRINT(stream, " {}", child);
+    }
+    PRINT_RAW(stream, "\n");
   }
 }
 
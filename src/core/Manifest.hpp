@@ -1,4 +1,4 @@
-// Copyright (C) 2009-2023 Joel Rosdahl and other contributors
+// Copyright (C) 2009-2024 Joel Rosdahl and other contributors
 //
 // See doc/AUTHORS.adoc for a complete list of contributors.
 //
@@ -20,14 +20,17 @@
 
 #include <Hash.hpp>
 #include <core/Serializer.hpp>
+#include <util/Bytes.hpp>
 #include <util/TimePoint.hpp>
 
 #include <third_party/nonstd/span.hpp>
 
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -47,24 +50,56 @@ public:
     util::TimePoint ctime;
   };
 
-  using FileStater = std::function<FileStats(std::string)>;
+  using FileStater = std::function<FileStats(std::string_view)>;
 
   Manifest() = default;
 
-  void read(nonstd::span<const uint8_t> data);
+  // Read a serialized manifest. The serialized form is used as is and is only
+  // split into separate entries when the manifest is modified or inspected, so
+  // a lookup doesn't need to parse or allocate anything per entry. Indexes are
+  // checked when entries are accessed.
+  //
+  // If `data_owner` is set, it must keep `data` valid and the manifest refers
+  // to `data` instead of copying it.
+  void read(nonstd::span<const uint8_t> data,
+            std::shared_ptr<const void> data_owner = nullptr);
 
   std::optional<Hash::Digest> look_up_result_digest(const Context& ctx) const;
 
   bool add_result(
     const Hash::Digest& result_key,
-    const std::unordered_map<std::string, Hash::Digest>& included_files,
+    const std::unordered_map<std::string_view, Hash::Digest>& included_files,
     const FileStater& stat_file);
 
+  // Return a manifest containing only the result `result_key` and the include
+  // entries it refers to, e.g. to store an update as a small delta record.
+  Manifest extract(const Hash::Digest& result_key);
+
+  // Record that the result `result_key` was used at `now`. Returns true if the
+  // recorded time of last use was updated, i.e. if the manifest should be
+  // stored again. To avoid rewriting manifests on every cache hit, the time is
+  // only updated if it is older than a day.
+  bool touch(const Hash::Digest& result_key, const util::TimePoint& now);
+
+  // Return the key of the most recently added result, if any.
+  std::optional<Hash::Digest> newest_result_key() const;
+
+  struct ResultCounts
+  {
+    size_t results = 0;
+    // Results whose key is the same as the key of another result. Such a
+    // result is added when the preprocessor mode finds a result after a direct
+    // mode miss, so this is a record of preprocessor mode hits.
+    size_t reused_keys = 0;
+  };
+
+  ResultCounts count_results() const;
+
   // core::Serializer
   uint32_t serialized_size() const override;
   void serialize(util::Bytes& output) override;
 
-  void inspect(FILE* stream) const;
+  void inspect(FILE* stream);
 
 private:
   struct FileInfo
@@ -82,30 +117,72 @@ private:
 
   struct ResultEntry
   {
-    std::vector<uint32_t> file_info_indexes; // Indexes to m_file_infos.
+    std::vector<uint32_t> file_info_indexes; // Sorted indexes to m_file_infos.
     Hash::Digest key;                        // Key of the result.
+    util::TimePoint last_used;               // Time of last use.
+  };
 
-    bool operator==(const ResultEntry& other) const;
+  // Node in the decision trie over file infos. The path from the root to a
+  // node with a result consists of exactly the file infos of that result.
+  // File infos for paths that have few variants are placed closer to the root
+  // so that headers shared by many results are only checked once.
+  struct TrieNode
+  {
+    uint32_t file_info_index; // Index to m_file_infos, k_no_index for root.
+    uint32_t result_index;    // Index to m_results, or k_no_index.
+    uint32_t newest_result;   // Highest result index in the subtree.
+    std::vector<uint32_t> children; // Indexes to m_trie, newest result first.
   };
 
+  class View;
+
+  static const uint32_t k_no_index;
+
+  // Serialized form of the manifest, created lazily if m_materialized is true.
+  mutable util::Bytes m_data;
+
+  // Data passed to read() with an owner, used instead of m_data if set.
+  nonstd::span<const uint8_t> m_borrowed_data;
+  std::shared_ptr<const void> m_data_owner;
+
+  // Whether the entries below are valid. If not, data() holds the manifest.
+  bool m_materialized = true;
+
   std::vector<std::string> m_files;   // Names of referenced include files.
   std::vector<FileInfo> m_file_infos; // Info about referenced include files.
-  std::vector<ResultEntry> m_results;
+  std::vector<ResultEntry> m_results; // Results, oldest added first.
+  mutable std::vector<TrieNode> m_trie; // Built lazily, root is node 0.
+
+  nonstd::span<const uint8_t> data() const;
+  void own_data();
+  void materialize();
+  void modified();
+  void serialize_entries(util::Bytes& output) const;
+
+  bool add_result(
+    const Hash::Digest& result_key,
+    const std::unordered_map<std::string_view, Hash::Digest>& included_files,
+    const FileStater& stat_file,
+    const util::TimePoint& last_used);
+
+  void evict_least_recently_used(size_t max_results, size_t max_file_infos);
 
-  void clear();
+  const std::vector<TrieNode>& trie() const;
+  void finish_trie() const;
 
   std::optional<uint32_t> get_file_info_index(
-    const std::string& path,
+    std::string_view path,
     const Hash::Digest& digest,
-    const std::unordered_map<std::string, uint32_t>& mf_files,
+    const std::unordered_map<std::string_view, uint32_t>& mf_files,
     const std::unordered_map<FileInfo, uint32_t>& mf_file_infos,
     const FileStater& file_state);
 
-  bool result_matches(
+  bool file_info_matches(
     const Context& ctx,
-    const ResultEntry& result,
-    std::unordered_map<std::string, FileStats>& stated_files,
-    std::unordered_map<std::string, Hash::Digest>& hashed_files) const;
+    std::string_view path,
+    const FileInfo& fi,
+    std::unordered_map<std::string_view, FileStats>& stated_files,
+    std::unordered_map<std::string_view, Hash::Digest>& hashed_files) const;
 };
 
 } // namespace core
@@ -22,12 +22,14 @@
 #include "Context.hpp"
 
 #include <ccache.hpp>
+#include <core/CacheEntry.hpp>
 #include <core/CacheEntryDataReader.hpp>
 #include <core/CacheEntryDataWriter.hpp>
 #include <core/Statistic.hpp>
 #include <core/exceptions.hpp>
 #include <util/Bytes.hpp>
 #include <util/DirEntry.hpp>
+#include <util/chunking.hpp>
 #include <util/FileStream.hpp>
 #include <util/expected.hpp>
 #include <util/file.hpp>
@@ -37,6 +39,7 @@
 #include <util/path.hpp>
 #include <util/string.hpp>
 #include <util/wincompat.hpp>
+#include <util/zstd.hpp>
 
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -59,6 +62,7 @@ namespace fs = util::filesystem;
 // <format_ver>           ::= uint8_t
 // <n_files>              ::= uint8_t
 // <file_entry>           ::= <embedded_file_entry> | <raw_file_entry>
+//                            | <chunked_file_entry> | <delta_file_entry>
 // <embedded_file_entry>  ::= <embedded_file_marker> <file_type> <file_size>
 //                            <file_data>
 // <embedded_file_marker> ::= 0 (uint8_t)
@@ -68,6 +72,20 @@ namespace fs = util::filesystem;
 // <raw_file_entry>       ::= <raw_file_marker> <file_type> <file_size>
 // <raw_file_marker>      ::= 1 (uint8_t)
 // <file_size>            ::= uint64_t
+// <chunked_file_entry>   ::= <chunked_file_marker> <file_type> <file_size>
+//                            <n_chunks> <chunk>*
+// <chunked_file_marker>  ::= 2 (uint8_t)
+// <n_chunks>             ::= uint32_t
+// <chunk>                ::= <chunk_size> <chunk_digest>
+// <chunk_size>           ::= uint32_t
+// <chunk_digest>         ::= 20 bytes ; key of the chunk cache entry
+// <delta_file_entry>     ::= <delta_file_marker> <file_type> <file_size>
+//                            <base_key> <delta_depth> <delta_size> <delta_data>
+// <delta_file_marker>    ::= 3 (uint8_t)
+// <base_key>             ::= 20 bytes ; key of the result with the base file
+// <delta_depth>          ::= uint8_t ; delta chain length including this file
+// <delta_size>           ::= uint64_t
+// <delta_data>           ::= delta_size bytes ; zstd frame with base as prefix
 
 using util::DirEntry;
 
@@ -79,8 +97,27 @@ const uint8_t k_embedded_file_marker = 0;
 // File stored as-is in the file system.
 const uint8_t k_raw_file_marker = 1;
 
+// File split into chunks stored as separate cache entries.
+const uint8_t k_chunked_file_marker = 2;
+
+// File stored as a delta against the same file type in another result.
+const uint8_t k_delta_file_marker = 3;
+
 const uint8_t k_max_raw_file_entries = 10;
 
+// The delta is compressed again as part of the result cache entry, so there is
+// little point in spending more time on it.
+const int8_t k_delta_compression_level = 1;
+
+// Content-defined chunk sizes for deduplicated files. Smaller chunks find more
+// duplicates but cost more files in the cache.
+const size_t k_min_chunk_size = 8 * 1024;
+const size_t k_average_chunk_size = 32 * 1024;
+const size_t k_max_chunk_size = 128 * 1024;
+
+// Smaller files are embedded since they would consist of only a chunk or two.
+const uint64_t k_min_deduplicated_file_size = 2 * k_average_chunk_size;
+
 bool
 should_store_raw_file(const Config& config, core::Result::FileType type)
 {
@@ -107,12 +144,20 @@ should_store_raw_file(const Config& config, core::Result::FileType type)
   return type == core::Result::FileType::object;
 }
 
+bool
+should_deduplicate_file(const Config& config, uint64_t file_size)
+{
+  return config.deduplicate() && file_size >= k_min_deduplicated_file_size;
+}
+
 } // namespace
 
 namespace core::Result {
 
 const uint8_t k_format_version = 0;
 
+const uint8_t k_max_delta_chain_length = 16;
+
 const char* const k_unknown_file_type = "<unknown type>";
 
 const char*
@@ -175,6 +220,189 @@ gcno_file_in_unmangled_form(const Context& ctx)
   return fs::path(ctx.args_info.output_obj).replace_extension(".gcno").string();
 }
 
+void
+append_chunk(const ChunkRef& chunk,
+             nonstd::span<const uint8_t> cache_entry_data,
+             util::Bytes& output)
+{
+  CacheEntry cache_entry(cache_entry_data);
+  cache_entry.verify_checksum();
+  if (cache_entry.header().entry_type != CacheEntryType::chunk) {
+    throw Error(FMT("Unexpected entry type: {}",
+                    to_string(cache_entry.header().entry_type)));
+  }
+  const auto payload = cache_entry.payload();
+  if (payload.size() != chunk.size) {
+    throw Error(FMT("Bad chunk size (actual {} bytes, expected {} bytes)",
+                    payload.size(),
+                    chunk.size));
+  }
+  output.insert(output.end(), payload.begin(), payload.end());
+}
+
+util::Bytes
+read_chunks(const GetEntryFunction& get_entry,
+            const std::vector<ChunkRef>& chunks,
+            uint64_t file_size)
+{
+  util::Bytes data;
+  data.reserve(file_size);
+  for (const auto& chunk : chunks) {
+    const auto cache_entry_data =
+      get_entry(chunk.digest, CacheEntryType::chunk);
+    if (!cache_entry_data) {
+      throw Error(FMT("Missing chunk {}", util::format_digest(chunk.digest)));
+    }
+    append_chunk(chunk, *cache_entry_data, data);
+  }
+  return data;
+}
+
+namespace {
+
+util::Bytes read_file(const GetEntryFunction& get_entry,
+                      const Hash::Digest& result_key,
+                      FileType file_type,
+                      uint8_t max_delta_depth,
+                      uint8_t& delta_depth);
+
+// Reads the file of a given type from a result.
+class FileReader : public Deserializer::Visitor
+{
+public:
+  FileReader(const GetEntryFunction& get_entry,
+             FileType file_type,
+             uint8_t max_delta_depth)
+    : m_get_entry(get_entry),
+      m_file_type(file_type),
+      m_max_delta_depth(max_delta_depth)
+  {
+  }
+
+  void
+  on_embedded_file(uint8_t /*file_number*/,
+                   FileType file_type,
+                   nonstd::span<const uint8_t> data) override
+  {
+    if (file_type == m_file_type) {
+      m_data = util::Bytes(data);
+    }
+  }
+
+  void
+  on_raw_file(uint8_t /*file_number*/,
+              FileType file_type,
+              uint64_t /*file_size*/) override
+  {
+    if (file_type == m_file_type) {
+      throw Error("Cannot read raw file from result");
+    }
+  }
+
+  void
+  on_chunked_file(uint8_t /*file_number*/,
+                  FileType file_type,
+                  uint64_t file_size,
+                  const std::vector<ChunkRef>& chunks) override
+  {
+    if (file_type == m_file_type) {
+      m_data = read_chunks(m_get_entry, chunks, file_size);
+    }
+  }
+
+  void
+  on_delta_file(uint8_t /*file_number*/,
+                FileType file_type,
+                uint64_t file_size,
+                const DeltaRef& ref,
+                nonstd::span<const uint8_t> delta) override
+  {
+    if (file_type != m_file_type) {
+      return;
+    }
+    // The depth decreases along the chain, which guarantees that reading a
+    // corrupt chain terminates.
+    if (ref.depth > m_max_delta_depth) {
+      throw Error(
+        FMT("Bad delta chain depth: {} > {}", ref.depth, m_max_delta_depth));
+    }
+    m_data = apply_delta(m_get_entry, file_type, ref, delta, file_size);
+    m_delta_depth = ref.depth;
+  }
+
+  const GetEntryFunction& m_get_entry;
+  const FileType m_file_type;
+  const uint8_t m_max_delta_depth;
+  std::optional<util::Bytes> m_data;
+  uint8_t m_delta_depth = 0;
+};
+
+util::Bytes
+read_file(const GetEntryFunction& get_entry,
+          const Hash::Digest& result_key,
+          FileType file_type,
+          uint8_t max_delta_depth,
+          uint8_t& delta_depth)
+{
+  const auto cache_entry_data = get_entry(result_key, CacheEntryType::result);
+  if (!cache_entry_data) {
+    throw Error(FMT("Missing result {}", util::format_digest(result_key)));
+  }
+  CacheEntry cache_entry(*cache_entry_data);
+  cache_entry.verify_checksum();
+  if (cache_entry.header().entry_type != CacheEntryType::result) {
+    throw Error(FMT("Unexpected entry type: {}",
+                    to_string(cache_entry.header().entry_type)));
+  }
+
+  FileReader reader(get_entry, file_type, max_delta_depth);
+  Deserializer(cache_entry.payload()).visit(reader);
+  if (!reader.m_data) {
+    throw Error(FMT("No {} file in result {}",
+                    file_type_to_string(file_type),
+                    util::format_digest(result_key)));
+  }
+  delta_depth = reader.m_delta_depth;
+  return std::move(*reader.m_data);
+}
+
+} // namespace
+
+util::Bytes
+apply_delta(const GetEntryFunction& get_entry,
+            FileType file_type,
+            const DeltaRef& ref,
+            nonstd::span<const uint8_t> delta,
+            uint64_t file_size)
+{
+  if (ref.depth == 0 || ref.depth > k_max_delta_chain_length) {
+    throw Error(FMT("Bad delta chain depth: {}", ref.depth));
+  }
+  uint8_t base_depth;
+  const auto base =
+    read_file(get_entry, ref.base_key, file_type, ref.depth - 1, base_depth);
+  util::Bytes data;
+  util::throw_on_error<Error>(
+    util::zstd_decompress_delta(delta, base, data, file_size),
+    "Failed to apply delta: ");
+  if (data.size() != file_size) {
+    throw Error(FMT("Bad delta file size (actual {} bytes, expected {} bytes)",
+                    data.size(),
+                    file_size));
+  }
+  return data;
+}
+
+util::Bytes
+read_file(const GetEntryFunction& get_entry,
+          const Hash::Digest& result_key,
+          FileType file_type,
+          uint8_t& delta_depth)
+{
+  return read_file(
+    get_entry, result_key, file_type, k_max_delta_chain_length, delta_depth);
+}
+
 Deserializer::Deserializer(nonstd::span<const uint8_t> data) : m_data(data)
 {
 }
@@ -209,6 +437,8 @@ Deserializer::visit(Deserializer::Visitor& visitor) const
     switch (marker) {
     case k_embedded_file_marker:
     case k_raw_file_marker:
+    case k_chunked_file_marker:
+    case k_delta_file_marker:
       break;
 
     default:
@@ -222,9 +452,33 @@ Deserializer::visit(Deserializer::Visitor& visitor) const
     if (marker == k_embedded_file_marker) {
       visitor.on_embedded_file(
         file_number, file_type, reader.read_bytes(file_size));
-    } else {
-      ASSERT(marker == k_raw_file_marker);
+    } else if (marker == k_raw_file_marker) {
       visitor.on_raw_file(file_number, file_type, file_size);
+    } else if (marker == k_delta_file_marker) {
+      DeltaRef ref;
+      reader.read_and_copy_bytes(ref.base_key);
+      reader.read_int(ref.depth);
+      const auto delta_size = reader.read_int<uint64_t>();
+      visitor.on_delta_file(
+        file_number, file_type, file_size, ref, reader.read_bytes(delta_size));
+    } else {
+      ASSERT(marker == k_chunked_file_marker);
+      const auto n_chunks = reader.read_int<uint32_t>();
+      std::vector<ChunkRef> chunks;
+      uint64_t chunks_size = 0;
+      for (uint32_t i = 0; i < n_chunks; ++i) {
+        ChunkRef chunk;
+        reader.read_int(chunk.size);
+        reader.read_and_copy_bytes(chunk.digest);
+        chunks_size += chunk.size;
+        chunks.push_back(chunk);
+      }
+      if (chunks_size != file_size) {
+        throw Error(FMT("Bad size of chunks (actual {} bytes, expected {})",
+                        chunks_size,
+                        file_size));
+      }
+      visitor.on_chunked_file(file_number, file_type, file_size, chunks);
     }
   }
 
@@ -252,17 +506,113 @@ bool
 Serializer::add_file(const FileType file_type, const std::string& path)
 {
   m_serialized_size += 1 + 1 + 8; // marker + file_type + file_size
-  if (!should_store_raw_file(m_config, file_type)) {
-    DirEntry entry(path);
-    if (!entry.is_regular_file()) {
-      return false;
-    }
-    m_serialized_size += entry.size();
+  if (should_store_raw_file(m_config, file_type)) {
+    // A raw file is hard linked or cloned as is, so it's neither split into
+    // chunks nor stored as a delta.
+    m_file_entries.push_back(FileEntry{file_type, path});
+    return true;
   }
+
+  DirEntry entry(path);
+  if (!entry.is_regular_file()) {
+    return false;
+  }
+  if (should_deduplicate_file(m_config, entry.size())) {
+    return add_chunked_file(file_type, path, entry.size());
+  }
+  if (try_add_delta_file(file_type, path, entry.size())) {
+    return true;
+  }
+  m_serialized_size += entry.size();
   m_file_entries.push_back(FileEntry{file_type, path});
   return true;
 }
 
+bool
+Serializer::add_chunked_file(const FileType file_type,
+                             const std::string& path,
+                             uint64_t file_size)
+{
+  auto data = util::read_file<util::Bytes>(path, file_size);
+  if (!data) {
+    LOG("Failed to read {}: {}", path, data.error());
+    return false;
+  }
+
+  ChunkedFile file{std::move(*data), {}};
+  for (const auto chunk : util::split_into_chunks(
+         file.data, k_min_chunk_size, k_average_chunk_size, k_max_chunk_size)) {
+    Hash hash;
+    hash.hash(chunk);
+    file.chunks.push_back(
+      ChunkRef{hash.digest(), static_cast<uint32_t>(chunk.size())});
+  }
+
+  // n_chunks + (chunk_size + chunk_digest) * n_chunks
+  m_serialized_size +=
+    4 + (4 + sizeof(Hash::Digest)) * static_cast<uint64_t>(file.chunks.size());
+  m_file_entries.push_back(FileEntry{file_type, std::move(file)});
+  return true;
+}
+
+void
+Serializer::set_delta_base(const FileType file_type,
+                           const Hash::Digest& base_key,
+                           util::Bytes base_data,
+                           const uint8_t base_depth)
+{
+  if (base_depth >= m_config.delta_chain_length()) {
+    LOG("Not storing {} as delta since the base is at delta chain depth {}",
+        file_type_to_string(file_type),
+        base_depth);
+    return;
+  }
+  m_delta_base = DeltaBase{file_type,
+                           DeltaRef{base_key, uint8_t(base_depth + 1)},
+                           std::move(base_data)};
+}
+
+bool
+Serializer::try_add_delta_file(const FileType file_type,
+                               const std::string& path,
+                               uint64_t file_size)
+{
+  if (!m_delta_base || m_delta_base->file_type != file_type) {
+    return false;
+  }
+
+  const auto data = util::read_file<util::Bytes>(path, file_size);
+  if (!data) {
+    LOG("Failed to read {}: {}", path, data.error());
+    return false;
+  }
+
+  util::Bytes delta;
+  if (const auto result = util::zstd_compress_delta(
+        *data, m_delta_base->data, delta, k_delta_compression_level);
+      !result) {
+    LOG("Failed to compute delta for {}: {}", path, result.error());
+    return false;
+  }
+
+  // Only use the delta if the base actually helps.
+  util::Bytes compressed;
+  if (util::zstd_compress(*data, compressed, k_delta_compression_level)
+      && compressed.size() <= delta.size()) {
+    LOG("Not storing {} as delta since it's not smaller ({} >= {} bytes)",
+        path,
+        delta.size(),
+        compressed.size());
+    return false;
+  }
+
+  // base_key + delta_depth + delta_size + delta_data
+  m_serialized_size += sizeof(Hash::Digest) + 1 + 8 + delta.size();
+  m_file_entries.push_back(FileEntry{
+    file_type, DeltaFile{data->size(), m_delta_base->ref, std::move(delta)}});
+  return true;
+}
+
 uint32_t
 Serializer::serialized_size() const
 {
@@ -286,6 +636,41 @@ Serializer::serialize(util::Bytes& output)
 
   uint8_t file_number = 0;
   for (const auto& entry : m_file_entries) {
+    if (const auto* file = std::get_if<DeltaFile>(&entry.data)) {
+      LOG("Storing delta entry #{} {} ({} bytes as {} bytes, depth {})",
+          file_number,
+          file_type_to_string(entry.file_type),
+          file->file_size,
+          file->delta.size(),
+          file->ref.depth);
+      writer.write_int(k_delta_file_marker);
+      writer.write_int(UnderlyingFileTypeInt(entry.file_type));
+      writer.write_int(file->file_size);
+      writer.write_bytes(file->ref.base_key);
+      writer.write_int(file->ref.depth);
+      writer.write_int<uint64_t>(file->delta.size());
+      writer.write_bytes(file->delta);
+      ++file_number;
+      continue;
+    }
+    if (const auto* file = std::get_if<ChunkedFile>(&entry.data)) {
+      LOG("Storing chunked entry #{} {} ({} bytes in {} chunks)",
+          file_number,
+          file_type_to_string(entry.file_type),
+          file->data.size(),
+          file->chunks.size());
+      writer.write_int(k_chunked_file_marker);
+      writer.write_int(UnderlyingFileTypeInt(entry.file_type));
+      writer.write_int<uint64_t>(file->data.size());
+      writer.write_int(static_cast<uint32_t>(file->chunks.size()));
+      for (const auto& chunk : file->chunks) {
+        writer.write_int(chunk.size);
+        writer.write_bytes(chunk.digest);
+      }
+      ++file_number;
+      continue;
+    }
+
     const bool is_file_entry = std::holds_alternative<std::string>(entry.data);
     const bool store_raw =
       is_file_entry && should_store_raw_file(m_config, entry.file_type);
@@ -336,4 +721,20 @@ Serializer::get_raw_files() const
   return m_raw_files;
 }
 
+std::vector<Serializer::Chunk>
+Serializer::get_chunks() const
+{
+  std::vector<Chunk> result;
+  for (const auto& entry : m_file_entries) {
+    if (const auto* file = std::get_if<ChunkedFile>(&entry.data)) {
+      nonstd::span<const uint8_t> data = file->data;
+      for (const auto& chunk : file->chunks) {
+        result.push_back(Chunk{chunk.digest, data.first(chunk.size)});
+        data = data.subspan(chunk.size);
+      }
+    }
+  }
+  return result;
+}
+
 } // namespace core::Result
@@ -18,12 +18,17 @@
 
 #pragma once
 
+#include <Hash.hpp>
 #include <core/Serializer.hpp>
+#include <core/types.hpp>
+#include <util/Bytes.hpp>
 #include <util/types.hpp>
 
 #include <third_party/nonstd/span.hpp>
 
 #include <cstdint>
+#include <functional>
+#include <optional>
 #include <string>
 #include <variant>
 #include <vector>
@@ -39,6 +44,10 @@ namespace Result {
 
 extern const uint8_t k_format_version;
 
+// Maximum length of a delta chain. Reconstructing a delta file recurses once
+// per delta in the chain.
+extern const uint8_t k_max_delta_chain_length;
+
 extern const char* const k_unknown_file_type;
 
 using UnderlyingFileTypeInt = uint8_t;
@@ -91,6 +100,61 @@ const char* file_type_to_string(FileType type);
 std::string gcno_file_in_mangled_form(const Context& ctx);
 std::string gcno_file_in_unmangled_form(const Context& ctx);
 
+// Reference to a part of a deduplicated file. The part is stored as a separate
+// chunk cache entry keyed by the digest of its content so that identical parts
+// of different results are only stored once.
+struct ChunkRef
+{
+  Hash::Digest digest;
+  uint32_t size;
+};
+
+// Verify `cache_entry_data`, the chunk cache entry for `chunk`, and append the
+// chunk content to `output`. Throws core::Error on error, in which case
+// `output` is unchanged.
+void append_chunk(const ChunkRef& chunk,
+                  nonstd::span<const uint8_t> cache_entry_data,
+                  util::Bytes& output);
+
+// Reference to the file that a delta file was computed against, i.e. the file
+// of the same type in the result with key `base_key`. `depth` is the length of
+// the delta chain including the delta file itself.
+struct DeltaRef
+{
+  Hash::Digest base_key;
+  uint8_t depth;
+};
+
+// Return the cache entry with key `key` and type `type`, or std::nullopt if
+// missing.
+using GetEntryFunction = std::function<std::optional<util::Bytes>(
+  const Hash::Digest& key, CacheEntryType type)>;
+
+// Assemble a file of size `file_size` from `chunks`. Throws core::Error on
+// error, e.g. if a chunk is missing.
+util::Bytes read_chunks(const GetEntryFunction& get_entry,
+                        const std::vector<ChunkRef>& chunks,
+                        uint64_t file_size);
+
+// Reconstruct a file of type `file_type` and size `file_size` stored as
+// `delta` against the base referenced by `ref`. Throws core::Error on error,
+// e.g. if the base is missing.
+util::Bytes apply_delta(const GetEntryFunction& get_entry,
+                        FileType file_type,
+                        const DeltaRef& ref,
+                        nonstd::span<const uint8_t> delta,
+                        uint64_t file_size);
+
+// Read the file of type `file_type` in the result with key `result_key`,
+// reconstructing it from chunks or a delta if needed. `delta_depth` is set to
+// the length of the delta chain that the file was stored with (0 if not stored
+// as a delta). Throws core::Error on error, e.g. if the result has no such
+// file.
+util::Bytes read_file(const GetEntryFunction& get_entry,
+                      const Hash::Digest& result_key,
+                      FileType file_type,
+                      uint8_t& delta_depth);
+
 // This class knows how to deserializer a result cache entry.
 class Deserializer
 {
@@ -117,6 +181,15 @@ public:
     virtual void on_raw_file(uint8_t file_number,
                              FileType file_type,
                              uint64_t file_size) = 0;
+    virtual void on_chunked_file(uint8_t file_number,
+                                 FileType file_type,
+                                 uint64_t file_size,
+                                 const std::vector<ChunkRef>& chunks) = 0;
+    virtual void on_delta_file(uint8_t file_number,
+                               FileType file_type,
+                               uint64_t file_size,
+                               const DeltaRef& ref,
+                               nonstd::span<const uint8_t> delta) = 0;
   };
 
   // Throws core::Error on error.
@@ -162,18 +235,70 @@ public:
   // Get raw files to store in local storage.
   const std::vector<RawFile>& get_raw_files() const;
 
+  struct Chunk
+  {
+    Hash::Digest digest;
+    nonstd::span<const uint8_t> data;
+  };
+
+  // Get chunks of deduplicated files, which must be stored before the result.
+  std::vector<Chunk> get_chunks() const;
+
+  // Store a file of type `file_type` added after this call as a delta against
+  // `base_data`, the file of the same type in the result with key `base_key`
+  // stored with delta chain depth `base_depth`. This is only done if the delta
+  // chain stays within the delta_chain_length limit and the file would
+  // otherwise be embedded.
+  void set_delta_base(FileType file_type,
+                      const Hash::Digest& base_key,
+                      util::Bytes base_data,
+                      uint8_t base_depth);
+
 private:
   const Config& m_config;
   uint64_t m_serialized_size;
 
+  struct ChunkedFile
+  {
+    util::Bytes data;
+    std::vector<ChunkRef> chunks; // Consecutive parts of data.
+  };
+
+  struct DeltaBase
+  {
+    FileType file_type;
+    DeltaRef ref; // Reference to use for a delta against the base.
+    util::Bytes data;
+  };
+  std::optional<DeltaBase> m_delta_base;
+
+  struct DeltaFile
+  {
+    uint64_t file_size;
+    DeltaRef ref;
+    util::Bytes delta;
+  };
+
   struct FileEntry
   {
     FileType file_type;
-    std::variant<nonstd::span<const uint8_t>, std::string> data;
+    std::variant<nonstd::span<const uint8_t>,
+                 std::string,
+                 ChunkedFile,
+                 DeltaFile>
+      data;
   };
   std::vector<FileEntry> m_file_entries;
 
   std::vector<RawFile> m_raw_files;
+
+  bool try_add_delta_file(FileType file_type,
+                          const std::string& path,
+                          uint64_t file_size);
+
+  bool add_chunked_file(FileType file_type,
+                        const std::string& path,
+                        uint64_t file_size);
 };
 
 } // namespace Result
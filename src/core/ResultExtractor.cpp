@@ -26,6 +26,7 @@
 #include <util/expected.hpp>
 #include <util/file.hpp>
 #include <util/fmtmacros.hpp>
+#include <util/string.hpp>
 #include <util/wincompat.hpp>
 
 #include <fcntl.h>
@@ -40,9 +41,11 @@ namespace core {
 
 ResultExtractor::ResultExtractor(
   const std::string& output_directory,
-  std::optional<GetRawFilePathFunction> get_raw_file_path)
+  std::optional<GetRawFilePathFunction> get_raw_file_path,
+  std::optional<Result::GetEntryFunction> get_entry)
   : m_output_directory(output_directory),
-    m_get_raw_file_path(get_raw_file_path)
+    m_get_raw_file_path(get_raw_file_path),
+    m_get_entry(get_entry)
 {
 }
 
@@ -92,4 +95,34 @@ ResultExtractor::on_raw_file(uint8_t file_number,
   on_embedded_file(file_number, file_type, data);
 }
 
+void
+ResultExtractor::on_chunked_file(uint8_t file_number,
+                                 Result::FileType file_type,
+                                 uint64_t file_size,
+                                 const std::vector<Result::ChunkRef>& chunks)
+{
+  if (!m_get_entry) {
+    throw Error("Chunked entry for non-local result");
+  }
+  on_embedded_file(file_number,
+                   file_type,
+                   Result::read_chunks(*m_get_entry, chunks, file_size));
+}
+
+void
+ResultExtractor::on_delta_file(uint8_t file_number,
+                               Result::FileType file_type,
+                               uint64_t file_size,
+                               const Result::DeltaRef& ref,
+                               nonstd::span<const uint8_t> delta)
+{
+  if (!m_get_entry) {
+    throw Error("Delta entry for non-local result");
+  }
+  on_embedded_file(
+    file_number,
+    file_type,
+    Result::apply_delta(*m_get_entry, file_type, ref, delta, file_size));
+}
+
 } // namespace core
@@ -23,6 +23,7 @@
 #include <functional>
 #include <optional>
 #include <string>
+#include <vector>
 
 namespace core {
 
@@ -36,7 +37,8 @@ public:
   // result comes from local storage.
   ResultExtractor(
     const std::string& output_directory,
-    std::optional<GetRawFilePathFunction> get_raw_file_path = std::nullopt);
+    std::optional<GetRawFilePathFunction> get_raw_file_path = std::nullopt,
+    std::optional<Result::GetEntryFunction> get_entry = std::nullopt);
 
   void on_embedded_file(uint8_t file_number,
                         Result::FileType file_type,
@@ -44,10 +46,20 @@ public:
   void on_raw_file(uint8_t file_number,
                    Result::FileType file_type,
                    uint64_t file_size) override;
+  void on_chunked_file(uint8_t file_number,
+                       Result::FileType file_type,
+                       uint64_t file_size,
+                       const std::vector<Result::ChunkRef>& chunks) override;
+  void on_delta_file(uint8_t file_number,
+                     Result::FileType file_type,
+                     uint64_t file_size,
+                     const Result::DeltaRef& ref,
+                     nonstd::span<const uint8_t> delta) override;
 
 private:
   std::string m_output_directory;
   std::optional<GetRawFilePathFunction> m_get_raw_file_path;
+  std::optional<Result::GetEntryFunction> m_get_entry;
 };
 
 } // namespace core
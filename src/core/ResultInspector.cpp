@@ -22,6 +22,7 @@
 
 #include <util/fmtmacros.hpp>
 #include <util/logging.hpp>
+#include <util/string.hpp>
 
 namespace core {
 
@@ -60,4 +61,43 @@ ResultInspector::on_raw_file(uint8_t file_number,
         file_size);
 }
 
+void
+ResultInspector::on_chunked_file(uint8_t file_number,
+                                 Result::FileType file_type,
+                                 uint64_t file_size,
+                                 const std::vector<Result::ChunkRef>& chunks)
+{
+  PRINT(m_stream,
+        "Chunked file #{}: {} ({} bytes in {} chunks)\n",
+        file_number,
+        Result::file_type_to_string(file_type),
+        file_size,
+        chunks.size());
+  for (const auto& chunk : chunks) {
+    PRINT(m_stream,
+          "  Chunk {} ({} bytes)\n",
+          util::format_digest(chunk.digest),
+          chunk.size);
+  }
+}
+
+void
+ResultInspector::on_delta_file(uint8_t file_number,
+                               Result::FileType file_type,
+                               uint64_t file_size,
+                               const Result::DeltaRef& ref,
+                               nonstd::span<const uint8_t> delta)
+{
+  PRINT(m_stream,
+        "Delta file #{}: {} ({} bytes as {} bytes)\n",
+        file_number,
+        Result::file_type_to_string(file_type),
+        file_size,
+        delta.size());
+  PRINT(m_stream,
+        "  Base {} (depth {})\n",
+        util::format_digest(ref.base_key),
+        ref.depth);
+}
+
 } // namespace core
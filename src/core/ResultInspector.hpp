@@ -22,6 +22,7 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <vector>
 
 namespace core {
 
@@ -39,6 +40,15 @@ public:
   void on_raw_file(uint8_t file_number,
                    Result::FileType file_type,
                    uint64_t file_size) override;
+  void on_chunked_file(uint8_t file_number,
+                       Result::FileType file_type,
+                       uint64_t file_size,
+                       const std::vector<Result::ChunkRef>& chunks) override;
+  void on_delta_file(uint8_t file_number,
+                     Result::FileType file_type,
+                     uint64_t file_size,
+                     const Result::DeltaRef& ref,
+                     nonstd::span<const uint8_t> delta) override;
 
 private:
   FILE* m_stream;
@@ -22,8 +22,10 @@
 
 #include <Context.hpp>
 #include <core/MsvcShowIncludesOutput.hpp>
+#include <core/Statistic.hpp>
 #include <core/common.hpp>
 #include <core/exceptions.hpp>
+#include <util/Bytes.hpp>
 #include <util/DirEntry.hpp>
 #include <util/Fd.hpp>
 #include <util/expected.hpp>
@@ -51,7 +53,7 @@ namespace core {
 
 using Result::FileType;
 
-ResultRetriever::ResultRetriever(const Context& ctx,
+ResultRetriever::ResultRetriever(Context& ctx,
                                  std::optional<Hash::Digest> result_key)
   : m_ctx(ctx),
     m_result_key(result_key)
@@ -145,6 +147,78 @@ ResultRetriever::on_raw_file(uint8_t file_number,
   }
 }
 
+void
+ResultRetriever::on_chunked_file(uint8_t file_number,
+                                 FileType file_type,
+                                 const uint64_t file_size,
+                                 const std::vector<Result::ChunkRef>& chunks)
+{
+  LOG("Reading chunked entry #{} {} ({} bytes in {} chunks)",
+      file_number,
+      Result::file_type_to_string(file_type),
+      file_size,
+      chunks.size());
+
+  // Assemble the whole file before writing it so that a missing or corrupt
+  // chunk is detected before the destination is touched.
+  util::Bytes data;
+  data.reserve(file_size);
+  for (const auto& chunk : chunks) {
+    bool found = false;
+    m_ctx.storage.get(chunk.digest,
+                      CacheEntryType::chunk,
+                      [&](nonstd::span<const uint8_t> value) {
+                        try {
+                          Result::append_chunk(chunk, value, data);
+                          found = true;
+                        } catch (core::Error& e) {
+                          LOG("Failed to read chunk {}: {}",
+                              util::format_digest(chunk.digest),
+                              e.what());
+                        }
+                        return found;
+                      });
+    if (!found) {
+      m_ctx.storage.local.increment_statistic(Statistic::missing_chunk);
+      throw core::Error(
+        FMT("Missing chunk {}", util::format_digest(chunk.digest)));
+    }
+  }
+
+  on_embedded_file(file_number, file_type, data);
+}
+
+void
+ResultRetriever::on_delta_file(uint8_t file_number,
+                               FileType file_type,
+                               uint64_t file_size,
+                               const Result::DeltaRef& ref,
+                               nonstd::span<const uint8_t> delta)
+{
+  LOG("Reading delta entry #{} {} ({} bytes as {} bytes, base {}, depth {})",
+      file_number,
+      Result::file_type_to_string(file_type),
+      file_size,
+      delta.size(),
+      util::format_digest(ref.base_key),
+      ref.depth);
+
+  const auto get_entry =
+    [&](const Hash::Digest& key,
+        CacheEntryType type) -> std::optional<util::Bytes> {
+    std::optional<util::Bytes> value;
+    m_ctx.storage.get(key, type, [&](nonstd::span<const uint8_t> data) {
+      value = util::Bytes(data);
+      return true;
+    });
+    return value;
+  };
+  on_embedded_file(
+    file_number,
+    file_type,
+    Result::apply_delta(get_entry, file_type, ref, delta, file_size));
+}
+
 std::string
 ResultRetriever::get_dest_path(FileType file_type) const
 {
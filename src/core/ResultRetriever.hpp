@@ -23,6 +23,7 @@
 #include <core/exceptions.hpp>
 
 #include <optional>
+#include <vector>
 
 class Context;
 
@@ -39,7 +40,7 @@ public:
 
   //`path` should be the path to the local result entry file if the result comes
   // from local storage.
-  ResultRetriever(const Context& ctx,
+  ResultRetriever(Context& ctx,
                   std::optional<Hash::Digest> result_key = std::nullopt);
 
   void on_embedded_file(uint8_t file_number,
@@ -48,9 +49,18 @@ public:
   void on_raw_file(uint8_t file_number,
                    Result::FileType file_type,
                    uint64_t file_size) override;
+  void on_chunked_file(uint8_t file_number,
+                       Result::FileType file_type,
+                       uint64_t file_size,
+                       const std::vector<Result::ChunkRef>& chunks) override;
+  void on_delta_file(uint8_t file_number,
+                     Result::FileType file_type,
+                     uint64_t file_size,
+                     const Result::DeltaRef& ref,
+                     nonstd::span<const uint8_t> delta) override;
 
 private:
-  const Context& m_ctx;
+  Context& m_ctx;
   std::optional<Hash::Digest> m_result_key;
 
   std::string get_dest_path(Result::FileType file_type) const;
@@ -18,6 +18,8 @@
 
 #pragma once
 
+#include <cstddef>
+
 namespace core {
 
 // Statistics fields in storage order.
@@ -81,12 +83,34 @@ enum class Statistic {
   disabled = 81,
   bad_input_file = 82,
   modified_input_file = 83,
-  END = 84
+  compile_time_saved_ms = 84,
+  compile_cpu_time_saved_ms = 85,
+
+  // 86-232: latency histograms, k_latency_histogram_size counters each
+  hit_latency_histogram_base = 86,
+  miss_overhead_histogram_base = 107,
+  manifest_lookup_histogram_base = 128,
+  remote_get_histogram_base = 149,
+  remote_put_histogram_base = 170,
+  compression_histogram_base = 191,
+  lock_wait_histogram_base = 212,
+
+  missing_chunk = 233,
+
+  END = 234
 };
 
+// A latency histogram consists of k_latency_buckets counters followed by the
+// sum of all recorded durations in microseconds. Bucket i counts durations up
+// to 2^(i + 7) microseconds (i.e. 128 us to 33.6 s), except that the last
+// bucket has no upper bound.
+const size_t k_latency_buckets = 20;
+const size_t k_latency_histogram_size = k_latency_buckets + 1;
+
 enum class StatisticsFormat {
   Tab,
   Json,
+  OpenMetrics,
 };
 
 } // namespace core
@@ -36,6 +36,7 @@ const unsigned FLAG_NOZERO = 1U << 0;      // don't zero with --zero-stats
 const unsigned FLAG_NEVER = 1U << 1;       // don't include in --print-stats
 const unsigned FLAG_ERROR = 1U << 2;       // include in error count
 const unsigned FLAG_UNCACHEABLE = 1U << 3; // include in uncacheable count
+const unsigned FLAG_NOLOG = 1U << 4;       // don't include in stats log
 
 namespace {
 
@@ -101,9 +102,17 @@ const StatisticsField k_statistics_fields[] = {
   // cleanup operations that actually removed files are counted.
   FIELD(cleanups_performed, nullptr),
 
+  // Sum of the compiler CPU time (in milliseconds) recorded in results that
+  // were retrieved from the cache.
+  FIELD(compile_cpu_time_saved_ms, nullptr, FLAG_NOLOG),
+
   // The compilation failed. No result stored in the cache.
   FIELD(compile_failed, "Compilation failed", FLAG_UNCACHEABLE),
 
+  // Sum of the compiler wall time (in milliseconds) recorded in results that
+  // were retrieved from the cache.
+  FIELD(compile_time_saved_ms, nullptr, FLAG_NOLOG),
+
   // A compiler check program specified by compiler_check/CCACHE_COMPILERCHECK
   // failed.
   FIELD(compiler_check_failed, "Compiler check failed", FLAG_ERROR),
@@ -176,6 +185,10 @@ const StatisticsField k_statistics_fields[] = {
   // cache while another instance removed the file as part of cache cleanup.
   FIELD(missing_cache_file, "Missing cache file", FLAG_ERROR),
 
+  // A chunk of a deduplicated result file was missing from the cache, e.g.
+  // since cache cleanup removed it but not the result that refers to it.
+  FIELD(missing_chunk, "Missing deduplicated chunk", FLAG_ERROR),
+
   // An input file was modified during compilation.
   FIELD(
     modified_input_file, "Input file modified during compilation", FLAG_ERROR),
@@ -258,12 +271,58 @@ const StatisticsField k_statistics_fields[] = {
         FLAG_UNCACHEABLE),
 
   // subdir_files_base and subdir_size_kibibyte_base are intentionally omitted
-  // since they are not interesting to show.
+  // since they are not interesting to show. Latency histograms are described by
+  // k_latency_histograms below.
+};
+
+namespace {
+
+struct LatencyHistogram
+{
+  const Statistic base;
+  const char* const id;          // for --print-stats --format=openmetrics
+  const char* const description; // for --show-stats --verbose
+};
+
+} // namespace
+
+const LatencyHistogram k_latency_histograms[] = {
+  // Time from start of ccache to the result being written for cache hits.
+  {Statistic::hit_latency_histogram_base, "hit_latency", "Hit"},
+
+  // Time spent by ccache for cache misses, excluding the compiler execution.
+  {Statistic::miss_overhead_histogram_base, "miss_overhead", "Miss overhead"},
+
+  // Time spent parsing manifests and verifying their include files.
+  {Statistic::manifest_lookup_histogram_base,
+   "manifest_lookup",
+   "Manifest lookup"},
+
+  // Time spent getting an entry from a remote storage backend.
+  {Statistic::remote_get_histogram_base, "remote_get", "Remote get"},
+
+  // Time spent putting an entry in a remote storage backend.
+  {Statistic::remote_put_histogram_base, "remote_put", "Remote put"},
+
+  // Time spent serializing and compressing cache entries.
+  {Statistic::compression_histogram_base, "compression", "Compression"},
+
+  // Time spent waiting for local storage content locks.
+  {Statistic::lock_wait_histogram_base, "lock_wait", "Lock wait"},
 };
 
 static_assert(std::size(k_statistics_fields)
               == static_cast<size_t>(Statistic::END)
-                   - (/*none*/ 1 + /*subdir files*/ 16 + /*subdir size*/ 16));
+                   - (/*none*/ 1 + /*subdir files*/ 16 + /*subdir size*/ 16
+                      + std::size(k_latency_histograms)
+                          * k_latency_histogram_size));
+
+// Upper bound in microseconds of latency histogram bucket `bucket`.
+static uint64_t
+latency_bucket_bound(const size_t bucket)
+{
+  return uint64_t(1) << (bucket + 7);
+}
 
 static std::string
 format_timestamp(const util::TimePoint& value)
@@ -309,7 +368,7 @@ Statistics::get_statistics_ids() const
 {
   std::vector<std::string> result;
   for (const auto& field : k_statistics_fields) {
-    if (!(field.flags & FLAG_NOZERO)) {
+    if (!(field.flags & (FLAG_NOZERO | FLAG_NOLOG))) {
       for (size_t i = 0; i < m_counters.get(field.statistic); ++i) {
         result.emplace_back(field.id);
       }
@@ -363,11 +422,33 @@ add_ratio_row(util::TextTable& table,
   }
 }
 
+static std::string
+format_milliseconds(const uint64_t milliseconds)
+{
+  return FMT("{:.1f} s", static_cast<double>(milliseconds) / 1000);
+}
+
+static std::string
+format_microseconds(const uint64_t microseconds)
+{
+  if (microseconds < 1000) {
+    return FMT("{} us", microseconds);
+  } else if (microseconds < 1'000'000) {
+    return FMT("{:.1f} ms", static_cast<double>(microseconds) / 1000);
+  } else {
+    return FMT("{:.1f} s", static_cast<double>(microseconds) / 1'000'000);
+  }
+}
+
 std::string
-Statistics::format_human_readable(const Config& config,
-                                  const util::TimePoint& last_updated,
-                                  const uint8_t verbosity,
-                                  const bool from_log) const
+Statistics::format_human_readable(
+  const Config& config,
+  const util::TimePoint& last_updated,
+  const uint8_t verbosity,
+  const bool from_log,
+  const std::vector<std::pair<std::string, StatisticsCounters>>&
+    namespace_counters,
+  const std::optional<StatisticsCounters>& cold_tier_counters) const
 {
   util::TextTable table;
   using C = util::TextTable::Cell;
@@ -438,6 +519,28 @@ Statistics::format_human_readable(const Config& config,
     add_ratio_row(table, "  Preprocessed:", p_hits, p_hits + p_misses);
   }
 
+  const uint64_t time_saved = S(compile_time_saved_ms);
+  if (time_saved > 0 || verbosity > 1) {
+    table.add_row({"Compile time saved:",
+                   C(format_milliseconds(time_saved)).right_align()});
+    if (verbosity > 0) {
+      table.add_row({"  CPU time:",
+                     C(format_milliseconds(S(compile_cpu_time_saved_ms)))
+                       .right_align()});
+    }
+    for (const auto& [namespace_, counters] : namespace_counters) {
+      const uint64_t ns_time_saved =
+        counters.get(Statistic::compile_time_saved_ms);
+      if (ns_time_saved > 0 || verbosity > 1) {
+        table.add_row({FMT("  Namespace {}:", namespace_),
+                       C(format_milliseconds(ns_time_saved)).right_align(),
+                       "/",
+                       C(format_milliseconds(time_saved)).right_align(),
+                       percent(ns_time_saved, time_saved)});
+      }
+    }
+  }
+
   const char* size_unit =
     config.size_unit_prefix_type() == util::SizeUnitPrefixType::binary ? "GiB"
                                                                        : "GB";
@@ -463,21 +566,25 @@ Statistics::format_human_readable(const Config& config,
   if (!from_log || verbosity > 0 || (local_hits + local_misses) > 0) {
     table.add_heading("Local storage:");
   }
-  if (!from_log) {
+  const auto add_size_row = [&](uint64_t size, uint64_t max_size) {
     std::vector<C> size_cells{FMT("  Cache size ({}):", size_unit),
                               C(FMT("{:.1f}",
-                                    static_cast<double>(local_size)
+                                    static_cast<double>(size)
                                       / static_cast<double>(size_divider)))
                                 .right_align()};
-    if (config.max_size() != 0) {
+    if (max_size != 0) {
       size_cells.emplace_back("/");
       size_cells.emplace_back(C(FMT("{:.1f}",
-                                    static_cast<double>(config.max_size())
+                                    static_cast<double>(max_size)
                                       / static_cast<double>(size_divider)))
                                 .right_align());
-      size_cells.emplace_back(percent(local_size, config.max_size()));
+      size_cells.emplace_back(percent(size, max_size));
     }
     table.add_row(size_cells);
+  };
+
+  if (!from_log) {
+    add_size_row(local_size, config.max_size());
 
     if (verbosity > 0 || config.max_files() > 0) {
       std::vector<C> files_cells{"  Files:", S(files_in_cache)};
@@ -502,6 +609,69 @@ Statistics::format_human_readable(const Config& config,
     table.add_row({"  Writes:", local_writes});
   }
 
+  if (cold_tier_counters && !from_log) {
+    // Reads from and writes to the cold tier are promotions and demotions.
+    const auto& cold = *cold_tier_counters;
+    table.add_heading("Cold tier:");
+    add_size_row(cold.get(Statistic::cache_size_kibibyte) * 1024,
+                 config.cold_max_size());
+    if (verbosity > 0) {
+      table.add_row({"  Files:", cold.get(Statistic::files_in_cache)});
+    }
+    if (cold.get(Statistic::cleanups_performed) > 0 || verbosity > 1) {
+      table.add_row(
+        {"  Cleanups:", cold.get(Statistic::cleanups_performed)});
+    }
+    if (verbosity > 0) {
+      table.add_row(
+        {"  Promotions:", cold.get(Statistic::local_storage_read_hit)});
+      table.add_row({"  Demotions:", cold.get(Statistic::local_storage_write)});
+    }
+  }
+
+  if (verbosity > 0) {
+    bool heading_added = false;
+    for (const auto& histogram : k_latency_histograms) {
+      uint64_t count = 0;
+      for (size_t i = 0; i < k_latency_buckets; ++i) {
+        count += m_counters.get_offsetted(histogram.base, i);
+      }
+      if (count == 0 && verbosity < 2) {
+        continue;
+      }
+      if (!heading_added) {
+        table.add_heading("Latency (mean / 95th percentile):");
+        heading_added = true;
+      }
+      if (count == 0) {
+        table.add_row(
+          {FMT("  {}:", histogram.description), C("-").right_align()});
+        continue;
+      }
+
+      const uint64_t sum =
+        m_counters.get_offsetted(histogram.base, k_latency_buckets);
+      uint64_t cumulative = 0;
+      size_t p95_bucket = 0;
+      while (p95_bucket < k_latency_buckets - 1) {
+        cumulative += m_counters.get_offsetted(histogram.base, p95_bucket);
+        if (cumulative * 100 >= count * 95) {
+          break;
+        }
+        ++p95_bucket;
+      }
+      const auto p95 =
+        p95_bucket < k_latency_buckets - 1
+          ? FMT("<= {}", format_microseconds(latency_bucket_bound(p95_bucket)))
+          : FMT("> {}",
+                format_microseconds(latency_bucket_bound(p95_bucket - 1)));
+      table.add_row({FMT("  {}:", histogram.description),
+                     C(format_microseconds(sum / count)).right_align(),
+                     "/",
+                     C(p95).right_align()});
+    }
+  }
+
   if (verbosity > 1
       || remote_hits + remote_misses + remote_errors + remote_timeouts > 0) {
     table.add_heading("Remote storage:");
@@ -565,6 +735,9 @@ Statistics::format_machine_readable(const Config& config,
       result += FMT("{}\t{}\n", id, value);
     }
     break;
+  case StatisticsFormat::OpenMetrics:
+    result = format_openmetrics(fields);
+    break;
   default:
     ASSERT(false);
   }
@@ -572,6 +745,55 @@ Statistics::format_machine_readable(const Config& config,
   return result;
 }
 
+std::string
+Statistics::format_openmetrics(
+  const std::vector<std::pair<std::string, uint64_t>>& fields) const
+{
+  std::unordered_map<std::string, unsigned> flags;
+  for (const auto& field : k_statistics_fields) {
+    flags[field.id] = field.flags;
+  }
+
+  std::string result;
+  for (const auto& [id, value] : fields) {
+    // Counters that are not zeroed (sizes, limits and timestamps) are gauges.
+    const auto it = flags.find(id);
+    if (it != flags.end() && !(it->second & FLAG_NOZERO)
+        && id != "stats_zeroed_timestamp") {
+      result += FMT("# TYPE ccache_{} counter\n", id);
+      result += FMT("ccache_{}_total {}\n", id, value);
+    } else {
+      result += FMT("# TYPE ccache_{} gauge\n", id);
+      result += FMT("ccache_{} {}\n", id, value);
+    }
+  }
+
+  for (const auto& histogram : k_latency_histograms) {
+    const auto name = FMT("ccache_{}_seconds", histogram.id);
+    result += FMT("# TYPE {} histogram\n", name);
+    result += FMT("# UNIT {} seconds\n", name);
+    uint64_t count = 0;
+    for (size_t i = 0; i < k_latency_buckets; ++i) {
+      count += m_counters.get_offsetted(histogram.base, i);
+      const auto bound =
+        i < k_latency_buckets - 1
+          ? FMT("{}", static_cast<double>(latency_bucket_bound(i)) / 1'000'000)
+          : std::string("+Inf");
+      result += FMT("{}_bucket{{le=\"{}\"}} {}\n", name, bound, count);
+    }
+    result += FMT(
+      "{}_sum {}\n",
+      name,
+      static_cast<double>(
+        m_counters.get_offsetted(histogram.base, k_latency_buckets))
+        / 1'000'000);
+    result += FMT("{}_count {}\n", name, count);
+  }
+
+  result += "# EOF\n";
+  return result;
+}
+
 std::unordered_map<std::string, Statistic>
 Statistics::get_id_map()
 {
@@ -591,6 +813,12 @@ Statistics::get_zeroable_fields()
       result.push_back(field.statistic);
     }
   }
+  for (const auto& histogram : k_latency_histograms) {
+    for (size_t i = 0; i < k_latency_histogram_size; ++i) {
+      result.push_back(
+        static_cast<Statistic>(static_cast<size_t>(histogram.base) + i));
+    }
+  }
   return result;
 }
 
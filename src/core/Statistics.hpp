@@ -23,6 +23,7 @@
 
 #include <cstdint>
 #include <ctime>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -40,11 +41,18 @@ public:
   // Return machine-readable strings representing the statistics counters.
   std::vector<std::string> get_statistics_ids() const;
 
-  // Format cache statistics in human-readable format.
-  std::string format_human_readable(const Config& config,
-                                    const util::TimePoint& last_updated,
-                                    uint8_t verbosity,
-                                    bool from_log) const;
+  // Format cache statistics in human-readable format. `namespace_counters` are
+  // used to show compile time saved per namespace and `cold_tier_counters` to
+  // show the cold tier of local storage.
+  std::string format_human_readable(
+    const Config& config,
+    const util::TimePoint& last_updated,
+    uint8_t verbosity,
+    bool from_log,
+    const std::vector<std::pair<std::string, StatisticsCounters>>&
+      namespace_counters = {},
+    const std::optional<StatisticsCounters>& cold_tier_counters =
+      std::nullopt) const;
 
   // Format cache statistics in machine-readable format.
   std::string format_machine_readable(const Config& config,
@@ -66,6 +74,8 @@ private:
   std::vector<std::pair<std::string, uint64_t>>
   prepare_statistics_entries(const Config& config,
                              const util::TimePoint& last_updated) const;
+  std::string format_openmetrics(
+    const std::vector<std::pair<std::string, uint64_t>>& fields) const;
 };
 
 // --- Inline implementations ---
@@ -124,6 +124,20 @@ StatisticsCounters::increment_offsetted(Statistic statistic,
             value);
 }
 
+void
+StatisticsCounters::record_latency(const Statistic histogram,
+                                   const util::Duration& duration)
+{
+  const int64_t microseconds = std::max(duration.nsec() / 1000, int64_t(0));
+  size_t bucket = 0;
+  while (bucket < k_latency_buckets - 1
+         && microseconds > (int64_t(1) << (bucket + 7))) {
+    ++bucket;
+  }
+  increment_offsetted(histogram, bucket, 1);
+  increment_offsetted(histogram, k_latency_buckets, microseconds);
+}
+
 size_t
 StatisticsCounters::size() const
 {
@@ -20,6 +20,8 @@
 
 #include "Statistic.hpp"
 
+#include <util/Duration.hpp>
+
 #include <cstddef>
 #include <cstdint>
 #include <initializer_list>
@@ -48,6 +50,9 @@ public:
   void increment(const StatisticsCounters& other);
   void increment_offsetted(Statistic statistic, size_t offset, int64_t value);
 
+  // Add `duration` to the latency histogram starting at `histogram`.
+  void record_latency(Statistic histogram, const util::Duration& duration);
+
   size_t size() const;
 
   // Return true if all counters are zero, false otherwise.
@@ -20,6 +20,7 @@
 
 #include <Config.hpp>
 #include <Hash.hpp>
+#include <HeaderWatcher.hpp>
 #include <InodeCache.hpp>
 #include <ProgressBar.hpp>
 #include <Util.hpp>
@@ -141,7 +142,12 @@ Common options:
     -s, --show-stats           show summary of configuration and statistics
                                counters in human-readable format (use
                                -v/--verbose once or twice for more details)
+        --threads THREADS      use up to THREADS threads when cleaning up,
+                               evicting or scanning the cache; default: number
+                               of CPUs
     -v, --verbose              increase verbosity
+        --watch-headers        run a service that watches directories of
+                               include files for changes until interrupted
     -z, --zero-stats           zero statistics counters
 
     -h, --help                 print this help text
@@ -171,7 +177,8 @@ Options for scripting or debugging:
         --extract-result PATH  extract file data stored in result file at PATH
                                to the current working directory
         --format FORMAT        specify format for --print-log-stats and
-                               --print-stats (tab, json); default: tab
+                               --print-stats (tab, json, openmetrics);
+                               default: tab
     -k, --get-config KEY       print the value of configuration key KEY
         --hash-file PATH       print the hash (160 bit BLAKE3) of the file at
                                PATH
@@ -238,12 +245,16 @@ inspect_path(const std::string& path)
     manifest.inspect(stdout);
     break;
   }
-  case core::CacheEntryType::result:
+  case core::CacheEntryType::result: {
     Result::Deserializer result_deserializer(payload);
     ResultInspector result_inspector(stdout);
     result_deserializer.visit(result_inspector);
     break;
   }
+  case core::CacheEntryType::chunk:
+    PRINT(stdout, "Chunk size: {}\n", payload.size());
+    break;
+  }
 
   cache_entry.verify_checksum();
 
@@ -444,11 +455,13 @@ enum {
   PRINT_STATS,
   RECOMPRESS_THREADS,
   SHOW_LOG_STATS,
+  THREADS,
   TRIM_DIR,
   TRIM_MAX_SIZE,
   TRIM_METHOD,
   TRIM_RECOMPRESS,
   TRIM_RECOMPRESS_THREADS,
+  WATCH_HEADERS,
 };
 
 const char options_string[] = "cCd:k:hF:M:po:svVxX:z";
@@ -480,6 +493,7 @@ const option long_options[] = {
   {"show-config", no_argument, nullptr, 'p'},
   {"show-log-stats", no_argument, nullptr, SHOW_LOG_STATS},
   {"show-stats", no_argument, nullptr, 's'},
+  {"threads", required_argument, nullptr, THREADS},
   {"trim-dir", required_argument, nullptr, TRIM_DIR},
   {"trim-max-size", required_argument, nullptr, TRIM_MAX_SIZE},
   {"trim-method", required_argument, nullptr, TRIM_METHOD},
@@ -490,6 +504,7 @@ const option long_options[] = {
    TRIM_RECOMPRESS_THREADS},
   {"verbose", no_argument, nullptr, 'v'},
   {"version", no_argument, nullptr, 'V'},
+  {"watch-headers", no_argument, nullptr, WATCH_HEADERS},
   {"zero-stats", no_argument, nullptr, 'z'},
   {nullptr, 0, nullptr, 0}};
 
@@ -511,6 +526,7 @@ process_main_options(int argc, const char* const* argv)
   std::optional<uint64_t> evict_max_age;
 
   uint32_t recompress_threads = std::thread::hardware_concurrency();
+  uint32_t threads = std::thread::hardware_concurrency();
 
   // First pass: Handle non-command options that affect command options.
   while ((c = getopt_long(argc,
@@ -530,6 +546,8 @@ process_main_options(int argc, const char* const* argv)
         format = StatisticsFormat::Tab;
       } else if (arg == "json") {
         format = StatisticsFormat::Json;
+      } else if (arg == "openmetrics") {
+        format = StatisticsFormat::OpenMetrics;
       } else {
         PRINT(stderr, "Error: unknown format \"{}\"\n", arg);
         return EXIT_FAILURE;
@@ -546,6 +564,12 @@ process_main_options(int argc, const char* const* argv)
           arg, 1, std::numeric_limits<uint32_t>::max(), "threads")));
       break;
 
+    case THREADS:
+      threads =
+        static_cast<uint32_t>(util::value_or_throw<Error>(util::parse_unsigned(
+          arg, 1, std::numeric_limits<uint32_t>::max(), "threads")));
+      break;
+
     case TRIM_MAX_SIZE: {
       auto [size, suffix_type] =
         util::value_or_throw<Error>(util::parse_size(arg));
@@ -598,6 +622,7 @@ process_main_options(int argc, const char* const* argv)
     case 'd': // --dir
     case FORMAT:
     case RECOMPRESS_THREADS:
+    case THREADS:
     case TRIM_MAX_SIZE:
     case TRIM_METHOD:
     case TRIM_RECOMPRESS:
@@ -643,7 +668,17 @@ process_main_options(int argc, const char* const* argv)
                                                                  file_number);
         };
       }
-      ResultExtractor result_extractor(".", get_raw_file_path);
+      storage::local::LocalStorage local_storage(config);
+      const auto get_entry =
+        [&](const Hash::Digest& key,
+            core::CacheEntryType type) -> std::optional<util::Bytes> {
+        const auto value = local_storage.get(key, type);
+        if (!value) {
+          return std::nullopt;
+        }
+        return util::Bytes(value->data());
+      };
+      ResultExtractor result_extractor(".", get_raw_file_path, get_entry);
       core::CacheEntry cache_entry(*cache_entry_data);
       const auto payload = cache_entry.payload();
 
@@ -685,7 +720,7 @@ process_main_options(int argc, const char* const* argv)
     {
       ProgressBar progress_bar("Cleaning...");
       storage::local::LocalStorage(config).clean_all(
-        [&](double progress) { progress_bar.update(progress); });
+        [&](double progress) { progress_bar.update(progress); }, threads);
       if (isatty(STDOUT_FILENO)) {
         PRINT_RAW(stdout, "\n");
       }
@@ -780,12 +815,17 @@ process_main_options(int argc, const char* const* argv)
     }
 
     case 's': { // --show-stats
-      const auto [counters, last_updated] =
-        storage::local::LocalStorage(config).get_all_statistics();
+      storage::local::LocalStorage local_storage(config);
+      const auto [counters, last_updated] = local_storage.get_all_statistics();
       Statistics statistics(counters);
       PRINT_RAW(stdout,
                 statistics.format_human_readable(
-                  config, last_updated, verbosity, false));
+                  config,
+                  last_updated,
+                  verbosity,
+                  false,
+                  local_storage.get_namespace_statistics(),
+                  local_storage.get_cold_tier_statistics()));
       break;
     }
 
@@ -812,7 +852,7 @@ process_main_options(int argc, const char* const* argv)
       ProgressBar progress_bar("Scanning...");
       const auto compression_statistics =
         storage::local::LocalStorage(config).get_compression_statistics(
-          [&](double progress) { progress_bar.update(progress); });
+          [&](double progress) { progress_bar.update(progress); }, threads);
       if (isatty(STDOUT_FILENO)) {
         PRINT_RAW(stdout, "\n\n");
       }
@@ -832,6 +872,23 @@ process_main_options(int argc, const char* const* argv)
       break;
     }
 
+    case WATCH_HEADERS: {
+#ifdef INODE_CACHE_SUPPORTED
+      if (HeaderWatcher::supported()) {
+        HeaderWatcher::Service service(config);
+        service.start();
+        PRINT(stdout,
+              "Watching include directories (PID {}), press Ctrl-C to stop\n",
+              getpid());
+        service.run();
+        break;
+      }
+#endif
+      PRINT_RAW(stderr,
+                "Error: The header watcher is not supported on this system\n");
+      return EXIT_FAILURE;
+    }
+
     case 'z': // --zero-stats
       storage::local::LocalStorage(config).zero_all_statistics();
       PRINT_RAW(stdout, "Statistics zeroed\n");
@@ -851,7 +908,8 @@ process_main_options(int argc, const char* const* argv)
     storage::local::LocalStorage(config).evict(
       [&](double progress) { progress_bar.update(progress); },
       evict_max_age,
-      evict_namespace);
+      evict_namespace,
+      threads);
     if (isatty(STDOUT_FILENO)) {
       PRINT_RAW(stdout, "\n");
     }
@@ -51,6 +51,23 @@
 #  include <sys/wait.h>
 #endif
 
+#ifdef HAVE_SYS_RESOURCE_H
+#  include <sys/resource.h>
+#endif
+
+#ifdef HAVE_SPAWN_H
+#  include <spawn.h>
+#endif
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <poll.h>
+#endif
+
+#if defined(HAVE_SPAWN_H) && !defined(environ)
+extern char** environ;
+#endif
+
 namespace fs = util::filesystem;
 
 using pstr = util::PathString;
@@ -67,7 +84,8 @@ int
 execute(Context& ctx,
         const char* const* argv,
         util::Fd&& fd_out,
-        util::Fd&& fd_err)
+        util::Fd&& fd_err,
+        util::Duration* /*cpu_time*/)
 {
   LOG("Executing {}", util::format_argv_for_logging(argv));
 
@@ -79,6 +97,55 @@ execute(Context& ctx,
                       ctx.config.temporary_dir());
 }
 
+tl::expected<int, std::string>
+execute_and_capture(Context& ctx,
+                    const char* const* argv,
+                    util::Bytes* stdout_data,
+                    util::Bytes& stderr_data,
+                    util::Duration* cpu_time)
+{
+  // There are no pipes that can be polled together with process handles, so
+  // let the compiler write to temporary files instead.
+  const auto create_tmp_file = [&](std::string_view description) {
+    auto tmp_file =
+      util::value_or_throw<core::Fatal>(util::TemporaryFile::create(
+        FMT("{}/{}", ctx.config.temporary_dir(), description)));
+    ctx.register_pending_tmp_file(pstr(tmp_file.path));
+    return tmp_file;
+  };
+
+  std::optional<util::TemporaryFile> tmp_stdout;
+  util::Fd fd_out;
+  if (stdout_data) {
+    tmp_stdout = create_tmp_file("stdout");
+    fd_out = std::move(tmp_stdout->fd);
+  } else {
+    fd_out = util::Fd(open(util::get_dev_null_path(), O_WRONLY | O_BINARY));
+  }
+  auto tmp_stderr = create_tmp_file("stderr");
+
+  const int status = execute(
+    ctx, argv, std::move(fd_out), std::move(tmp_stderr.fd), cpu_time);
+
+  if (stdout_data) {
+    auto data = util::read_file<util::Bytes>(tmp_stdout->path);
+    if (!data) {
+      return tl::unexpected(FMT("Failed to read {}: {}",
+                                pstr(tmp_stdout->path).str(),
+                                data.error()));
+    }
+    *stdout_data = std::move(*data);
+  }
+  auto data = util::read_file<util::Bytes>(tmp_stderr.path);
+  if (!data) {
+    return tl::unexpected(FMT(
+      "Failed to read {}: {}", pstr(tmp_stderr.path).str(), data.error()));
+  }
+  stderr_data = std::move(*data);
+
+  return status;
+}
+
 void
 execute_noreturn(const char* const* argv, const std::string& temp_dir)
 {
@@ -291,52 +358,140 @@ win32execute(const char* path,
 
 #else
 
-// Execute a compiler backend, capturing all output to the given paths the full
-// path to the compiler to run is in argv[0].
-int
-execute(Context& ctx,
-        const char* const* argv,
-        util::Fd&& fd_out,
-        util::Fd&& fd_err)
+// Start `argv` with stdout and stderr redirected to `fd_out` and `fd_err` and
+// record the process ID in `pid`. If `own_process_group` is true, the process
+// is made the leader of a new process group. Returns false if the program could
+// not be started.
+static bool
+spawn(pid_t& pid,
+      const char* const* argv,
+      int fd_out,
+      int fd_err,
+      bool own_process_group)
 {
-  LOG("Executing {}", util::format_argv_for_logging(argv));
+#ifdef HAVE_SPAWN_H
+  // posix_spawn avoids copying the page tables of ccache's mappings into a
+  // child that is only going to call exec.
+  posix_spawn_file_actions_t file_actions;
+  posix_spawn_file_actions_init(&file_actions);
+  posix_spawn_file_actions_adddup2(&file_actions, fd_out, STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2(&file_actions, fd_err, STDERR_FILENO);
+
+  // The compiler should not inherit the signal mask set by
+  // SignalHandlerBlocker below.
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t empty_set;
+  sigemptyset(&empty_set);
+  posix_spawnattr_setsigmask(&attr, &empty_set);
+  short flags = POSIX_SPAWN_SETSIGMASK;
+  if (own_process_group) {
+    posix_spawnattr_setpgroup(&attr, 0);
+    flags |= POSIX_SPAWN_SETPGROUP;
+  }
+  posix_spawnattr_setflags(&attr, flags);
 
+  int result;
   {
     SignalHandlerBlocker signal_handler_blocker;
-    ctx.compiler_pid = fork();
+    pid_t child_pid;
+    result = posix_spawn(&child_pid,
+                         argv[0],
+                         &file_actions,
+                         &attr,
+                         const_cast<char* const*>(argv),
+                         environ);
+    pid = result == 0 ? child_pid : 0;
   }
 
-  if (ctx.compiler_pid == -1) {
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&file_actions);
+
+  if (result != 0) {
+    LOG("Failed to execute {}: {}", argv[0], strerror(result));
+    return false;
+  }
+#else
+  {
+    SignalHandlerBlocker signal_handler_blocker;
+    pid = fork();
+  }
+
+  if (pid == -1) {
     throw core::Fatal(FMT("Failed to fork: {}", strerror(errno)));
   }
 
-  if (ctx.compiler_pid == 0) {
+  if (pid == 0) {
     // Child.
-    dup2(*fd_out, STDOUT_FILENO);
-    fd_out.close();
-    dup2(*fd_err, STDERR_FILENO);
-    fd_err.close();
+    if (own_process_group) {
+      setpgid(0, 0);
+    }
+    dup2(fd_out, STDOUT_FILENO);
+    dup2(fd_err, STDERR_FILENO);
     exit(execv(argv[0], const_cast<char* const*>(argv)));
   }
+#endif
+  return true;
+}
 
-  fd_out.close();
-  fd_err.close();
+// Exit status of a compiler that could not be started, the same as for a child
+// process whose exec call failed.
+const int k_spawn_failure_status = 255;
 
+// How often to check whether a compiler whose output is being captured has
+// exited while a process started by it still has the output pipes open.
+const int k_exit_check_interval_ms = 10;
+
+// Reap the process `pid` and set `pid` to 0. If `block` is false, return
+// std::nullopt without waiting if the process is still running. Returns the
+// status from waitpid(2).
+static std::optional<int>
+reap_process(pid_t& pid, bool block, util::Duration* cpu_time)
+{
   int status;
   int result;
+  const int options = block ? 0 : WNOHANG;
 
-  while ((result = waitpid(ctx.compiler_pid, &status, 0)) != ctx.compiler_pid) {
+#if defined(HAVE_WAIT4) && defined(HAVE_SYS_RESOURCE_H)
+  struct rusage usage;
+  while ((result = wait4(pid, &status, options, &usage)) != pid) {
+    if (result == 0) {
+      return std::nullopt;
+    }
+    if (result == -1 && errno == EINTR) {
+      continue;
+    }
+    throw core::Fatal(FMT("wait4 failed: {}", strerror(errno)));
+  }
+  if (cpu_time) {
+    *cpu_time =
+      util::Duration(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec,
+                     1000 * (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec));
+  }
+#else
+  while ((result = waitpid(pid, &status, options)) != pid) {
+    if (result == 0) {
+      return std::nullopt;
+    }
     if (result == -1 && errno == EINTR) {
       continue;
     }
     throw core::Fatal(FMT("waitpid failed: {}", strerror(errno)));
   }
+  (void)cpu_time;
+#endif
 
   {
     SignalHandlerBlocker signal_handler_blocker;
-    ctx.compiler_pid = 0;
+    pid = 0;
   }
 
+  return status;
+}
+
+static int
+exit_status(int status)
+{
   if (WEXITSTATUS(status) == 0 && WIFSIGNALED(status)) {
     return -1;
   }
@@ -344,6 +499,148 @@ execute(Context& ctx,
   return WEXITSTATUS(status);
 }
 
+int
+wait_for_process(pid_t& pid, util::Duration* cpu_time)
+{
+  return exit_status(*reap_process(pid, true, cpu_time));
+}
+
+// Create a pipe whose file descriptors are not inherited by the compiler.
+static void
+create_pipe(util::Fd& read_fd, util::Fd& write_fd)
+{
+  int fds[2];
+  if (pipe(fds) != 0) {
+    throw core::Fatal(FMT("Failed to create pipe: {}", strerror(errno)));
+  }
+  read_fd = util::Fd(fds[0]);
+  write_fd = util::Fd(fds[1]);
+  util::set_cloexec_flag(fds[0]);
+  util::set_cloexec_flag(fds[1]);
+}
+
+// Execute a compiler backend, capturing all output to the given paths the full
+// path to the compiler to run is in argv[0].
+int
+execute(Context& ctx,
+        const char* const* argv,
+        util::Fd&& fd_out,
+        util::Fd&& fd_err,
+        util::Duration* cpu_time)
+{
+  LOG("Executing {}", util::format_argv_for_logging(argv));
+
+  if (!spawn(ctx.compiler_pid, argv, *fd_out, *fd_err, false)) {
+    return k_spawn_failure_status;
+  }
+  fd_out.close();
+  fd_err.close();
+
+  return wait_for_process(ctx.compiler_pid, cpu_time);
+}
+
+bool
+execute_async(pid_t& pid,
+              const char* const* argv,
+              util::Fd&& fd_out,
+              util::Fd&& fd_err)
+{
+  LOG("Executing {} in the background", util::format_argv_for_logging(argv));
+
+  return spawn(pid, argv, *fd_out, *fd_err, true);
+}
+
+tl::expected<int, std::string>
+execute_and_capture(Context& ctx,
+                    const char* const* argv,
+                    util::Bytes* stdout_data,
+                    util::Bytes& stderr_data,
+                    util::Duration* cpu_time)
+{
+  LOG("Executing {}", util::format_argv_for_logging(argv));
+
+  util::Fd stdout_read_fd;
+  util::Fd stdout_write_fd;
+  if (stdout_data) {
+    create_pipe(stdout_read_fd, stdout_write_fd);
+  } else {
+    stdout_write_fd = util::Fd(open(util::get_dev_null_path(), O_WRONLY));
+  }
+  util::Fd stderr_read_fd;
+  util::Fd stderr_write_fd;
+  create_pipe(stderr_read_fd, stderr_write_fd);
+
+  if (!spawn(
+        ctx.compiler_pid, argv, *stdout_write_fd, *stderr_write_fd, false)) {
+    return k_spawn_failure_status;
+  }
+  stdout_write_fd.close();
+  stderr_write_fd.close();
+
+  // Drain both pipes until the compiler has closed them or has exited. Reading
+  // them in turn would deadlock if the compiler fills one pipe while we wait
+  // for the other. A process started by the compiler, e.g. a compiler server,
+  // may inherit the pipes and keep them open, so poll with a timeout and check
+  // whether the compiler itself has exited.
+  struct pollfd poll_fds[2] = {{stdout_read_fd.get(), POLLIN, 0},
+                               {stderr_read_fd.get(), POLLIN, 0}};
+  util::Bytes* buffers[2] = {stdout_data, &stderr_data};
+  size_t open_fds = stdout_data ? 2 : 1;
+  uint8_t chunk[64 * 1024];
+  // Read from pipe `i` and stop polling it on EOF or error. Returns whether
+  // there may be more data to read right away.
+  const auto read_chunk = [&](size_t i) {
+    const auto n = read(poll_fds[i].fd, chunk, sizeof(chunk));
+    if (n > 0) {
+      buffers[i]->insert(buffers[i]->end(), chunk, static_cast<size_t>(n));
+      return true;
+    }
+    if (n == 0 || errno != EINTR) {
+      // Negative file descriptors are ignored by poll.
+      poll_fds[i].fd = -1;
+      --open_fds;
+    }
+    return n < 0 && errno == EINTR;
+  };
+
+  std::optional<int> status;
+  while (open_fds > 0) {
+    if (poll(poll_fds, 2, k_exit_check_interval_ms) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw core::Fatal(FMT("poll failed: {}", strerror(errno)));
+    }
+    for (size_t i = 0; i < 2; ++i) {
+      if (poll_fds[i].fd != -1 && poll_fds[i].revents != 0) {
+        read_chunk(i);
+      }
+    }
+    if (open_fds > 0) {
+      status = reap_process(ctx.compiler_pid, false, cpu_time);
+      if (status) {
+        break;
+      }
+    }
+  }
+
+  if (!status) {
+    return wait_for_process(ctx.compiler_pid, cpu_time);
+  }
+
+  // The compiler has exited, so all its output is in the pipes. Read what is
+  // left without waiting for other processes that keep the pipes open.
+  for (size_t i = 0; i < 2; ++i) {
+    if (poll_fds[i].fd == -1) {
+      continue;
+    }
+    fcntl(poll_fds[i].fd, F_SETFL, fcntl(poll_fds[i].fd, F_GETFL) | O_NONBLOCK);
+    while (poll_fds[i].fd != -1 && read_chunk(i)) {
+    }
+  }
+  return exit_status(*status);
+}
+
 void
 execute_noreturn(const char* const* argv, const std::string& /*temp_dir*/)
 {
@@ -18,6 +18,9 @@
 
 #pragma once
 
+#include <third_party/tl/expected.hpp>
+#include <util/Bytes.hpp>
+#include <util/Duration.hpp>
 #include <util/Fd.hpp>
 
 #include <filesystem>
@@ -26,10 +29,42 @@
 
 class Context;
 
+// Execute `argv`, redirecting stdout and stderr to `fd_out` and `fd_err`. If
+// `cpu_time` is non-null, it is set to the user + system CPU time consumed by
+// the process, if known.
 int execute(Context& ctx,
             const char* const* argv,
             util::Fd&& fd_out,
-            util::Fd&& fd_err);
+            util::Fd&& fd_err,
+            util::Duration* cpu_time = nullptr);
+
+// Like execute() but capture stdout and stderr in `stdout_data` and
+// `stderr_data`. If `stdout_data` is null, stdout is discarded. Output written
+// after the process has exited, e.g. by a server that it started, is not
+// captured. Returns the exit status or an error message if the output could not
+// be captured.
+tl::expected<int, std::string>
+execute_and_capture(Context& ctx,
+                    const char* const* argv,
+                    util::Bytes* stdout_data,
+                    util::Bytes& stderr_data,
+                    util::Duration* cpu_time = nullptr);
+
+#ifndef _WIN32
+// Start `argv` as the leader of a new process group with stdout and stderr
+// redirected to `fd_out` and `fd_err`, without waiting for it to finish. `pid`
+// is set to the process ID with signals blocked so that the signal handler can
+// rely on it. Returns false if the program could not be started.
+bool execute_async(pid_t& pid,
+                   const char* const* argv,
+                   util::Fd&& fd_out,
+                   util::Fd&& fd_err);
+
+// Wait for the process `pid` and set `pid` to 0. Returns the exit status, or -1
+// if the process was killed by a signal. If `cpu_time` is non-null, it is set
+// to the user + system CPU time consumed by the process, if known.
+int wait_for_process(pid_t& pid, util::Duration* cpu_time = nullptr);
+#endif
 
 void execute_noreturn(const char* const* argv, const std::string& temp_dir);
 
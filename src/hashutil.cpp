@@ -27,6 +27,7 @@
 #include <core/exceptions.hpp>
 #include <util/DirEntry.hpp>
 #include <util/file.hpp>
+#include <util/filesystem.hpp>
 #include <util/fmtmacros.hpp>
 #include <util/logging.hpp>
 #include <util/string.hpp>
@@ -51,6 +52,8 @@
 #  include <immintrin.h>
 #endif
 
+namespace fs = util::filesystem;
+
 namespace {
 
 // Pre-condition: str[pos - 1] == '_'
@@ -86,8 +89,10 @@ check_for_temporal_macros_helper(std::string_view str, size_t pos)
   return HashSourceCode::ok;
 }
 
+} // namespace
+
 HashSourceCodeResult
-check_for_temporal_macros_bmh(std::string_view str, size_t start = 0)
+check_for_temporal_macros_bmh(std::string_view str, size_t start)
 {
   HashSourceCodeResult result;
 
@@ -173,6 +178,8 @@ check_for_temporal_macros_avx2(std::string_view str)
 }
 #endif
 
+namespace {
+
 HashSourceCodeResult
 do_hash_file(const Context& ctx,
              Hash::Digest& digest,
@@ -217,8 +224,120 @@ do_hash_file(const Context& ctx,
   return result;
 }
 
+#ifdef INODE_CACHE_SUPPORTED
+
+InodeCache::ContentType
+source_code_content_type(const Context& ctx)
+{
+  return ctx.config.sloppiness().contains(core::Sloppy::time_macros)
+           ? InodeCache::ContentType::raw
+           : InodeCache::ContentType::checked_for_temporal_macros;
+}
+
+// Relative paths are relative to the working directory of the compilation,
+// which may differ between compilations.
+std::string
+absolute_path(const Context& ctx, std::string_view path)
+{
+  return fs::path(path).is_absolute() ? std::string(path)
+                                      : FMT("{}/{}", ctx.actual_cwd, path);
+}
+
+#endif
+
+// A digest of a file recorded in a verification session can be trusted without
+// accessing the file for the rest of the session. The session is either the
+// build session, if configured, or the header watcher's current state of the
+// file's directory. If the watcher could not be synchronized with, a change may
+// not have been processed yet, so the file's mtime, ctime and size are then
+// part of the session.
+struct VerificationSession
+{
+  std::string session;
+  std::string path;
+  bool watched = false;
+};
+
+std::optional<VerificationSession>
+get_verification_session(const Context& ctx, std::string_view path)
+{
+#ifdef INODE_CACHE_SUPPORTED
+  if (!ctx.config.inode_cache()) {
+    return std::nullopt;
+  }
+  auto abs_path = absolute_path(ctx, path);
+  if (!ctx.config.build_session().empty()) {
+    return VerificationSession{
+      FMT("build {}", ctx.config.build_session()), std::move(abs_path)};
+  }
+  const auto dir = std::string_view(abs_path).substr(
+    0, std::max(abs_path.rfind('/'), size_t(1)));
+  if (const auto state = ctx.header_watcher.get_directory_state(dir)) {
+    if (ctx.header_watcher.is_synchronized()) {
+      return VerificationSession{
+        FMT("watch {}", *state), std::move(abs_path), true};
+    }
+    const util::DirEntry entry(abs_path);
+    if (!entry.is_regular_file()) {
+      return std::nullopt;
+    }
+    return VerificationSession{FMT("watch {} {} {} {}",
+                                   *state,
+                                   entry.mtime().nsec(),
+                                   entry.ctime().nsec(),
+                                   entry.size()),
+                               std::move(abs_path),
+                               true};
+  }
+#else
+  (void)ctx;
+  (void)path;
+#endif
+  return std::nullopt;
+}
+
+std::optional<Hash::Digest>
+get_verified_digest(const Context& ctx, const VerificationSession& session)
+{
+#ifdef INODE_CACHE_SUPPORTED
+  return ctx.inode_cache.get_session_digest(
+    session.session, session.path, source_code_content_type(ctx));
+#else
+  (void)ctx;
+  (void)session;
+  return std::nullopt;
+#endif
+}
+
+void
+put_verified_digest(const Context& ctx,
+                    const VerificationSession& session,
+                    const Hash::Digest& digest)
+{
+#ifdef INODE_CACHE_SUPPORTED
+  // Changes to the target of a symlink in another directory are not seen by
+  // the header watcher.
+  if (session.watched && util::DirEntry(session.path).is_symlink()) {
+    return;
+  }
+  ctx.inode_cache.put_session_digest(
+    session.session, session.path, source_code_content_type(ctx), digest);
+#else
+  (void)ctx;
+  (void)session;
+  (void)digest;
+#endif
+}
+
 } // namespace
 
+std::optional<Hash::Digest>
+get_verified_digest(const Context& ctx, std::string_view path)
+{
+  const auto session = get_verification_session(ctx, path);
+  return session ? get_verified_digest(ctx, *session) : std::nullopt;
+}
+
 HashSourceCodeResult
 check_for_temporal_macros(std::string_view str)
 {
@@ -236,11 +355,27 @@ hash_source_code_file(const Context& ctx,
                       const std::string& path,
                       size_t size_hint)
 {
+  // Note: The session must be determined before hashing so that a change
+  // during hashing is not recorded as verified in the new session.
+  const auto session = get_verification_session(ctx, path);
+  if (session) {
+    if (const auto verified_digest = get_verified_digest(ctx, *session)) {
+      digest = *verified_digest;
+      return HashSourceCodeResult();
+    }
+  }
+
   const bool check_temporal_macros =
     !ctx.config.sloppiness().contains(core::Sloppy::time_macros);
   auto result =
     do_hash_file(ctx, digest, path, size_hint, check_temporal_macros);
 
+  if (session && result.empty()) {
+    // Files with temporal macros are never recorded since their digests may
+    // change during the session.
+    put_verified_digest(ctx, *session, digest);
+  }
+
   if (!check_temporal_macros || result.empty()
       || result.contains(HashSourceCode::error)) {
     return result;
@@ -22,6 +22,7 @@
 #include <util/BitSet.hpp>
 
 #include <cstddef>
+#include <optional>
 #include <string>
 #include <string_view>
 
@@ -41,12 +42,26 @@ using HashSourceCodeResult = util::BitSet<HashSourceCode>;
 // Search for tokens (described in HashSourceCode) in `str`.
 HashSourceCodeResult check_for_temporal_macros(std::string_view str);
 
+// The implementations that check_for_temporal_macros chooses between, exposed
+// for benchmarking. check_for_temporal_macros_avx2 is only defined if HAVE_AVX2
+// is defined and must only be called if the CPU supports AVX2.
+HashSourceCodeResult check_for_temporal_macros_bmh(std::string_view str,
+                                                   size_t start = 0);
+HashSourceCodeResult check_for_temporal_macros_avx2(std::string_view str);
+
 // Hash a source code file using the inode cache if enabled.
 HashSourceCodeResult hash_source_code_file(const Context& ctx,
                                            Hash::Digest& digest,
                                            const std::string& path,
                                            size_t size_hint = 0);
 
+// Get the digest that hash_source_code_file computed for `path` earlier in the
+// build session (see Config::build_session) or, if a header watcher is running,
+// since the file's directory last changed. The file is not accessed unless the
+// header watcher could not be synchronized with.
+std::optional<Hash::Digest> get_verified_digest(const Context& ctx,
+                                                std::string_view path);
+
 // Hash a binary file (using the inode cache if enabled) and put its digest in
 // `digest`
 //
@@ -24,6 +24,7 @@
 #include <core/CacheEntry.hpp>
 #include <core/Statistic.hpp>
 #include <core/exceptions.hpp>
+#include <core/types.hpp>
 #include <storage/remote/FileStorage.hpp>
 #include <storage/remote/HttpStorage.hpp>
 #include <util/assertions.hpp>
@@ -33,6 +34,8 @@
 #  include <storage/remote/RedisStorage.hpp>
 #endif
 #include <util/Bytes.hpp>
+#include <util/Duration.hpp>
+#include <util/MemoryMap.hpp>
 #include <util/Timer.hpp>
 #include <util/Tokenizer.hpp>
 #include <util/XXH3_64.hpp>
@@ -243,6 +246,21 @@ get_storage(const std::string& scheme)
   }
 }
 
+// Return the cache entry `value` with its payload stored with
+// `compression_type`.
+static util::Bytes
+with_compression_type(nonstd::span<const uint8_t> value,
+                      const core::CompressionType compression_type,
+                      const int8_t compression_level)
+{
+  core::CacheEntry cache_entry(value);
+  cache_entry.verify_checksum();
+  core::CacheEntry::Header header(cache_entry.header());
+  header.compression_type = compression_type;
+  header.compression_level = compression_level;
+  return core::CacheEntry::serialize(header, cache_entry.payload());
+}
+
 Storage::Storage(const Config& config) : local(config), m_config(config)
 {
 }
@@ -267,6 +285,19 @@ void
 Storage::get(const Hash::Hash::Digest& key,
              const core::CacheEntryType type,
              const EntryReceiver& entry_receiver)
+{
+  get(key,
+      type,
+      [&](nonstd::span<const uint8_t> data,
+          const std::shared_ptr<const void>& /*data_owner*/) {
+        return entry_receiver(data);
+      });
+}
+
+void
+Storage::get(const Hash::Digest& key,
+             const core::CacheEntryType type,
+             const SharedEntryReceiver& entry_receiver)
 {
   MTR_SCOPE("storage", "get");
 
@@ -274,33 +305,59 @@ Storage::get(const Hash::Hash::Digest& key,
     auto value = local.get(key, type);
     if (value) {
       if (m_config.reshare()) {
-        put_in_remote_storage(key, *value, true);
+        put_in_remote_storage(key, value->data(), true);
       }
-      if (entry_receiver(std::move(*value))) {
+      const auto mapping =
+        std::make_shared<const util::MemoryMap>(std::move(*value));
+      if (entry_receiver(mapping->data(), mapping)) {
         return;
       }
     }
   }
 
-  get_from_remote_storage(key, type, [&](util::Bytes&& data) {
-    if (!m_config.remote_only()) {
-      local.put(key, type, data, true);
-    }
-    return entry_receiver(std::move(data));
-  });
+  get_from_remote_storage(
+    key,
+    type,
+    [&](nonstd::span<const uint8_t> data,
+        const std::shared_ptr<const void>& data_owner) {
+      if (!m_config.remote_only()) {
+        // Manifests are compressed in remote storage (see
+        // put_in_remote_storage) but stored uncompressed locally so that they
+        // can be read in place.
+        util::Bytes uncompressed_data;
+        nonstd::span<const uint8_t> local_data = data;
+        if (type == core::CacheEntryType::manifest) {
+          try {
+            const core::CacheEntry::Header header(data);
+            if (header.compression_type != core::CompressionType::none) {
+              uncompressed_data = with_compression_type(
+                data, core::CompressionType::none, header.compression_level);
+              local_data = uncompressed_data;
+            }
+          } catch (const core::Error& e) {
+            LOG("Failed to decompress manifest {}: {}",
+                util::format_digest(key),
+                e.what());
+          }
+        }
+        local.put(key, type, local_data, true);
+      }
+      return entry_receiver(data, data_owner);
+    });
 }
 
 void
 Storage::put(const Hash::Digest& key,
              const core::CacheEntryType type,
-             nonstd::span<const uint8_t> value)
+             nonstd::span<const uint8_t> value,
+             bool only_if_missing)
 {
   MTR_SCOPE("storage", "put");
 
   if (!m_config.remote_only()) {
-    local.put(key, type, value);
+    local.put(key, type, value, only_if_missing);
   }
-  put_in_remote_storage(key, value, false);
+  put_in_remote_storage(key, value, only_if_missing);
 }
 
 void
@@ -462,7 +519,7 @@ Storage::get_backend(RemoteStorageEntry& entry,
 void
 Storage::get_from_remote_storage(const Hash::Digest& key,
                                  const core::CacheEntryType type,
-                                 const EntryReceiver& entry_receiver)
+                                 const SharedEntryReceiver& entry_receiver)
 {
   MTR_SCOPE("remote_storage", "get");
 
@@ -475,6 +532,8 @@ Storage::get_from_remote_storage(const Hash::Digest& key,
     Timer timer;
     auto result = backend->impl->get(key);
     const auto ms = timer.measure_ms();
+    local.record_latency(core::Statistic::remote_get_histogram_base,
+                         util::Duration(0, static_cast<int64_t>(ms * 1e6)));
     if (!result) {
       mark_backend_as_failed(*backend, result.error());
       continue;
@@ -490,7 +549,8 @@ Storage::get_from_remote_storage(const Hash::Digest& key,
       if (type == core::CacheEntryType::result) {
         local.increment_statistic(core::Statistic::remote_storage_hit);
       }
-      if (entry_receiver(std::move(*value))) {
+      const auto data = std::make_shared<const util::Bytes>(std::move(*value));
+      if (entry_receiver(*data, data)) {
         return;
       }
     } else {
@@ -510,12 +570,35 @@ Storage::put_in_remote_storage(const Hash::Digest& key,
 {
   MTR_SCOPE("remote_storage", "put");
 
-  if (!core::CacheEntry::Header(value).self_contained) {
+  const core::CacheEntry::Header header(value);
+  if (!header.self_contained) {
     LOG("Not putting {} in remote storage since it's not self-contained",
         util::format_digest(key));
     return;
   }
 
+  // Manifests are stored uncompressed locally so that they can be read in
+  // place, but there is no such benefit for remote storage.
+  util::Bytes compressed_value;
+  if (!m_remote_storages.empty()
+      && header.entry_type == core::CacheEntryType::manifest
+      && header.compression_type == core::CompressionType::none
+      && core::compression_type_from_config(m_config)
+           != core::CompressionType::none) {
+    try {
+      compressed_value = with_compression_type(
+        value,
+        core::compression_type_from_config(m_config),
+        core::compression_level_from_config(m_config));
+      value = compressed_value;
+    } catch (const core::Error& e) {
+      LOG("Failed to compress manifest {}: {}",
+          util::format_digest(key),
+          e.what());
+      return;
+    }
+  }
+
   for (const auto& entry : m_remote_storages) {
     auto backend = get_backend(*entry, key, "putting in", true);
     if (!backend) {
@@ -525,6 +608,8 @@ Storage::put_in_remote_storage(const Hash::Digest& key,
     Timer timer;
     const auto result = backend->impl->put(key, value, only_if_missing);
     const auto ms = timer.measure_ms();
+    local.record_latency(core::Statistic::remote_put_histogram_base,
+                         util::Duration(0, static_cast<int64_t>(ms * 1e6)));
     if (!result) {
       // The backend is expected to log details about the error.
       mark_backend_as_failed(*backend, result.error());
@@ -53,18 +53,35 @@ public:
 
   local::LocalStorage local;
 
-  using EntryReceiver = std::function<bool(util::Bytes&&)>;
+  // The data passed to an EntryReceiver is only valid during the call. The
+  // receiver returns true if the entry was accepted, otherwise the entry is
+  // looked up in the next storage.
+  using EntryReceiver = std::function<bool(nonstd::span<const uint8_t>)>;
+
+  // Like EntryReceiver, but also receives an object that keeps the data valid
+  // for as long as a reference to it is kept.
+  using SharedEntryReceiver = std::function<bool(
+    nonstd::span<const uint8_t>, const std::shared_ptr<const void>&)>;
 
   void get(const Hash::Digest& key,
            core::CacheEntryType type,
            const EntryReceiver& entry_receiver);
 
+  void get(const Hash::Digest& key,
+           core::CacheEntryType type,
+           const SharedEntryReceiver& entry_receiver);
+
   void put(const Hash::Digest& key,
            core::CacheEntryType type,
-           nonstd::span<const uint8_t> value);
+           nonstd::span<const uint8_t> value,
+           bool only_if_missing = false);
 
   void remove(const Hash::Digest& key, core::CacheEntryType type);
 
+  void put_in_remote_storage(const Hash::Digest& key,
+                             nonstd::span<const uint8_t> value,
+                             bool only_if_missing);
+
   bool has_remote_storage() const;
   std::string get_remote_storage_config_for_logging() const;
 
@@ -84,11 +101,7 @@ private:
 
   void get_from_remote_storage(const Hash::Digest& key,
                                core::CacheEntryType type,
-                               const EntryReceiver& entry_receiver);
-
-  void put_in_remote_storage(const Hash::Digest& key,
-                             nonstd::span<const uint8_t> value,
-                             bool only_if_missing);
+                               const SharedEntryReceiver& entry_receiver);
 
   void remove_from_remote_storage(const Hash::Digest& key);
 };
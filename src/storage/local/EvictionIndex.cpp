@@ -0,0 +1,366 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "EvictionIndex.hpp"
+
+#include <core/AtomicFile.hpp>
+#include <core/exceptions.hpp>
+#include <util/FileStream.hpp>
+#include <util/PathString.hpp>
+#include <util/fmtmacros.hpp>
+#include <util/logging.hpp>
+#include <util/string.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+
+using util::DirEntry;
+
+using pstr = util::PathString;
+
+namespace storage::local {
+
+// Raw files ("<prefix><number>W") share the entry of their result file
+// ("<prefix>R").
+static std::string
+group_name(std::string name)
+{
+  if (name.length() >= 2 && name.back() == 'W') {
+    name.resize(name.length() - 2);
+    name += 'R';
+  }
+  return name;
+}
+
+// Only result, manifest and chunk files (and raw files via their result) are
+// indexed, not temporary files or other unknown files.
+static bool
+is_indexed(std::string_view name)
+{
+  return util::ends_with(name, "R") || util::ends_with(name, "M")
+         || util::ends_with(name, "C");
+}
+
+EvictionIndex::EvictionIndex(const std::string& l2_dir)
+  : m_l2_dir(l2_dir),
+    m_path(FMT("{}/{}", l2_dir, k_filename))
+{
+}
+
+void
+EvictionIndex::record_insertion(const std::string& l2_dir,
+                                std::string_view name,
+                                uint64_t cost_ms)
+{
+  const auto path = FMT("{}/{}", l2_dir, k_filename);
+  util::FileStream file(path, "ab");
+  if (!file) {
+    LOG("Failed to open {}: {}", path, strerror(errno));
+    return;
+  }
+  PRINT(*file, "i {} {}\n", name, cost_ms);
+}
+
+void
+EvictionIndex::record_hit(const std::string& l2_dir, std::string_view name)
+{
+  const auto path = FMT("{}/{}", l2_dir, k_filename);
+  util::FileStream file(path, "ab");
+  if (!file) {
+    LOG("Failed to open {}: {}", path, strerror(errno));
+    return;
+  }
+  PRINT(*file, "h {}\n", name);
+}
+
+void
+EvictionIndex::load()
+{
+  std::ifstream in(m_path);
+  std::string line;
+  while (std::getline(in, line, '\n')) {
+    const auto fields = util::split_into_strings(line, " ");
+    if (fields.empty()) {
+      continue;
+    }
+
+    const auto& type = fields[0];
+    if (type == "i" && fields.size() == 3) {
+      // Reinserting a recently evicted entry means that the ARC list it was
+      // evicted from was too small. An entry that comes back is also
+      // considered frequently used.
+      for (int i = 0; i < 2; ++i) {
+        if (m_ghost_set[i].count(fields[1]) > 0) {
+          adapt_arc_target(i);
+          m_ghost_set[i].erase(fields[1]);
+          ++m_entries[fields[1]].hits;
+        }
+      }
+      auto& entry = m_entries[fields[1]];
+      entry.cost_ms = util::parse_unsigned(fields[2]).value_or(0);
+      entry.touched = true;
+    } else if (type == "h" && fields.size() == 2) {
+      auto& entry = m_entries[fields[1]];
+      ++entry.hits;
+      entry.touched = true;
+    } else if (type == "e" && fields.size() == 6) {
+      auto& entry = m_entries[fields[1]];
+      entry.cost_ms = util::parse_unsigned(fields[2]).value_or(0);
+      entry.hits = util::parse_unsigned(fields[3]).value_or(0);
+      entry.priority = util::parse_double(fields[4]).value_or(0.0);
+      entry.touched = fields[5] != "0";
+    } else if (type == "g" && fields.size() == 3
+               && (fields[1] == "0" || fields[1] == "1")) {
+      const int i = fields[1] == "0" ? 0 : 1;
+      if (m_ghost_set[i].insert(fields[2]).second) {
+        m_ghosts[i].push_back(fields[2]);
+      }
+    } else if (type == "L" && fields.size() == 2) {
+      m_inflation = util::parse_double(fields[1]).value_or(0.0);
+    } else if (type == "p" && fields.size() == 2) {
+      m_arc_target =
+        std::clamp(util::parse_double(fields[1]).value_or(0.5), 0.0, 1.0);
+    } else {
+      LOG("Ignoring invalid line in {}: {}", m_path, line);
+    }
+  }
+}
+
+void
+EvictionIndex::sort(std::vector<DirEntry>& files, const EvictionPolicy policy)
+{
+  m_policy = policy;
+
+  const auto by_mtime = [&](size_t i, size_t j) {
+    return files[i].mtime() < files[j].mtime();
+  };
+
+  std::vector<size_t> order(files.size());
+  std::iota(order.begin(), order.end(), 0);
+
+  std::vector<std::string> names;
+  names.reserve(files.size());
+  std::unordered_map<std::string, uint64_t> sizes;
+  for (const auto& file : files) {
+    names.push_back(name_from_path(file));
+    sizes[names.back()] += file.size_on_disk();
+  }
+
+  switch (policy) {
+  case EvictionPolicy::lru:
+    std::sort(order.begin(), order.end(), by_mtime);
+    break;
+
+  case EvictionPolicy::gdsf: {
+    // Priority H = L + F * C / S where L is the inflation value, F the number
+    // of references, C the compile cost and S the total size of the entry.
+    // Untouched entries keep the priority they got when last referenced, so L
+    // makes recently referenced entries win over entries that were valuable a
+    // long time ago.
+    //
+    // Entries without a known cost, e.g. manifests and entries stored by older
+    // ccache versions, get the median of the known costs in the directory so
+    // that they are neither favored nor penalized.
+    std::vector<uint64_t> known_costs;
+    std::unordered_set<std::string_view> seen;
+    for (const auto& name : names) {
+      const auto it = m_entries.find(name);
+      if (is_indexed(name) && it != m_entries.end() && it->second.cost_ms > 0
+          && seen.insert(name).second) {
+        known_costs.push_back(it->second.cost_ms);
+      }
+    }
+    uint64_t default_cost = 1;
+    if (!known_costs.empty()) {
+      const auto middle = known_costs.begin() + known_costs.size() / 2;
+      std::nth_element(known_costs.begin(), middle, known_costs.end());
+      default_cost = *middle;
+    }
+
+    std::vector<double> priorities;
+    priorities.reserve(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+      Entry unindexed_entry;
+      auto& entry =
+        is_indexed(names[i]) ? m_entries[names[i]] : unindexed_entry;
+      if (entry.touched) {
+        const uint64_t cost =
+          entry.cost_ms > 0 ? entry.cost_ms : default_cost;
+        entry.priority =
+          m_inflation
+          + static_cast<double>((entry.hits + 1) * cost)
+              / static_cast<double>(std::max(sizes[names[i]], uint64_t(1)));
+        entry.touched = false;
+      }
+      priorities.push_back(entry.priority);
+    }
+    std::sort(order.begin(), order.end(), [&](size_t i, size_t j) {
+      return priorities[i] < priorities[j]
+             || (priorities[i] == priorities[j] && by_mtime(i, j));
+    });
+    break;
+  }
+
+  case EvictionPolicy::arc: {
+    // Entries that have been referenced once are in the recency list (T1) and
+    // the others in the frequency list (T2), each in LRU order. Evict from T1
+    // while it is larger than the adaptive target, otherwise from T2.
+    std::vector<size_t> recent;
+    std::vector<size_t> frequent;
+    for (size_t i = 0; i < files.size(); ++i) {
+      const auto it = m_entries.find(names[i]);
+      const bool is_frequent = it != m_entries.end() && it->second.hits > 0;
+      (is_frequent ? frequent : recent).push_back(i);
+    }
+    std::sort(recent.begin(), recent.end(), by_mtime);
+    std::sort(frequent.begin(), frequent.end(), by_mtime);
+
+    const double target = m_arc_target * static_cast<double>(files.size());
+    size_t r = 0;
+    size_t f = 0;
+    for (size_t& slot : order) {
+      const bool take_recent =
+        r < recent.size()
+        && (f == frequent.size()
+            || static_cast<double>(recent.size() - r) > target);
+      slot = take_recent ? recent[r++] : frequent[f++];
+    }
+    break;
+  }
+  }
+
+  std::vector<DirEntry> sorted;
+  sorted.reserve(files.size());
+  for (size_t i : order) {
+    sorted.push_back(std::move(files[i]));
+  }
+  files = std::move(sorted);
+}
+
+void
+EvictionIndex::record_eviction(const DirEntry& file)
+{
+  const auto name = name_from_path(file);
+  if (!is_indexed(name) || !m_evicted.insert(name).second) {
+    return;
+  }
+
+  const auto it = m_entries.find(name);
+  switch (m_policy) {
+  case EvictionPolicy::lru:
+    break;
+
+  case EvictionPolicy::gdsf:
+    if (it != m_entries.end()) {
+      m_inflation = std::max(m_inflation, it->second.priority);
+    }
+    break;
+
+  case EvictionPolicy::arc: {
+    const int i = it != m_entries.end() && it->second.hits > 0 ? 1 : 0;
+    if (m_ghost_set[i].insert(name).second) {
+      m_ghosts[i].push_back(name);
+    }
+    break;
+  }
+  }
+}
+
+void
+EvictionIndex::save(const std::vector<DirEntry>* files)
+{
+  std::unordered_set<std::string> kept_names;
+  if (files) {
+    for (const auto& file : *files) {
+      if (file.is_regular_file()) {
+        auto name = name_from_path(file);
+        if (m_evicted.count(name) == 0) {
+          kept_names.insert(std::move(name));
+        }
+      }
+    }
+  }
+
+  core::AtomicFile file(m_path, core::AtomicFile::Mode::text);
+  file.write(FMT("L {}\np {}\n", m_inflation, m_arc_target));
+
+  size_t kept_entries = 0;
+  for (const auto& [name, entry] : m_entries) {
+    if (!files || kept_names.count(name) > 0) {
+      file.write(FMT("e {} {} {} {} {}\n",
+                     name,
+                     entry.cost_ms,
+                     entry.hits,
+                     entry.priority,
+                     entry.touched ? 1 : 0));
+      ++kept_entries;
+    }
+  }
+
+  // Like in ARC, remember at most as many evicted entries as there are live
+  // entries.
+  for (int i = 0; i < 2; ++i) {
+    std::vector<std::string_view> ghosts;
+    for (auto it = m_ghosts[i].rbegin();
+         it != m_ghosts[i].rend() && ghosts.size() < kept_entries;
+         ++it) {
+      if (m_ghost_set[i].count(*it) > 0 && kept_names.count(*it) == 0) {
+        ghosts.push_back(*it);
+      }
+    }
+    for (auto it = ghosts.rbegin(); it != ghosts.rend(); ++it) {
+      file.write(FMT("g {} {}\n", i, *it));
+    }
+  }
+
+  try {
+    file.commit();
+  } catch (const core::Error& e) {
+    LOG("Error: {}", e.what());
+  }
+}
+
+std::string
+EvictionIndex::name_from_path(const DirEntry& file) const
+{
+  std::string path = pstr(file.path()).str();
+  if (util::starts_with(path, m_l2_dir) && path.length() > m_l2_dir.length()) {
+    path.erase(0, m_l2_dir.length() + 1);
+  }
+  path.erase(std::remove_if(path.begin(),
+                            path.end(),
+                            [](char c) { return c == '/' || c == '\\'; }),
+             path.end());
+  return group_name(std::move(path));
+}
+
+void
+EvictionIndex::adapt_arc_target(const int ghost_list)
+{
+  const double capacity =
+    static_cast<double>(std::max(m_entries.size(), size_t(1)));
+  const double own = static_cast<double>(m_ghost_set[ghost_list].size());
+  const double other = static_cast<double>(m_ghost_set[1 - ghost_list].size());
+  const double delta = std::max(other / own, 1.0) / capacity;
+  // A hit in the recency ghost list grows the recency list and vice versa.
+  m_arc_target = std::clamp(
+    m_arc_target + (ghost_list == 0 ? delta : -delta), 0.0, 1.0);
+}
+
+} // namespace storage::local
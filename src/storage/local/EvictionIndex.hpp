@@ -0,0 +1,104 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#pragma once
+
+#include <Config.hpp>
+#include <util/DirEntry.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace storage::local {
+
+// Usage metadata (compile cost and hit count) for the cache entries in a level
+// 2 directory, used by the GDSF and ARC eviction policies to decide in which
+// order files should be removed without reading each cache entry header.
+//
+// The index file is a log: insertions and hits are appended without holding
+// any lock and the log is compacted while holding the level 2 content lock.
+// Records appended during compaction may be lost, which is acceptable since
+// the index only affects eviction order.
+//
+// Entries are identified by name, i.e. the path of the cache file relative to
+// the level 2 directory with directory separators removed, which makes the
+// name independent of the cache level. Raw files share the entry of their
+// result file.
+class EvictionIndex
+{
+public:
+  static constexpr const char k_filename[] = "eviction_index";
+
+  explicit EvictionIndex(const std::string& l2_dir);
+
+  static void record_insertion(const std::string& l2_dir,
+                               std::string_view name,
+                               uint64_t cost_ms);
+  static void record_hit(const std::string& l2_dir, std::string_view name);
+
+  // Read and aggregate the index file. A nonexistent file is OK.
+  void load();
+
+  // Sort `files` so that files that should be evicted first come first.
+  void sort(std::vector<util::DirEntry>& files, EvictionPolicy policy);
+
+  // Register that `file` has been evicted.
+  void record_eviction(const util::DirEntry& file);
+
+  // Write a compacted index file. If `files` is given, only entries for those
+  // files (except evicted ones) are kept.
+  void save(const std::vector<util::DirEntry>* files = nullptr);
+
+  // Size of the index file above which insertions trigger compaction.
+  static constexpr uint64_t k_max_size = 512 * 1024;
+
+private:
+  struct Entry
+  {
+    uint64_t cost_ms = 0;
+    uint64_t hits = 0;
+    double priority = 0.0;
+    bool touched = true; // Inserted or hit since the priority was computed?
+  };
+
+  std::string m_l2_dir;
+  std::string m_path;
+  EvictionPolicy m_policy = EvictionPolicy::lru;
+  std::unordered_map<std::string, Entry> m_entries;
+  std::unordered_set<std::string> m_evicted;
+
+  // GDSF inflation value ("L"), i.e. the highest priority evicted so far.
+  double m_inflation = 0.0;
+
+  // ARC target size of the recency list ("p") as a fraction of all files.
+  double m_arc_target = 0.5;
+
+  // ARC ghost lists of evicted names, oldest first.
+  std::deque<std::string> m_ghosts[2];
+  std::unordered_set<std::string> m_ghost_set[2];
+
+  std::string name_from_path(const util::DirEntry& file) const;
+  void adapt_arc_target(int ghost_list);
+};
+
+} // namespace storage::local
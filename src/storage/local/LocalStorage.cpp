@@ -28,7 +28,9 @@
 #include <core/Statistics.hpp>
 #include <core/common.hpp>
 #include <core/exceptions.hpp>
+#include <storage/local/EvictionIndex.hpp>
 #include <util/Duration.hpp>
+#include <util/Fd.hpp>
 #include <util/FileStream.hpp>
 #include <util/PathString.hpp>
 #include <util/TemporaryFile.hpp>
@@ -77,8 +79,10 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cctype>
 #include <cstdlib>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <string>
 #include <utility>
@@ -189,6 +193,9 @@ set_counters(const StatsFile& stats_file, const Level1Counters& level_1_cs)
   });
 }
 
+// Suffix of files with manifest delta records.
+const char k_manifest_delta_suffix[] = "D";
+
 static std::string
 suffix_from_type(const core::CacheEntryType type)
 {
@@ -198,11 +205,37 @@ suffix_from_type(const core::CacheEntryType type)
 
   case core::CacheEntryType::result:
     return "R";
+
+  case core::CacheEntryType::chunk:
+    return "C";
   }
 
   ASSERT(false);
 }
 
+// Percent-encode characters that are not safe in a file name.
+static std::string
+escape_namespace(std::string_view namespace_)
+{
+  std::string result;
+  for (const char c : namespace_) {
+    if (std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_'
+        || (c == '.' && !result.empty())) {
+      result += c;
+    } else {
+      result += FMT("%{:02X}", static_cast<uint8_t>(c));
+    }
+  }
+  return result;
+}
+
+static std::string
+eviction_index_name(const Hash::Digest& key, const core::CacheEntryType type)
+{
+  // The level 1 and level 2 directory characters are not part of the name.
+  return FMT("{}{}", util::format_digest(key).substr(2), suffix_from_type(type));
+}
+
 static uint8_t
 calculate_wanted_cache_level(const uint64_t files_in_level_1)
 {
@@ -296,6 +329,25 @@ clone_file(const std::string& src, const std::string& dest, bool via_tmp_file)
 
 #endif // FILE_CLONING_SUPPORTED
 
+// Clone `source` to `dest`. Returns false if not possible, for instance
+// because they are on different file systems.
+static bool
+try_clone_file(const std::string& source, const std::string& dest)
+{
+#ifdef FILE_CLONING_SUPPORTED
+  try {
+    clone_file(source, dest, true);
+    return true;
+  } catch (core::Error& e) {
+    LOG("Failed to clone {} to {}: {}", source, dest, e.what());
+  }
+#else
+  (void)source;
+  (void)dest;
+#endif
+  return false;
+}
+
 struct CleanDirResult
 {
   Level2Counters before;
@@ -313,14 +365,33 @@ ratio(T numerator, T denominator)
   }
 }
 
+static void
+saturating_subtract(std::atomic<uint64_t>& counter, const uint64_t value)
+{
+  uint64_t old_value = counter.load();
+  while (!counter.compare_exchange_weak(
+    old_value, old_value - std::min(value, old_value))) {
+    // Retry with the updated old_value.
+  }
+}
+
+// Called with each file that is about to be evicted.
+using EvictionReceiver = std::function<void(const DirEntry& file)>;
+
+// Called before evicting a file. Returns false if the file should be kept.
+using EvictionPermit = std::function<bool(const DirEntry& file)>;
+
 static CleanDirResult
 clean_dir(
   const std::string& l2_dir,
   const uint64_t max_size,
   const uint64_t max_files,
+  const EvictionPolicy eviction_policy,
+  const EvictionReceiver& eviction_receiver = nullptr,
   const std::optional<uint64_t> max_age = std::nullopt,
   const std::optional<std::string> namespace_ = std::nullopt,
-  const ProgressReceiver& progress_receiver = [](double /*progress*/) {})
+  const ProgressReceiver& progress_receiver = [](double /*progress*/) {},
+  const EvictionPermit& eviction_permit = nullptr)
 {
   LOG("Cleaning up cache directory {}", l2_dir);
 
@@ -361,10 +432,19 @@ clean_dir(
     files_in_cache += 1;
   }
 
-  // Sort according to modification time, oldest first.
-  std::sort(files.begin(), files.end(), [](const auto& f1, const auto& f2) {
-    return f1.mtime() < f2.mtime();
-  });
+  // Eviction based on age or namespace is always done in mtime order since the
+  // loop below relies on that for max_age.
+  std::optional<EvictionIndex> eviction_index;
+  if (eviction_policy != EvictionPolicy::lru && !max_age && !namespace_) {
+    eviction_index.emplace(l2_dir);
+    eviction_index->load();
+    eviction_index->sort(files, eviction_policy);
+  } else {
+    // Sort according to modification time, oldest first.
+    std::sort(files.begin(), files.end(), [](const auto& f1, const auto& f2) {
+      return f1.mtime() < f2.mtime();
+    });
+  }
 
   LOG("Before cleanup: {:.0f} KiB, {:.0f} files",
       static_cast<double>(cache_size) / 1024,
@@ -411,10 +491,24 @@ clean_dir(
       }
     }
 
+    if (eviction_permit && !eviction_permit(file)) {
+      break;
+    }
+
+    if (eviction_receiver && !util::TemporaryFile::is_tmp_file(file.path())) {
+      eviction_receiver(file);
+    }
     delete_file(file, cache_size, files_in_cache);
+    if (eviction_index) {
+      eviction_index->record_eviction(file);
+    }
     cleaned = true;
   }
 
+  if (eviction_index) {
+    eviction_index->save(&files);
+  }
+
   LOG("After cleanup: {:.0f} KiB, {:.0f} files",
       static_cast<double>(cache_size) / 1024,
       static_cast<double>(files_in_cache));
@@ -437,12 +531,23 @@ file_type_from_path(const fs::path& path)
     return FileType::result;
   } else if (util::ends_with(filename, "W")) {
     return FileType::raw;
+  } else if (util::ends_with(filename, "C")) {
+    return FileType::chunk;
   } else {
     return FileType::unknown;
   }
 }
 
-LocalStorage::LocalStorage(const Config& config) : m_config(config)
+LocalStorage::LocalStorage(const Config& config)
+  : LocalStorage(config, Tier::hot)
+{
+  m_cold_tier.reset(new LocalStorage(config, Tier::cold));
+  m_base_tier.reset(new LocalStorage(config, Tier::base));
+}
+
+LocalStorage::LocalStorage(const Config& config, const Tier tier)
+  : m_config(config),
+    m_tier(tier)
 {
 }
 
@@ -482,37 +587,70 @@ LocalStorage::finalize()
 
       perform_automatic_cleanup();
     }
+
+    if (!m_config.namespace_().empty()) {
+      const auto dir = get_namespace_stats_dir(m_config.namespace_());
+      if (!fs::create_directories(dir)) {
+        LOG("Failed to create directory {}", dir);
+      }
+      get_namespace_stats_file(m_config.namespace_(),
+                               static_cast<uint8_t>(bucket % 16))
+        .update([&](auto& cs) { cs.increment(m_counter_updates); });
+    }
+  }
+
+  // The hot tier's cleanup above may have demoted entries to the cold tier,
+  // so finalize it last.
+  if (cold_tier()) {
+    cold_tier()->finalize();
   }
 
-  if (m_config.temporary_dir() == m_config.default_temporary_dir()) {
+  // Only the hot tier owns the temporary directory.
+  if (m_tier == Tier::hot
+      && m_config.temporary_dir() == m_config.default_temporary_dir()) {
     clean_internal_tempdir();
   }
 }
 
-std::optional<util::Bytes>
+std::optional<util::MemoryMap>
 LocalStorage::get(const Hash::Digest& key, const core::CacheEntryType type)
 {
   MTR_SCOPE("local_storage", "get");
 
-  std::optional<util::Bytes> return_value;
+  std::optional<util::MemoryMap> return_value;
 
   const auto cache_file = look_up_cache_file(key, type);
   if (cache_file.dir_entry.is_regular_file()) {
-    const auto value = util::read_file<util::Bytes>(cache_file.path);
+    auto value =
+      util::MemoryMap::open(cache_file.path, cache_file.dir_entry.size());
     if (value) {
       LOG("Retrieved {} from local storage ({})",
           util::format_digest(key),
           cache_file.path);
 
       // Update modification timestamp to save file from LRU cleanup.
-      util::set_timestamps(cache_file.path);
+      if (m_tier != Tier::base) {
+        util::set_timestamps(cache_file.path);
+      }
+      if (m_tier != Tier::base
+          && m_config.eviction_policy() != EvictionPolicy::lru) {
+        EvictionIndex::record_hit(get_subdir(key[0] >> 4, key[0] & 0xF),
+                                  eviction_index_name(key, type));
+      }
 
-      return_value = *value;
+      return_value = std::move(*value);
     } else {
       LOG("Failed to read {}: {}", cache_file.path, value.error());
     }
   } else {
-    LOG("No {} in local storage", util::format_digest(key));
+    for (auto* tier : {cold_tier(), base_tier()}) {
+      if (tier && (return_value = promote(*tier, key, type))) {
+        break;
+      }
+    }
+    if (!return_value) {
+      LOG("No {} in local storage", util::format_digest(key));
+    }
   }
 
   increment_statistic(return_value ? Statistic::local_storage_read_hit
@@ -545,7 +683,7 @@ LocalStorage::put(const Hash::Digest& key,
     AtomicFile result_file(cache_file.path, AtomicFile::Mode::binary);
     result_file.write(value);
     result_file.flush();
-    if (!l2_content_lock.acquire()) {
+    if (!acquire_content_lock(l2_content_lock)) {
       LOG("Not storing {} due to lock failure", cache_file.path);
       return;
     }
@@ -555,11 +693,40 @@ LocalStorage::put(const Hash::Digest& key,
     return;
   }
 
+  finish_put(key, type, value, cache_file, l2_content_lock);
+}
+
+void
+LocalStorage::finish_put(const Hash::Digest& key,
+                         const core::CacheEntryType type,
+                         nonstd::span<const uint8_t> value,
+                         const LookUpCacheFileResult& cache_file,
+                         util::LockFile& l2_content_lock)
+{
   LOG("Stored {} in local storage ({})",
       util::format_digest(key),
       cache_file.path);
   m_stored_data = true;
 
+  if (m_config.eviction_policy() != EvictionPolicy::lru) {
+    uint64_t cost_ms = 0;
+    try {
+      cost_ms = core::CacheEntry::Header(value).compile_time_ms;
+    } catch (const core::Error& e) {
+      LOG("Failed to read header of {}: {}", cache_file.path, e.what());
+    }
+    const auto l2_dir = get_subdir(key[0] >> 4, key[0] & 0xF);
+    EvictionIndex::record_insertion(
+      l2_dir, eviction_index_name(key, type), cost_ms);
+    DirEntry index_dir_entry(FMT("{}/{}", l2_dir, EvictionIndex::k_filename));
+    if (index_dir_entry.size() > EvictionIndex::k_max_size) {
+      // Still holding the level 2 content lock, so compaction is safe.
+      EvictionIndex eviction_index(l2_dir);
+      eviction_index.load();
+      eviction_index.save();
+    }
+  }
+
   if (!m_config.stats()) {
     return;
   }
@@ -589,7 +756,7 @@ LocalStorage::put(const Hash::Digest& key,
   // be done almost anywhere, but we might as well do it near the end as we save
   // the stat call if we exit early.
   util::create_cachedir_tag(
-    FMT("{}/{}", m_config.cache_dir(), util::format_digest(key)[0]));
+    FMT("{}/{}", cache_dir(), util::format_digest(key)[0]));
 }
 
 void
@@ -597,6 +764,10 @@ LocalStorage::remove(const Hash::Digest& key, const core::CacheEntryType type)
 {
   MTR_SCOPE("local_storage", "remove");
 
+  if (cold_tier()) {
+    cold_tier()->remove(key, type);
+  }
+
   const auto cache_file = look_up_cache_file(key, type);
   if (!cache_file.dir_entry) {
     LOG("No {} to remove from local storage", util::format_digest(key));
@@ -607,7 +778,7 @@ LocalStorage::remove(const Hash::Digest& key, const core::CacheEntryType type)
 
   {
     auto l2_content_lock = get_level_2_content_lock(key);
-    if (!l2_content_lock.acquire()) {
+    if (!acquire_content_lock(l2_content_lock)) {
       LOG("Not removing {} due to lock failure", cache_file.path);
     }
     util::remove_nfs_safe(cache_file.path);
@@ -620,6 +791,222 @@ LocalStorage::remove(const Hash::Digest& key, const core::CacheEntryType type)
     key, -1, -static_cast<int64_t>(cache_file.dir_entry.size_on_disk() / 1024));
 }
 
+bool
+LocalStorage::touch(const Hash::Digest& key, const core::CacheEntryType type)
+{
+  const auto cache_file = look_up_cache_file(key, type);
+  if (!cache_file.dir_entry.is_regular_file()) {
+    // An entry in the cold tier is promoted when it's read.
+    return cold_tier() && cold_tier()->touch(key, type);
+  }
+
+  util::set_timestamps(cache_file.path);
+  if (m_config.eviction_policy() != EvictionPolicy::lru) {
+    EvictionIndex::record_hit(get_subdir(key[0] >> 4, key[0] & 0xF),
+                              eviction_index_name(key, type));
+  }
+  return true;
+}
+
+void
+LocalStorage::append_manifest_delta(const Hash::Digest& key,
+                                    nonstd::span<const uint8_t> value)
+{
+  MTR_SCOPE("local_storage", "append_manifest_delta");
+
+  // A delta record is a valid manifest on its own, so use it as the manifest
+  // if there is none. Unlike put(), never replace a manifest stored
+  // concurrently.
+  const auto manifest_file =
+    look_up_cache_file(key, core::CacheEntryType::manifest);
+  if (!manifest_file.dir_entry.exists()) {
+    auto l2_content_lock = get_level_2_content_lock(key);
+    if (acquire_content_lock(l2_content_lock)
+        && create_file_exclusively(manifest_file.path, value)) {
+      finish_put(key,
+                 core::CacheEntryType::manifest,
+                 value,
+                 manifest_file,
+                 l2_content_lock);
+      return;
+    }
+  }
+
+  // Keep the delta file next to the manifest.
+  auto cache_file = look_up_cache_file(key, k_manifest_delta_suffix);
+  if (!cache_file.dir_entry.exists()) {
+    cache_file.path = get_path_in_cache(
+      manifest_file.level,
+      FMT("{}{}", util::format_digest(key), k_manifest_delta_suffix));
+  }
+  core::ensure_dir_exists(fs::path(cache_file.path).parent_path());
+
+  // A single write to a file opened in append mode is atomic with respect to
+  // other appenders on a local file system, so the level 2 content lock is not
+  // needed. NFS clients emulate O_APPEND, so concurrent appends there may
+  // overwrite each other partially; readers skip such damaged records. A
+  // recount racing with the creation of the file may miss it until the next
+  // recount.
+  util::Fd fd(open(cache_file.path.c_str(),
+                   O_WRONLY | O_APPEND | O_CREAT | O_BINARY,
+                   0666));
+  if (!fd) {
+    LOG("Failed to open {}: {}", cache_file.path, strerror(errno));
+    return;
+  }
+  if (const auto ret = util::write_fd(*fd, value.data(), value.size()); !ret) {
+    LOG("Failed to write to {}: {}", cache_file.path, ret.error());
+    return;
+  }
+  fd.close();
+
+  LOG("Appended manifest delta for {} to local storage ({})",
+      util::format_digest(key),
+      cache_file.path);
+  m_stored_data = true;
+
+  if (!m_config.stats()) {
+    return;
+  }
+
+  increment_statistic(Statistic::local_storage_write);
+
+  DirEntry new_dir_entry(cache_file.path, DirEntry::LogOnError::yes);
+  if (new_dir_entry.exists()) {
+    increment_files_and_size_counters(
+      key,
+      cache_file.dir_entry.exists() ? 0 : 1,
+      kibibyte_size_diff(cache_file.dir_entry, new_dir_entry));
+  }
+}
+
+bool
+LocalStorage::create_file_exclusively(const std::string& path,
+                                      nonstd::span<const uint8_t> value)
+{
+  auto tmp_file = util::TemporaryFile::create(path);
+  if (!tmp_file) {
+    LOG("Failed to create temporary file for {}: {}", path, tmp_file.error());
+    return false;
+  }
+  const auto written =
+    util::write_fd(*tmp_file->fd, value.data(), value.size());
+  tmp_file->fd.close();
+
+  // Unlike rename, creating a hard link fails if the destination exists.
+  bool created = false;
+  if (!written) {
+    LOG("Failed to write to {}: {}", tmp_file->path, written.error());
+  } else if (const auto ret = fs::create_hard_link(tmp_file->path, path);
+             !ret) {
+    LOG("Failed to create {}: {}", path, ret.error().message());
+  } else {
+    created = true;
+  }
+  util::remove(tmp_file->path);
+  return created;
+}
+
+std::optional<util::Bytes>
+LocalStorage::get_manifest_deltas(const Hash::Digest& key)
+{
+  const auto cache_file = look_up_cache_file(key, k_manifest_delta_suffix);
+  if (!cache_file.dir_entry.is_regular_file()) {
+    return std::nullopt;
+  }
+
+  auto value = util::read_file<util::Bytes>(cache_file.path);
+  if (!value) {
+    LOG("Failed to read {}: {}", cache_file.path, value.error());
+    return std::nullopt;
+  }
+  LOG("Retrieved manifest deltas for {} from local storage ({})",
+      util::format_digest(key),
+      cache_file.path);
+
+  // Update modification timestamp to save file from LRU cleanup.
+  util::set_timestamps(cache_file.path);
+
+  return std::move(*value);
+}
+
+void
+LocalStorage::compact_manifest(const Hash::Digest& key,
+                               const ManifestMerger& merge)
+{
+  MTR_SCOPE("local_storage", "compact_manifest");
+
+  auto l2_content_lock = get_level_2_content_lock(key);
+  if (!acquire_content_lock(l2_content_lock)) {
+    LOG("Not compacting manifest {} due to lock failure",
+        util::format_digest(key));
+    return;
+  }
+
+  const auto cache_file =
+    look_up_cache_file(key, core::CacheEntryType::manifest);
+  util::Bytes manifest;
+  if (cache_file.dir_entry.is_regular_file()) {
+    auto data = util::read_file<util::Bytes>(cache_file.path);
+    if (!data) {
+      LOG("Failed to read {}: {}", cache_file.path, data.error());
+      return;
+    }
+    manifest = std::move(*data);
+  }
+
+  // Move the delta file away before reading it so that records appended from
+  // now on end up in a new file instead of being removed unread.
+  const auto deltas_file = look_up_cache_file(key, k_manifest_delta_suffix);
+  const auto deltas_tmp_path = FMT("{}{}{}",
+                                   deltas_file.path,
+                                   util::TemporaryFile::tmp_file_infix,
+                                   getpid());
+  util::Bytes deltas;
+  if (deltas_file.dir_entry.is_regular_file()) {
+    if (const auto ret = fs::rename(deltas_file.path, deltas_tmp_path); !ret) {
+      LOG("Failed to rename {} to {}: {}",
+          deltas_file.path,
+          deltas_tmp_path,
+          ret.error().message());
+      return;
+    }
+    auto data = util::read_file<util::Bytes>(deltas_tmp_path);
+    if (!data) {
+      LOG("Failed to read {}: {}", deltas_tmp_path, data.error());
+      fs::rename(deltas_tmp_path, deltas_file.path); // Ignore any error.
+      return;
+    }
+    deltas = std::move(*data);
+  }
+
+  const auto value = merge(manifest, deltas);
+  try {
+    AtomicFile manifest_file(cache_file.path, AtomicFile::Mode::binary);
+    manifest_file.write(value);
+    manifest_file.commit();
+  } catch (core::Error& e) {
+    LOG("Failed to write to {}: {}", cache_file.path, e.what());
+    if (!deltas.empty() && !DirEntry(deltas_file.path).exists()) {
+      fs::rename(deltas_tmp_path, deltas_file.path); // Ignore any error.
+    }
+    return;
+  }
+
+  if (!deltas.empty()) {
+    const DirEntry tmp_dir_entry(deltas_tmp_path);
+    util::remove_nfs_safe(deltas_tmp_path);
+    increment_files_and_size_counters(
+      key, -1, -static_cast<int64_t>(tmp_dir_entry.size_on_disk() / 1024));
+    LOG("Compacted manifest deltas for {} in local storage ({})",
+        util::format_digest(key),
+        deltas_file.path);
+  }
+
+  finish_put(
+    key, core::CacheEntryType::manifest, value, cache_file, l2_content_lock);
+}
+
 std::string
 LocalStorage::get_raw_file_path(std::string_view result_path,
                                 uint8_t file_number)
@@ -745,6 +1132,15 @@ LocalStorage::increment_statistics(const StatisticsCounters& statistics)
   }
 }
 
+void
+LocalStorage::record_latency(const Statistic histogram,
+                             const util::Duration& duration)
+{
+  if (m_config.stats()) {
+    m_counter_updates.record_latency(histogram, duration);
+  }
+}
+
 // Zero all statistics counters except those tracking cache size and number of
 // files in the cache.
 void
@@ -754,7 +1150,7 @@ LocalStorage::zero_all_statistics()
   const auto zeroable_fields = core::Statistics::get_zeroable_fields();
 
   for_each_level_1_and_2_stats_file(
-    m_config.cache_dir(), [=](const std::string& path) {
+    cache_dir(), [=](const std::string& path) {
       StatsFile(path).update([=](auto& cs) {
         for (const auto statistic : zeroable_fields) {
           cs.set(statistic, 0);
@@ -762,6 +1158,23 @@ LocalStorage::zero_all_statistics()
         cs.set(Statistic::stats_zeroed_timestamp, now.sec());
       });
     });
+
+  for (const auto& [namespace_, counters] : get_namespace_statistics()) {
+    for (uint8_t i = 0; i <= 0xF; ++i) {
+      const auto stats_file = get_namespace_stats_file(namespace_, i);
+      stats_file.update(
+        [&](auto& cs) {
+          for (const auto statistic : zeroable_fields) {
+            cs.set(statistic, 0);
+          }
+        },
+        StatsFile::OnlyIfChanged::yes);
+    }
+  }
+
+  if (cold_tier()) {
+    cold_tier()->zero_all_statistics();
+  }
 }
 
 // Get statistics and last time of update for the whole local storage cache.
@@ -774,7 +1187,7 @@ LocalStorage::get_all_statistics() const
 
   // Add up the stats in each directory.
   for_each_level_1_and_2_stats_file(
-    m_config.cache_dir(), [&](const auto& path) {
+    cache_dir(), [&](const auto& path) {
       counters.set(Statistic::stats_zeroed_timestamp, 0); // Don't add
       counters.increment(StatsFile(path).read());
       zero_timestamp = std::max(counters.get(Statistic::stats_zeroed_timestamp),
@@ -786,22 +1199,76 @@ LocalStorage::get_all_statistics() const
   return {counters, last_updated};
 }
 
+std::vector<std::pair<std::string, StatisticsCounters>>
+LocalStorage::get_namespace_statistics() const
+{
+  std::vector<std::pair<std::string, StatisticsCounters>> result;
+
+  const auto root = get_namespace_stats_root();
+  if (!DirEntry(root).is_directory()) {
+    return result;
+  }
+
+  try {
+    for (const auto& entry : fs::directory_iterator(root)) {
+      if (!entry.is_directory()) {
+        continue;
+      }
+      const auto namespace_ =
+        util::percent_decode(pstr(entry.path().filename()).str());
+      if (!namespace_) {
+        continue;
+      }
+      StatisticsCounters counters;
+      for (uint8_t i = 0; i <= 0xF; ++i) {
+        counters.increment(get_namespace_stats_file(*namespace_, i).read());
+      }
+      result.emplace_back(*namespace_, counters);
+    }
+  } catch (const std::filesystem::filesystem_error& e) {
+    LOG("Failed to read {}: {}", root, e.what());
+  }
+
+  std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+    return a.first < b.first;
+  });
+  return result;
+}
+
+std::optional<StatisticsCounters>
+LocalStorage::get_cold_tier_statistics() const
+{
+  if (!cold_tier()) {
+    return std::nullopt;
+  }
+  return cold_tier()->get_all_statistics().first;
+}
+
 void
 LocalStorage::evict(const ProgressReceiver& progress_receiver,
                     std::optional<uint64_t> max_age,
-                    std::optional<std::string> namespace_)
+                    std::optional<std::string> namespace_,
+                    uint32_t threads)
 {
-  return do_clean_all(progress_receiver, 0, 0, max_age, namespace_);
+  do_clean_all(progress_receiver, 0, 0, max_age, namespace_, threads);
+  if (cold_tier()) {
+    cold_tier()->evict(progress_receiver, max_age, namespace_, threads);
+  }
 }
 
 void
-LocalStorage::clean_all(const ProgressReceiver& progress_receiver)
+LocalStorage::clean_all(const ProgressReceiver& progress_receiver,
+                        uint32_t threads)
 {
-  return do_clean_all(progress_receiver,
-                      m_config.max_size(),
-                      m_config.max_files(),
-                      std::nullopt,
-                      std::nullopt);
+  do_clean_all(progress_receiver,
+               max_size(),
+               max_files(),
+               std::nullopt,
+               std::nullopt,
+               threads);
+  if (cold_tier()) {
+    cold_tier()->clean_all(progress_receiver, threads);
+  }
 }
 
 // Wipe all cached files in all subdirectories.
@@ -827,6 +1294,8 @@ LocalStorage::wipe_all(const ProgressReceiver& progress_receiver)
             util::remove_nfs_safe(files[i].path());
             l2_progress_receiver(0.5 + 0.5 * ratio(i, files.size()));
           }
+          util::remove_nfs_safe(FMT("{}/{}", l2_dir, EvictionIndex::k_filename),
+                                util::LogFailure::no);
 
           if (!files.empty()) {
             ++level_1_counters.cleanups;
@@ -835,17 +1304,24 @@ LocalStorage::wipe_all(const ProgressReceiver& progress_receiver)
 
       set_counters(get_stats_file(l1_index), level_1_counters);
     });
+
+  if (cold_tier()) {
+    cold_tier()->wipe_all(progress_receiver);
+  }
 }
 
 CompressionStatistics
 LocalStorage::get_compression_statistics(
-  const ProgressReceiver& progress_receiver) const
+  const ProgressReceiver& progress_receiver, const uint32_t threads) const
 {
-  CompressionStatistics cs{};
+  // One accumulator per level 1 directory so that workers don't share state.
+  CompressionStatistics l1_cs[16] = {};
 
   for_each_cache_subdir(
+    threads,
     progress_receiver,
     [&](const auto& l1_index, const auto& l1_progress_receiver) {
+      auto& cs = l1_cs[l1_index];
       for_each_cache_subdir(
         l1_progress_receiver,
         [&](const auto& l2_index, const auto& l2_progress_receiver) {
@@ -867,6 +1343,12 @@ LocalStorage::get_compression_statistics(
         });
     });
 
+  CompressionStatistics cs{};
+  for (const auto& l1 : l1_cs) {
+    cs.content_size += l1.content_size;
+    cs.actual_size += l1.actual_size;
+    cs.incompressible_size += l1.incompressible_size;
+  }
   return cs;
 }
 
@@ -1023,24 +1505,78 @@ LocalStorage::recompress(const std::optional<int8_t> level,
 
 // Private methods
 
+const std::string&
+LocalStorage::cache_dir() const
+{
+  switch (m_tier) {
+  case Tier::hot:
+    return m_config.cache_dir();
+  case Tier::cold:
+    return m_config.cold_cache_dir();
+  case Tier::base:
+    return m_config.base_cache_dir();
+  }
+  ASSERT(false);
+}
+
+uint64_t
+LocalStorage::max_size() const
+{
+  switch (m_tier) {
+  case Tier::hot:
+    return m_config.max_size();
+  case Tier::cold:
+    return m_config.cold_max_size();
+  case Tier::base:
+    return 0;
+  }
+  ASSERT(false);
+}
+
+uint64_t
+LocalStorage::max_files() const
+{
+  return m_tier == Tier::hot ? m_config.max_files() : 0;
+}
+
+LocalStorage*
+LocalStorage::cold_tier() const
+{
+  return m_cold_tier && !m_config.cold_cache_dir().empty() ? m_cold_tier.get()
+                                                            : nullptr;
+}
+
+LocalStorage*
+LocalStorage::base_tier() const
+{
+  return m_base_tier && !m_config.base_cache_dir().empty() ? m_base_tier.get()
+                                                            : nullptr;
+}
+
 std::string
 LocalStorage::get_subdir(uint8_t l1_index) const
 {
-  return FMT("{}/{:x}", m_config.cache_dir(), l1_index);
+  return FMT("{}/{:x}", cache_dir(), l1_index);
 }
 
 std::string
 LocalStorage::get_subdir(uint8_t l1_index, uint8_t l2_index) const
 {
-  return FMT("{}/{:x}/{:x}", m_config.cache_dir(), l1_index, l2_index);
+  return FMT("{}/{:x}/{:x}", cache_dir(), l1_index, l2_index);
 }
 
 LocalStorage::LookUpCacheFileResult
 LocalStorage::look_up_cache_file(const Hash::Digest& key,
                                  const core::CacheEntryType type) const
 {
-  const auto key_string =
-    FMT("{}{}", util::format_digest(key), suffix_from_type(type));
+  return look_up_cache_file(key, suffix_from_type(type));
+}
+
+LocalStorage::LookUpCacheFileResult
+LocalStorage::look_up_cache_file(const Hash::Digest& key,
+                                 const std::string_view suffix) const
+{
+  const auto key_string = FMT("{}{}", util::format_digest(key), suffix);
 
   for (uint8_t level = k_min_cache_levels; level <= k_max_cache_levels;
        ++level) {
@@ -1056,17 +1592,198 @@ LocalStorage::look_up_cache_file(const Hash::Digest& key,
   return {shallowest_path, DirEntry(), k_min_cache_levels};
 }
 
+std::optional<util::MemoryMap>
+LocalStorage::promote(LocalStorage& tier,
+                      const Hash::Digest& key,
+                      const core::CacheEntryType type)
+{
+  auto value = tier.get(key, type);
+  if (!value) {
+    return std::nullopt;
+  }
+
+  const bool from_base = tier.m_tier == Tier::base;
+  LOG("Promoting {} from {} tier",
+      util::format_digest(key),
+      from_base ? "base" : "cold");
+  const auto key_string = util::format_digest(key);
+  const auto tier_file = tier.look_up_cache_file(key, type);
+  if (type == core::CacheEntryType::result) {
+    // Import raw files before the result that refers to them. put() then moves
+    // them together with the result if needed.
+    for (uint8_t i = 0; i < 10; ++i) {
+      const auto raw_file = get_raw_file_path(tier_file.path, i);
+      if (DirEntry(raw_file).is_regular_file()) {
+        if (auto path =
+              import_file(FMT("{}{}W", key_string, i), raw_file, from_base)) {
+          m_added_raw_files.push_back(std::move(*path));
+        }
+      }
+    }
+  } else if (type == core::CacheEntryType::manifest) {
+    const auto deltas = tier.look_up_cache_file(key, k_manifest_delta_suffix);
+    if (deltas.dir_entry.is_regular_file()) {
+      // Always copy delta records since they are appended to in place.
+      import_file(key_string + k_manifest_delta_suffix, deltas.path, false);
+    }
+  }
+
+  if (from_base) {
+    // Files in the base tier are never modified, so share their data by cloning
+    // instead of writing a copy.
+    import_file(
+      key_string + suffix_from_type(type), tier_file.path, from_base);
+  } else {
+    put(key, type, value->data(), true);
+  }
+  return value;
+}
+
+std::optional<std::string>
+LocalStorage::import_file(const std::string_view name,
+                          const std::string& path,
+                          const bool clone,
+                          std::mutex* const state_mutex)
+{
+  const auto lock_state = [&] {
+    return state_mutex ? std::unique_lock<std::mutex>(*state_mutex)
+                       : std::unique_lock<std::mutex>();
+  };
+
+  for (uint8_t level = k_min_cache_levels; level <= k_max_cache_levels;
+       ++level) {
+    const auto existing_path = get_path_in_cache(level, name);
+    if (DirEntry(existing_path).is_regular_file()) {
+      util::set_timestamps(existing_path);
+      return existing_path;
+    }
+  }
+
+  // The first two characters of the name are the level 1 and level 2 indexes.
+  const auto l1_index = util::parse_unsigned(name.substr(0, 1), 0, 15, "", 16);
+  const auto l2_index = util::parse_unsigned(name.substr(1, 1), 0, 15, "", 16);
+  if (name.length() <= k_max_cache_levels || !l1_index || !l2_index) {
+    LOG("Not importing {} with unexpected name {}", path, name);
+    return std::nullopt;
+  }
+
+  const auto dest_path = get_path_in_cache(k_min_cache_levels, name);
+  auto l2_content_lock = get_level_2_content_lock(
+    static_cast<uint8_t>(*l1_index), static_cast<uint8_t>(*l2_index));
+  const auto lock_start = util::TimePoint::now();
+  const bool acquired = l2_content_lock.acquire();
+  const auto lock_wait = util::TimePoint::now() - lock_start;
+  if (!acquired) {
+    const auto state_lock = lock_state();
+    record_latency(Statistic::lock_wait_histogram_base, lock_wait);
+    LOG("Not importing {} due to lock failure", path);
+    return std::nullopt;
+  }
+  core::ensure_dir_exists(fs::path(dest_path).parent_path());
+  bool imported = true;
+  if (clone && try_clone_file(path, dest_path)) {
+    LOG("Cloned {} to {}", path, dest_path);
+    // Save the file from LRU cleanup, which would otherwise see the age of the
+    // source file.
+    util::set_timestamps(dest_path);
+  } else if (const auto result =
+               util::copy_file(path, dest_path, util::ViaTmpFile::yes);
+             !result) {
+    LOG("Failed to copy {} to {}: {}", path, dest_path, result.error());
+    imported = false;
+  } else {
+    LOG("Copied {} to {}", path, dest_path);
+  }
+
+  {
+    const auto state_lock = lock_state();
+    record_latency(Statistic::lock_wait_histogram_base, lock_wait);
+    if (imported) {
+      m_stored_data = true;
+      increment_statistic(Statistic::local_storage_write);
+    }
+  }
+  if (!imported) {
+    return std::nullopt;
+  }
+
+  if (m_config.eviction_policy() != EvictionPolicy::lru) {
+    uint64_t cost_ms = 0;
+    try {
+      cost_ms = core::CacheEntry::Header(dest_path).compile_time_ms;
+    } catch (const core::Error&) {
+      // Not a cache entry, e.g. a raw file.
+    }
+    EvictionIndex::record_insertion(
+      get_subdir(*l1_index, *l2_index), name.substr(2), cost_ms);
+  }
+
+  if (m_config.stats()) {
+    DirEntry dir_entry(dest_path);
+    increment_files_and_size_counters(
+      static_cast<uint8_t>(*l1_index),
+      static_cast<uint8_t>(*l2_index),
+      1,
+      static_cast<int64_t>(dir_entry.size_on_disk() / 1024));
+  }
+  return dest_path;
+}
+
+std::function<void(const DirEntry&)>
+LocalStorage::get_demoter()
+{
+  if (!cold_tier()) {
+    return nullptr;
+  }
+
+  // Cleanup may process several directories concurrently.
+  auto mutex = std::make_shared<std::mutex>();
+  return [this, mutex](const DirEntry& file) {
+    // The path is <cache_dir>/<name> with directory separators inserted after
+    // the first characters of the name.
+    const auto path = pstr(file.path()).str();
+    std::string name;
+    for (const char c : std::string_view(path).substr(cache_dir().length())) {
+      if (c != '/') {
+        name += c;
+      }
+    }
+    LOG("Demoting {} to cold tier", path);
+    cold_tier()->import_file(name, path, false, mutex.get());
+  };
+}
+
 StatsFile
 LocalStorage::get_stats_file(uint8_t l1_index) const
 {
-  return StatsFile(FMT("{}/{:x}/stats", m_config.cache_dir(), l1_index));
+  return StatsFile(FMT("{}/{:x}/stats", cache_dir(), l1_index));
 }
 
 StatsFile
 LocalStorage::get_stats_file(uint8_t l1_index, uint8_t l2_index) const
 {
   return StatsFile(
-    FMT("{}/{:x}/{:x}/stats", m_config.cache_dir(), l1_index, l2_index));
+    FMT("{}/{:x}/{:x}/stats", cache_dir(), l1_index, l2_index));
+}
+
+std::string
+LocalStorage::get_namespace_stats_root() const
+{
+  return FMT("{}/namespace_stats", cache_dir());
+}
+
+std::string
+LocalStorage::get_namespace_stats_dir(std::string_view namespace_) const
+{
+  return FMT("{}/{}", get_namespace_stats_root(), escape_namespace(namespace_));
+}
+
+StatsFile
+LocalStorage::get_namespace_stats_file(std::string_view namespace_,
+                                       uint8_t index) const
+{
+  return StatsFile(
+    FMT("{}/{:x}", get_namespace_stats_dir(namespace_), index));
 }
 
 void
@@ -1251,8 +1968,12 @@ LocalStorage::perform_automatic_cleanup()
   const uint64_t target_files = static_cast<uint64_t>(
     0.9 * static_cast<double>(evaluation->total_files) / 256);
 
-  auto clean_dir_result = clean_dir(
-    get_subdir(evaluation->l1_index, largest_level_2_index), 0, target_files);
+  auto clean_dir_result =
+    clean_dir(get_subdir(evaluation->l1_index, largest_level_2_index),
+              0,
+              target_files,
+              m_config.eviction_policy(),
+              get_demoter());
 
   stats_file.update([&](auto& cs) {
     const auto old_files =
@@ -1281,22 +2002,52 @@ LocalStorage::do_clean_all(const ProgressReceiver& progress_receiver,
                            uint64_t max_size,
                            uint64_t max_files,
                            std::optional<uint64_t> max_age,
-                           std::optional<std::string> namespace_)
+                           std::optional<std::string> namespace_,
+                           uint32_t threads)
 {
   util::LongLivedLockFileManager lock_manager;
 
-  uint64_t current_size = 0;
-  uint64_t current_files = 0;
+  uint64_t initial_size = 0;
+  uint64_t initial_files = 0;
   if (max_size > 0 || max_files > 0) {
     for_each_cache_subdir([&](uint8_t i) {
       auto counters = get_stats_file(i).read();
-      current_size += 1024 * counters.get(Statistic::cache_size_kibibyte);
-      current_files += counters.get(Statistic::files_in_cache);
+      initial_size += 1024 * counters.get(Statistic::cache_size_kibibyte);
+      initial_files += counters.get(Statistic::files_in_cache);
     });
   }
 
+  // Level 1 directories may be processed concurrently, so the running totals
+  // are shared between the workers.
+  std::atomic<uint64_t> current_size = initial_size;
+  std::atomic<uint64_t> current_files = initial_files;
+
+  // Files removed explicitly by age or namespace are not demoted.
+  const auto demoter =
+    !max_age && !namespace_ ? get_demoter() : EvictionReceiver();
+
+  // Concurrent workers may all see that the limits are exceeded, so each file
+  // is only evicted if the shared totals still exceed them, which keeps the
+  // workers from together removing more files than needed.
+  std::mutex budget_mutex;
+  EvictionPermit eviction_permit;
+  if (max_size > 0 || max_files > 0) {
+    eviction_permit = [&](const DirEntry& file) {
+      std::lock_guard<std::mutex> lock(budget_mutex);
+      if ((max_size == 0 || current_size <= max_size)
+          && (max_files == 0 || current_files <= max_files)) {
+        return false;
+      }
+      saturating_subtract(current_size, file.size_on_disk());
+      saturating_subtract(current_files, 1);
+      return true;
+    };
+  }
+
   for_each_cache_subdir(
-    progress_receiver, [&](uint8_t l1_index, const auto& l1_progress_receiver) {
+    threads,
+    progress_receiver,
+    [&](uint8_t l1_index, const auto& l1_progress_receiver) {
       auto acquired_locks =
         acquire_all_level_2_content_locks(lock_manager, l1_index);
       Level1Counters level_1_counters;
@@ -1311,19 +2062,24 @@ LocalStorage::do_clean_all(const ProgressReceiver& progress_receiver,
           auto clean_dir_result = clean_dir(get_subdir(l1_index, l2_index),
                                             level_2_max_size,
                                             level_2_max_files,
+                                            m_config.eviction_policy(),
+                                            demoter,
                                             max_age,
                                             namespace_,
-                                            l2_progress_receiver);
-          uint64_t removed_size =
-            clean_dir_result.before.size - clean_dir_result.after.size;
-          uint64_t removed_files =
-            clean_dir_result.before.files - clean_dir_result.after.files;
-
-          // removed_size/remove_files should never be larger than
-          // current_size/current_files, but in case there's some error we
-          // certainly don't want to underflow, so better safe than sorry.
-          current_size -= std::min(removed_size, current_size);
-          current_files -= std::min(removed_files, current_files);
+                                            l2_progress_receiver,
+                                            eviction_permit);
+          if (!eviction_permit) {
+            uint64_t removed_size =
+              clean_dir_result.before.size - clean_dir_result.after.size;
+            uint64_t removed_files =
+              clean_dir_result.before.files - clean_dir_result.after.files;
+
+            // removed_size/remove_files should never be larger than
+            // current_size/current_files, but in case there's some error we
+            // certainly don't want to underflow, so better safe than sorry.
+            saturating_subtract(current_size, removed_size);
+            saturating_subtract(current_files, removed_files);
+          }
 
           level_1_counters.level_2_counters[l2_index] = clean_dir_result.after;
           if (clean_dir_result.after.files != clean_dir_result.before.files) {
@@ -1395,21 +2151,21 @@ LocalStorage::evaluate_cleanup()
   });
 
   std::string max_size_str =
-    m_config.max_size() > 0
+    max_size() > 0
       ? FMT(", max size {}",
-            util::format_human_readable_size(m_config.max_size(),
+            util::format_human_readable_size(max_size(),
                                              m_config.size_unit_prefix_type()))
       : "";
   std::string max_files_str =
-    m_config.max_files() > 0 ? FMT(", max files {}", m_config.max_files()) : "";
+    max_files() > 0 ? FMT(", max files {}", max_files()) : "";
   std::string info_str = FMT("size {}, files {}{}{}",
                              util::format_human_readable_size(
                                total_size, m_config.size_unit_prefix_type()),
                              total_files,
                              max_size_str,
                              max_files_str);
-  if ((m_config.max_size() == 0 || total_size <= m_config.max_size())
-      && (m_config.max_files() == 0 || total_files <= m_config.max_files())) {
+  if ((max_size() == 0 || total_size <= max_size())
+      && (max_files() == 0 || total_files <= max_files())) {
     LOG("No automatic cleanup needed ({})", info_str);
     return std::nullopt;
   }
@@ -1490,7 +2246,7 @@ LocalStorage::get_path_in_cache(const uint8_t level,
   ASSERT(level >= 1 && level <= 8);
   ASSERT(name.length() >= level);
 
-  std::string path(m_config.cache_dir());
+  std::string path(cache_dir());
   path.reserve(path.size() + level * 2 + 1 + name.length() - level);
 
   for (uint8_t i = 0; i < level; ++i) {
@@ -1508,7 +2264,7 @@ LocalStorage::get_path_in_cache(const uint8_t level,
 std::string
 LocalStorage::get_lock_path(const std::string& name) const
 {
-  auto path = FMT("{}/lock/{}", m_config.cache_dir(), name);
+  auto path = FMT("{}/lock/{}", cache_dir(), name);
   core::ensure_dir_exists(fs::path(path).parent_path());
   return path;
 }
@@ -1532,4 +2288,14 @@ LocalStorage::get_level_2_content_lock(uint8_t l1_index, uint8_t l2_index) const
     get_lock_path(FMT("subdir_{:x}{:x}", l1_index, l2_index)));
 }
 
+bool
+LocalStorage::acquire_content_lock(util::LockFile& lock)
+{
+  const auto start = util::TimePoint::now();
+  const bool acquired = lock.acquire();
+  record_latency(Statistic::lock_wait_histogram_base,
+                 util::TimePoint::now() - start);
+  return acquired;
+}
+
 } // namespace storage::local
@@ -26,13 +26,18 @@
 #include <storage/local/util.hpp>
 #include <storage/types.hpp>
 #include <util/Bytes.hpp>
+#include <util/Duration.hpp>
 #include <util/LockFile.hpp>
+#include <util/MemoryMap.hpp>
 #include <util/TimePoint.hpp>
 
 #include <third_party/nonstd/span.hpp>
 
 #include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string_view>
 #include <vector>
@@ -53,10 +58,21 @@ struct CompressionStatistics
   uint64_t incompressible_size;
 };
 
-enum class FileType { result, manifest, raw, unknown };
+enum class FileType { result, manifest, raw, chunk, unknown };
 
 FileType file_type_from_path(const std::filesystem::path& path);
 
+// With cold_cache_dir set, local storage consists of two tiers: a hot tier in
+// cache_dir limited by max_size and max_files, and a cold tier in
+// cold_cache_dir limited by cold_max_size. Each tier has its own directory
+// layout, locks and statistics. Entries found only in the cold tier are
+// promoted (copied) to the hot tier and entries evicted from the hot tier by
+// cleanup are demoted (copied) to the cold tier instead of being lost.
+//
+// With base_cache_dir set, a read-only base tier is consulted last. Entries
+// found there are promoted to the hot tier by cloning or hard linking if
+// possible. No files, not even statistics, are written to the base tier, but
+// hard linked files share timestamps with the hot tier.
 class LocalStorage
 {
 public:
@@ -66,8 +82,9 @@ public:
 
   // --- Cache entry handling ---
 
-  std::optional<util::Bytes> get(const Hash::Digest& key,
-                                 core::CacheEntryType type);
+  // The returned data may be memory-mapped, see util::MemoryMap.
+  std::optional<util::MemoryMap> get(const Hash::Digest& key,
+                                     core::CacheEntryType type);
 
   void put(const Hash::Digest& key,
            core::CacheEntryType type,
@@ -76,6 +93,30 @@ public:
 
   void remove(const Hash::Digest& key, core::CacheEntryType type);
 
+  // Mark an existing entry as recently used so that it's not evicted before
+  // entries that depend on it. Returns false if there is no such entry.
+  bool touch(const Hash::Digest& key, core::CacheEntryType type);
+
+  // Manifest updates are appended as delta records (cache entries with a
+  // single-result manifest each) to a file next to the manifest instead of
+  // rewriting the manifest. If there is no manifest, the record becomes the
+  // manifest. No lock is needed, so concurrent updates neither wait for each
+  // other nor overwrite each other. The records are merged on read and
+  // compacted with compact_manifest().
+  void append_manifest_delta(const Hash::Digest& key,
+                             nonstd::span<const uint8_t> value);
+  std::optional<util::Bytes> get_manifest_deltas(const Hash::Digest& key);
+
+  // Called with the stored manifest and its delta records (empty if missing).
+  // Returns the manifest to store.
+  using ManifestMerger = std::function<util::Bytes(
+    nonstd::span<const uint8_t> manifest, nonstd::span<const uint8_t> deltas)>;
+
+  // Replace the manifest and its delta records with the result of `merge`.
+  // The stored manifest is read and replaced while holding the level 2 content
+  // lock, so concurrent compactions don't lose each other's updates.
+  void compact_manifest(const Hash::Digest& key, const ManifestMerger& merge);
+
   static std::string get_raw_file_path(std::string_view result_path,
                                        uint8_t file_number);
   std::string get_raw_file_path(const Hash::Digest& result_key,
@@ -96,6 +137,8 @@ public:
 
   void increment_statistic(core::Statistic statistic, int64_t value = 1);
   void increment_statistics(const core::StatisticsCounters& statistics);
+  void record_latency(core::Statistic histogram,
+                      const util::Duration& duration);
 
   const core::StatisticsCounters& get_statistics_updates() const;
 
@@ -107,20 +150,34 @@ public:
   std::pair<core::StatisticsCounters, util::TimePoint>
   get_all_statistics() const;
 
+  // Get statistics for each namespace (see the namespace configuration option)
+  // that has been used, sorted by namespace.
+  std::vector<std::pair<std::string, core::StatisticsCounters>>
+  get_namespace_statistics() const;
+
+  // Get statistics for the cold tier, or std::nullopt if there is none.
+  std::optional<core::StatisticsCounters> get_cold_tier_statistics() const;
+
   // --- Cleanup ---
 
+  // The `threads` parameter of the methods below specifies the maximum number
+  // of level 1 directories to process concurrently.
+
   void evict(const ProgressReceiver& progress_receiver,
              std::optional<uint64_t> max_age,
-             std::optional<std::string> namespace_);
+             std::optional<std::string> namespace_,
+             uint32_t threads = 1);
 
-  void clean_all(const ProgressReceiver& progress_receiver);
+  void clean_all(const ProgressReceiver& progress_receiver,
+                 uint32_t threads = 1);
 
   void wipe_all(const ProgressReceiver& progress_receiver);
 
   // --- Compression ---
 
   CompressionStatistics
-  get_compression_statistics(const ProgressReceiver& progress_receiver) const;
+  get_compression_statistics(const ProgressReceiver& progress_receiver,
+                             uint32_t threads = 1) const;
 
   void recompress(std::optional<int8_t> level,
                   uint32_t threads,
@@ -129,6 +186,14 @@ public:
 private:
   const Config& m_config;
 
+  enum class Tier { hot, cold, base };
+  const Tier m_tier;
+
+  // Only used if cold_cache_dir and base_cache_dir respectively are set, see
+  // cold_tier() and base_tier().
+  std::unique_ptr<LocalStorage> m_cold_tier;
+  std::unique_ptr<LocalStorage> m_base_tier;
+
   // Statistics updates (excluding size/count changes) that will get written to
   // a statistics file in the finalize method.
   core::StatisticsCounters m_counter_updates;
@@ -145,6 +210,57 @@ private:
 
   LookUpCacheFileResult look_up_cache_file(const Hash::Digest& key,
                                            core::CacheEntryType type) const;
+  LookUpCacheFileResult look_up_cache_file(const Hash::Digest& key,
+                                           std::string_view suffix) const;
+
+  LocalStorage(const Config& config, Tier tier);
+
+  // Directory and limits of this tier. The configuration is read after
+  // construction, so these must not be cached.
+  const std::string& cache_dir() const;
+  uint64_t max_size() const;
+  uint64_t max_files() const;
+
+  // Return the cold or base tier, or nullptr if there is none.
+  LocalStorage* cold_tier() const;
+  LocalStorage* base_tier() const;
+
+  // Copy the entry for `key` from the lower tier `tier` to this tier,
+  // including associated raw files and manifest delta records.
+  std::optional<util::MemoryMap> promote(LocalStorage& tier,
+                                         const Hash::Digest& key,
+                                         core::CacheEntryType type);
+
+  // Copy the cache file `path` from another tier to this tier unless it
+  // already exists, in which case it's only marked as recently used. `name` is
+  // the file name including the directory characters, like for
+  // get_path_in_cache. If `clone` is true, the file is cloned if possible,
+  // which requires that `path` is never modified in place. Files are never
+  // hard linked since the cache file would then share timestamps and content
+  // changes with `path`. If `state_mutex`
+  // is set, import_file may be called concurrently: the file is copied without
+  // holding it, but it's locked while updating member state. Returns the path
+  // of the file in this tier.
+  std::optional<std::string> import_file(std::string_view name,
+                                         const std::string& path,
+                                         bool clone,
+                                         std::mutex* state_mutex = nullptr);
+
+  // Return a function that demotes a file evicted from this tier to the cold
+  // tier, or an empty function if there is no cold tier.
+  std::function<void(const util::DirEntry&)> get_demoter();
+
+  // Write `value` to `path` unless it exists. Returns true if created.
+  bool create_file_exclusively(const std::string& path,
+                               nonstd::span<const uint8_t> value);
+
+  // Update statistics, eviction index and cache level after storing `value`
+  // in `cache_file` while holding `l2_content_lock`.
+  void finish_put(const Hash::Digest& key,
+                  core::CacheEntryType type,
+                  nonstd::span<const uint8_t> value,
+                  const LookUpCacheFileResult& cache_file,
+                  util::LockFile& l2_content_lock);
 
   std::string get_subdir(uint8_t l1_index) const;
   std::string get_subdir(uint8_t l1_index, uint8_t l2_index) const;
@@ -152,6 +268,14 @@ private:
   StatsFile get_stats_file(uint8_t l1_index) const;
   StatsFile get_stats_file(uint8_t l1_index, uint8_t l2_index) const;
 
+  // Per-namespace statistics are spread over 16 files in
+  // $CCACHE_DIR/namespace_stats/<escaped namespace>/, which is only created
+  // when writing.
+  std::string get_namespace_stats_root() const;
+  std::string get_namespace_stats_dir(std::string_view namespace_) const;
+  StatsFile get_namespace_stats_file(std::string_view namespace_,
+                                     uint8_t index) const;
+
   void move_to_wanted_cache_level(const core::StatisticsCounters& counters,
                                   const Hash::Digest& key,
                                   core::CacheEntryType type,
@@ -171,7 +295,8 @@ private:
                     uint64_t max_size,
                     uint64_t max_files,
                     std::optional<uint64_t> max_age,
-                    std::optional<std::string> namespace_);
+                    std::optional<std::string> namespace_,
+                    uint32_t threads);
 
   struct EvaluateCleanupResult
   {
@@ -205,6 +330,9 @@ private:
   util::LockFile get_level_2_content_lock(const Hash::Digest& key) const;
   util::LockFile get_level_2_content_lock(uint8_t l1_index,
                                           uint8_t l2_index) const;
+
+  // Acquire `lock` and record the time spent waiting for it.
+  bool acquire_content_lock(util::LockFile& lock);
 };
 
 // --- Inline implementations ---
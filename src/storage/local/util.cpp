@@ -20,12 +20,20 @@
 
 #include <Util.hpp>
 #include <core/exceptions.hpp>
+#include <storage/local/EvictionIndex.hpp>
 #include <util/PathString.hpp>
+#include <util/ThreadPool.hpp>
 #include <util/expected.hpp>
 #include <util/file.hpp>
 #include <util/fmtmacros.hpp>
 #include <util/string.hpp>
 
+#include <algorithm>
+#include <array>
+#include <exception>
+#include <mutex>
+#include <numeric>
+
 using util::DirEntry;
 using pstr = util::PathString;
 
@@ -53,6 +61,50 @@ for_each_cache_subdir(const ProgressReceiver& progress_receiver,
   progress_receiver(1.0);
 }
 
+void
+for_each_cache_subdir(uint32_t threads,
+                      const ProgressReceiver& progress_receiver,
+                      const SubdirProgressVisitor& visitor)
+{
+  std::mutex mutex;
+  std::array<double, 16> subdir_progress{};
+  std::exception_ptr first_exception;
+
+  auto report_progress = [&](uint8_t index, double progress) {
+    std::unique_lock<std::mutex> lock(mutex);
+    subdir_progress[index] = progress;
+    progress_receiver(
+      std::accumulate(subdir_progress.begin(), subdir_progress.end(), 0.0)
+      / 16);
+  };
+
+  progress_receiver(0.0);
+  {
+    util::ThreadPool thread_pool(std::clamp(threads, 1U, 16U));
+    for (uint8_t i = 0; i < 16; ++i) {
+      thread_pool.enqueue([&, i] {
+        try {
+          visitor(i, [&](double inner_progress) {
+            report_progress(i, inner_progress);
+          });
+        } catch (...) {
+          std::unique_lock<std::mutex> lock(mutex);
+          if (!first_exception) {
+            first_exception = std::current_exception();
+          }
+        }
+        report_progress(i, 1.0);
+      });
+    }
+    thread_pool.shut_down();
+  }
+
+  if (first_exception) {
+    std::rethrow_exception(first_exception);
+  }
+  progress_receiver(1.0);
+}
+
 void
 for_each_level_1_and_2_stats_file(
   const std::string& cache_dir,
@@ -78,6 +130,7 @@ get_cache_dir_files(const std::string& dir)
     util::traverse_directory(dir, [&](const auto& de) {
       std::string name = pstr(de.path().filename()).str();
       if (name == "CACHEDIR.TAG" || name == "stats"
+          || name == EvictionIndex::k_filename
           || util::starts_with(name, ".nfs")) {
         return;
       }
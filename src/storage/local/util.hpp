@@ -20,6 +20,7 @@
 
 #include <util/DirEntry.hpp>
 
+#include <cstdint>
 #include <functional>
 #include <string>
 #include <vector>
@@ -36,6 +37,15 @@ void for_each_cache_subdir(const SubdirVisitor& visitor);
 void for_each_cache_subdir(const ProgressReceiver& progress_receiver,
                            const SubdirProgressVisitor& visitor);
 
+// Like the above but visit the 16 subdirectories concurrently using up to
+// `threads` threads. The visitor must be safe to call from several threads at
+// once. Progress reported by the visitors is aggregated and forwarded to
+// `progress_receiver`, which is never called concurrently. If a visitor throws,
+// the first exception is rethrown when all visitors have finished.
+void for_each_cache_subdir(uint32_t threads,
+                           const ProgressReceiver& progress_receiver,
+                           const SubdirProgressVisitor& visitor);
+
 void for_each_level_1_and_2_stats_file(
   const std::string& cache_dir,
   const std::function<void(const std::string& path)> function);
@@ -20,10 +20,22 @@
 
 #include <util/assertions.hpp>
 
+namespace {
+
+// Unlike std::make_unique, this doesn't zero the bytes, which would touch each
+// page of a large buffer once more before it's written anyway.
+std::unique_ptr<uint8_t[]>
+allocate_uninitialized(size_t size)
+{
+  return std::unique_ptr<uint8_t[]>(new uint8_t[size]);
+}
+
+} // namespace
+
 namespace util {
 
 Bytes::Bytes(const Bytes& other) noexcept
-  : m_data(std::make_unique<uint8_t[]>(other.m_size)),
+  : m_data(allocate_uninitialized(other.m_size)),
     m_size(other.m_size),
     m_capacity(other.m_size)
 {
@@ -48,7 +60,7 @@ Bytes::operator=(const Bytes& other) noexcept
   if (&other == this) {
     return *this;
   }
-  m_data = std::make_unique<uint8_t[]>(other.m_size);
+  m_data = allocate_uninitialized(other.m_size);
   m_size = other.m_size;
   m_capacity = other.m_size;
   if (m_size > 0) {
@@ -76,7 +88,7 @@ void
 Bytes::reserve(size_t size) noexcept
 {
   if (size > m_capacity) {
-    auto data = std::make_unique<uint8_t[]>(size);
+    auto data = allocate_uninitialized(size);
     if (m_size > 0) {
       std::memcpy(data.get(), m_data.get(), m_size);
     }
@@ -97,7 +109,7 @@ Bytes::insert(const uint8_t* pos,
   const size_t offset = pos - m_data.get();
   if (m_size + inserted_size > m_capacity) {
     m_capacity = std::max(2 * m_capacity, m_size + inserted_size);
-    auto new_data = std::make_unique<uint8_t[]>(m_capacity);
+    auto new_data = allocate_uninitialized(m_capacity);
     if (offset > 0) {
       std::memcpy(new_data.get(), m_data.get(), offset);
     }
@@ -120,7 +132,7 @@ void
 Bytes::resize(size_t size) noexcept
 {
   if (size > m_capacity) {
-    auto new_data = std::make_unique<uint8_t[]>(size);
+    auto new_data = allocate_uninitialized(size);
     if (m_size > 0) {
       std::memcpy(new_data.get(), m_data.get(), m_size);
     }
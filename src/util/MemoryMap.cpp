@@ -0,0 +1,135 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "MemoryMap.hpp"
+
+#include <util/DirEntry.hpp>
+#include <util/Fd.hpp>
+#include <util/PathString.hpp>
+#include <util/file.hpp>
+#include <util/filesystem.hpp>
+#include <util/wincompat.hpp>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+namespace fs = util::filesystem;
+
+using pstr = util::PathString;
+
+namespace util {
+
+MemoryMap::MemoryMap(MemoryMap&& other) noexcept
+  : m_map(std::exchange(other.m_map, nullptr)),
+    m_map_size(std::exchange(other.m_map_size, 0)),
+    m_buffer(std::move(other.m_buffer))
+{
+}
+
+MemoryMap::~MemoryMap()
+{
+  unmap();
+}
+
+MemoryMap&
+MemoryMap::operator=(MemoryMap&& other) noexcept
+{
+  if (this != &other) {
+    unmap();
+    m_map = std::exchange(other.m_map, nullptr);
+    m_map_size = std::exchange(other.m_map_size, 0);
+    m_buffer = std::move(other.m_buffer);
+  }
+  return *this;
+}
+
+tl::expected<MemoryMap, std::string>
+MemoryMap::open(const fs::path& path, size_t size_hint)
+{
+  if (size_hint == 0) {
+    DirEntry de(path);
+    if (!de) {
+      return tl::unexpected(strerror(de.error_number()));
+    }
+    size_hint = de.size();
+  }
+
+  MemoryMap result;
+
+#ifdef HAVE_SYS_MMAN_H
+  if (size_hint >= k_min_map_size) {
+    Fd fd(::open(pstr(path), O_RDONLY | O_BINARY));
+    if (!fd) {
+      return tl::unexpected(strerror(errno));
+    }
+
+    // The size hint may belong to a file that has since been replaced, so map
+    // the size of the opened file to not access pages beyond its end.
+    struct stat st;
+    if (fstat(*fd, &st) != 0) {
+      return tl::unexpected(strerror(errno));
+    }
+    const auto size = static_cast<size_t>(st.st_size);
+    if (size < k_min_map_size) {
+      auto data = read_fd(*fd);
+      if (!data) {
+        return tl::unexpected(data.error());
+      }
+      result.m_buffer = std::move(*data);
+      return result;
+    }
+
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, *fd, 0);
+    if (map == MAP_FAILED) {
+      return tl::unexpected(strerror(errno));
+    }
+    result.m_map = map;
+    result.m_map_size = size;
+    return result;
+  }
+#endif
+
+  auto data = read_file<Bytes>(path, size_hint);
+  if (!data) {
+    return tl::unexpected(data.error());
+  }
+  result.m_buffer = std::move(*data);
+  return result;
+}
+
+void
+MemoryMap::unmap()
+{
+#ifdef HAVE_SYS_MMAN_H
+  if (m_map) {
+    munmap(m_map, m_map_size);
+  }
+#endif
+  m_map = nullptr;
+  m_map_size = 0;
+}
+
+} // namespace util
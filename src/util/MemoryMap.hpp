@@ -0,0 +1,83 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#pragma once
+
+#include <util/Bytes.hpp>
+#include <util/NonCopyable.hpp>
+
+#include <third_party/nonstd/span.hpp>
+#include <third_party/tl/expected.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace util {
+
+// Read-only view of the content of a file. Files of at least `k_min_map_size`
+// bytes are memory-mapped where supported, others are read into memory since
+// mapping a small file costs more than reading it.
+//
+// The file must not be truncated or modified in place while mapped, which holds
+// for cache entries since they are only ever replaced by rename.
+class MemoryMap : NonCopyable
+{
+public:
+  static constexpr size_t k_min_map_size = 64 * 1024;
+
+  MemoryMap() = default;
+  MemoryMap(MemoryMap&& other) noexcept;
+  ~MemoryMap();
+
+  MemoryMap& operator=(MemoryMap&& other) noexcept;
+
+  // If `size_hint` is not 0 then it is assumed that `path` has this size (this
+  // saves a system call).
+  static tl::expected<MemoryMap, std::string>
+  open(const std::filesystem::path& path, size_t size_hint = 0);
+
+  nonstd::span<const uint8_t> data() const;
+
+  // Whether the content is memory-mapped instead of read into memory.
+  bool is_mapped() const;
+
+private:
+  void* m_map = nullptr;
+  size_t m_map_size = 0;
+  Bytes m_buffer;
+
+  void unmap();
+};
+
+inline nonstd::span<const uint8_t>
+MemoryMap::data() const
+{
+  return m_map ? nonstd::span<const uint8_t>(
+                   static_cast<const uint8_t*>(m_map), m_map_size)
+               : nonstd::span<const uint8_t>(m_buffer);
+}
+
+inline bool
+MemoryMap::is_mapped() const
+{
+  return m_map != nullptr;
+}
+
+} // namespace util
@@ -0,0 +1,65 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "StringInterner.hpp"
+
+#include <cstring>
+
+namespace {
+
+const size_t k_block_size = 64 * 1024;
+
+} // namespace
+
+namespace util {
+
+std::string_view
+StringInterner::intern(std::string_view str)
+{
+  const auto it = m_strings.find(str);
+  if (it != m_strings.end()) {
+    return *it;
+  }
+  char* data = allocate(str.size());
+  if (!str.empty()) {
+    memcpy(data, str.data(), str.size());
+  }
+  return *m_strings.emplace(data, str.size()).first;
+}
+
+char*
+StringInterner::allocate(size_t size)
+{
+  if (size > k_block_size / 4) {
+    // Give large strings a block of their own so that the rest of the current
+    // block isn't wasted.
+    m_blocks.push_back(std::make_unique<char[]>(size));
+    return m_blocks.back().get();
+  }
+  if (size > m_left) {
+    m_blocks.push_back(std::make_unique<char[]>(k_block_size));
+    m_next = m_blocks.back().get();
+    m_left = k_block_size;
+  }
+  char* result = m_next;
+  m_next += size;
+  m_left -= size;
+  return result;
+}
+
+} // namespace util
@@ -0,0 +1,62 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#pragma once
+
+#include <util/NonCopyable.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace util {
+
+// Stores each distinct string once in memory allocated in large blocks that
+// are only freed when the interner is destroyed. Interned strings are therefore
+// cheap to create and can be referred to by std::string_view for as long as the
+// interner lives.
+class StringInterner : NonCopyable
+{
+public:
+  StringInterner() = default;
+
+  // Return a view of a stored copy of `str`. The same view is returned for
+  // equal strings.
+  std::string_view intern(std::string_view str);
+
+  // Return the number of distinct strings.
+  size_t size() const;
+
+private:
+  std::vector<std::unique_ptr<char[]>> m_blocks;
+  char* m_next = nullptr;
+  size_t m_left = 0;
+  std::unordered_set<std::string_view> m_strings;
+
+  char* allocate(size_t size);
+};
+
+inline size_t
+StringInterner::size() const
+{
+  return m_strings.size();
+}
+
+} // namespace util
@@ -0,0 +1,128 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "chunking.hpp"
+
+#include <util/assertions.hpp>
+
+#include <algorithm>
+#include <array>
+
+namespace util {
+
+namespace {
+
+// Random values for the gear hash, generated with SplitMix64. They must never
+// change since that would change all chunk boundaries.
+constexpr std::array<uint64_t, 256>
+make_gear_table()
+{
+  std::array<uint64_t, 256> table{};
+  uint64_t state = 0;
+  for (auto& value : table) {
+    state += 0x9e3779b97f4a7c15;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    value = z ^ (z >> 31);
+  }
+  return table;
+}
+
+constexpr auto k_gear = make_gear_table();
+
+// Mask with the `bits` most significant bits set. Since the gear hash is
+// shifted left for each byte, the top bits depend on the last 64 bytes.
+uint64_t
+top_bits_mask(unsigned bits)
+{
+  return bits == 0 ? 0 : ~uint64_t(0) << (64 - bits);
+}
+
+unsigned
+log2(size_t value)
+{
+  unsigned result = 0;
+  while (value > 1) {
+    value >>= 1;
+    ++result;
+  }
+  return result;
+}
+
+// Return the size of the first chunk of `data`.
+size_t
+find_cut_point(nonstd::span<const uint8_t> data,
+               size_t min_size,
+               size_t average_size,
+               size_t max_size,
+               uint64_t mask_small,
+               uint64_t mask_large)
+{
+  size_t size = data.size();
+  if (size <= min_size) {
+    return size;
+  }
+  size = std::min(size, max_size);
+  const size_t normal_size = std::min(average_size, size);
+
+  // Normalized chunking: use a harder cut condition before the average size
+  // and an easier one after it to concentrate sizes around the average.
+  uint64_t hash = 0;
+  size_t i = min_size;
+  for (; i < normal_size; ++i) {
+    hash = (hash << 1) + k_gear[data[i]];
+    if ((hash & mask_small) == 0) {
+      return i + 1;
+    }
+  }
+  for (; i < size; ++i) {
+    hash = (hash << 1) + k_gear[data[i]];
+    if ((hash & mask_large) == 0) {
+      return i + 1;
+    }
+  }
+  return size;
+}
+
+} // namespace
+
+std::vector<nonstd::span<const uint8_t>>
+split_into_chunks(nonstd::span<const uint8_t> data,
+                  size_t min_size,
+                  size_t average_size,
+                  size_t max_size)
+{
+  ASSERT(min_size <= average_size && average_size <= max_size);
+  ASSERT((average_size & (average_size - 1)) == 0);
+
+  const unsigned bits = log2(average_size);
+  const uint64_t mask_small = top_bits_mask(bits + 2);
+  const uint64_t mask_large = top_bits_mask(bits >= 2 ? bits - 2 : 0);
+
+  std::vector<nonstd::span<const uint8_t>> chunks;
+  while (!data.empty()) {
+    const size_t size = find_cut_point(
+      data, min_size, average_size, max_size, mask_small, mask_large);
+    chunks.push_back(data.first(size));
+    data = data.subspan(size);
+  }
+  return chunks;
+}
+
+} // namespace util
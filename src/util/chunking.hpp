@@ -0,0 +1,41 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#pragma once
+
+#include <third_party/nonstd/span.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace util {
+
+// Split `data` into content-defined chunks using FastCDC with normalized
+// chunking. Chunk boundaries depend only on the bytes near them, so data that
+// is inserted or removed in one place only changes the chunks around it.
+//
+// All chunks except the last are between `min_size` and `max_size` bytes.
+// `average_size` must be a power of two between `min_size` and `max_size`.
+std::vector<nonstd::span<const uint8_t>>
+split_into_chunks(nonstd::span<const uint8_t> data,
+                  size_t min_size,
+                  size_t average_size,
+                  size_t max_size);
+
+} // namespace util
@@ -18,8 +18,12 @@
 
 #include "zstd.hpp"
 
+#include <util/Finalizer.hpp>
+
 #include <zstd.h>
 
+#include <algorithm>
+
 namespace util {
 
 tl::expected<void, std::string>
@@ -63,6 +67,136 @@ zstd_decompress(nonstd::span<const uint8_t> input,
   return {};
 }
 
+tl::expected<void, std::string>
+zstd_decompress(
+  nonstd::span<const uint8_t> input,
+  Bytes& output,
+  size_t original_size,
+  const std::function<void(nonstd::span<const uint8_t>)>& input_observer)
+{
+  const size_t chunk_size = ZSTD_DStreamInSize();
+  const size_t original_output_size = output.size();
+  output.resize(original_output_size + original_size);
+
+  ZSTD_DStream* zstd_stream = ZSTD_createDStream();
+  if (!zstd_stream) {
+    return tl::unexpected("Failed to create decompression stream");
+  }
+  Finalizer stream_freer([&] { ZSTD_freeDStream(zstd_stream); });
+  ZSTD_initDStream(zstd_stream);
+
+  ZSTD_outBuffer out{&output[original_output_size], original_size, 0};
+  size_t ret = 0;
+  for (size_t pos = 0; pos < input.size(); pos += chunk_size) {
+    const auto chunk =
+      input.subspan(pos, std::min(chunk_size, input.size() - pos));
+    input_observer(chunk);
+    ZSTD_inBuffer in{chunk.data(), chunk.size(), 0};
+    while (in.pos < in.size) {
+      const size_t in_pos = in.pos;
+      const size_t out_pos = out.pos;
+      ret = ZSTD_decompressStream(zstd_stream, &out, &in);
+      if (ZSTD_isError(ret)) {
+        return tl::unexpected(ZSTD_getErrorName(ret));
+      }
+      if (in.pos == in_pos && out.pos == out_pos) {
+        // No progress, so the output buffer is full.
+        return tl::unexpected("Decompressed data larger than expected");
+      }
+    }
+  }
+  if (ret != 0) {
+    return tl::unexpected("Truncated compressed data");
+  }
+
+  output.resize(original_output_size + out.pos);
+  return {};
+}
+
+tl::expected<void, std::string>
+zstd_compress_delta(nonstd::span<const uint8_t> input,
+                    nonstd::span<const uint8_t> base,
+                    Bytes& output,
+                    int8_t compression_level)
+{
+  ZSTD_CCtx* cctx = ZSTD_createCCtx();
+  if (!cctx) {
+    return tl::unexpected("Failed to create compression context");
+  }
+  Finalizer cctx_freer([&] { ZSTD_freeCCtx(cctx); });
+
+  // The window must cover the base so that matches against all of it can be
+  // used, like zstd --patch-from does.
+  const auto bounds = ZSTD_cParam_getBounds(ZSTD_c_windowLog);
+  int window_log = bounds.lowerBound;
+  while (window_log < bounds.upperBound
+         && (size_t(1) << window_log) < base.size() + input.size()) {
+    ++window_log;
+  }
+
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, compression_level);
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, window_log);
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, 1);
+  // The base may have been replaced by different content with the same key,
+  // e.g. output from a nondeterministic compiler, so make sure that applying
+  // the delta to the wrong base is detected.
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+  size_t ret = ZSTD_CCtx_refPrefix(cctx, base.data(), base.size());
+  if (ZSTD_isError(ret)) {
+    return tl::unexpected(ZSTD_getErrorName(ret));
+  }
+
+  const size_t original_output_size = output.size();
+  const size_t compress_bound = zstd_compress_bound(input.size());
+  output.resize(original_output_size + compress_bound);
+  ret = ZSTD_compress2(cctx,
+                       &output[original_output_size],
+                       compress_bound,
+                       input.data(),
+                       input.size());
+  if (ZSTD_isError(ret)) {
+    return tl::unexpected(ZSTD_getErrorName(ret));
+  }
+
+  output.resize(original_output_size + ret);
+  return {};
+}
+
+tl::expected<void, std::string>
+zstd_decompress_delta(nonstd::span<const uint8_t> input,
+                      nonstd::span<const uint8_t> base,
+                      Bytes& output,
+                      size_t original_size)
+{
+  ZSTD_DCtx* dctx = ZSTD_createDCtx();
+  if (!dctx) {
+    return tl::unexpected("Failed to create decompression context");
+  }
+  Finalizer dctx_freer([&] { ZSTD_freeDCtx(dctx); });
+
+  ZSTD_DCtx_setParameter(dctx,
+                         ZSTD_d_windowLogMax,
+                         ZSTD_dParam_getBounds(ZSTD_d_windowLogMax).upperBound);
+  size_t ret = ZSTD_DCtx_refPrefix(dctx, base.data(), base.size());
+  if (ZSTD_isError(ret)) {
+    return tl::unexpected(ZSTD_getErrorName(ret));
+  }
+
+  const size_t original_output_size = output.size();
+  output.resize(original_output_size + original_size);
+  ret = ZSTD_decompressDCtx(dctx,
+                            &output[original_output_size],
+                            original_size,
+                            input.data(),
+                            input.size());
+  if (ZSTD_isError(ret)) {
+    return tl::unexpected(ZSTD_getErrorName(ret));
+  }
+
+  output.resize(original_output_size + ret);
+  return {};
+}
+
 size_t
 zstd_compress_bound(size_t input_size)
 {
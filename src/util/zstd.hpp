@@ -24,6 +24,7 @@
 #include <third_party/tl/expected.hpp>
 
 #include <cstdint>
+#include <functional>
 #include <string>
 #include <tuple>
 
@@ -35,6 +36,31 @@ namespace util {
 [[nodiscard]] tl::expected<void, std::string> zstd_decompress(
   nonstd::span<const uint8_t> input, Bytes& output, size_t original_size);
 
+// Like above but decompresses `input` in chunks, passing each chunk to
+// `input_observer` just before decompressing it. This lets the caller process
+// the input (e.g. checksum it) while it's still in the CPU cache instead of in
+// a separate pass.
+[[nodiscard]] tl::expected<void, std::string> zstd_decompress(
+  nonstd::span<const uint8_t> input,
+  Bytes& output,
+  size_t original_size,
+  const std::function<void(nonstd::span<const uint8_t>)>& input_observer);
+
+// Compress `input` as a delta against `base`, like `zstd --patch-from`. The
+// result can only be decompressed with zstd_decompress_delta and the same
+// `base`, which detects if a different base is used.
+[[nodiscard]] tl::expected<void, std::string>
+zstd_compress_delta(nonstd::span<const uint8_t> input,
+                    nonstd::span<const uint8_t> base,
+                    Bytes& output,
+                    int8_t compression_level);
+
+[[nodiscard]] tl::expected<void, std::string>
+zstd_decompress_delta(nonstd::span<const uint8_t> input,
+                      nonstd::span<const uint8_t> base,
+                      Bytes& output,
+                      size_t original_size);
+
 size_t zstd_compress_bound(size_t input_size);
 
 std::tuple<int8_t, std::string>
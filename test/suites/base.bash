@@ -1411,6 +1411,40 @@ EOF
     expect_content stdout "cc_out|"
     expect_content stderr "cpp_err|cc_err|"
 
+    # -------------------------------------------------------------------------
+    TEST "Compiler leaving a background process"
+
+    cat >compiler.sh <<EOF
+#!/bin/sh
+if [ \$1 != -E ]; then
+    # Keeps the compiler's stdout and stderr open.
+    sleep 30 </dev/null &
+    echo \$! >sleep.pid
+    printf "cc_err|" >&2
+fi
+exec $COMPILER "\$@"
+EOF
+    chmod +x compiler.sh
+
+    start=$(date +%s)
+    $CCACHE ./compiler.sh -c test1.c 2>stderr
+    end=$(date +%s)
+    kill $(cat sleep.pid)
+    if [ $((end - start)) -ge 20 ]; then
+        test_failed "ccache waited for the background process"
+    fi
+    expect_stat cache_miss 1
+    expect_content stderr "cc_err|"
+
+    # -------------------------------------------------------------------------
+    TEST "Compiler that can't be executed"
+
+    printf 'garbage\n' >compiler.sh
+    chmod +x compiler.sh
+
+    $CCACHE ./compiler.sh -c test1.c 2>stderr
+    expect_stat preprocessor_error 1
+
     # -------------------------------------------------------------------------
     TEST "--zero-stats"
 
@@ -1425,6 +1459,31 @@ EOF
     expect_stat cache_miss 0
     expect_stat files_in_cache 1
 
+    # -------------------------------------------------------------------------
+    TEST "Latency histograms"
+
+    $CCACHE_COMPILE -c test1.c
+    $CCACHE_COMPILE -c test1.c
+    expect_stat preprocessed_cache_hit 1
+    expect_stat cache_miss 1
+
+    $CCACHE --print-stats --format openmetrics >stats.txt
+    expect_contains stats.txt "ccache_cache_miss_total 1"
+    expect_contains stats.txt "ccache_hit_latency_seconds_count 1"
+    expect_contains stats.txt "ccache_miss_overhead_seconds_count 1"
+    expect_contains stats.txt 'ccache_hit_latency_seconds_bucket{le="+Inf"} 1'
+    if [ "$(tail -n 1 stats.txt)" != "# EOF" ]; then
+        test_failed "Expected OpenMetrics output to end with # EOF"
+    fi
+
+    $CCACHE --show-stats -v >stats.txt
+    expect_contains stats.txt "Latency (mean / 95th percentile):"
+    expect_contains stats.txt "Miss overhead:"
+
+    $CCACHE -z >/dev/null
+    $CCACHE --print-stats --format openmetrics >stats.txt
+    expect_contains stats.txt "ccache_hit_latency_seconds_count 0"
+
     # -------------------------------------------------------------------------
     TEST "--clear"
 
@@ -0,0 +1,117 @@
+SUITE_base_cache_SETUP() {
+    unset CCACHE_NODIRECT
+    export CCACHE_BASECACHEDIR=$PWD/base
+
+    generate_code 1 test1.c
+    compile_in_base_cache test1.c
+    snapshot_base_cache
+}
+
+compile_in_base_cache() {
+    CCACHE_DIR=$CCACHE_BASECACHEDIR CCACHE_BASECACHEDIR= \
+        $CCACHE_COMPILE -c "$@"
+}
+
+snapshot_base_cache() {
+    backdate $(find base -type f)
+    find base -type f -exec cksum {} + | sort >base.before
+}
+
+expect_base_unmodified() {
+    find base -type f -exec cksum {} + | sort >base.after
+    if ! cmp -s base.before base.after; then
+        test_failed_internal "Base cache was modified"
+    fi
+    if [ -n "$(find base -type f -newer base.before)" ]; then
+        test_failed_internal "Base cache timestamps were modified"
+    fi
+}
+
+SUITE_base_cache() {
+    # -------------------------------------------------------------------------
+    TEST "Hit from base cache"
+
+    $CCACHE_COMPILE -c test1.c
+    expect_stat direct_cache_hit 1
+    expect_stat cache_miss 0
+    expect_file_count 1 '*M' $CCACHE_DIR
+    expect_file_count 1 '*R' $CCACHE_DIR
+    expect_base_unmodified
+
+    rm -r base
+    $CCACHE_COMPILE -c test1.c
+    expect_stat direct_cache_hit 2
+    expect_stat cache_miss 0
+
+    # -------------------------------------------------------------------------
+    TEST "Miss in base cache"
+
+    echo 'int x;' >>test1.c
+    $CCACHE_COMPILE -c test1.c
+    expect_stat cache_miss 1
+    expect_file_count 1 '*R' $CCACHE_DIR
+    expect_base_unmodified
+
+    # -------------------------------------------------------------------------
+    TEST "Base cache is not cleaned or wiped"
+
+    $CCACHE_COMPILE -c test1.c
+    expect_stat direct_cache_hit 1
+
+    $CCACHE -M 1k -c >/dev/null
+    $CCACHE --evict-older-than 0s >/dev/null
+    $CCACHE -C -z >/dev/null
+    expect_file_count 0 '*R' $CCACHE_DIR
+    expect_base_unmodified
+
+    $CCACHE -M 0 >/dev/null
+    $CCACHE_COMPILE -c test1.c
+    expect_stat direct_cache_hit 1
+
+    # -------------------------------------------------------------------------
+    TEST "Cold tier is used before base cache"
+
+    export CCACHE_COLDDIR=$PWD/cold
+    echo 'int x;' >>test1.c
+    $CCACHE_COMPILE -c test1.c
+    expect_stat cache_miss 1
+
+    $CCACHE -M 1k -c >/dev/null
+    expect_file_count 1 '*R' $CCACHE_COLDDIR
+
+    $CCACHE -M 0 >/dev/null
+    $CCACHE_COMPILE -c test1.c
+    expect_stat direct_cache_hit 1
+    expect_file_count 1 '*R' $CCACHE_DIR
+    expect_base_unmodified
+
+    # -------------------------------------------------------------------------
+    TEST "Manifest delta records in base cache"
+
+    echo '#include "test2.h"' >test2.c
+    for i in 0 1; do
+        echo "int x$i;" >test2.h
+        backdate test2.h
+        compile_in_base_cache test2.c
+    done
+    expect_exists "$(find base -name '*D')"
+    snapshot_base_cache
+
+    # The manifest and its delta records are promoted, and the new result is
+    # appended to the delta records in the local cache only.
+    echo "int x2;" >test2.h
+    backdate test2.h
+    $CCACHE_COMPILE -c test2.c
+    expect_stat cache_miss 1
+    expect_exists "$(find $CCACHE_DIR -name '*D')"
+    expect_base_unmodified
+
+    for i in 0 1 2; do
+        echo "int x$i;" >test2.h
+        backdate test2.h
+        $CCACHE_COMPILE -c test2.c
+    done
+    expect_stat direct_cache_hit 3
+    expect_stat cache_miss 1
+    expect_base_unmodified
+}
@@ -61,6 +61,17 @@ SUITE_cleanup() {
     expect_stat files_in_cache 2557
     expect_stat cleanups_performed 3
 
+    # -------------------------------------------------------------------------
+    TEST "Forced cache cleanup, several threads"
+
+    $CCACHE -F 2543 --threads 4 -c >/dev/null
+
+    expect_file_count 2543 '*R' $CCACHE_DIR
+    expect_stat files_in_cache 2543
+
+    $CCACHE -M 0 -F 0 --threads 4 -c >/dev/null
+    expect_stat files_in_cache 2543
+
     # -------------------------------------------------------------------------
     TEST "Automatic cache cleanup, file limit"
 
@@ -85,6 +96,24 @@ SUITE_cleanup() {
     expect_stat files_in_cache 2559
     expect_stat cleanups_performed 1
 
+    # -------------------------------------------------------------------------
+    TEST "Cache cleanup, GDSF eviction policy"
+
+    export CCACHE_EVICTIONPOLICY=gdsf
+
+    $CCACHE -F 2543 -c >/dev/null
+    expect_file_count 2543 '*R' $CCACHE_DIR
+    expect_stat files_in_cache 2543
+    expect_file_count 256 eviction_index $CCACHE_DIR
+
+    touch test.c
+    $CCACHE_COMPILE -c test.c
+    $CCACHE_COMPILE -c test.c
+    expect_stat local_storage_hit 1
+    if ! grep -q '^h .*R$' $CCACHE_DIR/*/*/eviction_index; then
+        test_failed "No hit recorded in eviction index"
+    fi
+
     # -------------------------------------------------------------------------
     TEST "Cleanup of tmp file"
 
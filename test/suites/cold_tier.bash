@@ -0,0 +1,81 @@
+SUITE_cold_tier_SETUP() {
+    unset CCACHE_NODIRECT
+    export CCACHE_COLDDIR=$PWD/cold
+
+    generate_code 1 test1.c
+}
+
+SUITE_cold_tier() {
+    # -------------------------------------------------------------------------
+    TEST "Promotion from cold tier"
+
+    CCACHE_DIR=$CCACHE_COLDDIR CCACHE_COLDDIR= $CCACHE_COMPILE -c test1.c
+    expect_file_count 1 '*R' $CCACHE_COLDDIR
+    expect_file_count 0 '*R' $CCACHE_DIR
+
+    $CCACHE_COMPILE -c test1.c
+    expect_stat direct_cache_hit 1
+    expect_stat cache_miss 0
+    expect_file_count 1 '*M' $CCACHE_DIR
+    expect_file_count 1 '*R' $CCACHE_DIR
+    expect_file_count 1 '*R' $CCACHE_COLDDIR
+
+    rm $CCACHE_COLDDIR/?/?/*R
+    $CCACHE_COMPILE -c test1.c
+    expect_stat direct_cache_hit 2
+    expect_stat cache_miss 0
+
+    # -------------------------------------------------------------------------
+    TEST "Demotion to cold tier"
+
+    $CCACHE_COMPILE -c test1.c
+    expect_stat cache_miss 1
+    expect_file_count 0 '*R' $CCACHE_COLDDIR
+
+    $CCACHE -M 1k -c >/dev/null
+    expect_file_count 0 '*R' $CCACHE_DIR
+    expect_file_count 1 '*M' $CCACHE_COLDDIR
+    expect_file_count 1 '*R' $CCACHE_COLDDIR
+
+    $CCACHE -M 0 >/dev/null
+    $CCACHE_COMPILE -c test1.c
+    expect_stat direct_cache_hit 1
+    expect_stat cache_miss 1
+    expect_file_count 1 '*R' $CCACHE_DIR
+
+    # -------------------------------------------------------------------------
+    TEST "Eviction by age is not demoted"
+
+    $CCACHE_COMPILE -c test1.c
+    expect_stat cache_miss 1
+
+    $CCACHE --evict-older-than 0s >/dev/null
+    expect_file_count 0 '*R' $CCACHE_DIR
+    expect_file_count 0 '*R' $CCACHE_COLDDIR
+
+    # -------------------------------------------------------------------------
+    TEST "Cold tier limit"
+
+    CCACHE_DIR=$CCACHE_COLDDIR CCACHE_COLDDIR= $CCACHE_COMPILE -c test1.c
+    expect_file_count 1 '*R' $CCACHE_COLDDIR
+
+    CCACHE_COLDMAXSIZE=1k $CCACHE -c >/dev/null
+    expect_file_count 0 '*R' $CCACHE_COLDDIR
+
+    # -------------------------------------------------------------------------
+    TEST "Statistics per tier"
+
+    CCACHE_DIR=$CCACHE_COLDDIR CCACHE_COLDDIR= $CCACHE_COMPILE -c test1.c
+    $CCACHE_COMPILE -c test1.c
+    expect_stat direct_cache_hit 1
+
+    $CCACHE -sv >stats.txt
+    expect_contains stats.txt "Cold tier:"
+    expect_contains stats.txt "Promotions:"
+
+    # The cold tier's own statistics are kept in its directory.
+    CCACHE_DIR=$CCACHE_COLDDIR CCACHE_COLDDIR= $CCACHE --print-stats >cold_stats.txt
+    if ! grep -q "^local_storage_read_hit	2$" cold_stats.txt; then
+        test_failed "Expected 2 cold tier read hits"
+    fi
+}
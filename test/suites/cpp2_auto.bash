@@ -0,0 +1,54 @@
+SUITE_cpp2_auto_PROBE() {
+    if $HOST_OS_WINDOWS; then
+        echo "CCACHE_NOCPP2 does not work correct on Windows"
+        return
+    fi
+    if ! $COMPILER_TYPE_GCC && ! $COMPILER_TYPE_CLANG; then
+        echo "compiler type is not in the run_second_cpp = auto allowlist"
+        return
+    fi
+}
+
+SUITE_cpp2_auto_SETUP() {
+    export CCACHE_CPP2=auto
+    generate_code 1 test1.c
+}
+
+SUITE_cpp2_auto() {
+    # GCC and Clang warn about macro expansions in preprocessed code.
+    safe_flags="-w"
+
+    # -------------------------------------------------------------------------
+    TEST "Safe options"
+
+    $COMPILER $safe_flags -Werror=return-type -c -o reference_test1.o test1.c
+
+    $CCACHE_COMPILE $safe_flags -Werror=return-type -c test1.c
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 1
+    expect_contains $CCACHE_LOGFILE "Compiling preprocessed code"
+    expect_equal_object_files reference_test1.o test1.o
+
+    $CCACHE_COMPILE $safe_flags -Werror=return-type -c test1.c
+    expect_stat preprocessed_cache_hit 1
+    expect_stat cache_miss 1
+    expect_equal_object_files reference_test1.o test1.o
+
+    # -------------------------------------------------------------------------
+    TEST "Unsafe options"
+
+    for flags in "-Werror" "-Werror=misleading-indentation" "-pedantic-errors" \
+                 "-fdirectives-only -fno-directives-only"; do
+        rm -f $CCACHE_LOGFILE
+        $CCACHE_COMPILE $safe_flags $flags -c test1.c
+        expect_contains $CCACHE_LOGFILE "not compiling preprocessed code"
+    done
+    expect_stat cache_miss 4
+
+    # -------------------------------------------------------------------------
+    TEST "Without -w"
+
+    $CCACHE_COMPILE -c test1.c
+    expect_contains $CCACHE_LOGFILE "-w not used"
+    expect_stat cache_miss 1
+}
@@ -0,0 +1,129 @@
+SUITE_deduplicate_SETUP() {
+    export CCACHE_DEDUPLICATE=1
+
+    # A large table of pseudo-random data makes the object file large enough to
+    # be split into chunks.
+    awk 'BEGIN {
+        srand(1)
+        print "const unsigned table[] = {"
+        for (i = 0; i < 40000; i++) {
+            printf "%u,\n", int(rand() * 4294967295)
+        }
+        print "};"
+        print "int get(int i) { return table[i] + VALUE; }"
+    }' >test1.c
+}
+
+chunk_count() {
+    find $CCACHE_DIR -type f -name '*C' | wc -l
+}
+
+SUITE_deduplicate() {
+    # -------------------------------------------------------------------------
+    TEST "Base case"
+
+    $COMPILER -DVALUE=1 -c -o reference_test1.o test1.c
+
+    $CCACHE_COMPILE -DVALUE=1 -c test1.c
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 1
+    expect_equal_object_files reference_test1.o test1.o
+    if [ $(chunk_count) -lt 2 ]; then
+        test_failed "Expected object file to be stored in chunks"
+    fi
+
+    rm test1.o
+    $CCACHE_COMPILE -DVALUE=1 -c test1.c
+    expect_stat preprocessed_cache_hit 1
+    expect_stat cache_miss 1
+    expect_equal_object_files reference_test1.o test1.o
+
+    $CCACHE --inspect "$(find $CCACHE_DIR -name '*R')" >inspect.txt
+    expect_contains inspect.txt "Chunked file #0: .o"
+
+    # -------------------------------------------------------------------------
+    TEST "Chunks are shared between results"
+
+    $CCACHE_COMPILE -DVALUE=1 -c test1.c
+    expect_stat cache_miss 1
+    chunks_after_first=$(chunk_count)
+
+    $CCACHE_COMPILE -DVALUE=2 -c test1.c
+    expect_stat cache_miss 2
+    chunks_after_second=$(chunk_count)
+
+    if [ $chunks_after_second -ge $((2 * chunks_after_first)) ]; then
+        test_failed "No chunks shared ($chunks_after_first chunks, then $chunks_after_second)"
+    fi
+
+    $COMPILER -DVALUE=2 -c -o reference_test1.o test1.c
+    rm test1.o
+    $CCACHE_COMPILE -DVALUE=2 -c test1.c
+    expect_stat preprocessed_cache_hit 1
+    expect_equal_object_files reference_test1.o test1.o
+
+    # -------------------------------------------------------------------------
+    TEST "Missing chunk"
+
+    $COMPILER -DVALUE=1 -c -o reference_test1.o test1.c
+
+    $CCACHE_COMPILE -DVALUE=1 -c test1.c
+    expect_stat cache_miss 1
+
+    rm "$(find $CCACHE_DIR -type f -name '*C' | head -n 1)"
+    rm test1.o
+
+    $CCACHE_COMPILE -DVALUE=1 -c test1.c
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 2
+    expect_stat missing_chunk 1
+    expect_equal_object_files reference_test1.o test1.o
+
+    # -------------------------------------------------------------------------
+    TEST "Small files are embedded"
+
+    echo 'int x;' >test2.c
+    $CCACHE_COMPILE -c test2.c
+    expect_stat cache_miss 1
+    expect_file_count 0 '*C' $CCACHE_DIR
+
+    # -------------------------------------------------------------------------
+    TEST "Raw files are not chunked"
+
+    export CCACHE_HARDLINK=1
+
+    $COMPILER -DVALUE=1 -c -o reference_test1.o test1.c
+
+    $CCACHE_COMPILE -DVALUE=1 -c test1.c
+    expect_stat cache_miss 1
+    expect_file_count 0 '*C' $CCACHE_DIR
+    expect_file_count 1 '*W' $CCACHE_DIR
+
+    rm test1.o
+    $CCACHE_COMPILE -DVALUE=1 -c test1.c
+    expect_stat preprocessed_cache_hit 1
+    expect_equal_object_files reference_test1.o test1.o
+
+    # -------------------------------------------------------------------------
+    TEST "Chunks in remote storage"
+
+    export CCACHE_REMOTE_STORAGE="file:$PWD/remote"
+
+    $COMPILER -DVALUE=1 -c -o reference_test1.o test1.c
+
+    $CCACHE_COMPILE -DVALUE=1 -c test1.c
+    expect_stat cache_miss 1
+
+    $CCACHE -C >/dev/null
+    rm test1.o
+
+    $CCACHE_COMPILE -DVALUE=1 -c test1.c
+    expect_stat preprocessed_cache_hit 1
+    expect_stat remote_storage_hit 1
+    expect_equal_object_files reference_test1.o test1.o
+    if [ $(chunk_count) -lt 2 ]; then
+        test_failed "Expected chunks to be fetched from remote storage"
+    fi
+
+    unset CCACHE_REMOTE_STORAGE
+}
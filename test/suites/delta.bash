@@ -0,0 +1,135 @@
+SUITE_delta_SETUP() {
+    unset CCACHE_NODIRECT
+    export CCACHE_DELTACHAINLENGTH=4
+
+    # A table of pseudo-random data makes the object file compress badly on its
+    # own but well against a previous version of itself.
+    awk 'BEGIN {
+        srand(1)
+        print "#include \"test1.h\""
+        print "const unsigned table[] = {"
+        for (i = 0; i < 10000; i++) {
+            printf "%u,\n", int(rand() * 4294967295)
+        }
+        print "};"
+        print "int get(int i) { return table[i] + VALUE; }"
+    }' >test1.c
+    set_value 1
+}
+
+set_value() {
+    echo "#define VALUE $1" >test1.h
+    backdate test1.h
+}
+
+delta_result_count() {
+    local count=0
+    for result in $(find $CCACHE_DIR -type f -name '*R'); do
+        if $CCACHE --inspect "$result" | grep -q "Delta file"; then
+            count=$((count + 1))
+        fi
+    done
+    echo $count
+}
+
+SUITE_delta() {
+    # -------------------------------------------------------------------------
+    TEST "Base case"
+
+    $CCACHE_COMPILE -c test1.c
+    expect_stat direct_cache_miss 1
+    expect_stat cache_miss 1
+    if [ "$(delta_result_count)" -ne 0 ]; then
+        test_failed "Expected no delta without base"
+    fi
+
+    set_value 2
+    $COMPILER -c -o reference_test1.o test1.c
+
+    $CCACHE_COMPILE -c test1.c
+    expect_stat direct_cache_miss 2
+    expect_stat cache_miss 2
+    expect_equal_object_files reference_test1.o test1.o
+    if [ "$(delta_result_count)" -ne 1 ]; then
+        test_failed "Expected object file to be stored as delta"
+    fi
+
+    rm test1.o
+    $CCACHE_COMPILE -c test1.c
+    expect_stat direct_cache_hit 1
+    expect_stat cache_miss 2
+    expect_equal_object_files reference_test1.o test1.o
+
+    # -------------------------------------------------------------------------
+    TEST "Bounded chain length"
+
+    export CCACHE_DELTACHAINLENGTH=2
+
+    for value in 1 2 3 4 5; do
+        set_value $value
+        $CCACHE_COMPILE -c test1.c
+    done
+    expect_stat cache_miss 5
+
+    # 1 is stored as is, 2 and 3 as deltas, 4 as is since 3 is at depth 2 and
+    # 5 as delta against 4.
+    if [ "$(delta_result_count)" -ne 3 ]; then
+        test_failed "Expected 3 deltas, got $(delta_result_count)"
+    fi
+
+    for value in 1 2 3 4 5; do
+        set_value $value
+        $COMPILER -c -o reference_test1.o test1.c
+        rm test1.o
+        $CCACHE_COMPILE -c test1.c
+        expect_equal_object_files reference_test1.o test1.o
+    done
+    expect_stat direct_cache_hit 5
+
+    # -------------------------------------------------------------------------
+    TEST "Missing base"
+
+    $CCACHE_COMPILE -c test1.c
+    base=$(find $CCACHE_DIR -type f -name '*R')
+
+    set_value 2
+    $COMPILER -c -o reference_test1.o test1.c
+    $CCACHE_COMPILE -c test1.c
+    expect_stat cache_miss 2
+
+    rm "$base"
+    rm test1.o
+
+    $CCACHE_COMPILE -c test1.c
+    expect_stat direct_cache_hit 0
+    expect_stat cache_miss 3
+    expect_equal_object_files reference_test1.o test1.o
+
+    # -------------------------------------------------------------------------
+    TEST "Raw files"
+
+    export CCACHE_HARDLINK=1
+
+    $CCACHE_COMPILE -c test1.c
+    set_value 2
+    $COMPILER -c -o reference_test1.o test1.c
+    $CCACHE_COMPILE -c test1.c
+    expect_stat cache_miss 2
+    expect_equal_object_files reference_test1.o test1.o
+    if [ "$(delta_result_count)" -ne 0 ]; then
+        test_failed "Expected no delta for raw object file"
+    fi
+
+    # -------------------------------------------------------------------------
+    TEST "Disabled"
+
+    export CCACHE_DELTACHAINLENGTH=0
+
+    $CCACHE_COMPILE -c test1.c
+    set_value 2
+    $CCACHE_COMPILE -c test1.c
+    expect_stat cache_miss 2
+    if [ "$(delta_result_count)" -ne 0 ]; then
+        test_failed "Expected no delta when disabled"
+    fi
+}
@@ -239,7 +239,8 @@ EOF
     expect_stat direct_cache_hit 1
     expect_stat preprocessed_cache_hit 0
     expect_stat cache_miss 2
-    expect_stat files_in_cache 3      # 2x result, 1x manifest
+    # The new result is appended to a delta file next to the manifest.
+    expect_stat files_in_cache 4      # 2x result, 1x manifest, 1x delta
 
     # Compile dir3. dir3 header change does not change object file compared to
     # dir1, but ccache still adds an additional .o/.d file in the cache due to
@@ -252,7 +253,7 @@ EOF
     expect_stat direct_cache_hit 1
     expect_stat preprocessed_cache_hit 0
     expect_stat cache_miss 3
-    expect_stat files_in_cache 4      # 3x result, 1x manifest
+    expect_stat files_in_cache 5      # 3x result, 1x manifest, 1x delta
 
     # Compile dir4. dir4 header adds a new dependency.
     cd $BASEDIR4
@@ -264,7 +265,7 @@ EOF
     expect_stat direct_cache_hit 1
     expect_stat preprocessed_cache_hit 0
     expect_stat cache_miss 4
-    expect_stat files_in_cache 5      # 4x result, 1x manifest
+    expect_stat files_in_cache 6      # 4x result, 1x manifest, 1x delta
 
     # Compile dir5. dir5 is identical to dir1
     cd $BASEDIR5
@@ -276,6 +277,7 @@ EOF
     expect_stat direct_cache_hit 2
     expect_stat preprocessed_cache_hit 0
     expect_stat cache_miss 4
+    # The hit merges the delta file into the manifest.
     expect_stat files_in_cache 5      # 4x result, 1x manifest
 
     # Recompile dir1 second time.
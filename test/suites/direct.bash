@@ -93,6 +93,57 @@ SUITE_direct() {
     expect_stat preprocessed_cache_hit 1
     expect_stat cache_miss 1
 
+    # -------------------------------------------------------------------------
+    TEST "Manifest delta records"
+
+    for i in 0 1 2 3 4 5 6 7 8; do
+        echo "int x$i;" >test2.h
+        backdate test2.h
+        $CCACHE_COMPILE -c test.c
+        expect_stat cache_miss $((i + 1))
+    done
+    expect_stat direct_cache_hit 0
+    expect_exists "$(find $CCACHE_DIR -name '*D')"
+
+    echo "int x1;" >test2.h
+    backdate test2.h
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 1
+    expect_stat cache_miss 9
+    if [ -n "$(find $CCACHE_DIR -name '*D')" ]; then
+        test_failed "Delta records not compacted"
+    fi
+
+    echo "int x0;" >test2.h
+    backdate test2.h
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 2
+    expect_stat cache_miss 9
+
+    # -------------------------------------------------------------------------
+    TEST "Corrupt manifest delta record"
+
+    for i in 0 1 2; do
+        echo "int x$i;" >test2.h
+        backdate test2.h
+        $CCACHE_COMPILE -c test.c
+    done
+    expect_stat cache_miss 3
+
+    # Simulate a torn record like the ones concurrent appends on NFS may leave.
+    delta_file="$(find $CCACHE_DIR -name '*D')"
+    head -c 10 "$delta_file" >delta.tmp
+    cat "$delta_file" >>delta.tmp
+    mv delta.tmp "$delta_file"
+
+    for i in 1 2; do
+        echo "int x$i;" >test2.h
+        backdate test2.h
+        $CCACHE_COMPILE -c test.c
+    done
+    expect_stat direct_cache_hit 2
+    expect_stat cache_miss 3
+
     # -------------------------------------------------------------------------
     TEST "CCACHE_NODIRECT"
 
@@ -126,6 +177,92 @@ SUITE_direct() {
     expect_stat preprocessed_cache_hit 0
     expect_stat cache_miss 2
 
+    # -------------------------------------------------------------------------
+    TEST "Speculative compilation"
+
+    export CCACHE_SPECULATIVE=1
+    echo "int test3; /* 1 */" >test3.h
+    backdate test3.h
+    $COMPILER -c -o reference_test.o test.c
+
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_miss 1
+    expect_stat preprocessed_cache_miss 1
+    expect_stat cache_miss 1
+    expect_equal_object_files reference_test.o test.o
+    expect_contains $CCACHE_LOGFILE "Using result of speculative compilation"
+    expect_file_count 0 '*.tmp.*' .
+
+    # A changed comment gives a direct mode miss and a preprocessor mode hit.
+    for i in 2 3; do
+        echo "int test3; /* $i */" >test3.h
+        backdate test3.h
+        rm $CCACHE_LOGFILE
+        $CCACHE_COMPILE -c test.c
+        expect_contains $CCACHE_LOGFILE "Killing speculative compilation"
+        expect_equal_object_files reference_test.o test.o
+        expect_file_count 0 '*.tmp.*' .
+    done
+    expect_stat direct_cache_miss 3
+    expect_stat preprocessed_cache_hit 2
+    expect_stat cache_miss 1
+
+    # Two of three results in the manifest now come from preprocessor mode
+    # hits, so don't speculate.
+    echo "int test3; /* 4 */" >test3.h
+    backdate test3.h
+    rm $CCACHE_LOGFILE
+    $CCACHE_COMPILE -c test.c
+    expect_not_contains $CCACHE_LOGFILE "speculative compilation"
+    expect_stat preprocessed_cache_hit 3
+    unset CCACHE_SPECULATIVE
+
+    # -------------------------------------------------------------------------
+    TEST "Include scanner"
+
+    export CCACHE_SCANINCLUDES=1
+    $COMPILER -c -o reference_test.o test.c
+
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_miss 1
+    expect_stat preprocessed_cache_miss 0
+    expect_stat cache_miss 1
+    expect_contains $CCACHE_LOGFILE "Result key from include scan"
+    expect_equal_object_files reference_test.o test.o
+
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 1
+    expect_stat cache_miss 1
+
+    # Without a manifest, the result is still found without the preprocessor.
+    find $CCACHE_DIR -name '*M' -delete
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 2
+    expect_stat preprocessed_cache_miss 0
+    expect_stat cache_miss 1
+    expect_equal_object_files reference_test.o test.o
+
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 3
+    expect_stat cache_miss 1
+
+    echo "int test3_2;" >>test3.h
+    backdate test3.h
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 3
+    expect_stat preprocessed_cache_miss 0
+    expect_stat cache_miss 2
+
+    # Computed includes make the preprocessor necessary.
+    echo '#define TEST2_H "test2.h"' >test1.h
+    echo '#include TEST2_H' >>test1.h
+    backdate test1.h
+    $CCACHE_COMPILE -c test.c
+    expect_contains $CCACHE_LOGFILE "Include scanner can't handle test1.h"
+    expect_stat preprocessed_cache_miss 1
+    expect_stat cache_miss 3
+    unset CCACHE_SCANINCLUDES
+
     # -------------------------------------------------------------------------
     TEST "Removed but previously compiled header file"
 
@@ -1296,6 +1433,39 @@ EOF
     expect_stat preprocessed_cache_hit 1
     expect_stat cache_miss 1
 
+    # -------------------------------------------------------------------------
+    TEST "Argument template in build session"
+
+    mkdir src out
+    for name in foo bar baz; do
+        echo "int $name;" >src/$name.c
+        $COMPILER -MD -MF ref_$name.o.d -MT out/$name.o -c -o ref_$name.o \
+            src/$name.c
+    done
+    export CCACHE_BUILDSESSION=1
+
+    for name in foo bar baz; do
+        $CCACHE_COMPILE -MD -MF out/$name.o.d -c -o out/$name.o src/$name.c
+    done
+    expect_stat cache_miss 3
+    expect_contains "$CCACHE_LOGFILE" "Confirmed argument template"
+    expect_contains "$CCACHE_LOGFILE" "Using argument template"
+
+    rm out/* "$CCACHE_LOGFILE"
+    for name in foo bar baz; do
+        $CCACHE_COMPILE -MD -MF out/$name.o.d -c -o out/$name.o src/$name.c
+        expect_equal_object_files ref_$name.o out/$name.o
+        expect_equal_content ref_$name.o.d out/$name.o.d
+    done
+    expect_stat direct_cache_hit 3
+    expect_stat cache_miss 3
+    expect_not_contains "$CCACHE_LOGFILE" "Detected input file"
+
+    CCACHE_BUILDSESSION=2 \
+        $CCACHE_COMPILE -MD -MF out/foo.o.d -c -o out/foo.o src/foo.c
+    expect_stat direct_cache_hit 4
+    expect_contains "$CCACHE_LOGFILE" "Detected input file"
+
     # -------------------------------------------------------------------------
     TEST "CCACHE_RECACHE doesn't add a new manifest entry"
 
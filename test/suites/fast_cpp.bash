@@ -0,0 +1,120 @@
+SUITE_fast_cpp_PROBE() {
+    touch test.c
+    if $COMPILER_TYPE_GCC; then
+        if ! $COMPILER -E -fdirectives-only test.c >&/dev/null; then
+            echo "-fdirectives-only not supported by compiler"
+            return
+        fi
+    elif $COMPILER_TYPE_CLANG; then
+        if ! $COMPILER -E -frewrite-includes test.c >&/dev/null; then
+            echo "-frewrite-includes not supported by compiler"
+            return
+        fi
+    else
+        echo "Unknown compiler: $COMPILER"
+        return
+    fi
+}
+
+SUITE_fast_cpp_SETUP() {
+    echo "#define FOO 1" >test1.h
+    backdate test1.h
+    echo '#include "test1.h"' >test1.c
+    echo 'int foo(int x) { return FOO; }' >>test1.c
+    echo 'int baz(int x) { return BAZ; }' >>test1.c
+}
+
+SUITE_fast_cpp() {
+    if $COMPILER_TYPE_GCC; then
+        cpp_flag="-fdirectives-only"
+    elif $COMPILER_TYPE_CLANG; then
+        cpp_flag="-frewrite-includes"
+    fi
+
+    # -------------------------------------------------------------------------
+    TEST "Base case"
+
+    $COMPILER -DBAZ=3 -c -o reference_test1.o test1.c
+
+    $CCACHE_COMPILE -DBAZ=3 -c test1.c
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 1
+    expect_not_contains $CCACHE_LOGFILE "$cpp_flag"
+
+    export CCACHE_FASTCPP=1
+
+    $CCACHE_COMPILE -DBAZ=3 -c test1.c
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 2
+    expect_contains $CCACHE_LOGFILE "$cpp_flag"
+    expect_equal_object_files reference_test1.o test1.o
+
+    $CCACHE_COMPILE -DBAZ=3 -c test1.c
+    expect_stat preprocessed_cache_hit 1
+    expect_stat cache_miss 2
+    expect_equal_object_files reference_test1.o test1.o
+
+    # -------------------------------------------------------------------------
+    TEST "Macros on the command line"
+
+    export CCACHE_FASTCPP=1
+
+    $CCACHE_COMPILE -DBAZ=3 -c test1.c
+    expect_stat cache_miss 1
+
+    $CCACHE_COMPILE -DBAZ=4 -c test1.c
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 2
+
+    $CCACHE_COMPILE -DBAZ=4 -UBAZ -DBAZ=3 -c test1.c
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 3
+
+    # -------------------------------------------------------------------------
+    TEST "Preprocessor options on the command line"
+
+    export CCACHE_FASTCPP=1
+
+    echo 'const char *s = "??/n";' >>test1.c
+
+    $CCACHE_COMPILE -DBAZ=3 -c test1.c 2>/dev/null
+    expect_stat cache_miss 1
+
+    $CCACHE_COMPILE -DBAZ=3 -trigraphs -c test1.c
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 2
+
+    $CCACHE_COMPILE -DBAZ=3 -trigraphs -c test1.c
+    expect_stat preprocessed_cache_hit 1
+    expect_stat cache_miss 2
+
+    # -------------------------------------------------------------------------
+    TEST "Modified include file"
+
+    export CCACHE_FASTCPP=1
+
+    $CCACHE_COMPILE -DBAZ=3 -c test1.c
+    expect_stat cache_miss 1
+
+    echo "#define FOO 2" >test1.h
+    backdate test1.h
+
+    $CCACHE_COMPILE -DBAZ=3 -c test1.c
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 2
+
+    # -------------------------------------------------------------------------
+    TEST "Temporal macro"
+
+    export CCACHE_FASTCPP=1
+
+    echo 'const char *date = __DATE__;' >>test1.c
+
+    $CCACHE_COMPILE -DBAZ=3 -c test1.c
+    expect_stat cache_miss 1
+    expect_contains $CCACHE_LOGFILE "Found temporal macro"
+
+    $CCACHE_COMPILE -DBAZ=3 -c test1.c
+    expect_stat preprocessed_cache_hit 1
+    expect_stat cache_miss 1
+}
@@ -9,7 +9,7 @@ SUITE_inode_cache_PROBE() {
 
     touch test.c
     $CCACHE $COMPILER -c test.c
-    if [[ ! -f "${CCACHE_TEMPDIR}/inode-cache-32.v2" && ! -f "${CCACHE_TEMPDIR}/inode-cache-64.v2" ]]; then
+    if [[ ! -f "${CCACHE_TEMPDIR}/inode-cache-32.v3" && ! -f "${CCACHE_TEMPDIR}/inode-cache-64.v3" ]]; then
         local fs_type=$(stat -fLc %T "${CCACHE_DIR}")
         echo "inode cache not supported on ${fs_type}"
     fi
@@ -110,4 +110,30 @@ inode_cache_tests() {
     echo "// replace" > test1.c
     $CCACHE_COMPILE -c test1.c
     expect_inode_cache 0 1 1 test1.c
+
+    # -------------------------------------------------------------------------
+    TEST "Build session"
+
+    echo "// build session" > test1.c
+    echo "int x;" > test.h
+    echo '#include "test.h"' > test2.c
+    backdate test.h
+    CCACHE_BUILDSESSION=1 $CCACHE_COMPILE -c test2.c
+    expect_stat cache_miss 1
+    rm *.ccache-*
+
+    CCACHE_BUILDSESSION=1 $CCACHE_COMPILE -c test2.c
+    expect_stat direct_cache_hit 1
+    expect_contains test2.o.*.ccache-log "Inode cache session hit: $(pwd -P)/test2.c"
+    expect_contains test2.o.*.ccache-log "Inode cache session hit: $(pwd -P)/test.h"
+
+    # The header is assumed to be unchanged within the session.
+    echo "int y;" > test.h
+    backdate test.h
+    CCACHE_BUILDSESSION=1 $CCACHE_COMPILE -c test2.c
+    expect_stat direct_cache_hit 2
+
+    CCACHE_BUILDSESSION=2 $CCACHE_COMPILE -c test2.c
+    expect_stat direct_cache_hit 2
+    expect_stat cache_miss 2
 }
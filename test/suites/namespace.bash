@@ -55,4 +55,28 @@ SUITE_namespace() {
 
     $CCACHE --evict-namespace a >/dev/null
     expect_stat files_in_cache 2
+
+    # -------------------------------------------------------------------------
+    TEST "Compile time saved per namespace"
+
+    CCACHE_NAMESPACE="a/b" $CCACHE_COMPILE -c test1.c
+    CCACHE_NAMESPACE="a/b" $CCACHE_COMPILE -c test1.c
+    expect_stat direct_cache_hit 1
+
+    time_saved=$($CCACHE --print-stats | awk '$1 == "compile_time_saved_ms" { print $2 }')
+    if [ -z "$time_saved" ] || [ "$time_saved" -eq 0 ]; then
+        test_failed "Expected compile_time_saved_ms to be positive, actual $time_saved"
+    fi
+
+    $CCACHE --show-stats >stats.txt
+    expect_contains stats.txt "Compile time saved:"
+    expect_contains stats.txt "Namespace a/b:"
+
+    $CCACHE --zero-stats >/dev/null
+    expect_stat compile_time_saved_ms 0
+    $CCACHE --show-stats -vv >stats.txt
+    expect_contains stats.txt "Namespace a/b:"
+
+    $CCACHE --inspect "$(find $CCACHE_DIR -name '*R')" >inspect.txt
+    expect_contains inspect.txt "Compile time:"
 }
@@ -496,6 +496,22 @@ SUITE_remote_file() {
     expect_stat remote_storage_read_miss 2
     expect_stat remote_storage_write 2 # miss: manifest + result
 
+    # Manifests are only stored uncompressed locally.
+    manifest=$(find $CCACHE_DIR -name '*M')
+    if ! $CCACHE --inspect $manifest | grep -q 'Compression type: none'; then
+        test_failed "Local manifest is compressed"
+    fi
+    compressed_manifests=0
+    for f in $(find remote -type f ! -name CACHEDIR.TAG); do
+        if $CCACHE --inspect $f | grep -q 'Entry type: .*manifest' \
+                && $CCACHE --inspect $f | grep -q 'Compression type: zstd'; then
+            compressed_manifests=$((compressed_manifests + 1))
+        fi
+    done
+    if [ $compressed_manifests -ne 1 ]; then
+        test_failed "Expected a compressed manifest in remote storage"
+    fi
+
     # Both local and remote now have an "int x;" key in the manifest.
 
     echo 'int y;' >test.h
@@ -558,6 +574,35 @@ SUITE_remote_file() {
     expect_stat remote_storage_read_miss 3
     expect_stat remote_storage_write 4
 
+    # -------------------------------------------------------------------------
+    TEST "Manifest from remote storage"
+
+    echo 'int x;' >test.h
+    backdate test.h
+    echo '#include "test.h"' >test.c
+
+    $CCACHE_COMPILE -c test.c
+    expect_stat cache_miss 1
+
+    $CCACHE -C >/dev/null
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 1
+    expect_stat remote_storage_hit 1
+
+    # The manifest is compressed in remote storage but only stored uncompressed
+    # locally, also after recompression.
+    manifest=$(find $CCACHE_DIR -name '*M')
+    if ! $CCACHE --inspect $manifest | grep -q 'Compression type: none'; then
+        test_failed "Local manifest from remote storage is compressed"
+    fi
+    $CCACHE -X 5 >/dev/null
+    if ! $CCACHE --inspect $manifest | grep -q 'Compression type: none'; then
+        test_failed "Local manifest was compressed by recompression"
+    fi
+
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 2
+
     # -------------------------------------------------------------------------
     TEST "Manifest merging"
 
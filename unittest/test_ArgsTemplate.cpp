@@ -0,0 +1,168 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "../src/ArgsTemplate.hpp"
+#include "../src/Context.hpp"
+#include "../src/Hash.hpp"
+#include "TestUtil.hpp"
+
+#include <util/file.hpp>
+#include <util/filesystem.hpp>
+#include <util/fmtmacros.hpp>
+#include <util/path.hpp>
+
+#include "third_party/doctest.h"
+
+#include <string>
+
+namespace fs = util::filesystem;
+
+using TestUtil::TestContext;
+
+namespace {
+
+void
+set_up_context(Context& ctx, const std::string& name)
+{
+  ctx.config.set_build_session("1");
+  ctx.config.set_temporary_dir(FMT("{}/tmp", util::actual_cwd()));
+  ctx.orig_args = Args::from_string(
+    FMT("cc -MD -MT out/{0}.o -MF out/{0}.o.d -o out/{0}.o -c src/{0}.c",
+        name));
+}
+
+} // namespace
+
+TEST_SUITE_BEGIN("ArgsTemplate");
+
+TEST_CASE("ArgsTemplate::templatize")
+{
+  CHECK(ArgsTemplate::templatize("foo.c", "foo") == "\x01.c");
+  CHECK(ArgsTemplate::templatize("dir/foo.c.o", "foo") == "dir/\x01.c.o");
+  CHECK(ArgsTemplate::templatize("foo/foo.c", "foo") == "foo/\x01.c");
+  CHECK(ArgsTemplate::templatize("foo.d/x.c", "foo") == "foo.d/x.c");
+  CHECK(ArgsTemplate::templatize("foobar.c", "foo") == "foobar.c");
+  CHECK(ArgsTemplate::templatize("foo", "foo") == "foo");
+  CHECK(ArgsTemplate::templatize("-MFfoo.d", "foo") == "-MFfoo.d");
+  CHECK(ArgsTemplate::templatize("-Ifoo.d", "foo") == "-Ifoo.d");
+}
+
+TEST_CASE("ArgsTemplate::instantiate")
+{
+  CHECK(ArgsTemplate::instantiate("dir/\x01.c.o", "bar") == "dir/bar.c.o");
+  CHECK(ArgsTemplate::instantiate("dir/x.c.o", "bar") == "dir/x.c.o");
+}
+
+TEST_CASE("Template is used after confirmation by another name")
+{
+  TestContext test_context;
+
+  REQUIRE(fs::create_directories("src"));
+  REQUIRE(fs::create_directories("out"));
+  for (const auto name : {"foo", "bar", "baz"}) {
+    util::write_file(FMT("src/{}.c", name), "");
+  }
+
+  Hash common_hash;
+  common_hash.hash("common");
+
+  for (const auto name : {"foo", "bar"}) {
+    Context ctx;
+    set_up_context(ctx, name);
+    const ArgsTemplate args_template(ctx);
+    Hash hash;
+    CHECK(!args_template.apply(ctx, hash));
+    const auto processed = process_args(ctx);
+    REQUIRE(!processed.error);
+    args_template.update(ctx, processed, common_hash);
+  }
+
+  Context expected_ctx;
+  set_up_context(expected_ctx, "baz");
+  const auto expected = process_args(expected_ctx);
+
+  Context ctx;
+  set_up_context(ctx, "baz");
+  const ArgsTemplate args_template(ctx);
+  Hash hash;
+  const auto result = args_template.apply(ctx, hash);
+  REQUIRE(result);
+  CHECK(result->preprocessor_args == expected.preprocessor_args);
+  CHECK(result->extra_args_to_hash == expected.extra_args_to_hash);
+  CHECK(result->compiler_args == expected.compiler_args);
+  CHECK(ctx.args_info.input_file == "src/baz.c");
+  CHECK(ctx.args_info.output_obj == "out/baz.o");
+  CHECK(ctx.args_info.output_dep == "out/baz.o.d");
+  CHECK(ctx.args_info.dependency_target == "out/baz.o");
+  CHECK(ctx.config.run_second_cpp() == expected_ctx.config.run_second_cpp());
+  CHECK(ctx.config.cpp_extension() == expected_ctx.config.cpp_extension());
+  CHECK(hash.digest() == common_hash.digest());
+
+  SUBCASE("Missing source file")
+  {
+    REQUIRE(fs::remove("src/baz.c"));
+    CHECK(!args_template.apply(ctx, hash));
+  }
+}
+
+TEST_CASE("Template is not confirmed by the same name")
+{
+  TestContext test_context;
+
+  REQUIRE(fs::create_directories("src"));
+  REQUIRE(fs::create_directories("out"));
+  util::write_file("src/foo.c", "");
+
+  for (int i = 0; i < 2; ++i) {
+    Context ctx;
+    set_up_context(ctx, "foo");
+    const ArgsTemplate args_template(ctx);
+    Hash hash;
+    CHECK(!args_template.apply(ctx, hash));
+    const auto processed = process_args(ctx);
+    REQUIRE(!processed.error);
+    args_template.update(ctx, processed, hash);
+  }
+}
+
+TEST_CASE("Name in other arguments")
+{
+  TestContext test_context;
+
+  REQUIRE(fs::create_directories("src"));
+  REQUIRE(fs::create_directories("out"));
+  for (const auto name : {"foo", "bar", "baz"}) {
+    util::write_file(FMT("src/{}.c", name), "");
+    util::write_file(FMT("src/{}.h", name), "");
+  }
+
+  for (const auto name : {"foo", "bar", "baz"}) {
+    Context ctx;
+    set_up_context(ctx, name);
+    ctx.orig_args.push_back("-include");
+    ctx.orig_args.push_back(FMT("src/{}.h", name));
+    const ArgsTemplate args_template(ctx);
+    Hash hash;
+    CHECK(!args_template.apply(ctx, hash));
+    const auto processed = process_args(ctx);
+    REQUIRE(!processed.error);
+    args_template.update(ctx, processed, hash);
+  }
+}
+
+TEST_SUITE_END();
@@ -40,8 +40,11 @@ TEST_CASE("Config: default values")
 {
   Config config;
 
+  CHECK(config.base_cache_dir().empty());
   CHECK(config.base_dir().empty());
   CHECK(config.cache_dir().empty()); // Set later
+  CHECK(config.cold_cache_dir().empty());
+  CHECK(config.cold_max_size() == 0);
   CHECK(config.compiler().empty());
   CHECK(config.compiler_check() == "mtime");
   CHECK(config.compiler_type() == CompilerType::auto_guess);
@@ -51,10 +54,14 @@ TEST_CASE("Config: default values")
   CHECK(!config.debug());
   CHECK(config.debug_dir().empty());
   CHECK(config.debug_level() == 2);
+  CHECK(!config.deduplicate());
+  CHECK(config.delta_chain_length() == 0);
   CHECK(!config.depend_mode());
   CHECK(config.direct_mode());
   CHECK(!config.disable());
+  CHECK(config.eviction_policy() == EvictionPolicy::lru);
   CHECK(config.extra_files_to_hash().empty());
+  CHECK(!config.fast_cpp());
   CHECK(!config.file_clone());
   CHECK(!config.hard_link());
   CHECK(config.hash_dir());
@@ -77,7 +84,9 @@ TEST_CASE("Config: default values")
   CHECK(config.remote_storage().empty());
   CHECK_FALSE(config.reshare());
   CHECK(config.run_second_cpp());
+  CHECK_FALSE(config.scan_includes());
   CHECK(config.sloppiness().to_bitmask() == 0);
+  CHECK_FALSE(config.speculative_compilation());
   CHECK(config.stats());
   CHECK(config.temporary_dir().empty()); // Set later
   CHECK(config.umask() == std::nullopt);
@@ -98,9 +107,12 @@ TEST_CASE("Config::update_from_file")
 
   util::write_file(
     "ccache.conf",
+    "base_cache_dir = /base\n"
     "base_dir = " + base_dir + "\n"
     "cache_dir=\n"
     "cache_dir = $USER$/${USER}/.ccache\n"
+    "cold_cache_dir = /cold\n"
+    "cold_max_size = 500G\n"
     "\n"
     "\n"
     "  #A comment\n"
@@ -112,10 +124,14 @@ TEST_CASE("Config::update_from_file")
     "cpp_extension = .foo\n"
     "debug_dir = $USER$/${USER}/.ccache_debug\n"
     "debug_level = 2\n"
+    "deduplicate = true\n"
+    "delta_chain_length = 4\n"
     "depend_mode = true\n"
     "direct_mode = false\n"
     "disable = true\n"
+    "eviction_policy = gdsf\n"
     "extra_files_to_hash = a:b c:$USER\n"
+    "fast_cpp = true\n"
     "file_clone = true\n"
     "hard_link = true\n"
     "hash_dir = false\n"
@@ -135,18 +151,23 @@ TEST_CASE("Config::update_from_file")
     "recache = true\n"
     "reshare = true\n"
     "run_second_cpp = false\n"
+    "scan_includes = true\n"
     "sloppiness =     time_macros   ,include_file_mtime"
     "  include_file_ctime,file_stat_matches,file_stat_matches_ctime,pch_defines"
     " ,  no_system_headers,system_headers,clang_index_store,ivfsoverlay,"
     " gcno_cwd,\n"
+    "speculative_compilation = true\n"
     "stats = false\n"
     "temporary_dir = ${USER}_foo\n"
     "umask = 777"); // Note: no newline.
 
   Config config;
   REQUIRE(config.update_from_file("ccache.conf"));
+  CHECK(config.base_cache_dir() == "/base");
   CHECK(config.base_dir() == base_dir);
   CHECK(config.cache_dir() == FMT("{0}$/{0}/.ccache", user));
+  CHECK(config.cold_cache_dir() == "/cold");
+  CHECK(config.cold_max_size() == 500ULL * 1000 * 1000 * 1000);
   CHECK(config.compiler() == "foo");
   CHECK(config.compiler_check() == "none");
   CHECK(config.compiler_type() == CompilerType::nvcc);
@@ -155,10 +176,14 @@ TEST_CASE("Config::update_from_file")
   CHECK(config.cpp_extension() == ".foo");
   CHECK(config.debug_dir() == FMT("{0}$/{0}/.ccache_debug", user));
   CHECK(config.debug_level() == 2);
+  CHECK(config.deduplicate());
+  CHECK(config.delta_chain_length() == 4);
   CHECK(config.depend_mode());
   CHECK_FALSE(config.direct_mode());
   CHECK(config.disable());
+  CHECK(config.eviction_policy() == EvictionPolicy::gdsf);
   CHECK(config.extra_files_to_hash() == FMT("a:b c:{}", user));
+  CHECK(config.fast_cpp());
   CHECK(config.file_clone());
   CHECK(config.hard_link());
   CHECK_FALSE(config.hash_dir());
@@ -178,6 +203,7 @@ TEST_CASE("Config::update_from_file")
   CHECK(config.recache());
   CHECK(config.reshare());
   CHECK_FALSE(config.run_second_cpp());
+  CHECK(config.scan_includes());
   CHECK(config.sloppiness().to_bitmask()
         == (static_cast<uint32_t>(core::Sloppy::clang_index_store)
             | static_cast<uint32_t>(core::Sloppy::file_stat_matches)
@@ -189,6 +215,7 @@ TEST_CASE("Config::update_from_file")
             | static_cast<uint32_t>(core::Sloppy::pch_defines)
             | static_cast<uint32_t>(core::Sloppy::system_headers)
             | static_cast<uint32_t>(core::Sloppy::time_macros)));
+  CHECK(config.speculative_compilation());
   CHECK_FALSE(config.stats());
   CHECK(config.temporary_dir() == FMT("{}_foo", user));
   CHECK(config.umask() == 0777U);
@@ -224,6 +251,13 @@ TEST_CASE("Config::update_from_file, error handling")
                         "ccache.conf:1: not a boolean value: \"foo\"");
   }
 
+  SUBCASE("invalid eviction policy")
+  {
+    util::write_file("ccache.conf", "eviction_policy = lfu");
+    REQUIRE_THROWS_WITH(config.update_from_file("ccache.conf"),
+                        "ccache.conf:1: unknown eviction policy \"lfu\"");
+  }
+
   SUBCASE("invalid variable reference")
   {
     util::write_file("ccache.conf", "base_dir = ${foo");
@@ -271,6 +305,18 @@ TEST_CASE("Config::update_from_file, error handling")
                         "ccache.conf:1: invalid unsigned integer: \"foo\"");
   }
 
+  SUBCASE("too long delta chain")
+  {
+    util::write_file("ccache.conf", "delta_chain_length = 16");
+    CHECK(config.update_from_file("ccache.conf"));
+    CHECK(config.delta_chain_length() == 16);
+
+    util::write_file("ccache.conf", "delta_chain_length = 17");
+    REQUIRE_THROWS_WITH(
+      config.update_from_file("ccache.conf"),
+      "ccache.conf:1: delta_chain_length must be between 0 and 16");
+  }
+
   SUBCASE("missing file")
   {
     CHECK(!config.update_from_file("ccache.conf"));
@@ -366,6 +412,14 @@ TEST_CASE("Config::get_string_value")
     CHECK(config.get_string_value("max_files") == "42");
   }
 
+  SUBCASE("run_second_cpp = auto")
+  {
+    config.update_from_map({{"run_second_cpp", "auto"}});
+    CHECK(config.run_second_cpp());
+    CHECK(config.run_second_cpp_auto());
+    CHECK(config.get_string_value("run_second_cpp") == "auto");
+  }
+
   SUBCASE("unknown key")
   {
     try {
@@ -384,12 +438,16 @@ TEST_CASE("Config::visit_items")
   util::write_file(
     "test.conf",
     "absolute_paths_in_stderr = true\n"
+    "base_cache_dir = bcd\n"
 #ifndef _WIN32
     "base_dir = /bd\n"
 #else
     "base_dir = C:/bd\n"
 #endif
+    "build_session = bs\n"
     "cache_dir = cd\n"
+    "cold_cache_dir = ccd\n"
+    "cold_max_size = 12.3M\n"
     "compiler = c\n"
     "compiler_check = cc\n"
     "compiler_type = clang\n"
@@ -399,10 +457,14 @@ TEST_CASE("Config::visit_items")
     "debug = false\n"
     "debug_dir = /dd\n"
     "debug_level = 2\n"
+    "deduplicate = true\n"
+    "delta_chain_length = 4\n"
     "depend_mode = true\n"
     "direct_mode = false\n"
     "disable = true\n"
+    "eviction_policy = arc\n"
     "extra_files_to_hash = efth\n"
+    "fast_cpp = true\n"
     "file_clone = true\n"
     "hard_link = true\n"
     "hash_dir = false\n"
@@ -426,9 +488,11 @@ TEST_CASE("Config::visit_items")
     "remote_storage = rs\n"
     "reshare = true\n"
     "run_second_cpp = false\n"
+    "scan_includes = true\n"
     "sloppiness = include_file_mtime, include_file_ctime, time_macros,"
     " file_stat_matches, file_stat_matches_ctime, pch_defines, system_headers,"
     " clang_index_store, ivfsoverlay, gcno_cwd \n"
+    "speculative_compilation = true\n"
     "stats = false\n"
     "stats_log = sl\n"
     "temporary_dir = td\n"
@@ -446,12 +510,16 @@ TEST_CASE("Config::visit_items")
 
   std::vector<std::string> expected = {
     "(test.conf) absolute_paths_in_stderr = true",
+    "(test.conf) base_cache_dir = bcd",
 #ifndef _WIN32
     "(test.conf) base_dir = /bd",
 #else
     "(test.conf) base_dir = C:/bd",
 #endif
+    "(test.conf) build_session = bs",
     "(test.conf) cache_dir = cd",
+    "(test.conf) cold_cache_dir = ccd",
+    "(test.conf) cold_max_size = 12.3 MB",
     "(test.conf) compiler = c",
     "(test.conf) compiler_check = cc",
     "(test.conf) compiler_type = clang",
@@ -461,10 +529,14 @@ TEST_CASE("Config::visit_items")
     "(test.conf) debug = false",
     "(test.conf) debug_dir = /dd",
     "(test.conf) debug_level = 2",
+    "(test.conf) deduplicate = true",
+    "(test.conf) delta_chain_length = 4",
     "(test.conf) depend_mode = true",
     "(test.conf) direct_mode = false",
     "(test.conf) disable = true",
+    "(test.conf) eviction_policy = arc",
     "(test.conf) extra_files_to_hash = efth",
+    "(test.conf) fast_cpp = true",
     "(test.conf) file_clone = true",
     "(test.conf) hard_link = true",
     "(test.conf) hash_dir = false",
@@ -488,10 +560,12 @@ TEST_CASE("Config::visit_items")
     "(test.conf) remote_storage = rs",
     "(test.conf) reshare = true",
     "(test.conf) run_second_cpp = false",
+    "(test.conf) scan_includes = true",
     "(test.conf) sloppiness = clang_index_store, file_stat_matches,"
     " file_stat_matches_ctime, gcno_cwd, include_file_ctime,"
     " include_file_mtime, ivfsoverlay, pch_defines, system_headers,"
     " time_macros",
+    "(test.conf) speculative_compilation = true",
     "(test.conf) stats = false",
     "(test.conf) stats_log = sl",
     "(test.conf) temporary_dir = td",
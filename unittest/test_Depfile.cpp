@@ -20,6 +20,7 @@
 #include "../src/Depfile.hpp"
 #include "TestUtil.hpp"
 
+#include <util/file.hpp>
 #include <util/filesystem.hpp>
 #include <util/fmtmacros.hpp>
 
@@ -83,6 +84,27 @@ TEST_CASE("Depfile::rewrite_source_paths")
   }
 }
 
+TEST_CASE("Depfile::make_paths_relative_in_output_dep")
+{
+  TestContext test_context;
+
+  Context ctx;
+  const fs::path cwd = ctx.actual_cwd;
+  ctx.args_info.output_dep = "foo.d";
+  ctx.config.set_base_dir(cwd.string());
+  REQUIRE(util::write_file("foo.d", FMT("foo.o: {}/bar.h\n", cwd)));
+
+  Depfile::make_paths_relative_in_output_dep(ctx);
+  REQUIRE(ctx.output_dep_content);
+  CHECK(*ctx.output_dep_content == "foo.o: ./bar.h\n");
+  CHECK(util::read_file<std::string>("foo.d") == "foo.o: ./bar.h\n");
+
+  // The content is not read again.
+  REQUIRE(util::write_file("foo.d", "changed"));
+  CHECK(Depfile::read_output_dep(ctx));
+  CHECK(*ctx.output_dep_content == "foo.o: ./bar.h\n");
+}
+
 TEST_CASE("Depfile::tokenize")
 {
   SUBCASE("Empty")
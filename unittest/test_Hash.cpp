@@ -22,6 +22,9 @@
 
 #include "third_party/doctest.h"
 
+#include <algorithm>
+#include <vector>
+
 TEST_SUITE_BEGIN("Hash");
 
 TEST_CASE("known strings")
@@ -76,4 +79,24 @@ TEST_CASE("Hash::digest should be idempotent")
   CHECK(util::format_digest(h.digest()) == "af1396svbud1kqg40jfa6reciicrpcisi");
 }
 
+TEST_CASE("Hash::set_state")
+{
+  Hash h1;
+  h1.hash("message");
+  const auto state = h1.state();
+  const std::vector<uint8_t> saved_state(state.begin(), state.end());
+
+  Hash h2;
+  h2.hash("message");
+  CHECK(std::equal(
+    saved_state.begin(), saved_state.end(), h2.state().begin()));
+
+  Hash h3;
+  CHECK(!h3.set_state(nonstd::span<const uint8_t>(saved_state).first(1)));
+  REQUIRE(h3.set_state(saved_state));
+  h3.hash(" digest");
+  CHECK(util::format_digest(h3.digest())
+        == "7bc2kbnbinerv6ruptldpdrb8ko93hcdo");
+}
+
 TEST_SUITE_END();
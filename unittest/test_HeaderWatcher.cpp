@@ -0,0 +1,195 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "../src/Config.hpp"
+#include "../src/Context.hpp"
+#include "../src/Hash.hpp"
+#include "../src/HeaderWatcher.hpp"
+#include "../src/hashutil.hpp"
+#include "TestUtil.hpp"
+
+#include <util/file.hpp>
+#include <util/filesystem.hpp>
+#include <util/fmtmacros.hpp>
+#include <util/path.hpp>
+
+#include "third_party/doctest.h"
+
+#include <atomic>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace fs = util::filesystem;
+
+using TestUtil::TestContext;
+
+namespace {
+
+const util::Duration k_timeout(1);
+
+} // namespace
+
+TEST_SUITE_BEGIN("HeaderWatcher" * doctest::skip(!HeaderWatcher::supported()));
+
+TEST_CASE("No watcher")
+{
+  TestContext test_context;
+
+  Config config;
+  config.set_temporary_dir(util::actual_cwd());
+
+  HeaderWatcher header_watcher(config);
+  CHECK(!header_watcher.get_directory_state(util::actual_cwd()));
+}
+
+TEST_CASE("Directory state")
+{
+  TestContext test_context;
+
+  Config config;
+  config.set_temporary_dir(util::actual_cwd());
+  REQUIRE(fs::create_directories("dir"));
+  const auto dir = FMT("{}/dir", util::actual_cwd());
+  REQUIRE(util::write_file("dir/a.h", "a"));
+
+  std::optional<std::string> state;
+  {
+    HeaderWatcher::Service service(config);
+    service.start();
+
+    HeaderWatcher header_watcher(config);
+    CHECK(!header_watcher.get_directory_state(dir));
+    service.process(util::Duration(0));
+    state = header_watcher.get_directory_state(dir);
+    REQUIRE(state);
+    CHECK(header_watcher.get_directory_state(dir) == state);
+    CHECK(!header_watcher.get_directory_state("/nonexistent"));
+
+    SUBCASE("Modified file")
+    {
+      REQUIRE(util::write_file("dir/a.h", "b"));
+      service.process(k_timeout);
+      const auto new_state = header_watcher.get_directory_state(dir);
+      REQUIRE(new_state);
+      CHECK(new_state != state);
+    }
+
+    SUBCASE("New file")
+    {
+      REQUIRE(util::write_file("dir/b.h", "b"));
+      service.process(k_timeout);
+      CHECK(header_watcher.get_directory_state(dir) != state);
+    }
+
+    SUBCASE("Removed directory")
+    {
+      REQUIRE(util::remove("dir/a.h"));
+      REQUIRE(fs::remove("dir"));
+      service.process(k_timeout);
+      service.process(util::Duration(0));
+      CHECK(!header_watcher.get_directory_state(dir));
+    }
+
+    SUBCASE("Nonexistent directory")
+    {
+      service.process(util::Duration(0));
+      CHECK(!header_watcher.get_directory_state("/nonexistent"));
+    }
+  }
+
+  // The table is removed when the watcher stops.
+  HeaderWatcher header_watcher(config);
+  CHECK(!header_watcher.get_directory_state(dir));
+}
+
+#ifdef INODE_CACHE_SUPPORTED
+TEST_CASE("Change not processed yet")
+{
+  TestContext test_context;
+
+  Context ctx;
+  ctx.config.set_temporary_dir(util::actual_cwd());
+  ctx.config.set_inode_cache(true);
+  REQUIRE(fs::create_directories("dir"));
+  const auto path = FMT("{}/dir/a.h", util::actual_cwd());
+  REQUIRE(util::write_file(path, "a"));
+
+  HeaderWatcher::Service service(ctx.config);
+  service.start();
+
+  Hash::Digest digest;
+  hash_source_code_file(ctx, digest, path); // Requests watching the directory.
+  service.process(util::Duration(0));
+  hash_source_code_file(ctx, digest, path); // Records the digest.
+  CHECK(!ctx.header_watcher.is_synchronized());
+  CHECK(get_verified_digest(ctx, path) == digest);
+
+  // The service hasn't processed the event for this change.
+  REQUIRE(util::write_file(path, "bb"));
+  CHECK(!get_verified_digest(ctx, path));
+  Hash::Digest new_digest;
+  hash_source_code_file(ctx, new_digest, path);
+  CHECK(new_digest == Hash().hash("bb").digest());
+}
+
+TEST_CASE("Synchronized watcher")
+{
+  TestContext test_context;
+
+  Config config;
+  config.set_temporary_dir(util::actual_cwd());
+  REQUIRE(fs::create_directories("dir"));
+  const auto path = FMT("{}/dir/a.h", util::actual_cwd());
+  REQUIRE(util::write_file(path, "a"));
+
+  HeaderWatcher::Service service(config);
+  service.start();
+  std::atomic<bool> stop = false;
+  std::thread service_thread([&] {
+    while (!stop) {
+      service.process(util::Duration(0, 1'000'000));
+    }
+  });
+
+  const auto run = [&](auto&& f) {
+    Context ctx;
+    ctx.config.set_temporary_dir(config.temporary_dir());
+    ctx.config.set_inode_cache(true);
+    f(ctx);
+    CHECK(ctx.header_watcher.is_synchronized());
+  };
+
+  Hash::Digest digest;
+  // Requests watching the directory.
+  run([&](const Context& ctx) { hash_source_code_file(ctx, digest, path); });
+  run([&](const Context& ctx) {
+    hash_source_code_file(ctx, digest, path); // Records the digest.
+    CHECK(get_verified_digest(ctx, path) == digest);
+  });
+
+  // A process started after a change sees it without checking the file.
+  REQUIRE(util::write_file(path, "bb"));
+  run([&](const Context& ctx) { CHECK(!get_verified_digest(ctx, path)); });
+
+  stop = true;
+  service_thread.join();
+}
+#endif
+
+TEST_SUITE_END();
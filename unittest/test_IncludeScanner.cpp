@@ -0,0 +1,210 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "../src/Args.hpp"
+#include "../src/Context.hpp"
+#include "../src/IncludeScanner.hpp"
+#include "TestUtil.hpp"
+
+#include <util/file.hpp>
+#include <util/filesystem.hpp>
+
+#include "third_party/doctest.h"
+
+#include <string>
+#include <vector>
+
+namespace fs = util::filesystem;
+
+using IncludeScanner::find_includes;
+using TestUtil::TestContext;
+
+namespace {
+
+std::vector<std::string>
+names(std::string_view code)
+{
+  std::vector<std::string> result;
+  const auto includes = find_includes(code);
+  REQUIRE(includes);
+  for (const auto& include : *includes) {
+    result.push_back(include.angle ? "<" + include.name + ">"
+                                   : "\"" + include.name + "\"");
+  }
+  return result;
+}
+
+std::vector<std::string>
+paths(const std::vector<IncludeScanner::IncludeFile>& files)
+{
+  std::vector<std::string> result;
+  for (const auto& file : files) {
+    result.push_back(file.path);
+  }
+  return result;
+}
+
+} // namespace
+
+TEST_SUITE_BEGIN("IncludeScanner");
+
+TEST_CASE("IncludeScanner::find_includes")
+{
+  SUBCASE("Simple includes")
+  {
+    CHECK(names("") == std::vector<std::string>{});
+    CHECK(names("#include \"a.h\"\n#include <b.h>\n#import \"c.h\"")
+          == std::vector<std::string>{"\"a.h\"", "<b.h>", "\"c.h\""});
+    CHECK(names("  #  include<a.h>\n%:include \"b.h\"\n")
+          == std::vector<std::string>{"<a.h>", "\"b.h\""});
+  }
+
+  SUBCASE("Conditional sections")
+  {
+    CHECK(names("#ifdef X\n#include \"a.h\"\n"
+                "#else\n#include \"b.h\"\n#endif\n")
+          == std::vector<std::string>{"\"a.h\"", "\"b.h\""});
+  }
+
+  SUBCASE("Comments")
+  {
+    CHECK(names("// #include \"a.h\"\n"
+                "/* #include \"b.h\"\n */ #include <c.h>")
+          == std::vector<std::string>{"<c.h>"});
+    CHECK(names("#include /* x */ \"a.h\" // y\n")
+          == std::vector<std::string>{"\"a.h\""});
+  }
+
+  SUBCASE("Not at line start")
+  {
+    CHECK(names("int x; #include \"a.h\"\n") == std::vector<std::string>{});
+    CHECK(names("int x; /* y */ #include \"a.h\"\n")
+          == std::vector<std::string>{});
+  }
+
+  SUBCASE("Literals")
+  {
+    CHECK(names("char c = '\"';\n#include \"a.h\"\n")
+          == std::vector<std::string>{"\"a.h\""});
+    CHECK(names("int i = 1'000; const char* s = \"/*\";\n"
+                "#include \"a.h\"\n")
+          == std::vector<std::string>{"\"a.h\""});
+    CHECK(names("auto s = R\"x(\n#include \"a.h\"\n)x\";\n"
+                "#include \"b.h\"\n")
+          == std::vector<std::string>{"\"b.h\""});
+  }
+
+  SUBCASE("Line continuation")
+  {
+    CHECK(names("#inc\\\nlude \\\n \"a.h\"\n")
+          == std::vector<std::string>{"\"a.h\""});
+  }
+
+  SUBCASE("Unsupported constructs")
+  {
+    CHECK(!find_includes("#include FOO_H\n"));
+    CHECK(!find_includes("#include \"a.h\n"));
+    CHECK(!find_includes("#include_next <a.h>\n"));
+    CHECK(!find_includes("#if __has_include(<a.h>)\n#endif\n"));
+    CHECK(!find_includes("#embed \"data.bin\"\n"));
+    CHECK(!find_includes("asm(\".incbin \\\"data.bin\\\"\");\n"));
+    CHECK(!find_includes("auto s = R\"x(unterminated\n"));
+  }
+}
+
+TEST_CASE("IncludeScanner::scan")
+{
+  TestContext test_context;
+
+  fs::create_directories("src");
+  fs::create_directories("inc/sub");
+  fs::create_directories("sys");
+  REQUIRE(util::write_file("src/main.c",
+                           "#include \"local.h\"\n"
+                           "#include <a.h>\n"
+                           "#ifdef X\n"
+                           "#include <sys.h>\n"
+                           "#endif\n"));
+  REQUIRE(util::write_file("src/local.h", "#include \"sub/b.h\"\n"));
+  REQUIRE(util::write_file("inc/a.h", "#include \"local.h\"\n"));
+  REQUIRE(util::write_file("inc/local.h", ""));
+  REQUIRE(util::write_file("inc/sub/b.h", "#include \"c.h\"\n"));
+  REQUIRE(util::write_file("inc/sub/c.h", "#include <a.h>\n"));
+  REQUIRE(util::write_file("sys/sys.h", "#include \"sys2.h\"\n"));
+  REQUIRE(util::write_file("sys/sys2.h", "#include <stdio.h>\n"));
+
+  Context ctx;
+  ctx.args_info.input_file = "src/main.c";
+
+  SUBCASE("All files found")
+  {
+    REQUIRE(util::write_file("sys/sys2.h", ""));
+    const auto result = IncludeScanner::scan(
+      ctx, Args::from_string("cc -Iinc -isystem sys -DX"));
+    REQUIRE(result);
+    CHECK(paths(result->files)
+          == std::vector<std::string>{"src/local.h",
+                                      "inc/a.h",
+                                      "sys/sys.h",
+                                      "sys/sys2.h",
+                                      "inc/local.h",
+                                      "inc/sub/b.h",
+                                      "inc/sub/c.h"});
+    CHECK(!result->files[0].system);
+    CHECK(result->files[2].system);
+    CHECK(result->files[3].system);
+    CHECK(result->unresolved.empty());
+  }
+
+  SUBCASE("Unresolved include")
+  {
+    CHECK(
+      !IncludeScanner::scan(ctx, Args::from_string("cc -Iinc -isystem sys")));
+  }
+
+  SUBCASE("Unresolved include with system_headers sloppiness")
+  {
+    ctx.config.update_from_map({{"sloppiness", "system_headers"}});
+    const auto result = IncludeScanner::scan(
+      ctx, Args::from_string("cc -I inc -isystemsys"));
+    REQUIRE(result);
+    CHECK(result->unresolved == std::vector<std::string>{"<stdio.h>"});
+  }
+
+  SUBCASE("Forced include")
+  {
+    ctx.config.update_from_map({{"sloppiness", "system_headers"}});
+    REQUIRE(util::write_file("forced.h", ""));
+    const auto result = IncludeScanner::scan(
+      ctx, Args::from_string("cc -include forced.h -Iinc -isystem sys"));
+    REQUIRE(result);
+    CHECK(result->files.front().path == "forced.h");
+  }
+
+  SUBCASE("Unsupported options")
+  {
+    ctx.config.update_from_map({{"sloppiness", "system_headers"}});
+    CHECK(!IncludeScanner::scan(
+      ctx, Args::from_string("cc -Iinc -isystem sys -idirafter x")));
+    CHECK(!IncludeScanner::scan(ctx, Args::from_string("cc -Iinc -I- -Isys")));
+    CHECK(!IncludeScanner::scan(
+      ctx, Args::from_string("cc -Iinc -isystem sys -Wp,-Ix")));
+  }
+}
+
+TEST_SUITE_END();
@@ -22,8 +22,11 @@
 #include "../src/InodeCache.hpp"
 #include "TestUtil.hpp"
 
+#include <util/DirEntry.hpp>
 #include <util/Fd.hpp>
 #include <util/file.hpp>
+#include <util/filesystem.hpp>
+#include <util/fmtmacros.hpp>
 #include <util/path.hpp>
 
 #include "third_party/doctest.h"
@@ -32,6 +35,8 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+namespace fs = util::filesystem;
+
 using TestUtil::TestContext;
 
 namespace {
@@ -203,4 +208,55 @@ TEST_CASE("Test content type")
   CHECK(return_value->second == code_digest);
 }
 
+TEST_CASE("Test session digest")
+{
+  TestContext test_context;
+
+  Config config;
+  init(config);
+
+  InodeCache inode_cache(config, util::Duration(0));
+  const auto type = InodeCache::ContentType::checked_for_temporal_macros;
+  const auto digest = Hash().hash("a text").digest();
+
+  CHECK(!inode_cache.get_session_digest("s1", "/a", type));
+  CHECK(inode_cache.put_session_digest("s1", "/a", type, digest));
+  CHECK(inode_cache.get_session_digest("s1", "/a", type) == digest);
+
+  // The file is never accessed.
+  CHECK(!util::DirEntry("/a").exists());
+
+  CHECK(!inode_cache.get_session_digest("s2", "/a", type));
+  CHECK(!inode_cache.get_session_digest("s1", "/b", type));
+  CHECK(
+    !inode_cache.get_session_digest("s1", "/a", InodeCache::ContentType::raw));
+  CHECK(inode_cache.get_hits() == 1);
+  CHECK(inode_cache.get_misses() == 4);
+}
+
+TEST_CASE("Test normalized path")
+{
+  TestContext test_context;
+
+  Config config;
+  init(config);
+
+  InodeCache inode_cache(config, util::Duration(0));
+  REQUIRE(fs::create_directory("d"));
+  REQUIRE(util::write_file("d/a.h", ""));
+  const auto path = FMT("{}/d/../d/a.h", util::actual_cwd());
+
+  CHECK(!inode_cache.get_normalized_path("c1", path));
+  CHECK(inode_cache.put_normalized_path("c1", path, "d/a.h"));
+  CHECK(inode_cache.get_normalized_path("c1", path) == "d/a.h");
+  CHECK(!inode_cache.get_normalized_path("c2", path));
+  CHECK(!inode_cache.put_normalized_path("c1", path, std::string(1000, 'x')));
+
+  // A replaced directory invalidates the entry.
+  REQUIRE(fs::rename("d", "e"));
+  REQUIRE(fs::create_directory("d"));
+  REQUIRE(util::write_file("d/a.h", ""));
+  CHECK(!inode_cache.get_normalized_path("c1", path));
+}
+
 TEST_SUITE_END();
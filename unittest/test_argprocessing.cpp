@@ -283,6 +283,69 @@ TEST_CASE("MF_should_not_be_added_if_run_second_cpp_is_true")
   CHECK(result.compiler_args.to_string() == "cc -c -MD");
 }
 
+TEST_CASE("run_second_cpp_auto")
+{
+  TestContext test_context;
+  Context ctx;
+  ctx.config.update_from_map({{"run_second_cpp", "auto"}});
+  ctx.config.set_compiler_type(CompilerType::gcc);
+  util::write_file("foo.c", "");
+
+  SUBCASE("Safe arguments")
+  {
+    ctx.orig_args =
+      Args::from_string("cc -c foo.c -w -Werror=return-type -o foo.o");
+    CHECK(!process_args(ctx).error);
+    CHECK(!ctx.config.run_second_cpp());
+  }
+
+  SUBCASE("GCC without -w")
+  {
+    ctx.orig_args = Args::from_string("cc -c foo.c -Wall -o foo.o");
+    CHECK(!process_args(ctx).error);
+    CHECK(ctx.config.run_second_cpp());
+  }
+
+  SUBCASE("-Werror")
+  {
+    ctx.orig_args = Args::from_string("cc -c foo.c -w -Werror -o foo.o");
+    CHECK(!process_args(ctx).error);
+    CHECK(ctx.config.run_second_cpp());
+  }
+
+  SUBCASE("-Werror for macro sensitive warning")
+  {
+    ctx.orig_args = Args::from_string(
+      "cc -c foo.c -w -Werror=misleading-indentation -o foo.o");
+    CHECK(!process_args(ctx).error);
+    CHECK(ctx.config.run_second_cpp());
+  }
+
+  SUBCASE("-fdirectives-only")
+  {
+    ctx.orig_args =
+      Args::from_string("cc -c foo.c -w -fdirectives-only -o foo.o");
+    CHECK(!process_args(ctx).error);
+    CHECK(ctx.config.run_second_cpp());
+  }
+
+  SUBCASE("Clang")
+  {
+    ctx.config.set_compiler_type(CompilerType::clang);
+    ctx.orig_args = Args::from_string("cc -c foo.c -o foo.o");
+    CHECK(!process_args(ctx).error);
+    CHECK(ctx.config.run_second_cpp());
+  }
+
+  SUBCASE("Clang with -w")
+  {
+    ctx.config.set_compiler_type(CompilerType::clang);
+    ctx.orig_args = Args::from_string("cc -c foo.c -w -o foo.o");
+    CHECK(!process_args(ctx).error);
+    CHECK(!ctx.config.run_second_cpp());
+  }
+}
+
 TEST_CASE("equal_sign_after_MF_should_be_removed")
 {
   TestContext test_context;
@@ -21,6 +21,7 @@
 #include "third_party/doctest.h"
 
 bool compopt_verify_sortedness_and_flags();
+bool compopt_verify_lookups();
 
 TEST_SUITE_BEGIN("compopt");
 
@@ -29,6 +30,11 @@ TEST_CASE("option_table_should_be_sorted")
   CHECK(compopt_verify_sortedness_and_flags());
 }
 
+TEST_CASE("lookups_should_match_reference_searches")
+{
+  CHECK(compopt_verify_lookups());
+}
+
 TEST_CASE("affects_cpp_output")
 {
   CHECK(compopt_affects_cpp_output("-I"));
@@ -83,6 +89,10 @@ TEST_CASE("prefix_affects_cpp_output")
   CHECK(compopt_prefix_affects_cpp_output("-iframework"));
   CHECK(compopt_prefix_affects_cpp_output("-iframework42"));
   CHECK(!compopt_prefix_affects_cpp_output("-iframewor"));
+  CHECK(compopt_prefix_affects_cpp_output("-Fx"));
+  CHECK(compopt_prefix_affects_cpp_output("-FIfoo.h"));
+  CHECK(!compopt_prefix_affects_cpp_output("-fx"));
+  CHECK(!compopt_prefix_affects_cpp_output(""));
 }
 
 TEST_CASE("prefix_affects_compiler_output")
@@ -90,6 +100,10 @@ TEST_CASE("prefix_affects_compiler_output")
   CHECK(compopt_prefix_affects_compiler_output("-Wa,"));
   CHECK(compopt_prefix_affects_compiler_output("-Wa,something"));
   CHECK(!compopt_prefix_affects_compiler_output("-Wa"));
+  // The longest matching option, "-ast-dump-all=", takes a concatenated
+  // argument while "-ast-dump-all" doesn't.
+  CHECK(compopt_prefix_affects_compiler_output("-ast-dump-all=json"));
+  CHECK(!compopt_prefix_affects_compiler_output("-ast-dump-allx"));
 }
 
 TEST_SUITE_END();
@@ -0,0 +1,364 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "TestUtil.hpp"
+
+#include <Context.hpp>
+#include <Hash.hpp>
+#include <core/Manifest.hpp>
+#include <core/exceptions.hpp>
+#include <hashutil.hpp>
+#include <util/Bytes.hpp>
+#include <util/DirEntry.hpp>
+#include <util/Duration.hpp>
+#include <util/file.hpp>
+
+#include <third_party/doctest.h>
+
+#include <iostream> // macOS bug: https://github.com/onqtam/doctest/issues/126
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using TestUtil::TestContext;
+
+namespace {
+
+Hash::Digest
+key(const std::string& name)
+{
+  return Hash().hash(name).digest();
+}
+
+// Add a result that includes `paths` with their current content.
+bool
+add_result(const Context& ctx,
+           core::Manifest& manifest,
+           const Hash::Digest& result_key,
+           const std::vector<std::string>& paths)
+{
+  std::unordered_map<std::string_view, Hash::Digest> included_files;
+  for (const auto& path : paths) {
+    Hash::Digest digest;
+    hash_source_code_file(ctx, digest, path);
+    included_files.emplace(path, digest);
+  }
+  return manifest.add_result(
+    result_key, included_files, [](std::string_view path) {
+      util::DirEntry entry(path);
+      return core::Manifest::FileStats{
+        entry.size(), util::TimePoint(), util::TimePoint()};
+    });
+}
+
+} // namespace
+
+TEST_SUITE_BEGIN("core::Manifest");
+
+TEST_CASE("Look up result")
+{
+  TestContext test_context;
+
+  Context ctx;
+  ctx.config.set_inode_cache(false);
+  core::Manifest manifest;
+
+  REQUIRE(util::write_file("common.h", "common"));
+  REQUIRE(util::write_file("a.h", "a1"));
+  REQUIRE(util::write_file("b.h", "b1"));
+  CHECK(add_result(ctx, manifest, key("1"), {"common.h", "a.h", "b.h"}));
+  CHECK(!add_result(ctx, manifest, key("1"), {"common.h", "a.h", "b.h"}));
+
+  REQUIRE(util::write_file("a.h", "a2"));
+  CHECK(add_result(ctx, manifest, key("2"), {"common.h", "a.h", "b.h"}));
+
+  REQUIRE(util::write_file("b.h", "b2"));
+  CHECK(add_result(ctx, manifest, key("3"), {"common.h", "a.h", "b.h"}));
+  CHECK(add_result(ctx, manifest, key("4"), {"common.h", "a.h"}));
+
+  SUBCASE("Newest matching result")
+  {
+    CHECK(manifest.look_up_result_digest(ctx) == key("4"));
+  }
+
+  SUBCASE("Older result")
+  {
+    REQUIRE(util::write_file("b.h", "b1"));
+    CHECK(manifest.look_up_result_digest(ctx) == key("4"));
+
+    REQUIRE(util::write_file("a.h", "a1"));
+    CHECK(manifest.look_up_result_digest(ctx) == key("1"));
+  }
+
+  SUBCASE("No match")
+  {
+    REQUIRE(util::write_file("common.h", "changed"));
+    CHECK(!manifest.look_up_result_digest(ctx));
+  }
+
+  SUBCASE("Serialization round trip")
+  {
+    util::Bytes data;
+    manifest.serialize(data);
+    CHECK(data.size() == manifest.serialized_size());
+
+    core::Manifest manifest2;
+    manifest2.read(data);
+    CHECK(manifest2.look_up_result_digest(ctx) == key("4"));
+    REQUIRE(util::write_file("a.h", "a1"));
+    REQUIRE(util::write_file("b.h", "b1"));
+    CHECK(manifest2.look_up_result_digest(ctx) == key("1"));
+
+    util::Bytes data2;
+    manifest2.serialize(data2);
+    CHECK(data2 == data);
+  }
+
+  SUBCASE("Same includes replace result")
+  {
+    CHECK(add_result(ctx, manifest, key("5"), {"common.h", "a.h"}));
+    CHECK(manifest.look_up_result_digest(ctx) == key("5"));
+  }
+}
+
+TEST_CASE("Touch result")
+{
+  TestContext test_context;
+
+  Context ctx;
+  ctx.config.set_inode_cache(false);
+  core::Manifest manifest;
+
+  REQUIRE(util::write_file("a.h", "a"));
+  REQUIRE(add_result(ctx, manifest, key("1"), {"a.h"}));
+
+  const auto now = util::TimePoint::now();
+  CHECK(!manifest.touch(key("1"), now));
+  CHECK(!manifest.touch(key("2"), now + util::Duration(3 * 24 * 60 * 60)));
+  CHECK(manifest.touch(key("1"), now + util::Duration(2 * 24 * 60 * 60)));
+  CHECK(!manifest.touch(key("1"), now + util::Duration(2 * 24 * 60 * 60)));
+
+  SUBCASE("Serialized form")
+  {
+    util::Bytes data;
+    manifest.serialize(data);
+
+    core::Manifest manifest2;
+    manifest2.read(data);
+    CHECK(!manifest2.touch(key("1"),
+                           now + util::Duration(3 * 24 * 60 * 60 - 60)));
+    CHECK(manifest2.touch(key("1"), now + util::Duration(4 * 24 * 60 * 60)));
+
+    util::Bytes data2;
+    manifest2.serialize(data2);
+    core::Manifest manifest3;
+    manifest3.read(data2);
+    CHECK(!manifest3.touch(key("1"), now + util::Duration(4 * 24 * 60 * 60)));
+    CHECK(manifest3.look_up_result_digest(ctx) == key("1"));
+  }
+}
+
+TEST_CASE("Count results")
+{
+  TestContext test_context;
+
+  Context ctx;
+  ctx.config.set_inode_cache(false);
+  core::Manifest manifest;
+
+  CHECK(manifest.count_results().results == 0);
+  CHECK(manifest.count_results().reused_keys == 0);
+
+  REQUIRE(util::write_file("a.h", "a1"));
+  REQUIRE(add_result(ctx, manifest, key("1"), {"a.h"}));
+  REQUIRE(util::write_file("a.h", "a2"));
+  REQUIRE(add_result(ctx, manifest, key("1"), {"a.h"}));
+  REQUIRE(util::write_file("a.h", "a3"));
+  REQUIRE(add_result(ctx, manifest, key("2"), {"a.h"}));
+  CHECK(manifest.count_results().results == 3);
+  CHECK(manifest.count_results().reused_keys == 1);
+
+  util::Bytes data;
+  manifest.serialize(data);
+  core::Manifest manifest2;
+  manifest2.read(data);
+  CHECK(manifest2.count_results().results == 3);
+  CHECK(manifest2.count_results().reused_keys == 1);
+}
+
+TEST_CASE("Extract result")
+{
+  TestContext test_context;
+
+  Context ctx;
+  ctx.config.set_inode_cache(false);
+  core::Manifest manifest;
+
+  REQUIRE(util::write_file("a.h", "a1"));
+  REQUIRE(util::write_file("b.h", "b"));
+  REQUIRE(add_result(ctx, manifest, key("1"), {"a.h", "b.h"}));
+  REQUIRE(util::write_file("a.h", "a2"));
+  REQUIRE(add_result(ctx, manifest, key("2"), {"a.h"}));
+
+  auto delta = manifest.extract(key("1"));
+  CHECK(!delta.look_up_result_digest(ctx));
+  REQUIRE(util::write_file("a.h", "a1"));
+  CHECK(delta.look_up_result_digest(ctx) == key("1"));
+  CHECK(manifest.extract(key("3")).serialized_size()
+        == core::Manifest().serialized_size());
+
+  SUBCASE("Same key as older result")
+  {
+    REQUIRE(util::write_file("a.h", "a3"));
+    REQUIRE(add_result(ctx, manifest, key("1"), {"a.h"}));
+    CHECK(manifest.extract(key("1")).look_up_result_digest(ctx) == key("1"));
+  }
+
+  SUBCASE("Merge")
+  {
+    util::Bytes data;
+    delta.serialize(data);
+
+    core::Manifest manifest2;
+    REQUIRE(add_result(ctx, manifest2, key("3"), {"b.h"}));
+    manifest2.read(data);
+    CHECK(manifest2.look_up_result_digest(ctx) == key("1"));
+    REQUIRE(util::write_file("a.h", "changed"));
+    CHECK(manifest2.look_up_result_digest(ctx) == key("3"));
+  }
+}
+
+TEST_CASE("Merge older manifest")
+{
+  TestContext test_context;
+
+  Context ctx;
+  ctx.config.set_inode_cache(false);
+
+  REQUIRE(util::write_file("a.h", "a"));
+  core::Manifest old_manifest;
+  REQUIRE(add_result(ctx, old_manifest, key("1"), {"a.h"}));
+  util::Bytes old_data;
+  old_manifest.serialize(old_data);
+
+  core::Manifest manifest;
+  manifest.read(old_data);
+  REQUIRE(add_result(ctx, manifest, key("2"), {"a.h"}));
+  manifest.touch(key("2"),
+                 util::TimePoint::now() + util::Duration(2 * 24 * 60 * 60));
+
+  // The older result with the same include entries must not replace the newer.
+  manifest.read(old_data);
+  CHECK(manifest.look_up_result_digest(ctx) == key("2"));
+  CHECK(manifest.count_results().results == 1);
+}
+
+TEST_CASE("Read corrupt manifest")
+{
+  TestContext test_context;
+
+  Context ctx;
+  ctx.config.set_inode_cache(false);
+  core::Manifest manifest;
+
+  REQUIRE(util::write_file("a.h", "a"));
+  REQUIRE(add_result(ctx, manifest, key("1"), {"a.h"}));
+  util::Bytes data;
+  manifest.serialize(data);
+
+  SUBCASE("Truncated")
+  {
+    data.resize(data.size() - 1);
+    CHECK_THROWS_AS(core::Manifest().read(data), core::Error);
+  }
+
+  SUBCASE("Bad root node")
+  {
+    // Header, one path entry, one include entry and one result entry precede
+    // the root node's include index.
+    const size_t root_offset = 32 + 8 + 48 + 32;
+    REQUIRE(data.size() > root_offset + 4);
+    for (size_t i = 0; i < 4; ++i) {
+      data[root_offset + i] = 0;
+    }
+    core::Manifest corrupt;
+    corrupt.read(data);
+    CHECK_THROWS_AS(corrupt.look_up_result_digest(ctx), core::Error);
+  }
+}
+
+TEST_CASE("Read manifest without copying")
+{
+  TestContext test_context;
+
+  Context ctx;
+  ctx.config.set_inode_cache(false);
+  core::Manifest manifest;
+
+  REQUIRE(util::write_file("a.h", "a"));
+  REQUIRE(add_result(ctx, manifest, key("1"), {"a.h"}));
+  auto data = std::make_shared<util::Bytes>();
+  manifest.serialize(*data);
+  const util::Bytes original = *data;
+
+  core::Manifest borrowed;
+  borrowed.read(*data, data);
+  CHECK(borrowed.look_up_result_digest(ctx) == key("1"));
+
+  // Modifying the manifest must not modify the borrowed data.
+  borrowed.touch(key("1"),
+                 util::TimePoint::now() + util::Duration(2 * 24 * 60 * 60));
+  REQUIRE(util::write_file("b.h", "b"));
+  REQUIRE(add_result(ctx, borrowed, key("2"), {"b.h"}));
+  CHECK(*data == original);
+  CHECK(borrowed.count_results().results == 2);
+}
+
+TEST_CASE("Evict least recently used result")
+{
+  TestContext test_context;
+
+  Context ctx;
+  ctx.config.set_inode_cache(false);
+  core::Manifest manifest;
+
+  const size_t max_entries = 100;
+  for (size_t i = 0; i < max_entries; ++i) {
+    REQUIRE(util::write_file("gen.h", std::to_string(i)));
+    REQUIRE(add_result(ctx, manifest, key(std::to_string(i)), {"gen.h"}));
+  }
+  manifest.touch(key("0"),
+                 util::TimePoint::now() + util::Duration(2 * 24 * 60 * 60));
+
+  REQUIRE(util::write_file("gen.h", "new"));
+  REQUIRE(add_result(ctx, manifest, key("new"), {"gen.h"}));
+  CHECK(manifest.look_up_result_digest(ctx) == key("new"));
+
+  REQUIRE(util::write_file("gen.h", "0"));
+  CHECK(manifest.look_up_result_digest(ctx) == key("0"));
+
+  REQUIRE(util::write_file("gen.h", "1"));
+  CHECK(!manifest.look_up_result_digest(ctx));
+
+  REQUIRE(util::write_file("gen.h", "2"));
+  CHECK(manifest.look_up_result_digest(ctx) == key("2"));
+}
+
+TEST_SUITE_END();
@@ -18,8 +18,10 @@
 
 #include "TestUtil.hpp"
 
+#include <Config.hpp>
 #include <core/Statistic.hpp>
 #include <core/Statistics.hpp>
+#include <util/string.hpp>
 
 #include <third_party/doctest.h>
 
@@ -43,10 +45,45 @@ TEST_CASE("get_statistics_ids")
   counters.increment(Statistic::cache_miss);
   counters.increment(Statistic::direct_cache_hit);
   counters.increment(Statistic::autoconf_test);
+  counters.increment(Statistic::compile_time_saved_ms, 4711);
 
   std::vector<std::string> expected = {
     "autoconf_test", "cache_miss", "direct_cache_hit"};
   CHECK(Statistics(counters).get_statistics_ids() == expected);
 }
 
+TEST_CASE("format_machine_readable OpenMetrics")
+{
+  TestContext test_context;
+
+  Config config;
+  StatisticsCounters counters;
+  counters.increment(Statistic::cache_miss, 2);
+  counters.increment(Statistic::files_in_cache, 3);
+  counters.record_latency(Statistic::lock_wait_histogram_base,
+                          util::Duration(0, 200'000));
+  counters.record_latency(Statistic::lock_wait_histogram_base,
+                          util::Duration(1));
+
+  const auto output = Statistics(counters).format_machine_readable(
+    config, util::TimePoint(), core::StatisticsFormat::OpenMetrics);
+
+  CHECK(output.find("# TYPE ccache_cache_miss counter\n"
+                    "ccache_cache_miss_total 2\n")
+        != std::string::npos);
+  CHECK(output.find("# TYPE ccache_files_in_cache gauge\n"
+                    "ccache_files_in_cache 3\n")
+        != std::string::npos);
+  CHECK(output.find("# TYPE ccache_lock_wait_seconds histogram\n")
+        != std::string::npos);
+  CHECK(output.find("ccache_lock_wait_seconds_bucket{le=\"0.000128\"} 0\n"
+                    "ccache_lock_wait_seconds_bucket{le=\"0.000256\"} 1\n")
+        != std::string::npos);
+  CHECK(output.find("ccache_lock_wait_seconds_bucket{le=\"+Inf\"} 2\n"
+                    "ccache_lock_wait_seconds_sum 1.0002\n"
+                    "ccache_lock_wait_seconds_count 2\n")
+        != std::string::npos);
+  CHECK(util::ends_with(output, "# EOF\n"));
+}
+
 TEST_SUITE_END();
@@ -90,6 +90,23 @@ TEST_CASE("StatisticsCounters")
     CHECK(counters.get(Statistic::files_in_cache) == 9);
     CHECK(counters.get(Statistic::cache_size_kibibyte) == 0); // No wrap-around
   }
+
+  SUBCASE("Record latency")
+  {
+    const auto base = Statistic::hit_latency_histogram_base;
+    counters.record_latency(base, util::Duration(0, 50'000));     // 50 us
+    counters.record_latency(base, util::Duration(0, 128'000));    // 128 us
+    counters.record_latency(base, util::Duration(0, 129'000));    // 129 us
+    counters.record_latency(base, util::Duration(3600));          // 1 h
+    counters.record_latency(base, util::Duration(0, -1'000'000)); // Negative
+
+    CHECK(counters.get_offsetted(base, 0) == 3);
+    CHECK(counters.get_offsetted(base, 1) == 1);
+    CHECK(counters.get_offsetted(base, core::k_latency_buckets - 1) == 1);
+    CHECK(counters.get_offsetted(base, core::k_latency_buckets)
+          == 50 + 128 + 129 + 3'600'000'000);
+    CHECK(counters.get(Statistic::miss_overhead_histogram_base) == 0);
+  }
 }
 
 TEST_SUITE_END();
@@ -0,0 +1,178 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "TestUtil.hpp"
+
+#include <storage/local/EvictionIndex.hpp>
+#include <storage/local/util.hpp>
+#include <util/DirEntry.hpp>
+#include <util/PathString.hpp>
+#include <util/TimePoint.hpp>
+#include <util/file.hpp>
+#include <util/filesystem.hpp>
+
+#include <third_party/doctest.h>
+
+#include <string>
+#include <vector>
+
+using storage::local::EvictionIndex;
+using TestUtil::TestContext;
+
+namespace fs = util::filesystem;
+
+static void
+create_file(const std::string& path, size_t size, int64_t mtime)
+{
+  util::write_file(path, std::string(size, 'x'));
+  util::set_timestamps(path, util::TimePoint(mtime));
+}
+
+static std::vector<std::string>
+sorted_names(EvictionIndex& index, EvictionPolicy policy)
+{
+  auto files = storage::local::get_cache_dir_files("d");
+  index.sort(files, policy);
+  std::vector<std::string> names;
+  for (const auto& file : files) {
+    names.push_back(util::PathString(file.path().filename()).str());
+  }
+  return names;
+}
+
+TEST_SUITE_BEGIN("storage::local::EvictionIndex");
+
+TEST_CASE("Eviction order")
+{
+  TestContext test_context;
+
+  fs::create_directories("d");
+  create_file("d/aR", 100, 1);
+  create_file("d/bR", 100000, 2);
+  create_file("d/cR", 100, 3);
+  EvictionIndex::record_insertion("d", "aR", 0);
+  EvictionIndex::record_insertion("d", "bR", 0);
+  EvictionIndex::record_insertion("d", "cR", 0);
+  EvictionIndex::record_hit("d", "aR");
+  EvictionIndex::record_hit("d", "aR");
+
+  EvictionIndex index("d");
+  index.load();
+
+  SUBCASE("LRU")
+  {
+    CHECK(sorted_names(index, EvictionPolicy::lru)
+          == std::vector<std::string>{"aR", "bR", "cR"});
+  }
+
+  SUBCASE("GDSF")
+  {
+    CHECK(sorted_names(index, EvictionPolicy::gdsf)
+          == std::vector<std::string>{"bR", "cR", "aR"});
+  }
+
+  SUBCASE("ARC")
+  {
+    CHECK(sorted_names(index, EvictionPolicy::arc)
+          == std::vector<std::string>{"bR", "aR", "cR"});
+  }
+}
+
+TEST_CASE("Unknown cost is the median of known costs")
+{
+  TestContext test_context;
+
+  // aM has no known cost, so it's treated like bR and cR and evicted before
+  // them only because it's older.
+  fs::create_directories("d");
+  create_file("d/aM", 100, 1);
+  create_file("d/bR", 100, 2);
+  create_file("d/cR", 100, 3);
+  create_file("d/dR", 100, 4);
+  EvictionIndex::record_insertion("d", "aM", 0);
+  EvictionIndex::record_insertion("d", "bR", 20);
+  EvictionIndex::record_insertion("d", "cR", 20);
+  EvictionIndex::record_insertion("d", "dR", 5000);
+
+  EvictionIndex index("d");
+  index.load();
+  CHECK(sorted_names(index, EvictionPolicy::gdsf)
+        == std::vector<std::string>{"aM", "bR", "cR", "dR"});
+}
+
+TEST_CASE("Raw files share entry with result")
+{
+  TestContext test_context;
+
+  fs::create_directories("d/e");
+  create_file("d/aR", 100, 1);
+  create_file("d/e/fR", 100, 2);
+  create_file("d/e/f0W", 100000, 3);
+  EvictionIndex::record_insertion("d", "aR", 0);
+  EvictionIndex::record_insertion("d", "efR", 0);
+
+  EvictionIndex index("d");
+  index.load();
+  const auto names = sorted_names(index, EvictionPolicy::gdsf);
+  REQUIRE(names.size() == 3);
+  CHECK(names[2] == "aR");
+}
+
+TEST_CASE("Compaction keeps state")
+{
+  TestContext test_context;
+
+  fs::create_directories("d");
+  create_file("d/aR", 100, 1);
+  create_file("d/bR", 100000, 2);
+  create_file("d/cR", 100, 3);
+  EvictionIndex::record_insertion("d", "aR", 0);
+  EvictionIndex::record_insertion("d", "bR", 0);
+  EvictionIndex::record_insertion("d", "cR", 0);
+  EvictionIndex::record_hit("d", "cR");
+
+  {
+    EvictionIndex index("d");
+    index.load();
+    auto files = storage::local::get_cache_dir_files("d");
+    index.sort(files, EvictionPolicy::arc);
+    REQUIRE(util::PathString(files[0].path().filename()).str() == "aR");
+    util::remove(files[0].path());
+    index.record_eviction(files[0]);
+    index.save(&files);
+  }
+
+  const auto content = util::read_file<std::string>("d/eviction_index");
+  REQUIRE(content);
+  CHECK(content->find("e aR ") == std::string::npos);
+  CHECK(content->find("e bR 0 0 ") != std::string::npos);
+  CHECK(content->find("e cR 0 1 ") != std::string::npos);
+  CHECK(content->find("g 0 aR\n") != std::string::npos);
+
+  // Reinserting an entry evicted from the recency list grows the recency list
+  // target and makes the entry frequent, so the frequency list is now evicted
+  // first.
+  create_file("d/aR", 100, 4);
+  EvictionIndex::record_insertion("d", "aR", 0);
+  EvictionIndex index("d");
+  index.load();
+  CHECK(sorted_names(index, EvictionPolicy::arc)
+        == std::vector<std::string>{"cR", "aR", "bR"});
+}
+
+TEST_SUITE_END();
@@ -18,6 +18,7 @@
 
 #include "TestUtil.hpp"
 
+#include <core/exceptions.hpp>
 #include <storage/local/util.hpp>
 #include <util/file.hpp>
 #include <util/filesystem.hpp>
@@ -26,6 +27,7 @@
 #include <third_party/doctest.h>
 
 #include <algorithm>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -57,6 +59,49 @@ TEST_CASE("storage::local::for_each_cache_subdir")
   CHECK(actual == expected);
 }
 
+TEST_CASE("storage::local::for_each_cache_subdir with threads")
+{
+  std::mutex mutex;
+  std::vector<uint8_t> actual;
+  std::vector<double> progress;
+
+  SUBCASE("all subdirectories are visited")
+  {
+    storage::local::for_each_cache_subdir(
+      4,
+      [&](double p) { progress.push_back(p); },
+      [&](uint8_t index, const auto& progress_receiver) {
+        progress_receiver(0.5);
+        std::unique_lock<std::mutex> lock(mutex);
+        actual.push_back(index);
+      });
+
+    std::sort(actual.begin(), actual.end());
+    std::vector<uint8_t> expected = {
+      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+    CHECK(actual == expected);
+    REQUIRE(!progress.empty());
+    CHECK(std::is_sorted(progress.begin(), progress.end()));
+    CHECK(progress.back() == 1.0);
+  }
+
+  SUBCASE("exception is propagated")
+  {
+    CHECK_THROWS_WITH(storage::local::for_each_cache_subdir(
+                        4,
+                        [](double) {},
+                        [&](uint8_t index, const auto&) {
+                          if (index == 7) {
+                            throw core::Error("subdir 7");
+                          }
+                          std::unique_lock<std::mutex> lock(mutex);
+                          actual.push_back(index);
+                        }),
+                      "subdir 7");
+    CHECK(actual.size() == 15);
+  }
+}
+
 TEST_CASE("storage::local::get_cache_dir_files")
 {
   TestContext test_context;
@@ -0,0 +1,92 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "TestUtil.hpp"
+
+#include <util/Bytes.hpp>
+#include <util/MemoryMap.hpp>
+#include <util/file.hpp>
+
+#include <third_party/doctest.h>
+
+#include <utility>
+
+using TestUtil::TestContext;
+using util::MemoryMap;
+
+TEST_SUITE_BEGIN("util::MemoryMap");
+
+TEST_CASE("util::MemoryMap::open")
+{
+  TestContext test_context;
+
+  SUBCASE("Missing file")
+  {
+    CHECK(!MemoryMap::open("missing"));
+  }
+
+  SUBCASE("Empty file")
+  {
+    REQUIRE(util::write_file("empty", ""));
+    const auto map = MemoryMap::open("empty");
+    REQUIRE(map);
+    CHECK(!map->is_mapped());
+    CHECK(map->data().empty());
+  }
+
+  SUBCASE("Small file")
+  {
+    REQUIRE(util::write_file("small", "abc"));
+    const auto map = MemoryMap::open("small");
+    REQUIRE(map);
+    CHECK(!map->is_mapped());
+    CHECK(util::Bytes(map->data()) == util::Bytes{'a', 'b', 'c'});
+  }
+
+  SUBCASE("Large file")
+  {
+    util::Bytes content(MemoryMap::k_min_map_size + 1);
+    for (size_t i = 0; i < content.size(); ++i) {
+      content[i] = static_cast<uint8_t>(i);
+    }
+    REQUIRE(util::write_file("large", content));
+
+    auto map = MemoryMap::open("large");
+    REQUIRE(map);
+#ifdef HAVE_SYS_MMAN_H
+    CHECK(map->is_mapped());
+#endif
+    CHECK(util::Bytes(map->data()) == content);
+
+    MemoryMap moved(std::move(*map));
+    CHECK(!map->is_mapped());
+    CHECK(map->data().empty());
+    CHECK(util::Bytes(moved.data()) == content);
+  }
+
+  SUBCASE("Wrong size hint")
+  {
+    REQUIRE(util::write_file("small", "abc"));
+    const auto map = MemoryMap::open("small", MemoryMap::k_min_map_size);
+    REQUIRE(map);
+    CHECK(!map->is_mapped());
+    CHECK(map->data().size() == 3);
+  }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,64 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "../src/util/StringInterner.hpp"
+
+#include <third_party/doctest.h>
+
+#include <string>
+
+TEST_SUITE_BEGIN("util::StringInterner");
+
+TEST_CASE("Intern strings")
+{
+  util::StringInterner interner;
+  CHECK(interner.size() == 0);
+
+  std::string a = "/usr/include/stdio.h";
+  const auto a1 = interner.intern(a);
+  CHECK(a1 == a);
+  CHECK(a1.data() != a.data());
+  a = "changed";
+  CHECK(a1 == "/usr/include/stdio.h");
+
+  const auto a2 = interner.intern("/usr/include/stdio.h");
+  CHECK(a2.data() == a1.data());
+
+  const auto b = interner.intern("/usr/include/stdlib.h");
+  CHECK(b == "/usr/include/stdlib.h");
+  CHECK(interner.intern("").empty());
+  CHECK(interner.size() == 3);
+}
+
+TEST_CASE("Large and many strings")
+{
+  util::StringInterner interner;
+
+  const std::string large(100'000, 'x');
+  const auto first = interner.intern("first");
+  CHECK(interner.intern(large) == large);
+  for (size_t i = 0; i < 10'000; ++i) {
+    interner.intern(std::to_string(i) + "/header.h");
+  }
+  CHECK(interner.size() == 10'002);
+  CHECK(first == "first");
+  CHECK(interner.intern("9999/header.h") == "9999/header.h");
+  CHECK(interner.intern(large).data() == interner.intern(large).data());
+}
+
+TEST_SUITE_END();
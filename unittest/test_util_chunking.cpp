@@ -0,0 +1,116 @@
+// Copyright (C) 2024 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <util/Bytes.hpp>
+#include <util/chunking.hpp>
+
+#include <third_party/doctest.h>
+
+#include <set>
+#include <string>
+
+namespace {
+
+util::Bytes
+pseudo_random_data(size_t size, uint32_t seed)
+{
+  util::Bytes data(size);
+  uint32_t state = seed;
+  for (size_t i = 0; i < size; ++i) {
+    state = state * 1103515245 + 12345;
+    data[i] = static_cast<uint8_t>(state >> 24);
+  }
+  return data;
+}
+
+std::set<std::string>
+chunk_set(nonstd::span<const uint8_t> data)
+{
+  std::set<std::string> result;
+  for (const auto chunk : util::split_into_chunks(data, 256, 1024, 4096)) {
+    result.emplace(chunk.begin(), chunk.end());
+  }
+  return result;
+}
+
+} // namespace
+
+TEST_SUITE_BEGIN("util");
+
+TEST_CASE("util::split_into_chunks")
+{
+  SUBCASE("Empty and small data")
+  {
+    CHECK(util::split_into_chunks({}, 256, 1024, 4096).empty());
+
+    const auto data = pseudo_random_data(100, 1);
+    const auto chunks = util::split_into_chunks(data, 256, 1024, 4096);
+    REQUIRE(chunks.size() == 1);
+    CHECK(chunks[0].size() == 100);
+  }
+
+  SUBCASE("Chunks cover the data within size limits")
+  {
+    const auto data = pseudo_random_data(100000, 1);
+    const auto chunks = util::split_into_chunks(data, 256, 1024, 4096);
+    REQUIRE(chunks.size() > 1);
+
+    const uint8_t* expected_start = data.data();
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      CHECK(chunks[i].data() == expected_start);
+      CHECK(chunks[i].size() <= 4096);
+      if (i + 1 < chunks.size()) {
+        CHECK(chunks[i].size() >= 256);
+      }
+      expected_start += chunks[i].size();
+    }
+    CHECK(expected_start == data.data() + data.size());
+
+    // The average should be in the vicinity of the wanted average.
+    const size_t average = data.size() / chunks.size();
+    CHECK(average > 512);
+    CHECK(average < 2048);
+  }
+
+  SUBCASE("Data without cut points")
+  {
+    const util::Bytes data(10000);
+    for (const auto chunk : util::split_into_chunks(data, 256, 1024, 4096)) {
+      CHECK(chunk.size() <= 4096);
+    }
+  }
+
+  SUBCASE("Insertion only changes nearby chunks")
+  {
+    const auto data = pseudo_random_data(100000, 1);
+    util::Bytes modified = data;
+    const auto inserted = pseudo_random_data(10, 2);
+    modified.insert(
+      modified.begin() + 50000, inserted.begin(), inserted.end());
+
+    const auto original_chunks = chunk_set(data);
+    const auto modified_chunks = chunk_set(modified);
+    size_t shared = 0;
+    for (const auto& chunk : modified_chunks) {
+      shared += original_chunks.count(chunk);
+    }
+    CHECK(shared + 3 >= original_chunks.size());
+  }
+}
+
+TEST_SUITE_END();
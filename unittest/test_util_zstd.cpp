@@ -75,3 +75,96 @@ TEST_CASE("ZSTD roundtrip")
   CHECK(result);
   CHECK(decompressed_input == original_input);
 }
+
+TEST_CASE("util::zstd_decompress with input observer")
+{
+  TestContext test_context;
+
+  // Pseudo-random data so that the compressed data spans several chunks.
+  util::Bytes original_input(1000000);
+  uint32_t state = 1;
+  for (size_t i = 0; i < original_input.size(); i++) {
+    state = state * 1103515245 + 12345;
+    original_input[i] = static_cast<uint8_t>(state >> 24);
+  }
+  util::Bytes compressed;
+  REQUIRE(util::zstd_compress(original_input, compressed, 1));
+  REQUIRE(compressed.size() > 500000);
+
+  SUBCASE("Observes all input")
+  {
+    util::Bytes observed;
+    util::Bytes output;
+    auto result = util::zstd_decompress(
+      compressed,
+      output,
+      original_input.size(),
+      [&](nonstd::span<const uint8_t> chunk) {
+        observed.insert(observed.end(), chunk.begin(), chunk.end());
+      });
+    CHECK(result);
+    CHECK(output == original_input);
+    CHECK(observed == compressed);
+  }
+
+  SUBCASE("Too small original size")
+  {
+    util::Bytes output;
+    CHECK(!util::zstd_decompress(compressed,
+                                 output,
+                                 original_input.size() - 1,
+                                 [](nonstd::span<const uint8_t>) {}));
+  }
+
+  SUBCASE("Truncated input")
+  {
+    util::Bytes output;
+    CHECK(!util::zstd_decompress(
+      nonstd::span<const uint8_t>(compressed).first(compressed.size() - 1),
+      output,
+      original_input.size(),
+      [](nonstd::span<const uint8_t>) {}));
+  }
+}
+
+TEST_CASE("util::zstd_compress_delta")
+{
+  TestContext test_context;
+
+  // Pseudo-random data that doesn't compress on its own.
+  util::Bytes base(100000);
+  uint32_t state = 1;
+  for (size_t i = 0; i < base.size(); i++) {
+    state = state * 1103515245 + 12345;
+    base[i] = static_cast<uint8_t>(state >> 24);
+  }
+  util::Bytes input = base;
+  input[500] ^= 1;
+  input[50000] ^= 1;
+
+  util::Bytes delta;
+  REQUIRE(util::zstd_compress_delta(input, base, delta, 1));
+  CHECK(delta.size() < 1000);
+
+  SUBCASE("Roundtrip")
+  {
+    util::Bytes output;
+    CHECK(util::zstd_decompress_delta(delta, base, output, input.size()));
+    CHECK(output == input);
+  }
+
+  SUBCASE("Wrong base")
+  {
+    util::Bytes other_base = base;
+    other_base[1000] ^= 1;
+    util::Bytes output;
+    CHECK(
+      !util::zstd_decompress_delta(delta, other_base, output, input.size()));
+  }
+
+  SUBCASE("Too small original size")
+  {
+    util::Bytes output;
+    CHECK(!util::zstd_decompress_delta(delta, base, output, input.size() - 1));
+  }
+}